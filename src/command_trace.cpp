@@ -0,0 +1,177 @@
+#include "command_trace.h"
+#include "settings.h"
+#include "text_buffer.h"
+
+typedef struct {
+  uint16_t id;                // 0 when the slot is free
+  teTraceSource source;
+  teTraceKind kind;
+  byte partition;
+  bool written;
+  byte status;                // Partition status at the write
+  unsigned long received;
+} tsTraceSlot;
+
+static const char* const sourceNames[TRACE_SOURCE_COUNT] = { "mqtt", "telegram" };
+static const char* const kindNames[TRACE_KIND_COUNT] = { "arm_stay", "arm_away", "arm_night", "disarm", "other" };
+static const char* const phaseNames[TRACE_PHASE_COUNT] = { "dsc_command_write_ms", "dsc_command_confirm_ms" };
+static const char* const phaseHelp[TRACE_PHASE_COUNT] = {
+  "Time from receiving a command to its keypad write",
+  "Time from receiving a command to the panel status change confirming it"
+};
+
+static tsTraceSlot slots[TRACE_SLOTS];
+static tsTraceMetrics metrics[TRACE_SOURCE_COUNT][TRACE_KIND_COUNT];
+static uint16_t lastId = 0;
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+static byte bucketIndex(const uint32_t ms) {
+  if (ms < 16) return 0;
+  byte index = 31 - __builtin_clz(ms) - 3;
+  if (((uint32_t)16 << (index - 1)) == ms) index--;       // Upper bounds are inclusive
+  return (index < TRACE_BUCKETS) ? index : TRACE_BUCKETS - 1;
+}
+
+static void record(tsTraceHistogram &histogram, const uint32_t ms) {
+  histogram.count++;
+  histogram.sumMs += ms;
+  if (ms > histogram.maxMs) histogram.maxMs = ms;
+  histogram.buckets[bucketIndex(ms)]++;
+}
+
+static tsTraceSlot* findSlot(const uint16_t id) {
+  for (byte idx = 0; idx < TRACE_SLOTS; idx++) {
+    if (slots[idx].id == id) return &slots[idx];
+  }
+  return nullptr;
+}
+
+// Whether the changes in `dsc` confirm the written command in `slot`
+static bool confirms(const tsTraceSlot &slot, const dscKeybusInterface &dsc) {
+  byte partition = slot.partition;
+  bool armedStarted = (dsc.armedChanged[partition] && dsc.armed[partition]) ||
+                      (dsc.exitDelayChanged[partition] && dsc.exitDelay[partition]);
+  bool armedEnded = (dsc.armedChanged[partition] && !dsc.armed[partition]) ||
+                    (dsc.exitDelayChanged[partition] && !dsc.exitDelay[partition]) ||
+                    (dsc.alarmChanged[partition] && !dsc.alarm[partition]);
+
+  switch (slot.kind) {
+    case TRACE_ARM_STAY:
+    case TRACE_ARM_AWAY:
+    case TRACE_ARM_NIGHT:
+      return armedStarted;
+    case TRACE_DISARM:
+      return armedEnded;
+    default:
+      return armedStarted || armedEnded || dsc.status[partition] != slot.status;
+  }
+}
+
+uint16_t traceBegin(const teTraceSource source, const teTraceKind kind, const byte partition) {
+  uint16_t id = 0;
+  portENTER_CRITICAL(&traceMux);
+  tsTraceSlot* slot = findSlot(0);
+  if (slot != nullptr) {
+    if (++lastId == 0) lastId = 1;
+    id = lastId;
+    *slot = { id, source, kind, partition, false, 0, millis() };
+  }
+  else metrics[source][kind].untraced++;
+  portEXIT_CRITICAL(&traceMux);
+  return id;
+}
+
+void traceCancel(const uint16_t id) {
+  if (id == 0) return;
+  portENTER_CRITICAL(&traceMux);
+  tsTraceSlot* slot = findSlot(id);
+  if (slot != nullptr) slot->id = 0;
+  portEXIT_CRITICAL(&traceMux);
+}
+
+void traceWritten(const uint16_t id, const dscKeybusInterface &dsc) {
+  if (id == 0) return;
+  portENTER_CRITICAL(&traceMux);
+  tsTraceSlot* slot = findSlot(id);
+  if (slot != nullptr && !slot->written) {
+    slot->written = true;
+    slot->status = dsc.status[slot->partition];
+    record(metrics[slot->source][slot->kind].phases[TRACE_WRITTEN], millis() - slot->received);
+  }
+  portEXIT_CRITICAL(&traceMux);
+}
+
+void traceConfirm(const dscKeybusInterface &dsc) {
+  portENTER_CRITICAL(&traceMux);
+  for (byte idx = 0; idx < TRACE_SLOTS; idx++) {
+    tsTraceSlot &slot = slots[idx];
+    if (slot.id == 0 || !slot.written || !confirms(slot, dsc)) continue;
+    record(metrics[slot.source][slot.kind].phases[TRACE_CONFIRMED], millis() - slot.received);
+    slot.id = 0;
+  }
+  portEXIT_CRITICAL(&traceMux);
+}
+
+void traceExpire() {
+  portENTER_CRITICAL(&traceMux);
+  for (byte idx = 0; idx < TRACE_SLOTS; idx++) {
+    tsTraceSlot &slot = slots[idx];
+    if (slot.id == 0 || millis() - slot.received < TRACE_TIMEOUT_MS) continue;
+    metrics[slot.source][slot.kind].timeouts++;
+    slot.id = 0;
+  }
+  portEXIT_CRITICAL(&traceMux);
+}
+
+const tsTraceMetrics &traceMetrics(const teTraceSource source, const teTraceKind kind) {
+  return metrics[source][kind];
+}
+
+size_t traceFormatHistogram(const teTracePhase phase, const teTraceSource source, const teTraceKind kind,
+                            char* buffer, const size_t size) {
+  const tsTraceHistogram &histogram = metrics[source][kind].phases[phase];
+  const char* name = phaseNames[phase];
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  if (source == 0 && kind == 0) {
+    textPrintf(text, "# HELP %s %s\n# TYPE %s histogram\n", name, phaseHelp[phase], name);
+  }
+
+  uint32_t cumulative = 0;
+  for (byte bucket = 0; bucket < TRACE_BUCKETS - 1; bucket++) {
+    cumulative += histogram.buckets[bucket];
+    textPrintf(text, "%s_bucket{source=\"%s\",command=\"%s\",le=\"%lu\"} %lu\n",
+               name, sourceNames[source], kindNames[kind], (unsigned long)(16UL << bucket), (unsigned long)cumulative);
+  }
+  textPrintf(text, "%s_bucket{source=\"%s\",command=\"%s\",le=\"+Inf\"} %lu\n"
+                   "%s_sum{source=\"%s\",command=\"%s\"} %llu\n"
+                   "%s_count{source=\"%s\",command=\"%s\"} %lu\n",
+             name, sourceNames[source], kindNames[kind], (unsigned long)histogram.count,
+             name, sourceNames[source], kindNames[kind], (unsigned long long)histogram.sumMs,
+             name, sourceNames[source], kindNames[kind], (unsigned long)histogram.count);
+
+  return text.overflow ? 0 : text.length;
+}
+
+size_t traceFormatCounters(char* buffer, const size_t size) {
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  textAppend(text, "# TYPE dsc_command_timeouts_total counter\n");
+  for (byte source = 0; source < TRACE_SOURCE_COUNT; source++) {
+    for (byte kind = 0; kind < TRACE_KIND_COUNT; kind++) {
+      textPrintf(text, "dsc_command_timeouts_total{source=\"%s\",command=\"%s\"} %lu\n",
+                 sourceNames[source], kindNames[kind], (unsigned long)metrics[source][kind].timeouts);
+    }
+  }
+  textAppend(text, "# TYPE dsc_command_untraced_total counter\n");
+  for (byte source = 0; source < TRACE_SOURCE_COUNT; source++) {
+    for (byte kind = 0; kind < TRACE_KIND_COUNT; kind++) {
+      textPrintf(text, "dsc_command_untraced_total{source=\"%s\",command=\"%s\"} %lu\n",
+                 sourceNames[source], kindNames[kind], (unsigned long)metrics[source][kind].untraced);
+    }
+  }
+
+  return text.overflow ? 0 : text.length;
+}
@@ -0,0 +1,96 @@
+/**
+   End-to-end latency of panel commands. A command gets an ID when it is
+   received over MQTT or Telegram; the ID travels with its keypad write to
+   the Keybus task, which timestamps the write and the first panel status
+   change that confirms it: the exit delay or armed state starting for an
+   arm command, ending for a disarm, any change of the partition status for
+   other keys. Latencies from receive to write and from receive to
+   confirmation go into log2 histograms per source and command type.
+   Commands not confirmed within TRACE_TIMEOUT_MS are counted as timeouts.
+*/
+#ifndef COMMAND_TRACE_H
+#define COMMAND_TRACE_H
+
+#include <Arduino.h>
+#include <dscKeybusInterface.h>
+
+// Bucket i counts latencies up to 2^(i+4) ms, 16 ms to about 65 s, the last one everything above
+#define TRACE_BUCKETS   13
+
+typedef enum {
+  TRACE_MQTT,
+  TRACE_TELEGRAM,
+  TRACE_SOURCE_COUNT
+} teTraceSource;
+
+typedef enum {
+  TRACE_ARM_STAY,
+  TRACE_ARM_AWAY,
+  TRACE_ARM_NIGHT,
+  TRACE_DISARM,
+  TRACE_OTHER,                // Keys, bypass, outputs and alarm keys
+  TRACE_KIND_COUNT
+} teTraceKind;
+
+typedef enum {
+  TRACE_WRITTEN,              // Receive to keypad write
+  TRACE_CONFIRMED,            // Receive to panel confirmation
+  TRACE_PHASE_COUNT
+} teTracePhase;
+
+typedef struct {
+  uint32_t count;
+  uint64_t sumMs;
+  uint32_t maxMs;
+  uint32_t buckets[TRACE_BUCKETS];
+} tsTraceHistogram;
+
+typedef struct {
+  tsTraceHistogram phases[TRACE_PHASE_COUNT];
+  uint32_t timeouts;          // Never confirmed
+  uint32_t untraced;          // No free slot when received
+} tsTraceMetrics;
+
+/**
+   Start tracing a command on `partition` (0 based). Returns its ID, 0 if
+   all TRACE_SLOTS are in use.
+*/
+uint16_t traceBegin(const teTraceSource source, const teTraceKind kind, const byte partition);
+
+/**
+   Drop a trace whose command was refused before it was written.
+*/
+void traceCancel(const uint16_t id);
+
+/**
+   Record the keypad write of a command, from the Keybus task.
+*/
+void traceWritten(const uint16_t id, const dscKeybusInterface &dsc);
+
+/**
+   Match a panel status change against the written commands, from the
+   Keybus task before the change flags are consumed.
+*/
+void traceConfirm(const dscKeybusInterface &dsc);
+
+/**
+   Count the commands that were not confirmed in time as timeouts.
+*/
+void traceExpire();
+
+const tsTraceMetrics &traceMetrics(const teTraceSource source, const teTraceKind kind);
+
+/**
+   Prometheus text of one `phase` histogram. The family header is written
+   with the first source and kind, so call for all of them in order.
+   Returns the text length, 0 if it did not fit.
+*/
+size_t traceFormatHistogram(const teTracePhase phase, const teTraceSource source, const teTraceKind kind,
+                            char* buffer, const size_t size);
+
+/**
+   Prometheus text of the timeout and untraced counters.
+*/
+size_t traceFormatCounters(char* buffer, const size_t size);
+
+#endif
@@ -0,0 +1,177 @@
+#include "config_store.h"
+#include "settings.h"
+#include <ArduinoJson.h>
+
+static const char* storePath = "/config.bin";
+static const char* tempPath = "/config.tmp";
+static const char* legacyPath = "/config.json";
+
+static fs::FS* storeFs = nullptr;
+static tsConfig* table = nullptr;
+static size_t tableCount = 0;
+static size_t storeLength = 0;    // Bytes of valid records and header in the store
+static uint32_t generation = 0;   // Bumped by every save, the table value has changed even if the write fails
+
+static uint16_t crc16(const uint8_t* data, const size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (byte bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Encodes a record for `entry` into `buffer`, returns its length or 0 if it does not fit
+static size_t encodeRecord(const tsConfig &entry, uint8_t* buffer, const size_t size) {
+  size_t keyLength = entry.name.length();
+  size_t valueLength = strnlen(entry.val, entry.len - 1);
+  size_t length = 1 + keyLength + 1 + valueLength + 2;
+  if (keyLength > 255 || valueLength > 255 || length > size) return 0;
+
+  buffer[0] = keyLength;
+  memcpy(buffer + 1, entry.name.c_str(), keyLength);
+  buffer[1 + keyLength] = valueLength;
+  memcpy(buffer + 2 + keyLength, entry.val, valueLength);
+  uint16_t crc = crc16(buffer, length - 2);
+  buffer[length - 2] = crc;
+  buffer[length - 1] = crc >> 8;
+  return length;
+}
+
+static void setValue(const char* key, const size_t keyLength, const char* value, const size_t valueLength) {
+  for (size_t idx = 0; idx < tableCount; idx++) {
+    tsConfig &entry = table[idx];
+    if (entry.name.length() != keyLength || memcmp(entry.name.c_str(), key, keyLength) != 0) continue;
+    size_t length = min(valueLength, entry.len - 1);
+    memcpy(entry.val, value, length);
+    entry.val[length] = 0;
+    return;
+  }
+}
+
+// Applies the records in `buffer`, returns the length up to the first torn or corrupt record
+static size_t parseStore(const uint8_t* buffer, const size_t size) {
+  if (size < CONFIG_STORE_HEADER_LEN || buffer[0] != 'C' || buffer[1] != 'S' || buffer[2] != CONFIG_STORE_VERSION) return 0;
+
+  size_t position = CONFIG_STORE_HEADER_LEN;
+  while (position + 1 < size) {
+    const uint8_t* record = buffer + position;
+    size_t keyLength = record[0];
+    if (position + 1 + keyLength + 1 > size) break;
+    size_t valueLength = record[1 + keyLength];
+    size_t length = 1 + keyLength + 1 + valueLength + 2;
+    if (position + length > size) break;
+    uint16_t crc = record[length - 2] | (record[length - 1] << 8);
+    if (crc != crc16(record, length - 2)) break;
+
+    setValue((const char*)record + 1, keyLength, (const char*)record + 2 + keyLength, valueLength);
+    position += length;
+  }
+  return position;
+}
+
+static bool migrateLegacy() {
+  File file = storeFs->open(legacyPath, FILE_READ);
+  if (!file) return false;
+
+  DynamicJsonDocument json(1024);
+  DeserializationError error = deserializeJson(json, file);
+  file.close();
+  if (error) {
+    Serial.println("failed to load json config");
+    return false;
+  }
+
+  for (size_t idx = 0; idx < tableCount; idx++) {
+    if (json.containsKey(table[idx].name)) {
+      const char* value = json[table[idx].name];
+      if (value != nullptr) setValue(table[idx].name.c_str(), table[idx].name.length(), value, strlen(value));
+    }
+  }
+  return true;
+}
+
+teConfigSource configBegin(fs::FS &fs, tsConfig* configTable, const size_t count) {
+  storeFs = &fs;
+  table = configTable;
+  tableCount = count;
+  storeLength = 0;
+
+  // A compaction interrupted between removing the store and renaming its snapshot
+  if (!fs.exists(storePath) && fs.exists(tempPath)) fs.rename(tempPath, storePath);
+
+  File file = fs.open(storePath, FILE_READ);
+  if (file) {
+    uint8_t buffer[CONFIG_STORE_LEN];
+    size_t size = file.read(buffer, sizeof(buffer));
+    bool complete = file.size() == size;
+    file.close();
+
+    storeLength = parseStore(buffer, size);
+    if (storeLength != 0) {
+      // Drops a torn record so later appends are not hidden behind it
+      if (storeLength != size || !complete) configCompact();
+      return CONFIG_LOADED;
+    }
+  }
+
+  if (fs.exists(legacyPath) && migrateLegacy()) {
+    if (configCompact()) fs.remove(legacyPath);
+    return CONFIG_MIGRATED;
+  }
+  return CONFIG_DEFAULTS;
+}
+
+bool configSave(const tsConfig &entry) {
+  generation++;
+  if (storeFs == nullptr) return false;
+
+  uint8_t record[1 + 255 + 1 + 255 + 2];
+  size_t length = encodeRecord(entry, record, sizeof(record));
+  if (length == 0) return false;
+  if (storeLength == 0 || storeLength + length > CONFIG_STORE_LEN) return configCompact();
+
+  File file = storeFs->open(storePath, FILE_APPEND);
+  if (!file) return false;
+  bool ok = file.write(record, length) == length;
+  file.close();
+
+  if (!ok) return configCompact();
+  storeLength += length;
+  return true;
+}
+
+bool configCompact() {
+  if (storeFs == nullptr) return false;
+
+  uint8_t buffer[CONFIG_STORE_LEN] = { 'C', 'S', CONFIG_STORE_VERSION, 0 };
+  size_t length = CONFIG_STORE_HEADER_LEN;
+  for (size_t idx = 0; idx < tableCount; idx++) {
+    size_t recordLength = encodeRecord(table[idx], buffer + length, sizeof(buffer) - length);
+    if (recordLength == 0) return false;
+    length += recordLength;
+  }
+
+  File file = storeFs->open(tempPath, FILE_WRITE);
+  if (!file) return false;
+  bool ok = file.write(buffer, length) == length;
+  file.close();
+  if (!ok) {
+    storeFs->remove(tempPath);
+    return false;
+  }
+
+  storeFs->remove(storePath);
+  if (!storeFs->rename(tempPath, storePath)) return false;
+  storeLength = length;
+  return true;
+}
+
+uint32_t configGeneration() {
+  return generation;
+}
+
+bool configStoreFile(const char* path) {
+  while (*path == '/') path++;    // Also matches the names with extra leading slashes
+  return strcmp(path, storePath + 1) == 0 || strcmp(path, tempPath + 1) == 0 || strcmp(path, legacyPath + 1) == 0;
+}
@@ -0,0 +1,76 @@
+/**
+   Binary configuration store for the `_config` table. The file is a short
+   header followed by a journal of key/value records, each with its own
+   CRC, read with a single read at boot and parsed without a JSON document.
+
+   File layout:
+     0      'C'
+     1      'S'
+     2      CONFIG_STORE_VERSION
+     3      reserved
+     4..    records: key length, key, value length, value, CRC-16 (little
+            endian) over the preceding bytes of the record
+
+   Records are matched to table entries by key, so entries can be added,
+   removed or reordered between versions. A later record overrides an
+   earlier one: changing a field appends one record, and a torn append
+   fails its CRC and leaves the previous value in place. When the journal
+   would outgrow CONFIG_STORE_LEN it is compacted into a snapshot written
+   to a temporary file and renamed over the store.
+
+   A legacy /config.json is migrated on the first boot without a store and
+   then removed.
+*/
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <FS.h>
+
+#define CONFIG_STORE_VERSION     1
+#define CONFIG_STORE_HEADER_LEN  4
+
+typedef struct {
+  char *val;
+  size_t len;
+  String name;
+  String webFormName;
+  String webFormText;
+} tsConfig;
+
+typedef enum {
+  CONFIG_DEFAULTS,            // No stored configuration, the table keeps its defaults
+  CONFIG_LOADED,              // Loaded from the binary store
+  CONFIG_MIGRATED             // Loaded from /config.json and converted
+} teConfigSource;
+
+/**
+   Load the stored values into the `count` entries of `table` and keep the
+   table for the save functions. Values longer than an entry are truncated.
+*/
+teConfigSource configBegin(fs::FS &fs, tsConfig* table, const size_t count);
+
+/**
+   Store the current value of `entry`, a member of the table, by appending
+   one record. Returns false if it could not be written.
+*/
+bool configSave(const tsConfig &entry);
+
+/**
+   Rewrite the store as a snapshot of the whole table. Returns false if it
+   could not be written, the previous store is kept then.
+*/
+bool configCompact();
+
+/**
+   Number of configSave() calls since boot, for callers that cache a view
+   of the table.
+*/
+uint32_t configGeneration();
+
+/**
+   True if `path` names one of the store files, the current, temporary or
+   legacy one. They hold the secrets in the clear and must not be served.
+*/
+bool configStoreFile(const char* path);
+
+#endif
@@ -0,0 +1,310 @@
+#include "event_log.h"
+#include "settings.h"
+
+#define EVENT_LOG_INDEX_LEN  ((EVENT_LOG_SEGMENT_RECORDS + EVENT_LOG_INDEX_STRIDE - 1) / EVENT_LOG_INDEX_STRIDE)
+
+typedef struct {
+  uint32_t sequence;                      // 0 if the segment is unused
+  uint16_t count;
+  uint32_t lastTime;
+  uint32_t index[EVENT_LOG_INDEX_LEN];    // Time of record k * EVENT_LOG_INDEX_STRIDE
+} tsSegment;
+
+static fs::FS* logFs = nullptr;
+static tsSegment segments[EVENT_LOG_SEGMENTS];
+static byte current;                      // Segment holding the newest records
+static bool rotatePending;                // The current segment ends in a torn record, start a new one
+
+static tsEventLogRecord pending[EVENT_LOG_BUFFER_LEN];
+static unsigned long pendingMillis[EVENT_LOG_BUFFER_LEN];  // When events without a time were seen
+static byte pendingCount;
+static unsigned long pendingSince;
+static uint32_t lastTime;
+static unsigned long writeErrors;
+
+static void segmentPath(const byte slot, char* path, const size_t size) {
+  snprintf(path, size, "/events%u.log", slot);
+}
+
+static uint32_t readUint32(const uint8_t* buffer) {
+  return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static void writeUint32(uint8_t* buffer, const uint32_t value) {
+  buffer[0] = value;
+  buffer[1] = value >> 8;
+  buffer[2] = value >> 16;
+  buffer[3] = value >> 24;
+}
+
+static void encodeRecord(const tsEventLogRecord &record, uint8_t* buffer) {
+  writeUint32(buffer, record.time);
+  buffer[4] = record.event.type;
+  buffer[5] = record.event.index;
+  buffer[6] = record.event.value;
+  buffer[7] = record.flags;
+}
+
+static void decodeRecord(const uint8_t* buffer, tsEventLogRecord &record) {
+  record.time = readUint32(buffer);
+  record.event.type = buffer[4];
+  record.event.index = buffer[5];
+  record.event.value = buffer[6];
+  record.flags = buffer[7];
+}
+
+static int slotOf(const uint32_t sequence) {
+  if (sequence == 0) return -1;
+  for (byte slot = 0; slot < EVENT_LOG_SEGMENTS; slot++) {
+    if (segments[slot].sequence == sequence) return slot;
+  }
+  return -1;
+}
+
+static uint32_t oldestSequence() {
+  uint32_t oldest = 0;
+  for (byte slot = 0; slot < EVENT_LOG_SEGMENTS; slot++) {
+    if (segments[slot].sequence != 0 && (oldest == 0 || segments[slot].sequence < oldest)) oldest = segments[slot].sequence;
+  }
+  return oldest;
+}
+
+// Reads the header and the indexed record times of a segment file
+static size_t loadSegment(const byte slot) {
+  tsSegment &segment = segments[slot];
+  memset(&segment, 0, sizeof(segment));
+
+  char path[20];
+  segmentPath(slot, path, sizeof(path));
+  if (!logFs->exists(path)) return 0;
+  File file = logFs->open(path, FILE_READ);
+  if (!file) return 0;
+
+  uint8_t header[EVENT_LOG_HEADER_LEN];
+  size_t size = file.size();
+  if (size < EVENT_LOG_HEADER_LEN || file.read(header, sizeof(header)) != sizeof(header) ||
+      header[0] != 'E' || header[1] != 'L' || header[2] != EVENT_LOG_VERSION) {
+    file.close();
+    return 0;
+  }
+
+  segment.sequence = readUint32(header + 4);
+  size_t records = (size - EVENT_LOG_HEADER_LEN) / EVENT_LOG_RECORD_LEN;
+  segment.count = min(records, (size_t)EVENT_LOG_SEGMENT_RECORDS);
+  if ((size - EVENT_LOG_HEADER_LEN) % EVENT_LOG_RECORD_LEN) rotatePending = true;
+
+  uint8_t record[EVENT_LOG_RECORD_LEN];
+  for (uint16_t k = 0; k * EVENT_LOG_INDEX_STRIDE < segment.count; k++) {
+    file.seek(EVENT_LOG_HEADER_LEN + (k * EVENT_LOG_INDEX_STRIDE) * EVENT_LOG_RECORD_LEN);
+    if (file.read(record, sizeof(record)) == sizeof(record)) segment.index[k] = readUint32(record);
+  }
+  if (segment.count) {
+    file.seek(EVENT_LOG_HEADER_LEN + (segment.count - 1) * EVENT_LOG_RECORD_LEN);
+    if (file.read(record, sizeof(record)) == sizeof(record)) segment.lastTime = readUint32(record);
+  }
+
+  file.close();
+  return segment.count;
+}
+
+size_t eventLogBegin(fs::FS &fs) {
+  logFs = &fs;
+  current = 0;
+  rotatePending = false;
+  pendingCount = 0;
+  writeErrors = 0;
+
+  size_t records = 0;
+  for (byte slot = 0; slot < EVENT_LOG_SEGMENTS; slot++) {
+    records += loadSegment(slot);
+    if (segments[slot].sequence > segments[current].sequence) current = slot;
+  }
+  if (rotatePending && segments[current].sequence == 0) rotatePending = false;
+  lastTime = segments[current].lastTime;
+  return records;
+}
+
+void eventLogAppend(const tsPanelEvent &event, uint32_t time) {
+  if (logFs == nullptr) return;
+
+  if (time != EVENT_LOG_TIME_UNSYNCED) {
+    if (time < lastTime) time = lastTime;
+    lastTime = time;
+  }
+
+  if (pendingCount == 0) pendingSince = millis();
+  pending[pendingCount].time = time;
+  pending[pendingCount].flags = 0;
+  pendingMillis[pendingCount] = millis();
+  pending[pendingCount].event = event;
+  pendingCount++;
+
+  if (pendingCount == EVENT_LOG_BUFFER_LEN) eventLogFlush(true);
+}
+
+// Opens the next segment for writing, rewriting the oldest one once all are in use
+static File startSegment() {
+  uint32_t sequence = segments[current].sequence;
+  if (sequence != 0) current = (current + 1) % EVENT_LOG_SEGMENTS;
+  rotatePending = false;
+
+  tsSegment &segment = segments[current];
+  memset(&segment, 0, sizeof(segment));
+
+  char path[20];
+  segmentPath(current, path, sizeof(path));
+  File file = logFs->open(path, FILE_WRITE);
+  if (!file) return file;
+
+  uint8_t header[EVENT_LOG_HEADER_LEN] = { 'E', 'L', EVENT_LOG_VERSION, 0 };
+  writeUint32(header + 4, sequence + 1);
+  if (file.write(header, sizeof(header)) != sizeof(header)) {
+    file.close();
+    return File();
+  }
+  segment.sequence = sequence + 1;
+  return file;
+}
+
+// Back-dates the events appended without a time from the wall clock. Until the clock is set they
+// are held back, unless the buffer is full: then they are flagged unsynced, with the time of the
+// record before them as the only bound known.
+static bool stampPending() {
+  if (pending[0].time != EVENT_LOG_TIME_UNSYNCED) return true;
+
+  uint32_t now = time(nullptr);
+  bool synced = now >= CLOCK_VALID_AFTER;
+  if (!synced && pendingCount < EVENT_LOG_BUFFER_LEN) return false;
+
+  uint32_t floor = segments[current].lastTime;
+  for (byte i = 0; i < pendingCount; i++) {
+    if (pending[i].time == EVENT_LOG_TIME_UNSYNCED) {
+      if (synced) pending[i].time = now - ((millis() - pendingMillis[i]) / 1000);
+      else pending[i].flags = EVENT_LOG_UNSYNCED;
+    }
+    if (pending[i].time < floor) pending[i].time = floor;
+    floor = pending[i].time;
+  }
+  if (floor > lastTime) lastTime = floor;
+  return true;
+}
+
+void eventLogFlush(const bool force) {
+  if (pendingCount == 0) return;
+  if (!force && pendingCount < EVENT_LOG_BUFFER_LEN / 2 && millis() - pendingSince < EVENT_LOG_FLUSH_MS) return;
+  if (!stampPending()) return;
+
+  byte written = 0;
+  while (written < pendingCount) {
+    File file;
+    if (segments[current].sequence == 0 || segments[current].count >= EVENT_LOG_SEGMENT_RECORDS || rotatePending) {
+      file = startSegment();
+    }
+    else {
+      char path[20];
+      segmentPath(current, path, sizeof(path));
+      file = logFs->open(path, FILE_APPEND);
+    }
+    if (!file) break;
+
+    tsSegment &segment = segments[current];
+    byte count = min((size_t)(pendingCount - written), (size_t)(EVENT_LOG_SEGMENT_RECORDS - segment.count));
+    uint8_t records[EVENT_LOG_BUFFER_LEN * EVENT_LOG_RECORD_LEN];
+    for (byte i = 0; i < count; i++) encodeRecord(pending[written + i], records + i * EVENT_LOG_RECORD_LEN);
+
+    size_t length = count * EVENT_LOG_RECORD_LEN;
+    bool ok = file.write(records, length) == length;
+    file.close();
+    if (!ok) {
+      rotatePending = true;
+      break;
+    }
+
+    for (byte i = 0; i < count; i++) {
+      uint16_t position = segment.count + i;
+      if (position % EVENT_LOG_INDEX_STRIDE == 0) segment.index[position / EVENT_LOG_INDEX_STRIDE] = pending[written + i].time;
+    }
+    segment.count += count;
+    segment.lastTime = pending[written + count - 1].time;
+    written += count;
+  }
+
+  // Events that could not be written are dropped rather than retried on every flush
+  if (written < pendingCount) writeErrors++;
+  pendingCount = 0;
+}
+
+// Opens the segment at `sequence` for reading from `position`
+static bool openSegment(tsEventLogCursor &cursor, const uint32_t sequence, const uint16_t position) {
+  cursor.file.close();
+  cursor.sequence = 0;
+
+  int slot = slotOf(sequence);
+  if (slot < 0 || position >= segments[slot].count) return false;
+
+  char path[20];
+  segmentPath(slot, path, sizeof(path));
+  cursor.file = logFs->open(path, FILE_READ);
+  if (!cursor.file || !cursor.file.seek(EVENT_LOG_HEADER_LEN + position * EVENT_LOG_RECORD_LEN)) return false;
+  cursor.sequence = sequence;
+  cursor.position = position;
+  return true;
+}
+
+bool eventLogSeek(tsEventLogCursor &cursor, const uint32_t since) {
+  cursor.file.close();
+  cursor.sequence = 0;
+  if (logFs == nullptr) return false;
+
+  eventLogFlush(true);
+
+  for (uint32_t sequence = oldestSequence(); sequence != 0 && sequence <= segments[current].sequence; sequence++) {
+    int slot = slotOf(sequence);
+    if (slot < 0 || segments[slot].count == 0 || segments[slot].lastTime < since) continue;
+
+    // Starts at the last indexed record before `since`, at most one stride is scanned
+    const tsSegment &segment = segments[slot];
+    uint16_t k = 0;
+    while ((k + 1) * EVENT_LOG_INDEX_STRIDE < segment.count && segment.index[k + 1] < since) k++;
+    if (!openSegment(cursor, sequence, k * EVENT_LOG_INDEX_STRIDE)) return false;
+
+    uint8_t record[EVENT_LOG_RECORD_LEN];
+    while (cursor.position < segment.count) {
+      if (cursor.file.read(record, sizeof(record)) != sizeof(record)) break;
+      if (readUint32(record) >= since) return cursor.file.seek(EVENT_LOG_HEADER_LEN + cursor.position * EVENT_LOG_RECORD_LEN);
+      cursor.position++;
+    }
+    break;
+  }
+
+  cursor.file.close();
+  cursor.sequence = 0;
+  return false;
+}
+
+bool eventLogNext(tsEventLogCursor &cursor, tsEventLogRecord &record) {
+  int slot = slotOf(cursor.sequence);
+  if (slot < 0) return false;
+
+  if (cursor.position >= segments[slot].count && !openSegment(cursor, cursor.sequence + 1, 0)) return false;
+
+  uint8_t buffer[EVENT_LOG_RECORD_LEN];
+  if (cursor.file.read(buffer, sizeof(buffer)) != sizeof(buffer)) {
+    cursor.file.close();
+    cursor.sequence = 0;
+    return false;
+  }
+  decodeRecord(buffer, record);
+  cursor.position++;
+  return true;
+}
+
+tsEventLogStats eventLogStats() {
+  tsEventLogStats stats = {};
+  for (byte slot = 0; slot < EVENT_LOG_SEGMENTS; slot++) stats.records += segments[slot].count;
+  stats.buffered = pendingCount;
+  stats.writeErrors = writeErrors;
+  int oldest = slotOf(oldestSequence());
+  if (oldest >= 0 && segments[oldest].count) stats.oldest = segments[oldest].index[0];
+  return stats;
+}
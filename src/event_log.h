@@ -0,0 +1,98 @@
+/**
+   Persistent panel event history. Events are fixed 8 byte records kept in
+   EVENT_LOG_SEGMENTS segment files on the filesystem, used round robin:
+   when the newest segment is full the oldest one is rewritten, so the log
+   size is bounded and writes are spread over all segments.
+
+   Segment layout (multi-byte fields little endian):
+     0      'E'
+     1      'L'
+     2      EVENT_LOG_VERSION
+     3      reserved
+     4..7   sequence number, the oldest segment has the lowest
+     8..    records: time (4 bytes, Unix time), type, index, value, flags
+
+   For every segment a sparse index of the time of every
+   EVENT_LOG_INDEX_STRIDE-th record is kept in RAM, so a query seeks
+   straight to its start and reads at most one stride of older records.
+
+   eventLogAppend() only copies the event into a RAM buffer, the file
+   writes happen in eventLogFlush(). All functions must be called from the
+   network task, never from the Keybus task.
+*/
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <FS.h>
+#include "panel_events.h"
+
+#define EVENT_LOG_VERSION       1
+#define EVENT_LOG_HEADER_LEN    8
+#define EVENT_LOG_RECORD_LEN    8
+
+// Time passed to eventLogAppend() for an event seen before the wall clock was set
+#define EVENT_LOG_TIME_UNSYNCED 0
+
+// Record flags
+#define EVENT_LOG_UNSYNCED      0x01    // Written before the clock was set, `time` is a lower bound
+
+typedef struct {
+  uint32_t time;
+  tsPanelEvent event;
+  uint8_t flags;
+} tsEventLogRecord;
+
+typedef struct {
+  uint32_t sequence;          // Segment being read, 0 once the end of the log is reached
+  uint16_t position;          // Next record within the segment
+  File file;
+} tsEventLogCursor;
+
+/**
+   Mount the log on `fs`: reads the segment headers and rebuilds the time
+   index. Returns the number of records found.
+*/
+size_t eventLogBegin(fs::FS &fs);
+
+/**
+   Buffer an event that happened at `time`. Times are kept non-decreasing,
+   an earlier time is recorded as the previous one. The buffer is flushed
+   when it is full.
+
+   EVENT_LOG_TIME_UNSYNCED means the wall clock is not set yet: the event
+   keeps its millis() and is held in the buffer until the clock reads later
+   than CLOCK_VALID_AFTER, then it is back-dated from the current time. If
+   the buffer fills first, it is written with the time of the record before
+   it and flagged EVENT_LOG_UNSYNCED.
+*/
+void eventLogAppend(const tsPanelEvent &event, uint32_t time);
+
+/**
+   Write the buffered events to the filesystem. Unless `force` is set this
+   only happens once they are EVENT_LOG_FLUSH_MS old or fill half the
+   buffer.
+*/
+void eventLogFlush(const bool force);
+
+/**
+   Position `cursor` on the first record at or after `since`, flushing
+   buffered events first. Returns false if there is none.
+*/
+bool eventLogSeek(tsEventLogCursor &cursor, const uint32_t since);
+
+/**
+   Read the record at `cursor` and advance it. Returns false at the end of
+   the log.
+*/
+bool eventLogNext(tsEventLogCursor &cursor, tsEventLogRecord &record);
+
+typedef struct {
+  unsigned long records;      // Records on the filesystem
+  unsigned long buffered;     // Records waiting for eventLogFlush()
+  unsigned long writeErrors;  // Flushes that could not write all records
+  uint32_t oldest;            // Time of the oldest record, 0 if the log is empty
+} tsEventLogStats;
+
+tsEventLogStats eventLogStats();
+
+#endif
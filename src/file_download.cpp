@@ -0,0 +1,184 @@
+#include "file_download.h"
+#include "settings.h"
+#include <HTTPClient.h>
+#include <mbedtls/sha256.h>
+
+static HTTPClient http;           // Static, its destructor would close the shared connection
+static WiFiClient* downloadClient = nullptr;
+static fs::FS* downloadFs = nullptr;
+static File partFile;
+static String downloadUrl;
+static char finalPath[DOWNLOAD_PATH_LEN];
+static char partPath[DOWNLOAD_PATH_LEN + 5];
+static bool checkHash = false;
+static uint8_t expectedHash[32];
+static mbedtls_sha256_context sha;
+
+alignas(4) static uint8_t buffer[DOWNLOAD_BUFFER_LEN];
+static size_t buffered = 0;
+static bool streaming = false;    // A response body is being read, otherwise a request is due
+static byte failures = 0;         // Requests in a row that brought no data
+static byte progress = 0;         // Tenths reported so far
+static unsigned long lastData = 0;
+static tsDownload download = {};  // DOWNLOAD_IDLE
+
+static bool flush() {
+  if (buffered == 0) return true;
+  mbedtls_sha256_update_ret(&sha, buffer, buffered);
+  bool ok = partFile.write(buffer, buffered) == buffered;
+  buffered = 0;
+  return ok;
+}
+
+static teDownload finish(teDownload result, const char* error) {
+  if (!flush() && result == DOWNLOAD_DONE) {
+    result = DOWNLOAD_FAILED;
+    error = "write error";
+  }
+  partFile.close();
+  mbedtls_sha256_finish_ret(&sha, download.sha256);
+  mbedtls_sha256_free(&sha);
+
+  if (result == DOWNLOAD_DONE) {
+    if (download.total != 0 && download.received != download.total) {
+      result = DOWNLOAD_FAILED;
+      error = "size mismatch";
+    }
+    else if (checkHash && memcmp(download.sha256, expectedHash, sizeof(expectedHash)) != 0) {
+      result = DOWNLOAD_FAILED;
+      error = "checksum mismatch";
+    }
+  }
+
+  http.end();
+  if (result == DOWNLOAD_DONE) {
+    if (downloadFs->exists(finalPath)) downloadFs->remove(finalPath);
+    if (!downloadFs->rename(partPath, finalPath)) {
+      result = DOWNLOAD_FAILED;
+      error = "rename failed";
+    }
+  }
+  else {
+    // The rest of an unfinished body must not be read as the next response on the connection
+    if (streaming) downloadClient->stop();
+  }
+  if (result != DOWNLOAD_DONE) downloadFs->remove(partPath);
+
+  streaming = false;
+  download.state = result;
+  download.error = error;
+  download.elapsed = millis() - download.started;
+  return result;
+}
+
+// Sends the request, from the first missing byte when resuming
+static bool request() {
+  if (!http.begin(*downloadClient, downloadUrl)) return false;
+  if (download.received != 0) {
+    char range[24];
+    snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)download.received);
+    http.addHeader("Range", range);
+  }
+
+  int code = http.GET();
+  if (code == HTTP_CODE_OK && download.received != 0) {
+    // The server ignored the range, start over
+    partFile.close();
+    partFile = downloadFs->open(partPath, FILE_WRITE);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    download.received = 0;
+    if (!partFile) return false;
+  }
+  if (code == HTTP_CODE_OK) {
+    int size = http.getSize();
+    if (download.total == 0 && size > 0) download.total = size;
+    return true;
+  }
+  if (code == HTTP_CODE_PARTIAL_CONTENT) return true;
+
+  http.end();
+  return false;
+}
+
+bool downloadBegin(WiFiClient &client, const char* url, fs::FS &fs, const char* path, const size_t size, const uint8_t* sha256) {
+  if (download.state == DOWNLOAD_RUNNING) return false;
+  if (strlen(path) >= sizeof(finalPath)) return false;
+
+  strcpy(finalPath, path);
+  snprintf(partPath, sizeof(partPath), "%s.part", path);
+  partFile = fs.open(partPath, FILE_WRITE);
+  if (!partFile) return false;
+
+  downloadClient = &client;
+  downloadFs = &fs;
+  downloadUrl = url;
+  checkHash = sha256 != nullptr;
+  if (checkHash) memcpy(expectedHash, sha256, sizeof(expectedHash));
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+
+  download = {};
+  download.state = DOWNLOAD_RUNNING;
+  download.total = size;
+  download.started = millis();
+  buffered = 0;
+  streaming = false;
+  failures = 0;
+  progress = 0;
+  return true;
+}
+
+teDownload downloadPoll(const unsigned long budgetMs) {
+  if (download.state != DOWNLOAD_RUNNING) return download.state;
+
+  unsigned long sliceStart = millis();
+  do {
+    if (!streaming) {
+      if (!request()) return ++failures > DOWNLOAD_RETRIES ? finish(DOWNLOAD_FAILED, "request failed") : DOWNLOAD_RUNNING;
+      streaming = true;
+      lastData = millis();
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    int available = stream->available();
+    if (available > 0) {
+      size_t length = stream->readBytes(buffer + buffered, min((size_t)available, sizeof(buffer) - buffered));
+      buffered += length;
+      download.received += length;
+      failures = 0;
+      lastData = millis();
+      if (buffered == sizeof(buffer) && !flush()) return finish(DOWNLOAD_FAILED, "write error");
+      if (download.total != 0 && download.received >= download.total) return finish(DOWNLOAD_DONE, nullptr);
+
+      if (download.total != 0 && download.received * 10 / download.total > progress) {
+        progress = download.received * 10 / download.total;
+        Serial.print("Download ");
+        Serial.print(progress * 10);
+        Serial.println("%");
+      }
+      continue;
+    }
+
+    bool stalled = millis() - lastData > DOWNLOAD_STALL_MS;
+    if (http.connected() && !stalled) break;
+
+    // Without a length the body ends when the server closes the connection
+    if (download.total == 0 && !stalled) return finish(DOWNLOAD_DONE, nullptr);
+    if (!flush()) return finish(DOWNLOAD_FAILED, "write error");
+    http.end();
+    downloadClient->stop();
+    streaming = false;
+    download.resumes++;
+    if (++failures > DOWNLOAD_RETRIES) return finish(DOWNLOAD_FAILED, "connection lost");
+  } while (millis() - sliceStart < budgetMs);
+
+  return DOWNLOAD_RUNNING;
+}
+
+bool downloadActive() {
+  return download.state == DOWNLOAD_RUNNING;
+}
+
+const tsDownload &downloadStatus() {
+  return download;
+}
@@ -0,0 +1,55 @@
+/**
+   Streaming HTTP download into a file, run in short slices from the network
+   task so MQTT and the web server keep being served during the transfer.
+   Data is read in DOWNLOAD_BUFFER_LEN blocks and written to "<path>.part",
+   hashed with SHA-256 on the way. A dropped connection is resumed with a
+   Range request from the bytes already written; the file replaces `path`
+   only once it is complete and its hash matches.
+*/
+#ifndef FILE_DOWNLOAD_H
+#define FILE_DOWNLOAD_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <WiFi.h>
+
+typedef enum {
+  DOWNLOAD_IDLE,
+  DOWNLOAD_RUNNING,
+  DOWNLOAD_DONE,
+  DOWNLOAD_FAILED
+} teDownload;
+
+typedef struct {
+  teDownload state;
+  size_t received;            // Bytes written so far
+  size_t total;               // Expected size, 0 until the server sent it
+  byte resumes;               // Requests after the first one
+  unsigned long started;
+  unsigned long elapsed;      // Transfer time in ms once finished
+  uint8_t sha256[32];         // Hash of the file once finished
+  const char* error;          // Reason of a failure
+} tsDownload;
+
+/**
+   Start downloading `url` over `client` into `path` on `fs`. `size` is the
+   expected length or 0 if unknown; `sha256` the expected hash or nullptr.
+   Returns false if a download is already running or the file can't be
+   created.
+*/
+bool downloadBegin(WiFiClient &client, const char* url, fs::FS &fs, const char* path, const size_t size, const uint8_t* sha256);
+
+/**
+   Transfer for up to `budgetMs`, then return. Returns DOWNLOAD_RUNNING
+   until the download has finished, then its result.
+*/
+teDownload downloadPoll(const unsigned long budgetMs);
+
+/**
+   Returns true while a download is running.
+*/
+bool downloadActive();
+
+const tsDownload &downloadStatus();
+
+#endif
@@ -0,0 +1,120 @@
+#include "keypad_queue.h"
+#include "text_buffer.h"
+
+typedef struct {
+  tsKeypadCommand commands[KEYPAD_QUEUE_LEN];
+  byte head;
+  byte count;
+} tsKeypadRing;
+
+static tsKeypadRing rings[KEYPAD_PRIORITY_COUNT];
+static byte groupPriority = KEYPAD_PRIORITY_COUNT;    // Class of the group being written, if any
+static tsKeypadQueueStats stats;
+static portMUX_TYPE keypadMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const priorityNames[KEYPAD_PRIORITY_COUNT] = { "access_code", "arm", "keys" };
+static const char* const queueErrors[] = { "", "keypad queue full", "invalid keys" };
+
+static void push(const teKeypadPriority priority, const byte partition, const char* keys, const size_t length,
+                 const uint16_t traceId, const bool grouped) {
+  tsKeypadRing &ring = rings[priority];
+  tsKeypadCommand &command = ring.commands[(ring.head + ring.count) % KEYPAD_QUEUE_LEN];
+  command.partition = partition;
+  command.traceId = traceId;
+  command.grouped = grouped;
+  memcpy(command.keys, keys, length + 1);
+  ring.count++;
+  stats.queued[priority]++;
+  if (++stats.depth > stats.maxDepth) stats.maxDepth = stats.depth;
+}
+
+teKeypadQueue keypadQueuePush(const teKeypadPriority priority, const byte partition, const char* keys,
+                              const uint16_t traceId) {
+  size_t length = strlen(keys);
+  if (length == 0 || length >= KEYPAD_KEYS_LEN) return KEYPAD_INVALID;
+
+  teKeypadQueue result = KEYPAD_FULL;
+  portENTER_CRITICAL(&keypadMux);
+  if (rings[priority].count < KEYPAD_QUEUE_LEN) {
+    push(priority, partition, keys, length, traceId, false);
+    result = KEYPAD_QUEUED;
+  }
+  else stats.rejected[priority]++;
+  portEXIT_CRITICAL(&keypadMux);
+  return result;
+}
+
+teKeypadQueue keypadQueuePushAll(const teKeypadPriority priority, const byte partition,
+                                 const char (*keys)[KEYPAD_KEYS_LEN], const byte count, const uint16_t traceId) {
+  for (byte idx = 0; idx < count; idx++) {
+    size_t length = strnlen(keys[idx], KEYPAD_KEYS_LEN);
+    if (length == 0 || length >= KEYPAD_KEYS_LEN) return KEYPAD_INVALID;
+  }
+
+  teKeypadQueue result = KEYPAD_FULL;
+  portENTER_CRITICAL(&keypadMux);
+  if (KEYPAD_QUEUE_LEN - rings[priority].count >= count) {
+    for (byte idx = 0; idx < count; idx++) {
+      push(priority, partition, keys[idx], strlen(keys[idx]), idx == count - 1 ? traceId : 0, idx < count - 1);
+    }
+    result = KEYPAD_QUEUED;
+  }
+  else stats.rejected[priority]++;
+  portEXIT_CRITICAL(&keypadMux);
+  return result;
+}
+
+bool keypadQueuePop(tsKeypadCommand &command) {
+  bool found = false;
+  portENTER_CRITICAL(&keypadMux);
+  // A group being written keeps its class until its last write
+  byte priority = groupPriority < KEYPAD_PRIORITY_COUNT && rings[groupPriority].count > 0 ? groupPriority : 0;
+  for (; priority < KEYPAD_PRIORITY_COUNT && !found; priority++) {
+    tsKeypadRing &ring = rings[priority];
+    if (ring.count == 0) continue;
+    command = ring.commands[ring.head];
+    ring.head = (ring.head + 1) % KEYPAD_QUEUE_LEN;
+    ring.count--;
+    stats.depth--;
+    stats.written++;
+    groupPriority = command.grouped ? priority : KEYPAD_PRIORITY_COUNT;
+    found = true;
+  }
+  portEXIT_CRITICAL(&keypadMux);
+  return found;
+}
+
+void keypadQueueClear() {
+  portENTER_CRITICAL(&keypadMux);
+  for (byte priority = 0; priority < KEYPAD_PRIORITY_COUNT; priority++) rings[priority].count = 0;
+  groupPriority = KEYPAD_PRIORITY_COUNT;
+  stats.depth = 0;
+  portEXIT_CRITICAL(&keypadMux);
+}
+
+const tsKeypadQueueStats& keypadQueueStats() {
+  return stats;
+}
+
+size_t keypadQueueFormat(char* buffer, const size_t size) {
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  textAppend(text, "# TYPE dsc_keypad_queued_total counter\n");
+  for (byte priority = 0; priority < KEYPAD_PRIORITY_COUNT; priority++) {
+    textPrintf(text, "dsc_keypad_queued_total{class=\"%s\"} %lu\n", priorityNames[priority], (unsigned long)stats.queued[priority]);
+  }
+  textAppend(text, "# TYPE dsc_keypad_rejected_total counter\n");
+  for (byte priority = 0; priority < KEYPAD_PRIORITY_COUNT; priority++) {
+    textPrintf(text, "dsc_keypad_rejected_total{class=\"%s\"} %lu\n", priorityNames[priority], (unsigned long)stats.rejected[priority]);
+  }
+  textPrintf(text, "# TYPE dsc_keypad_written_total counter\ndsc_keypad_written_total %lu\n", (unsigned long)stats.written);
+  textPrintf(text, "# TYPE dsc_keypad_queue_depth gauge\ndsc_keypad_queue_depth %u\n", stats.depth);
+  textPrintf(text, "# TYPE dsc_keypad_queue_depth_max gauge\ndsc_keypad_queue_depth_max %u\n", stats.maxDepth);
+
+  return text.overflow ? 0 : text.length;
+}
+
+const char* keypadQueueError(const teKeypadQueue result) {
+  return result <= KEYPAD_INVALID ? queueErrors[result] : "";
+}
@@ -0,0 +1,81 @@
+/**
+   Keypad writes waiting for the Keybus task, one bounded FIFO per
+   priority class: access codes (disarm and the panel's access code prompt)
+   go out first, then arm keys, then any other key sequence. The Keybus
+   task takes the next command only once the library is ready for another
+   write, so keys are never written over ones still going out. The writes
+   of one multi-write sequence, like a bypass, go out as a group with no
+   other class in between. A command that does not fit its class is
+   rejected rather than dropped later, and the caller tells its source.
+*/
+#ifndef KEYPAD_QUEUE_H
+#define KEYPAD_QUEUE_H
+
+#include <Arduino.h>
+#include "settings.h"
+
+typedef enum {
+  KEYPAD_PRIORITY_ACCESS_CODE,    // Disarm and access code prompts
+  KEYPAD_PRIORITY_ARM,            // Stay, away and night arm
+  KEYPAD_PRIORITY_KEYS,           // Raw keys, bypass, outputs and alarm keys
+  KEYPAD_PRIORITY_COUNT
+} teKeypadPriority;
+
+typedef enum {
+  KEYPAD_QUEUED,
+  KEYPAD_FULL,                    // No room left in the priority class
+  KEYPAD_INVALID                  // Empty or longer than KEYPAD_KEYS_LEN - 1
+} teKeypadQueue;
+
+typedef struct {
+  byte partition;                 // Partition to write to, 0 keeps the current write partition
+  char keys[KEYPAD_KEYS_LEN];
+  uint16_t traceId;               // Command trace of the keys, 0 if untraced
+  bool grouped;                   // More writes of the same group follow
+} tsKeypadCommand;
+
+typedef struct {
+  uint32_t queued[KEYPAD_PRIORITY_COUNT];
+  uint32_t rejected[KEYPAD_PRIORITY_COUNT];
+  uint32_t written;
+  byte depth;                     // Commands waiting, all classes
+  byte maxDepth;
+} tsKeypadQueueStats;
+
+/**
+   Queue `keys` for `partition` in the class `priority`.
+*/
+teKeypadQueue keypadQueuePush(const teKeypadPriority priority, const byte partition, const char* keys,
+                              const uint16_t traceId);
+
+/**
+   Queue `count` key sequences for `partition` in the class `priority`,
+   all of them or none, as one group. `traceId` goes with the last one.
+*/
+teKeypadQueue keypadQueuePushAll(const teKeypadPriority priority, const byte partition,
+                                 const char (*keys)[KEYPAD_KEYS_LEN], const byte count, const uint16_t traceId);
+
+/**
+   Take the next command by priority into `command`, the rest of a group
+   before anything else. Returns false if nothing is waiting.
+*/
+bool keypadQueuePop(tsKeypadCommand &command);
+
+/**
+   Drop every waiting command.
+*/
+void keypadQueueClear();
+
+const tsKeypadQueueStats& keypadQueueStats();
+
+/**
+   Prometheus text of the queued and rejected counters and the queue depth.
+*/
+size_t keypadQueueFormat(char* buffer, const size_t size);
+
+/**
+   Short reason for a command source, e.g. "keypad queue full".
+*/
+const char* keypadQueueError(const teKeypadQueue result);
+
+#endif
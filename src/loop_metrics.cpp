@@ -0,0 +1,158 @@
+#include "loop_metrics.h"
+#include "text_buffer.h"
+
+// The cycle counter wraps after 2^32 cycles, about 17 s at 240 MHz
+#define METRICS_CYCLE_WRAP_MS  10000
+
+typedef struct {
+  const char* name;
+  uint32_t budgetUs;
+} tsStageInfo;
+
+static const tsStageInfo stageInfo[STAGE_COUNT] = {
+  { "wifi",            1000 },
+  { "mqtt",           50000 },
+  { "telegram",     2000000 },
+  { "ota",             5000 },
+  { "http",          100000 },
+  { "dispatch",      100000 },
+  { "network_loop", 2000000 },
+  { "keybus",          1000 },
+  { "keybus_interval", 5000 },
+};
+
+static tsStageMetrics stages[STAGE_COUNT];
+static uint32_t cyclesPerUs = 240;
+
+void metricsBegin() {
+  cyclesPerUs = ESP.getCpuFreqMHz();
+  if (cyclesPerUs == 0) cyclesPerUs = 1;
+}
+
+tsMetricsMark metricsMark() {
+  tsMetricsMark mark;
+  mark.cycles = ESP.getCycleCount();
+  mark.ms = millis();
+  return mark;
+}
+
+uint32_t metricsElapsedUs(const tsMetricsMark &start, const tsMetricsMark &end) {
+  uint32_t ms = end.ms - start.ms;
+  if (ms > METRICS_CYCLE_WRAP_MS) return ms * 1000;
+  return (end.cycles - start.cycles) / cyclesPerUs;
+}
+
+// Bucket i holds the durations up to 2^(i+1) us, its bound included as Prometheus `le` is inclusive
+static byte bucketIndex(const uint32_t us) {
+  if (us <= 1) return 0;
+  byte index = 31 - __builtin_clz(us - 1);
+  return (index < METRICS_BUCKETS) ? index : METRICS_BUCKETS - 1;
+}
+
+void metricsRecordBetween(const teLoopStage stage, const tsMetricsMark &start, const tsMetricsMark &end) {
+  uint32_t us = metricsElapsedUs(start, end);
+  tsStageMetrics &metrics = stages[stage];
+  metrics.count++;
+  metrics.sumUs += us;
+  if (us > metrics.maxUs) metrics.maxUs = us;
+  if (us > stageInfo[stage].budgetUs) metrics.overBudget++;
+  metrics.buckets[bucketIndex(us)]++;
+}
+
+tsMetricsMark metricsRecord(const teLoopStage stage, const tsMetricsMark &start) {
+  tsMetricsMark now = metricsMark();
+  metricsRecordBetween(stage, start, now);
+  return now;
+}
+
+const char* metricsStageName(const teLoopStage stage) {
+  return stageInfo[stage].name;
+}
+
+const tsStageMetrics &metricsStage(const teLoopStage stage) {
+  return stages[stage];
+}
+
+void metricsReset(const teLoopStage stage) {
+  memset(&stages[stage], 0, sizeof(stages[stage]));
+}
+
+uint32_t metricsP99(const teLoopStage stage) {
+  const tsStageMetrics &metrics = stages[stage];
+  if (metrics.count == 0) return 0;
+
+  uint32_t target = metrics.count - (metrics.count / 100);
+  uint32_t cumulative = 0;
+  for (byte bucket = 0; bucket < METRICS_BUCKETS - 1; bucket++) {
+    cumulative += metrics.buckets[bucket];
+    if (cumulative >= target) return 2UL << bucket;
+  }
+  return metrics.maxUs;
+}
+
+size_t metricsFormatHistogram(const teLoopStage stage, char* buffer, const size_t size) {
+  const tsStageMetrics &metrics = stages[stage];
+  const char* name = stageInfo[stage].name;
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  if (stage == 0) {
+    textAppend(text, "# HELP dsc_stage_duration_us Duration of gateway work stages\n"
+                     "# TYPE dsc_stage_duration_us histogram\n");
+  }
+
+  uint32_t cumulative = 0;
+  for (byte bucket = 0; bucket < METRICS_BUCKETS - 1; bucket++) {
+    cumulative += metrics.buckets[bucket];
+    textPrintf(text, "dsc_stage_duration_us_bucket{stage=\"%s\",le=\"%lu\"} %lu\n",
+               name, (unsigned long)(2UL << bucket), (unsigned long)cumulative);
+  }
+  textPrintf(text, "dsc_stage_duration_us_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n"
+                   "dsc_stage_duration_us_sum{stage=\"%s\"} %llu\n"
+                   "dsc_stage_duration_us_count{stage=\"%s\"} %lu\n",
+             name, (unsigned long)metrics.count,
+             name, (unsigned long long)metrics.sumUs,
+             name, (unsigned long)metrics.count);
+
+  return text.overflow ? 0 : text.length;
+}
+
+size_t metricsFormatSummary(char* buffer, const size_t size) {
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  textAppend(text, "# TYPE dsc_stage_duration_max_us gauge\n");
+  for (byte stage = 0; stage < STAGE_COUNT; stage++) {
+    textPrintf(text, "dsc_stage_duration_max_us{stage=\"%s\"} %lu\n",
+               stageInfo[stage].name, (unsigned long)stages[stage].maxUs);
+  }
+  textAppend(text, "# TYPE dsc_stage_duration_p99_us gauge\n");
+  for (byte stage = 0; stage < STAGE_COUNT; stage++) {
+    textPrintf(text, "dsc_stage_duration_p99_us{stage=\"%s\"} %lu\n",
+               stageInfo[stage].name, (unsigned long)metricsP99((teLoopStage)stage));
+  }
+  textAppend(text, "# TYPE dsc_stage_over_budget_total counter\n");
+  for (byte stage = 0; stage < STAGE_COUNT; stage++) {
+    textPrintf(text, "dsc_stage_over_budget_total{stage=\"%s\",budget_us=\"%lu\"} %lu\n",
+               stageInfo[stage].name, (unsigned long)stageInfo[stage].budgetUs,
+               (unsigned long)stages[stage].overBudget);
+  }
+
+  return text.overflow ? 0 : text.length;
+}
+
+size_t metricsFormatJson(char* buffer, const size_t size) {
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  textAppend(text, "{");
+  for (byte stage = 0; stage < STAGE_COUNT; stage++) {
+    textPrintf(text, "%s\"%s\":{\"count\":%lu,\"max\":%lu,\"p99\":%lu,\"over\":%lu}",
+               stage ? "," : "", stageInfo[stage].name,
+               (unsigned long)stages[stage].count, (unsigned long)stages[stage].maxUs,
+               (unsigned long)metricsP99((teLoopStage)stage), (unsigned long)stages[stage].overBudget);
+  }
+  textAppend(text, "}");
+
+  return text.overflow ? 0 : text.length;
+}
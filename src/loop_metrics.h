@@ -0,0 +1,98 @@
+/**
+   Lightweight timing of the gateway's work stages. Each stage keeps a
+   log2-bucketed histogram of its duration in microseconds plus count, sum,
+   max and the number of runs over the stage budget. Timing uses the CPU
+   cycle counter, falling back to millis() for stages long enough for the
+   counter to wrap. A stage must only be recorded from one task.
+*/
+#ifndef LOOP_METRICS_H
+#define LOOP_METRICS_H
+
+#include <Arduino.h>
+
+// Bucket i counts durations below 2^(i+1) us, the last one everything above
+#define METRICS_BUCKETS   24
+
+typedef enum {
+  STAGE_WIFI,               // WiFi reconnect handling
+  STAGE_MQTT,               // mqttHandle()
+  STAGE_TELEGRAM,           // Telegram poll and command handling
+  STAGE_OTA,                // ArduinoOTA.handle()
+  STAGE_HTTP,               // server.handleClient()
+  STAGE_DISPATCH,           // Status dispatch to MQTT and Telegram
+  STAGE_NETWORK_LOOP,       // Whole network task iteration
+  STAGE_KEYBUS,             // dsc.loop() and status capture
+  STAGE_KEYBUS_INTERVAL,    // Time between two Keybus services
+  STAGE_COUNT
+} teLoopStage;
+
+typedef struct {
+  uint32_t cycles;
+  uint32_t ms;
+} tsMetricsMark;
+
+typedef struct {
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+  uint32_t overBudget;
+  uint32_t buckets[METRICS_BUCKETS];
+} tsStageMetrics;
+
+/**
+   Read the CPU clock once, call before recording anything.
+*/
+void metricsBegin();
+
+/**
+   Current time mark, the start of a stage.
+*/
+tsMetricsMark metricsMark();
+
+/**
+   Microseconds between two marks.
+*/
+uint32_t metricsElapsedUs(const tsMetricsMark &start, const tsMetricsMark &end);
+
+/**
+   Record the time from `start` until now for `stage`. Returns the new mark
+   so consecutive stages can be chained.
+*/
+tsMetricsMark metricsRecord(const teLoopStage stage, const tsMetricsMark &start);
+
+/**
+   Record the time between two marks for `stage`.
+*/
+void metricsRecordBetween(const teLoopStage stage, const tsMetricsMark &start, const tsMetricsMark &end);
+
+const char* metricsStageName(const teLoopStage stage);
+const tsStageMetrics &metricsStage(const teLoopStage stage);
+
+/**
+   Clear the record of `stage`.
+*/
+void metricsReset(const teLoopStage stage);
+
+/**
+   Upper bound in microseconds of the bucket holding the 99th percentile.
+*/
+uint32_t metricsP99(const teLoopStage stage);
+
+/**
+   Prometheus text of the duration histogram of `stage`. The family header
+   is written with the first stage, so call for all stages in order.
+   Returns the text length, 0 if it did not fit.
+*/
+size_t metricsFormatHistogram(const teLoopStage stage, char* buffer, const size_t size);
+
+/**
+   Prometheus text of the max, p99 and over-budget gauges of all stages.
+*/
+size_t metricsFormatSummary(char* buffer, const size_t size);
+
+/**
+   Compact JSON with count, max, p99 and over-budget count per stage.
+*/
+size_t metricsFormatJson(char* buffer, const size_t size);
+
+#endif
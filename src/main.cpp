@@ -20,11 +20,20 @@
 
 #if defined(USE_MQTT)
 #include <PubSubClient.h>
+#include <mqtt_topics.h>
+#include <mqtt_cache.h>
+#include <mqtt_command.h>
+#include <mqtt_scheduler.h>
+#include <tcp_connect.h>
 #endif
 
 #if defined(USE_TELEGRAM)
 #include <UniversalTelegramBot.h>
 #include <HTTPUpdate.h>
+#include <telegram_queue.h>
+#include <telegram_recipients.h>
+#include <tls_client.h>
+#include <file_download.h>
 #endif
 
 #include <dscKeybusInterface.h>
@@ -36,14 +45,30 @@
 #include <WiFiClientSecure.h>
 
 WebServer server(80);    // Create a webserver object that listens for HTTP request on port 80
+alignas(4) uint8_t fileBlock[FILE_BLOCK_LEN];   // Files are sent from flash through this, by /file and /read_spiffs
 
 void handleRoot();              // function prototypes for HTTP handlers
 void handleSaveParams();
-
-#include <ArduinoJson.h>          //https://github.com/bblanchon/ArduinoJson
+void handleMetrics();
+void handleFile();
+void handleHistory();
+void handleApiState();
+void handleApiConfig();
+void handleWebAsset();
 
 #include <esp32_wdt.h>
 
+#include <panel_state.h>
+#include <panel_events.h>
+#include <event_log.h>
+#include <config_store.h>
+#include <loop_metrics.h>
+#include <command_trace.h>
+#include <keypad_queue.h>
+#include <state_codec.h>
+#include <text_buffer.h>
+#include <web_assets.h>
+
 // WiFi settings
 String wifiSSID = "";
 String wifiPassword = "";
@@ -53,22 +78,22 @@ bool saveResult = false;
 time_t startTime;
 
 #if defined(USE_MQTT)
-//define your default values here, if there are different values in config.json, they are overwritten.
+//define your default values here, stored values (config_store.h) override them.
 char mqtt_server[MQTT_SERVER_LEN];
 char mqtt_port[MQTT_PORT_LEN] = "1883";
 char mqtt_user[MQTT_USER_LEN] = "";
 char mqtt_password[MQTT_PASSWORD_LEN] = "";
+char mqtt_state_format[MQTT_STATE_FORMAT_LEN] = "json";  // dsc/Get/State encoding: json, binary or empty to disable
 #endif
 
 #if defined(USE_TELEGRAM)
 char telegram_chat_id[TELEGRAM_CHAT_ID_LEN] = "";
 char telegram_bot_token[TELEGRAM_BOT_TOKEN_LEN] = "";
 char telegram_msg_prefix[TELEGRAM_MSG_PREFIX_LEN] = "";
+char telegram_recipients[TELEGRAM_RECIPIENTS_LEN] = "";  // More notification chats, see telegram_recipients.h
 //const char* telegram_msg_prefix = "[Security system] ";
 
 bool telegramEnabled = false;
-
-char keybuf[32];
 #endif
 
 #if defined(USE_MQTT)
@@ -76,7 +101,8 @@ WiFiClient wifiClient;
 #endif
 
 #if defined(USE_TELEGRAM)
-WiFiClientSecure wifiClientSecured;
+TlsClient wifiClientSecured;              // Commands: long polling, replies and file transfers
+TlsClient wifiClientNotify;               // Notifications, so they don't wait for a long poll
 #endif
 
 #if defined(USE_MQTT) || defined(USE_TELEGRAM)
@@ -90,13 +116,33 @@ const char* mqttPartitionTopic = "dsc/Get/Partition";  // Sends armed and alarm
 const char* mqttZoneTopic = "dsc/Get/Zone";            // Sends zone status per zone: dsc/Get/Zone1 ... dsc/Get/Zone64
 const char* mqttFireTopic = "dsc/Get/Fire";            // Sends fire status per partition: dsc/Get/Fire1 ... dsc/Get/Fire8
 const char* mqttPgmTopic = "dsc/Get/PGM";              // Sends PGM status per PGM: dsc/Get/PGM1 ... dsc/Get/PGM14
-const char* mqttSubscribeTopic = "dsc/Set";            // Receives messages to write to the panel
+const char* mqttStateTopic = "dsc/Get/State";          // Sends partitions, zones, PGMs and troubles in one message
+tsMqttTopics mqttTopics;                               // Per-entity topics built from the ones above
+const char* mqttSubscribeTopic = "dsc/Set";            // Receives commands on dsc/Set and below, see mqtt_command.h
+const char* mqttCommandFilter = "dsc/Set/#";          // Subscription to mqttSubscribeTopic and its subtopics
+const char* mqttAckTopic = "dsc/status/Ack";           // Acknowledges every received command
 const char* mqttLWTTopic = "dsc/status/LWT";
+const char* mqttStatsTopic = "dsc/status/Stats";       // Sends stage timing statistics every MQTT_STATS_INTERVAL
+const char* mqttKeybusTopic = "dsc/status/Keybus";     // Sends Keybus buffer overflow and high-water accounting
 const char* mqttLWTonline = "Online";
 const char* mqttLWToffline = "Offline";
-unsigned long mqttPreviousTime;
 char exitState;
 
+// Broker connection, advanced a step per network task pass by mqttHandle()
+typedef enum {
+  MQTT_LINK_WAIT,                 // Waiting for mqttRetryTime
+  MQTT_LINK_TCP,                  // TCP handshake in progress
+  MQTT_LINK_SESSION,              // Connected, CONNECT/CONNACK and subscribe next
+  MQTT_LINK_ONLINE
+} teMqttLink;
+
+teMqttLink mqttLink = MQTT_LINK_WAIT;
+tsTcpConnect mqttTcp = { -1, 0 };
+unsigned long mqttRetryTime;
+byte mqttFailures = 0;
+IPAddress mqttBrokerIp;                  // Looked up once, again after MQTT_RESOLVE_FAILURES failures
+char mqttBrokerHost[MQTT_SERVER_LEN];    // Name mqttBrokerIp was looked up for, empty when none
+
 PubSubClient mqtt(mqtt_server, atoi(mqtt_port), wifiClient);
 
 void mqttCallback(char* topic, byte* payload, unsigned int length);
@@ -105,16 +151,48 @@ void mqttHandle();
 
 bool mqttEnabled = false;
 
-void publishState(const char* sourceTopic, byte partition, const char* targetSuffix, const char* currentState);
+void publishState(const char topics[][MQTT_TOPIC_LEN], byte partition, teMqttTarget target, const char* currentState);
+void mqttPublishEvent(const tsPanelEvent &event);
+void publishPanelState();
+bool publishRetained(teMqttLane lane, const char* topic, const char* payload);
+bool publishScheduled(const char* topic, const char* payload);
+void mqttFlush();
+void mqttResync();
+void publishStats();
 #endif
 
 #if defined(USE_TELEGRAM)
 UniversalTelegramBot telegramBot(telegram_bot_token, wifiClientSecured);
-const int telegramCheckInterval = 1000;
-
+UniversalTelegramBot telegramNotifier(telegram_bot_token, wifiClientNotify);
+const char* telegramOffsetFile = "/telegram.offset";
+long telegramOffsetSaved = 0;                 // Update offset last written to telegramOffsetFile
+char downloadChatId[TELEGRAM_CHAT_ID_LEN];    // Chat that sent the file being downloaded
+File uploadFile;                              // File being sent by /read_spiffs
+size_t uploadBlockLength = 0;
+
+// telegramBot is used by the poll task until it has updates, then by the network task until they
+// are handled; telegramNotifier only by the Telegram task
+volatile byte telegramPending = 0;  // Updates received by the poll task, waiting for the network task
+TaskHandle_t telegramTaskHandle;
+TaskHandle_t telegramPollTaskHandle;
+
+void telegramTask(void *pvParameters);
+void telegramPollTask(void *pvParameters);
+bool telegramNotifyHandle();
+byte telegramPollHandle();
+long telegramOffsetLoad();
+void telegramOffsetSave(long updateId, bool force = false);
 void handleTelegram(byte telegramMessages);
-bool sendMessage(const char* messageContent);
-void appendPartition(byte sourceNumber, char* message);
+void telegramDownloadPoll();
+bool parseSha256(const char* text, uint8_t* sha256);
+bool uploadMoreData();
+byte* uploadNextBuffer();
+int uploadNextBufferLength();
+bool sendMessage(const char* messageContent, teTelegramClass eventClass = TELEGRAM_CLASS_SYSTEM);
+void telegramDeliver(const tsTelegramBatch &batch);
+bool telegramConfigured();
+void appendPartition(byte sourceNumber, tsTextBuffer &message);
+void telegramNotifyEvent(const tsPanelEvent &event);
 
 void bot_setup();
 #endif
@@ -139,13 +217,42 @@ bool wifiConnected = true;
 // Initialize components
 dscKeybusInterface dsc(dscClockPin, dscReadPin, dscWritePin);
 
+// Keybus processing and network I/O run in separate tasks pinned to separate cores, so a slow TLS
+// handshake or broker timeout can't hold up dsc.loop()
+TaskHandle_t keybusTaskHandle;
+TaskHandle_t networkTaskHandle;
+volatile unsigned long keybusHeartbeat = 0;
+volatile teLoopStage networkStage = STAGE_NETWORK_LOOP;  // Network task stage currently running
+volatile bool servicesStarted = false;                   // Set once setup() has started WiFi and the services
+volatile bool keybusStopRequested = false;               // The network task asks the Keybus task to stop dsc
+volatile bool keybusStopped = false;
+
+// Keybus buffer accounting, written by the Keybus task
 typedef struct {
-  char *val;
-  size_t len;
-  String name;
-  String webFormName;
-  String webFormText;
-} tsConfig;
+  unsigned long overflows;        // Buffer overflow events
+  byte highWater;                 // Most commands drained in one service, a lower bound of the buffer occupancy
+  time_t lastOverflowTime;        // Wall clock of the last overflow, 0 if none
+  unsigned long lastOverflowMillis;
+  teLoopStage lastOverflowStage;  // Network task stage running when the last overflow was seen
+  uint32_t lastOverflowIntervalUs;  // Time since the previous Keybus service at the last overflow
+} tsKeybusStats;
+
+volatile tsKeybusStats keybusStats;
+
+void keybusTask(void *pvParameters);
+void networkTask(void *pvParameters);
+void keybusHandle();
+void keybusStop();
+void networkHandle();
+static void networkDispatch();
+bool clockSynced();
+
+teKeypadQueue keypadWrite(teKeypadPriority priority, byte partition, const char* keys, uint16_t traceId = 0);
+
+tsPanelState panel;               // Network task copy of the panel status
+tsPanelEvent panelEvents[PANEL_EVENT_MAX];  // Changes in panel, consumed by every sink
+uint32_t panelGeneration = 0;     // Changes taken into panel, the /api/state ETag
+uint32_t bootId;                  // Random per boot, so ETags of a previous boot never match
 
 tsConfig _config[] = {
 #if defined(USE_MQTT)
@@ -153,6 +260,7 @@ tsConfig _config[] = {
   { mqtt_port, sizeof(mqtt_port), "mqtt_port", "mqtt-port", "MQTT Port" },
   { mqtt_user, sizeof(mqtt_user), "mqtt_user", "mqtt-user", "MQTT User" },
   { mqtt_password, sizeof(mqtt_password), "mqtt_password", "mqtt-psw", "MQTT Password" },
+  { mqtt_state_format, sizeof(mqtt_state_format), "mqtt_state_format", "mqtt-state-format", "MQTT State Format (json/binary)" },
 #endif
 #if defined(USE_MQTT) || defined(USE_TELEGRAM)
   { dsc_access_code, sizeof(dsc_access_code), "dsc_access_code", "dsc-access-code", "DSC Panel Access Code" },
@@ -161,6 +269,7 @@ tsConfig _config[] = {
   { telegram_bot_token, sizeof(telegram_bot_token), "telegram_bot_token", "telegram-bot-token", "Telegram Bot Token" },
   { telegram_chat_id, sizeof(telegram_chat_id), "telegram_chat_id", "telegram-chat-id", "Telegram Chat ID" },
   { telegram_msg_prefix, sizeof(telegram_msg_prefix), "telegram_msg_prefix", "telegram-msg-prefix", "Telegram Message Prefix" },
+  { telegram_recipients, sizeof(telegram_recipients), "telegram_recipients", "telegram-recipients", "Telegram Recipients (chat[:alarm+arming+trouble+system], ...)" },
 #endif
 };
 
@@ -174,44 +283,46 @@ void setup() {
 
   wdt_enable(WDT_TMO);
   
-  //read configuration from FS json
+  //read configuration from FS
   Serial.println("mounting FS...");
 
   if (SPIFFS.begin(true)) {
     Serial.println("mounted file system");
-    if (SPIFFS.exists("/config.json")) {
-      //file exists, reading and loading
-      Serial.println("reading config file");
-      File configFile = SPIFFS.open("/config.json", "r");
-      if (configFile) {
-        Serial.println("opened config file");
-        size_t size = configFile.size();
-        // Allocate a buffer to store contents of the file.
-        std::unique_ptr<char[]> buf(new char[size]);
-
-        configFile.readBytes(buf.get(), size);
-        DynamicJsonDocument json(1024);
-        DeserializationError error = deserializeJson(json, buf.get());
-        serializeJson(json, Serial);
-        if (!error) {
-          Serial.println("\nparsed json");
-
-          for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
-            if (json.containsKey(_config[idx].name)) {
-              strcpy(_config[idx].val, json[_config[idx].name]);
-            }
-          }
-        } else {
-          Serial.println("failed to load json config");
-        }
-        configFile.close();
-      }
+    Serial.printf("event log: %u records\n", (unsigned)eventLogBegin(SPIFFS));
+    switch (configBegin(SPIFFS, _config, COMMON_NUMEL(_config))) {
+      case CONFIG_LOADED: Serial.println("loaded config"); break;
+      case CONFIG_MIGRATED: Serial.println("migrated config.json"); break;
+      default: Serial.println("no stored config, using defaults"); break;
     }
   } else {
     Serial.println("failed to mount FS");
   }
   //end read
 
+  // Starts the Keybus interface and optionally specifies how to print data.
+  // begin() sets Serial by default and can accept a different stream: begin(Serial1), etc.
+  // The panel is monitored from here on, while WiFi, NTP and the network services come up;
+  // status changes wait in panel_state until the network task dispatches them.
+  dsc.begin();
+
+  Serial.println(F("DSC Keybus Interface is online."));
+
+  metricsBegin();
+#if defined(USE_MQTT)
+  mqttTopicsBegin(mqttTopics, mqttPartitionTopic, mqttZoneTopic, mqttFireTopic, mqttPgmTopic);
+  mqttCacheBegin(mqttTopics);
+  mqttSchedulerBegin(publishScheduled, MQTT_PUBLISH_RATE, MQTT_PUBLISH_BURST);
+#endif
+#if defined(USE_TELEGRAM)
+  telegramQueueBegin(TELEGRAM_QUEUE_LEN);
+  Serial.printf("Telegram recipients: %u\n", telegramRecipientsBegin(telegram_chat_id, telegram_recipients));
+  telegramRecipientsPrefix(telegram_msg_prefix);
+#endif
+
+  xTaskCreatePinnedToCore(keybusTask, "keybus", KEYBUS_TASK_STACK, NULL, KEYBUS_TASK_PRIORITY, &keybusTaskHandle, KEYBUS_TASK_CORE);
+  // Logs and queues the panel changes while WiFiManager connects, the services start once it is done
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, &networkTaskHandle, NETWORK_TASK_CORE);
+
   //WiFiManager
   //Local intialization. Once its business is done, there is no need to keep it around
   WiFiManager wifiManager;
@@ -274,8 +385,17 @@ void setup() {
     Serial.println("Error setting up MDNS responder!");
   }
 
+  bootId = random(0x7fffffff);             // WiFi is up, the hardware RNG is seeded
   server.on("/", handleRoot);
   server.on("/SaveParams", HTTP_POST, handleSaveParams);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.on("/history", HTTP_GET, handleHistory);
+  server.on("/file", HTTP_GET, handleFile);
+  server.on("/api/state", HTTP_GET, handleApiState);
+  server.on("/api/config", HTTP_GET, handleApiConfig);
+  for (const tsWebAsset &asset : webAssets) server.on(asset.uri, HTTP_GET, handleWebAsset);
+  static const char* collectedHeaders[] = { "If-None-Match", "Accept-Encoding" };
+  server.collectHeaders(collectedHeaders, COMMON_NUMEL(collectedHeaders));
   server.onNotFound([](){
     server.send(404, "text/plain", "404: Not found");
   });
@@ -283,17 +403,8 @@ void setup() {
   server.begin();                           // Actually start the server
   Serial.println("HTTP server started");
 
-  Serial.print(F("NTP time..."));
+  // The clock is set in the background, startTime and the event times are back-dated once it is
   configTime(0, 0, "pool.ntp.org");
-  time_t now = time(nullptr);
-  while (now < 24 * 3600)
-  {
-    Serial.print(".");
-    delay(2000);
-    now = time(nullptr);
-  }
-  Serial.println(F("synchronized."));
-  startTime = time(nullptr);
 
   Serial.print("Local IP: ");
   Serial.println(WiFi.localIP());
@@ -320,8 +431,7 @@ void setup() {
     mqttEnabled = true;
     mqtt.setServer(mqtt_server, atoi(mqtt_port));
     mqtt.setCallback(mqttCallback);
-    if (mqttConnect()) mqttPreviousTime = millis();
-    else mqttPreviousTime = 0;
+    mqttRetryTime = millis();  // Connects from the first network task pass
   } else {
     Serial.println("Wrong MQTT configuration, start aborted!");
   }
@@ -332,15 +442,20 @@ void setup() {
   if (telegram_bot_token[0] != 0x00) {
     telegramEnabled = true;
     telegramBot.updateToken(telegram_bot_token);
+    telegramNotifier.updateToken(telegram_bot_token);
     wifiClientSecured.setCACert(TELEGRAM_CERTIFICATE_ROOT); // Add root certificate for api.telegram.org
-    // Sends a message on startup to verify connectivity
-    Serial.print(F("Telegram..."));
-    String tgHelloMsg = "";
-    tgHelloMsg = "Initializing v";
-    tgHelloMsg += version;
-    tgHelloMsg += "... ";
-    if (sendMessage(tgHelloMsg.c_str())) Serial.println(F("connected."));
-    else Serial.println(F("connection error."));
+    wifiClientNotify.setCACert(TELEGRAM_CERTIFICATE_ROOT);
+    // Workaround for https://github.com/espressif/arduino-esp32/issues/6165
+    wifiClientSecured.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT);
+    wifiClientNotify.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT);
+    // Waits on the server for updates, so an idle bot costs one request per TELEGRAM_LONG_POLL
+    telegramBot.longPoll = TELEGRAM_LONG_POLL;
+    // Skips the updates handled before a restart
+    telegramBot.last_message_received = telegramOffsetLoad();
+    // Sends a message on startup to verify connectivity, from the Telegram task
+    char tgHelloMsg[32];
+    snprintf(tgHelloMsg, sizeof(tgHelloMsg), "Initializing v%s... ", version);
+    sendMessage(tgHelloMsg);
     //bot_setup();
   } else {
     Serial.println("Wrong Telegram configuration, start aborted!");
@@ -371,7 +486,7 @@ void setup() {
     // NOTE: if updating FS this would be the place to unmount FS using FS.end()
     Serial.println("Start updating " + type);
 
-    dsc.stop();
+    keybusStop();
 
     wdt_reset();
   });
@@ -400,11 +515,14 @@ void setup() {
   });
   ArduinoOTA.begin();
 
-  // Starts the Keybus interface and optionally specifies how to print data.
-  // begin() sets Serial by default and can accept a different stream: begin(Serial1), etc.
-  dsc.begin();
+  servicesStarted = true;
 
-  Serial.println(F("DSC Keybus Interface is online."));
+#if defined(USE_TELEGRAM)
+  if (telegramEnabled) {
+    xTaskCreatePinnedToCore(telegramTask, "telegram", TELEGRAM_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, &telegramTaskHandle, NETWORK_TASK_CORE);
+    xTaskCreatePinnedToCore(telegramPollTask, "telegramPoll", TELEGRAM_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, &telegramPollTaskHandle, NETWORK_TASK_CORE);
+  }
+#endif
 
 //  MDNS.addService("http", "tcp", 80);
 }
@@ -418,469 +536,366 @@ void setup() {
 // }
 
 void loop() {
-  if (!saveResult) {
+  // All work is done by keybusTask() and networkTask(), the Arduino loop task is not needed
+  vTaskDelete(NULL);
+}
+
+// The wall clock reads 1970 until NTP has set it
+bool clockSynced() {
+  return time(nullptr) >= (time_t)CLOCK_VALID_AFTER;
+}
+
+void keybusTask(void *pvParameters) {
+  (void)pvParameters;
+  for (;;) {
+    keybusHandle();
+    vTaskDelay(1);
+  }
+}
+
+void networkTask(void *pvParameters) {
+  (void)pvParameters;
+  for (;;) {
+    networkHandle();
+    vTaskDelay(1);
+  }
+}
+
+// Runs on the Keybus core: services the library, answers the panel and hands status changes over
+// to the network task. Nothing here may block on network I/O.
+void keybusHandle() {
+  static tsMetricsMark keybusPreviousMark;
+  tsMetricsMark keybusMark = metricsMark();
+  uint32_t keybusIntervalUs = metricsElapsedUs(keybusPreviousMark, keybusMark);
+  if (keybusHeartbeat != 0) metricsRecordBetween(STAGE_KEYBUS_INTERVAL, keybusPreviousMark, keybusMark);
+  keybusPreviousMark = keybusMark;
+
+  keybusHeartbeat++;
+
+  // Stops the interface for the network task, e.g. before settings or an update are written
+  if (keybusStopRequested) {
+    if (!keybusStopped) {
+      dsc.stop();
+      keybusStopped = true;
+    }
+    return;
+  }
+
+  // Drains every command buffered since the previous service
+  byte keybusBacklog = 0;
+  while (keybusBacklog < dscBufferSize && dsc.loop()) keybusBacklog++;
+  if (keybusBacklog > keybusStats.highWater) keybusStats.highWater = keybusBacklog;
+
+  // If the Keybus data buffer is exceeded, the sketch is too busy to process all Keybus commands.  Call
+  // handlePanel() more often, or increase dscBufferSize in the library: src/dscKeybusInterface.h
+  if (dsc.bufferOverflow) {
+    dsc.bufferOverflow = false;
+    keybusStats.overflows++;
+    keybusStats.lastOverflowTime = time(nullptr);
+    keybusStats.lastOverflowMillis = millis();
+    keybusStats.lastOverflowStage = networkStage;
+    keybusStats.lastOverflowIntervalUs = keybusIntervalUs;
+    Serial.println(F("Keybus buffer overflow"));
+  }
+
+  // Writes the next queued keypad command by priority once the previous keys are out. The library
+  // keeps a pointer to the keys until they are written, so the buffer must outlive this call.
+  static tsKeypadCommand keypadCommand;
+  if (dsc.writeReady && keypadQueuePop(keypadCommand)) {
+    if (keypadCommand.partition != 0) dsc.writePartition = keypadCommand.partition;
+    dsc.write(keypadCommand.keys);
+    traceWritten(keypadCommand.traceId, dsc);
+  }
+
+  if (dsc.statusChanged) {                  // Checks if the security system status has changed
+    dsc.statusChanged = false;              // Resets the status flag
+
+#if defined(USE_MQTT) || defined(USE_TELEGRAM)
+    // Sends the access code when needed by the panel for arming, ahead of any waiting keys
+    if (dsc.accessCodePrompt) {
+      dsc.accessCodePrompt = false;
+      keypadWrite(KEYPAD_PRIORITY_ACCESS_CODE, 0, dsc_access_code);
+    }
+#endif
+
+    traceConfirm(dsc);
+    panelCapture(dsc);
+  }
+
+  metricsRecord(STAGE_KEYBUS, keybusMark);
+}
+
+// Asks the Keybus task to stop the interface and waits for it, the network task never calls dsc
+void keybusStop() {
+  keybusStopRequested = true;
+  for (unsigned long waited = 0; !keybusStopped && waited < KEYBUS_STOP_WAIT_MS; waited++) vTaskDelay(pdMS_TO_TICKS(1));
+}
+
+// Queues keys for the Keybus task to write, partition 0 keeps the current write partition
+teKeypadQueue keypadWrite(teKeypadPriority priority, byte partition, const char* keys, uint16_t traceId) {
+  teKeypadQueue result = keypadQueuePush(priority, partition, keys, traceId);
+  if (result != KEYPAD_QUEUED) {
+    Serial.print(F("Keypad write rejected: "));
+    Serial.println(keypadQueueError(result));
+  }
+  return result;
+}
+
+void networkHandle() {
+  tsMetricsMark loopMark = metricsMark();
+  tsMetricsMark stageMark = loopMark;
+
+  // Feeds the watchdog only while the Keybus task is alive as well
+  static unsigned long keybusHeartbeatSeen;
+  if (!saveResult && keybusHeartbeat != keybusHeartbeatSeen) {
+    keybusHeartbeatSeen = keybusHeartbeat;
     wdt_reset();
   }
   
   //MDNS.update();
 
+  // Counts the commands the panel never confirmed
+  traceExpire();
+
+  // WiFiManager owns WiFi until setup() is done, the changes are only logged and queued meanwhile
+  if (!servicesStarted) {
+    networkStage = STAGE_DISPATCH;
+    networkDispatch();
+    metricsRecord(STAGE_DISPATCH, stageMark);
+    return;
+  }
+
+  networkStage = STAGE_WIFI;
   // Updates status if WiFi drops and reconnects
   if (!wifiConnected && WiFi.status() == WL_CONNECTED) {
     Serial.println("WiFi reconnected");
     wifiConnected = true;
-    dsc.pauseStatus = false;
-    dsc.statusChanged = true;
   }
   else if (WiFi.status() != WL_CONNECTED && wifiConnected) {
     Serial.println("WiFi disconnected");
     wifiConnected = false;
-    dsc.pauseStatus = true;
     Serial.println("Reconnecting to WiFi...");
     WiFi.disconnect();
     WiFi.reconnect();
   }
+  // Back-dates the start time once NTP has set the clock
+  if (startTime == 0 && clockSynced()) startTime = time(nullptr) - (millis() / 1000);
+  stageMark = metricsRecord(STAGE_WIFI, stageMark);
 
 #if defined(USE_MQTT)
+  networkStage = STAGE_MQTT;
   if (mqttEnabled)   mqttHandle();
+  stageMark = metricsRecord(STAGE_MQTT, stageMark);
 #endif
 
 #if defined(USE_TELEGRAM)
-  if (telegramEnabled) {
-    // Checks for incoming Telegram messages
-    static unsigned long telegramPreviousTime;
-    if (millis() - telegramPreviousTime > telegramCheckInterval) {
-      wifiClientSecured.setHandshakeTimeout(30);  // Workaround for https://github.com/espressif/arduino-esp32/issues/6165
-      byte telegramMessages = telegramBot.getUpdates(telegramBot.last_message_received + 1);
-      while (telegramMessages) {
-        handleTelegram(telegramMessages);
-        telegramMessages = telegramBot.getUpdates(telegramBot.last_message_received + 1);
-      }
-      telegramPreviousTime = millis();
-    }
+  networkStage = STAGE_TELEGRAM;
+  // Runs the commands received by the poll task, which waits meanwhile
+  // A "write spiffs" download keeps the handoff until it is done, it uses the poll task's connection
+  if (downloadActive()) telegramDownloadPoll();
+  else if (telegramPending) {
+    handleTelegram(telegramPending);
+    if (!downloadActive()) telegramPending = 0;
   }
+  stageMark = metricsRecord(STAGE_TELEGRAM, stageMark);
 #endif
 
+  networkStage = STAGE_OTA;
   ArduinoOTA.handle();
+  stageMark = metricsRecord(STAGE_OTA, stageMark);
 
+  networkStage = STAGE_HTTP;
   server.handleClient();                    // Listen for HTTP requests from clients
+  stageMark = metricsRecord(STAGE_HTTP, stageMark);
 
-  dsc.loop();
-
-  if (dsc.statusChanged) {                  // Checks if the security system status has changed
-    dsc.statusChanged = false;              // Resets the status flag
-
-    // If the Keybus data buffer is exceeded, the sketch is too busy to process all Keybus commands.  Call
-    // handlePanel() more often, or increase dscBufferSize in the library: src/dscKeybusInterface.h
-    if (dsc.bufferOverflow) Serial.println(F("Keybus buffer overflow"));
-    dsc.bufferOverflow = false;
-
-#if defined(USE_TELEGRAM)
-    // Checks if the interface is connected to the Keybus
-    if (dsc.keybusChanged) {
-      dsc.keybusChanged = false;                 // Resets the Keybus data status flag
-      if (dsc.keybusConnected) {
-        sendMessage("Connected");
-      }
-      else {
-        sendMessage("Disconnected");
-      }
-    }
-#endif
-
-#if defined(USE_MQTT) || defined(USE_TELEGRAM)
-    // Sends the access code when needed by the panel for arming
-    if (dsc.accessCodePrompt) {
-      dsc.accessCodePrompt = false;
-      dsc.write(dsc_access_code);
-    }
-#endif
-
-    // Publishes status per partition
-    for (byte partition = 0; partition < dscPartitions; partition++) {
-#if defined(USE_MQTT) || defined(USE_TELEGRAM)
-      // Skips processing if the partition is disabled or in installer programming
-      if (dsc.disabled[partition]) continue;
-
-      // Publishes armed/disarmed status
-      if (dsc.armedChanged[partition]) {
-        if (dsc.armed[partition]) {
+  networkStage = STAGE_DISPATCH;
+  networkDispatch();
 #if defined(USE_MQTT)
-          exitState = 0;
-#endif
-#if defined(USE_TELEGRAM)
-        char messageContent[25];
+  // Publishes what the events queued, and what earlier iterations had no tokens or time left for
+  mqttFlush();
 #endif
+  stageMark = metricsRecord(STAGE_DISPATCH, stageMark);
 
-          // Night armed away
-          if (dsc.armedAway[partition] && dsc.noEntryDelay[partition]) {
-#if defined(USE_MQTT)
-            publishState(mqttPartitionTopic, partition, "N", "NA");
-#endif
-#if defined(USE_TELEGRAM)
-            strcpy(messageContent, "Armed night: Partition ");
-#endif
-          }
+  networkStage = STAGE_NETWORK_LOOP;
 
-          // Armed away
-          else if (dsc.armedAway[partition]) {
 #if defined(USE_MQTT)
-            publishState(mqttPartitionTopic, partition, "A", "AA");
-#endif
-#if defined(USE_TELEGRAM)
-            strcpy(messageContent, "Armed away: Partition ");
+  publishStats();
 #endif
-          }
 
-          // Night armed stay
-          else if (dsc.armedStay[partition] && dsc.noEntryDelay[partition]) {
-#if defined(USE_MQTT)
-            publishState(mqttPartitionTopic, partition, "N", "NA");
-#endif
-#if defined(USE_TELEGRAM)
-            strcpy(messageContent, "Armed night: Partition ");
-#endif
-          }
+  metricsRecord(STAGE_NETWORK_LOOP, loopMark);
+}
 
-          // Armed stay
-          else if (dsc.armedStay[partition]) {
+// Hands panel events to the MQTT and Telegram sinks
+static void networkNotify(const tsPanelEvent* events, size_t count) {
 #if defined(USE_MQTT)
-            publishState(mqttPartitionTopic, partition, "S", "SA");
+  for (size_t i = 0; i < count; i++) mqttPublishEvent(events[i]);
+  publishPanelState();
 #endif
-#if defined(USE_TELEGRAM)
-            strcpy(messageContent, "Armed stay: Partition ");
-#endif
-          }
-
-#if defined(USE_TELEGRAM)
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
-#endif
-        }
 
-        // Disarmed
-        else {
 #if defined(USE_TELEGRAM)
-          char messageContent[22] = "Disarmed: Partition ";
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
+  for (size_t i = 0; i < count; i++) telegramNotifyEvent(events[i]);
 #endif
-#if defined(USE_MQTT)
-          publishState(mqttPartitionTopic, partition, "D", "D");
-#endif
-        }
-      }
+}
 
-      // Checks exit delay status
-      if (dsc.exitDelayChanged[partition]) {
-        dsc.exitDelayChanged[partition] = false;  // Resets the exit delay status flag
-#if defined(USE_MQTT)
-        // Exit delay in progress
-        if (dsc.exitDelay[partition]) {
-
-          // Sets the arming target state if the panel is armed externally
-          if (exitState == 0 || dsc.exitStateChanged[partition]) {
-            dsc.exitStateChanged[partition] = 0;
-            switch (dsc.exitState[partition]) {
-              case DSC_EXIT_STAY: {
-                exitState = 'S';
-                publishState(mqttPartitionTopic, partition, "S", 0);
-                break;
-              }
-              case DSC_EXIT_AWAY: {
-                exitState = 'A';
-                publishState(mqttPartitionTopic, partition, "A", 0);
-                break;
-              }
-              case DSC_EXIT_NO_ENTRY_DELAY: {
-                exitState = 'N';
-                publishState(mqttPartitionTopic, partition, "N", 0);
-                break;
-              }
-            }
-          }
-        }
-        // Disarmed during exit delay
-        else if (!dsc.armed[partition]) {
-          exitState = 0;
-          publishState(mqttPartitionTopic, partition, "D", "D");
-        }
-#endif
-#if defined(USE_TELEGRAM)
-        if (dsc.exitDelay[partition]) {
-          char messageContent[36] = "Exit delay in progress: Partition ";
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
-        }
-        else if (!dsc.exitDelay[partition] && !dsc.armed[partition]) {
-          char messageContent[22] = "Disarmed: Partition ";
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
-        }
-#endif
-      }
+// Dispatches status changes captured by the Keybus task. Every change is logged as it is taken; while
+// WiFi is down the sinks' share is merged into one held image, sent once WiFi is back.
+static void networkDispatch() {
+  static tsPanelState held;
+  static bool holding = false;
+
+  if (panelTake(panel)) {
+    panelGeneration++;
+    size_t panelEventCount = panelDiff(panel, panelEvents, PANEL_EVENT_MAX);
+
+    // Events seen before NTP sync are stamped by the event log once the clock is set
+    uint32_t eventTime = clockSynced() ? time(nullptr) : EVENT_LOG_TIME_UNSYNCED;
+    for (size_t i = 0; i < panelEventCount; i++) eventLogAppend(panelEvents[i], eventTime);
+
+    if (wifiConnected && !holding) networkNotify(panelEvents, panelEventCount);
+    else if (holding) panelMerge(held, panel);
+    else {
+      held = panel;
+      holding = true;
+    }
+  }
 
-      // Publishes alarm triggered status
-      if (dsc.alarmChanged[partition]) {
-        dsc.alarmChanged[partition] = false;  // Resets the partition alarm status flag
-        if (dsc.alarm[partition]) {
-#if defined(USE_MQTT)
-          publishState(mqttPartitionTopic, partition, 0, "T");
-#endif
-#if defined(USE_TELEGRAM)
-          char messageContent[19] = "Alarm: Partition ";
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
-#endif
-        }
-        else if (!dsc.armedChanged[partition]) {
-#if defined(USE_MQTT)
-          publishState(mqttPartitionTopic, partition, "D", "D");
-#endif
-#if defined(USE_TELEGRAM)
-          char messageContent[22] = "Disarmed: Partition ";
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
-#endif
-        }
-      }
-      if (dsc.armedChanged[partition]) dsc.armedChanged[partition] = false;  // Resets the partition armed status flag
-#endif
+  if (holding && wifiConnected) {
+    holding = false;
+    networkNotify(panelEvents, panelDiff(held, panelEvents, PANEL_EVENT_MAX));
+  }
+  eventLogFlush(false);
+}
 
-      // Publishes fire alarm status
-      if (dsc.fireChanged[partition]) {
-        dsc.fireChanged[partition] = false;  // Resets the fire status flag
-#if defined(USE_MQTT) || defined(USE_TELEGRAM)
-        if (dsc.fire[partition]) {
 #if defined(USE_MQTT)
-          publishState(mqttFireTopic, partition, 0, "1");  // Fire alarm tripped
-#endif
-#if defined(USE_TELEGRAM)
-          char messageContent[24] = "Fire alarm: Partition ";
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
-#endif
-        }
-        else {
-#if defined(USE_MQTT)
-          publishState(mqttFireTopic, partition, 0, "0");  // Fire alarm restored
-#endif
-#if defined(USE_TELEGRAM)
-          char messageContent[33] = "Fire alarm restored: Partition ";
-          appendPartition(partition, messageContent);  // Appends the message with the partition number
-          sendMessage(messageContent);
-#endif
-        }
-#endif
-      }
+// Writes of the longest bypass, each one holds at least 15 zones: *1, 64 zones of two digits and #
+#define BYPASS_WRITES ((MQTT_ZONE_COUNT * 2 + 3) / (KEYPAD_KEYS_LEN - 2) + 1)
+
+// Queues the keys of a zone bypass: *1, two digits per zone and # to leave, in as many keypad
+// writes as needed, all of them or none; the trace follows the last one
+static teKeypadQueue keypadWriteBypass(byte partition, const uint8_t* zones, uint16_t traceId) {
+  static char keys[BYPASS_WRITES][KEYPAD_KEYS_LEN];
+  byte writes = 0;
+  tsTextBuffer text;
+  textBegin(text, keys[writes], sizeof(keys[writes]));
+  textAppend(text, "*1");
+  for (byte zone = 0; zone < MQTT_ZONE_COUNT; zone++) {
+    if (!bitRead(zones[zone / 8], zone % 8)) continue;
+    if (!textPrintf(text, "%02u", zone + 1)) {
+      writes++;
+      textBegin(text, keys[writes], sizeof(keys[writes]));
+      textPrintf(text, "%02u", zone + 1);
     }
+  }
+  if (!textAppend(text, "#")) {
+    writes++;
+    textBegin(text, keys[writes], sizeof(keys[writes]));
+    textAppend(text, "#");
+  }
+  return keypadQueuePushAll(KEYPAD_PRIORITY_KEYS, partition, keys, writes + 1, traceId);
+}
 
-    // Publishes zones 1-64 status in a separate topic per zone
-    // Zone status is stored in the openZones[] and openZonesChanged[] arrays using 1 bit per zone, up to 64 zones:
-    //   openZones[0] and openZonesChanged[0]: Bit 0 = Zone 1 ... Bit 7 = Zone 8
-    //   openZones[1] and openZonesChanged[1]: Bit 0 = Zone 9 ... Bit 7 = Zone 16
-    //   ...
-    //   openZones[7] and openZonesChanged[7]: Bit 0 = Zone 57 ... Bit 7 = Zone 64
-    if (dsc.openZonesStatusChanged) {
-      dsc.openZonesStatusChanged = false;                           // Resets the open zones status flag
-      for (byte zoneGroup = 0; zoneGroup < dscZones; zoneGroup++) {
-        for (byte zoneBit = 0; zoneBit < 8; zoneBit++) {
-          if (bitRead(dsc.openZonesChanged[zoneGroup], zoneBit)) {  // Checks an individual open zone status flag
-            bitWrite(dsc.openZonesChanged[zoneGroup], zoneBit, 0);  // Resets the individual open zone status flag
-#if defined(USE_MQTT)
-            // Appends the mqttZoneTopic with the zone number
-            char zonePublishTopic[strlen(mqttZoneTopic) + 3];
-            char zone[3];
-            strcpy(zonePublishTopic, mqttZoneTopic);
-            itoa(zoneBit + 1 + (zoneGroup * 8), zone, 10);
-            strcat(zonePublishTopic, zone);
-
-            if (mqttEnabled) {
-              if (bitRead(dsc.openZones[zoneGroup], zoneBit)) {
-                mqtt.publish(zonePublishTopic, "1", true);            // Zone open
-              }
-              else mqtt.publish(zonePublishTopic, "0", true);         // Zone closed
-            }
-#endif
-          }
-        }
+// Reason a keypad write was not queued, nullptr if it was
+static const char* queueError(teKeypadQueue result) {
+  return result == KEYPAD_QUEUED ? nullptr : keypadQueueError(result);
+}
+
+// Runs a parsed MQTT command, returns why it was refused or nullptr if the keys were queued
+static const char* mqttCommandRun(const tsMqttCommand &command, uint16_t traceId) {
+  static const char* const armKeys[] = { "s", "w", "n" };   // Keypad stay, away and no entry delay arm
+  static const teMqttTarget armTargets[] = { MQTT_TARGET_STAY, MQTT_TARGET_AWAY, MQTT_TARGET_NIGHT };
+  static const char armStates[] = { 'S', 'A', 'N' };
+  byte partition = command.partition;
+  char keys[KEYPAD_KEYS_LEN];
+  const char* error;
+
+  switch (command.command) {
+    case MQTT_CMD_ARM_STAY:
+    case MQTT_CMD_ARM_AWAY:
+    case MQTT_CMD_ARM_NIGHT:
+    case MQTT_CMD_DISARM:
+      // HomeKit shows the requested target now, the partition state is sent again even if unchanged
+      mqttCacheInvalidate(mqttTopics.partition[partition]);
+
+      // Resets the HomeKit target state if attempting to change the armed mode while armed or not ready
+      if (command.command != MQTT_CMD_DISARM && !panel.ready[partition]) {
+        panelRequestRefresh(partition);
+        return "not ready";
       }
-    }
 
-#if defined(USE_TELEGRAM)
-    // Zone alarm status is stored in the alarmZones[] and alarmZonesChanged[] arrays using 1 bit per zone, up to 64 zones
-    //   alarmZones[0] and alarmZonesChanged[0]: Bit 0 = Zone 1 ... Bit 7 = Zone 8
-    //   alarmZones[1] and alarmZonesChanged[1]: Bit 0 = Zone 9 ... Bit 7 = Zone 16
-    //   ...
-    //   alarmZones[7] and alarmZonesChanged[7]: Bit 0 = Zone 57 ... Bit 7 = Zone 64
-    if (dsc.alarmZonesStatusChanged) {
-      dsc.alarmZonesStatusChanged = false;                           // Resets the alarm zones status flag
-      for (byte zoneGroup = 0; zoneGroup < dscZones; zoneGroup++) {
-        for (byte zoneBit = 0; zoneBit < 8; zoneBit++) {
-          if (bitRead(dsc.alarmZonesChanged[zoneGroup], zoneBit)) {  // Checks an individual alarm zone status flag
-            bitWrite(dsc.alarmZonesChanged[zoneGroup], zoneBit, 0);  // Resets the individual alarm zone status flag
-            if (bitRead(dsc.alarmZones[zoneGroup], zoneBit)) {
-              char messageContent[15] = "Zone alarm: ";
-              char zoneNumber[3];
-              itoa((zoneBit + 1 + (zoneGroup * 8)), zoneNumber, 10); // Determines the zone number
-              strcat(messageContent, zoneNumber);
-              sendMessage(messageContent);
-            }
-            else {
-              char messageContent[24] = "Zone alarm restored: ";
-              char zoneNumber[3];
-              itoa((zoneBit + 1 + (zoneGroup * 8)), zoneNumber, 10); // Determines the zone number
-              strcat(messageContent, zoneNumber);
-              sendMessage(messageContent);
-            }
-          }
-        }
+      // Resets the HomeKit target state if attempting to change the arming mode during the exit delay
+      if (command.command != MQTT_CMD_DISARM && panel.exitDelay[partition] && exitState != 0) {
+        if (exitState == 'S') publishState(mqttTopics.partition, partition, MQTT_TARGET_STAY, 0);
+        else if (exitState == 'A') publishState(mqttTopics.partition, partition, MQTT_TARGET_AWAY, 0);
+        else if (exitState == 'N') publishState(mqttTopics.partition, partition, MQTT_TARGET_NIGHT, 0);
       }
-    }
-#endif
 
-    // Publishes PGM outputs 1-14 status in a separate topic per zone
-    // PGM status is stored in the pgmOutputs[] and pgmOutputsChanged[] arrays using 1 bit per PGM output:
-    //   pgmOutputs[0] and pgmOutputsChanged[0]: Bit 0 = PGM 1 ... Bit 7 = PGM 8
-    //   pgmOutputs[1] and pgmOutputsChanged[1]: Bit 0 = PGM 9 ... Bit 5 = PGM 14
-    if (dsc.pgmOutputsStatusChanged) {
-      dsc.pgmOutputsStatusChanged = false;  // Resets the PGM outputs status flag
-      for (byte pgmGroup = 0; pgmGroup < 2; pgmGroup++) {
-        for (byte pgmBit = 0; pgmBit < 8; pgmBit++) {
-          if (bitRead(dsc.pgmOutputsChanged[pgmGroup], pgmBit)) {  // Checks an individual PGM output status flag
-            bitWrite(dsc.pgmOutputsChanged[pgmGroup], pgmBit, 0);  // Resets the individual PGM output status flag
-#if defined(USE_MQTT)
-            // Appends the mqttPgmTopic with the PGM number
-            char pgmPublishTopic[strlen(mqttPgmTopic) + 3];
-            char pgm[3];
-            strcpy(pgmPublishTopic, mqttPgmTopic);
-            itoa(pgmBit + 1 + (pgmGroup * 8), pgm, 10);
-            strcat(pgmPublishTopic, pgm);
-
-            if (mqttEnabled) {
-              if (bitRead(dsc.pgmOutputs[pgmGroup], pgmBit)) {
-                mqtt.publish(pgmPublishTopic, "1", true);           // PGM enabled
-              }
-              else mqtt.publish(pgmPublishTopic, "0", true);        // PGM disabled
-            }
-#endif
-          }
-        }
+      // homebridge-mqttthing DISARM
+      if (command.command == MQTT_CMD_DISARM) {
+        if (!panel.armed[partition] && !panel.exitDelay[partition] && !panel.alarm[partition]) return "not armed";
+        return queueError(keypadWrite(KEYPAD_PRIORITY_ACCESS_CODE, partition + 1, dsc_access_code, traceId));
       }
-    }
 
-#if defined(USE_MQTT)
-    if (mqttEnabled) {
-      mqtt.subscribe(mqttSubscribeTopic);
-    }
-#endif
+      // homebridge-mqttthing STAY_ARM, AWAY_ARM and NIGHT_ARM
+      if (panel.armed[partition] || panel.exitDelay[partition]) return "already armed";
+      error = queueError(keypadWrite(KEYPAD_PRIORITY_ARM, partition + 1, armKeys[command.command], traceId));
+      if (error != nullptr) return error;
+      publishState(mqttTopics.partition, partition, armTargets[command.command], 0);
+      exitState = armStates[command.command];
+      return nullptr;
 
-#if defined(USE_TELEGRAM)
-    // Checks trouble status
-    if (dsc.troubleChanged) {
-      dsc.troubleChanged = false;  // Resets the trouble status flag
-      if (dsc.trouble) sendMessage("Trouble status on");
-      else sendMessage("Trouble status restored");
-    }
+    case MQTT_CMD_KEYS:
+      memcpy(keys, command.keys, command.keysLength);
+      keys[command.keysLength] = 0;
+      return queueError(keypadWrite(KEYPAD_PRIORITY_KEYS, partition + 1, keys, traceId));
 
-    // Checks for AC power status
-    if (dsc.powerChanged) {
-      dsc.powerChanged = false;  // Resets the battery trouble status flag
-      if (dsc.powerTrouble) sendMessage("AC power trouble");
-      else sendMessage("AC power restored");
-    }
+    case MQTT_CMD_BYPASS:
+      return queueError(keypadWriteBypass(partition + 1, command.zones, traceId));
 
-    // Checks panel battery status
-    if (dsc.batteryChanged) {
-      dsc.batteryChanged = false;  // Resets the battery trouble status flag
-      if (dsc.batteryTrouble) sendMessage("Panel battery trouble");
-      else sendMessage("Panel battery restored");
-    }
+    case MQTT_CMD_OUTPUT:
+      snprintf(keys, sizeof(keys), "*7%u", command.output);   // The panel asks for the access code if needed
+      return queueError(keypadWrite(KEYPAD_PRIORITY_KEYS, partition + 1, keys, traceId));
 
-    // Checks for keypad fire alarm status
-    if (dsc.keypadFireAlarm) {
-      dsc.keypadFireAlarm = false;  // Resets the keypad fire alarm status flag
-      sendMessage("Keypad Fire alarm");
-    }
+    case MQTT_CMD_PANIC:
+      return queueError(keypadWrite(KEYPAD_PRIORITY_KEYS, partition + 1, "p", traceId));
 
-    // Checks for keypad aux auxiliary alarm status
-    if (dsc.keypadAuxAlarm) {
-      dsc.keypadAuxAlarm = false;  // Resets the keypad auxiliary alarm status flag
-      sendMessage("Keypad Aux alarm");
-    }
+    case MQTT_CMD_FIRE:
+      return queueError(keypadWrite(KEYPAD_PRIORITY_KEYS, partition + 1, "f", traceId));
 
-    // Checks for keypad panic alarm status
-    if (dsc.keypadPanicAlarm) {
-      dsc.keypadPanicAlarm = false;  // Resets the keypad panic alarm status flag
-      sendMessage("Keypad Panic alarm");
-    }
-#endif
+    case MQTT_CMD_AUX:
+      return queueError(keypadWrite(KEYPAD_PRIORITY_KEYS, partition + 1, "a", traceId));
+
+    default:
+      return "unknown command";
   }
 }
 
-#if defined(USE_MQTT)
-// Handles messages received in the mqttSubscribeTopic
+// Handles messages received below mqttSubscribeTopic, every command is acknowledged on mqttAckTopic
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  // Handles unused parameters
-  (void)topic;
-  (void)length;
-
-  byte partition = 0;
-  byte payloadIndex = 0;
-
-  // Checks if a partition number 1-8 has been sent and sets the second character as the payload
-  if (payload[0] >= 0x31 && payload[0] <= 0x38) {
-    partition = payload[0] - 49;
-    payloadIndex = 1;
+  tsMqttCommand command;
+  teMqttParse result = mqttCommandParse(command, mqttSubscribeTopic, topic, payload, length);
+  const char* error = mqttParseError(result);
+  uint16_t traceId = 0;
+  if (result == MQTT_PARSE_OK) {
+    // The arm and disarm commands come first in both enums
+    teTraceKind kind = command.command <= MQTT_CMD_DISARM ? (teTraceKind)command.command : TRACE_OTHER;
+    traceId = traceBegin(TRACE_MQTT, kind, command.partition);
+    error = mqttCommandRun(command, traceId);
+    if (error != nullptr) traceCancel(traceId);
   }
 
-  // Resets the HomeKit target state if attempting to change the armed mode while armed or not ready
-  if (payload[payloadIndex] != 'D' && !dsc.ready[partition]) {
-    dsc.armedChanged[partition] = true;
-    dsc.statusChanged = true;
-    return;
-  }
-
-  // Resets the HomeKit target state if attempting to change the arming mode during the exit delay
-  if (payload[payloadIndex] != 'D' && dsc.exitDelay[partition] && exitState != 0) {
-    if (exitState == 'S') publishState(mqttPartitionTopic, partition, "S", 0);
-    else if (exitState == 'A') publishState(mqttPartitionTopic, partition, "A", 0);
-    else if (exitState == 'N') publishState(mqttPartitionTopic, partition, "N", 0);
-  }
-
-
-  // homebridge-mqttthing STAY_ARM
-  if (payload[payloadIndex] == 'S' && !dsc.armed[partition] && !dsc.exitDelay[partition]) {
-    dsc.writePartition = partition + 1;    // Sets writes to the partition number
-    dsc.write('s');  // Keypad stay arm
-    publishState(mqttPartitionTopic, partition, "S", 0);
-    exitState = 'S';
-    return;
-  }
-
-  // homebridge-mqttthing AWAY_ARM
-  if (payload[payloadIndex] == 'A' && !dsc.armed[partition] && !dsc.exitDelay[partition]) {
-    dsc.writePartition = partition + 1;    // Sets writes to the partition number
-    dsc.write('w');  // Keypad away arm
-    publishState(mqttPartitionTopic, partition, "A", 0);
-    exitState = 'A';
-    return;
-  }
-
-  // homebridge-mqttthing NIGHT_ARM
-  if (payload[payloadIndex] == 'N' && !dsc.armed[partition] && !dsc.exitDelay[partition]) {
-    dsc.writePartition = partition + 1;    // Sets writes to the partition number
-    dsc.write('n');  // Keypad arm with no entry delay
-    publishState(mqttPartitionTopic, partition, "N", 0);
-    exitState = 'N';
-    return;
-  }
-
-  // homebridge-mqttthing DISARM
-  if (payload[payloadIndex] == 'D' && (dsc.armed[partition] || dsc.exitDelay[partition] || dsc.alarm[partition])) {
-    dsc.writePartition = partition + 1;    // Sets writes to the partition number
-    dsc.write(dsc_access_code);
-    return;
-  }
+  // Formatted before publishing, the ID points into the client buffer the publish reuses
+  char ack[128];
+  tsTextBuffer text;
+  textBegin(text, ack, sizeof(ack));
+  textAppend(text, "{");
+  if (command.id != nullptr) textPrintf(text, "\"id\":\"%.*s\",", command.idLength, command.id);
+  textPrintf(text, "\"command\":\"%s\",\"partition\":%u,", mqttCommandName(command.command), command.partition + 1);
+  if (error == nullptr) textPrintf(text, "\"result\":\"ok\",\"trace\":%u}", traceId);
+  else textPrintf(text, "\"result\":\"error\",\"error\":\"%s\"}", error);
+  mqtt.publish(mqttAckTopic, ack, false);
+
+  // HomeKit sees the requested target state now rather than after the next panel event
+  mqttFlush();
 }
 
 bool MQTTclient_must_send_LWT_connected = false;
@@ -890,36 +905,98 @@ int mqttLWTPeriod;
 static const int MQTT_LWT_PERIOD = 10000;
 #endif
 
+// Schedules the next connect attempt: the delay doubles with every failure, half of it is random
+// so gateways that lost the same broker don't retry in lockstep
+static void mqttRetry() {
+  tcpConnectAbort(mqttTcp);
+  unsigned long backoff = (unsigned long)MQTT_BACKOFF_MIN_MS << min(mqttFailures, (byte)16);
+  if (backoff > MQTT_BACKOFF_MAX_MS) backoff = MQTT_BACKOFF_MAX_MS;
+  mqttRetryTime = millis() + (backoff / 2) + random(backoff / 2 + 1);
+  if (mqttFailures < 255) mqttFailures++;
+  mqttLink = MQTT_LINK_WAIT;
+}
+
+// Starts the TCP connect to the broker. A host name is looked up (blocking) only the first time,
+// when it changed, or every MQTT_RESOLVE_FAILURES failed attempts in case the broker moved
+static bool mqttConnectBegin() {
+  if (strcmp(mqttBrokerHost, mqtt_server) != 0 || (mqttFailures > 0 && mqttFailures % MQTT_RESOLVE_FAILURES == 0)) {
+    mqttBrokerHost[0] = '\0';
+    if (!mqttBrokerIp.fromString(mqtt_server) && !WiFi.hostByName(mqtt_server, mqttBrokerIp)) return false;
+    snprintf(mqttBrokerHost, sizeof(mqttBrokerHost), "%s", mqtt_server);
+  }
+  return tcpConnectBegin(mqttTcp, mqttBrokerIp, atoi(mqtt_port));
+}
+
 void mqttHandle() {
-  if (!mqtt.connected()) {
-    unsigned long mqttCurrentTime = millis();
-    if (mqttCurrentTime - mqttPreviousTime > 5000) {
-      mqttPreviousTime = mqttCurrentTime;
-      if (mqttConnect()) {
-        Serial.println(F("MQTT disconnected, successfully reconnected."));
-        mqttPreviousTime = 0;
+  switch (mqttLink) {
+    case MQTT_LINK_WAIT:
+      if ((long)(millis() - mqttRetryTime) < 0) return;
+      if (!mqttConnectBegin()) {
+        Serial.println(F("MQTT connection failed to start"));
+        mqttRetry();
+        return;
       }
-      else Serial.println(F("MQTT disconnected, failed to reconnect."));
+      mqttLink = MQTT_LINK_TCP;
+      // A local broker may have answered already
+      [[fallthrough]];
+
+    case MQTT_LINK_TCP: {
+      teTcpConnect result = tcpConnectPoll(mqttTcp, MQTT_CONNECT_TIMEOUT_MS);
+      if (result == TCP_CONNECT_PENDING) return;
+      if (result == TCP_CONNECT_FAILED) {
+        Serial.print(F("MQTT broker unreachable: "));
+        Serial.println(mqtt_server);
+        mqttRetry();
+        return;
+      }
+      // PubSubClient finds the client connected and only sends CONNECT
+      wifiClient = WiFiClient(mqttTcp.fd);
+      mqttTcp.fd = -1;
+      mqttLink = MQTT_LINK_SESSION;
+      return;
     }
-  }
-  else {
+
+    case MQTT_LINK_SESSION:
+      if (!mqttConnect()) {
+        wifiClient.stop();
+        mqttRetry();
+        return;
+      }
+      mqttFailures = 0;
+      mqttLink = MQTT_LINK_ONLINE;
+      mqttResync();
+      return;
+
+    case MQTT_LINK_ONLINE:
+      if (!mqtt.connected()) {
+        // The first attempt after a drop is immediate, the backoff starts from there
+        Serial.println(F("MQTT disconnected, reconnecting."));
+        wifiClient.stop();
+        mqttRetryTime = millis();
+        mqttLink = MQTT_LINK_WAIT;
+        return;
+      }
 #if 0
-    if (mqttLWTPeriod + MQTT_LWT_PERIOD < millis()) {
-      MQTTclient_must_send_LWT_connected = true;
-      mqttLWTPeriod = millis();
-    }
+      if (mqttLWTPeriod + MQTT_LWT_PERIOD < millis()) {
+        MQTTclient_must_send_LWT_connected = true;
+        mqttLWTPeriod = millis();
+      }
 #endif
-    if (MQTTclient_must_send_LWT_connected) {
-      if (mqtt.publish(mqttLWTTopic, mqttLWTonline, true)) {
-        MQTTclient_must_send_LWT_connected = false;
+      if (MQTTclient_must_send_LWT_connected) {
+        if (mqtt.publish(mqttLWTTopic, mqttLWTonline, true)) {
+          MQTTclient_must_send_LWT_connected = false;
+        }
       }
-    }
-    mqtt.loop();
+      mqtt.loop();
+      return;
   }
 }
 
+// Opens the MQTT session over the connected wifiClient. PubSubClient sends CONNECT and waits for
+// CONNACK in one call, so this is the one step that blocks the network task, MQTT_CONNACK_TIMEOUT at most
 bool mqttConnect() {
   mqtt.setKeepAlive(10);
+  mqtt.setSocketTimeout(MQTT_CONNACK_TIMEOUT);
   if (mqtt.connect(mqttClientName, 
                    mqtt_user, 
                    mqtt_password,
@@ -931,7 +1008,7 @@ bool mqttConnect() {
     Serial.println(mqtt_server);
     Serial.println(mqttClientName);
     //dsc.resetStatus();
-    mqtt.subscribe(mqttSubscribeTopic);
+    mqtt.subscribe(mqttCommandFilter);
     if (!mqtt.publish(mqttLWTTopic, mqttLWTonline, true)) MQTTclient_must_send_LWT_connected = true;
 #if 0
     mqttLWTPeriod = millis();
@@ -945,77 +1022,317 @@ bool mqttConnect() {
 }
 #endif
 
-void handleRoot() {                          // When URI / is requested, send a web page with a button to toggle the LED
-  String s = "";
+// Static parts of the configuration page, kept in flash
+static const char rootPageHead[] PROGMEM =
+  "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">"
+  "<style>"
+    "body {"
+      " background-color: #505050;"
+      " text-align: center;"
+      " color: white;"
+      " font-family: Arial, Helvetica, sans-serif;"
+      " max-width: 150px"
+      " margin: auto;"
+    " }"
+  "</style>"
+  "<h1>WiFi DSC";
+static const char rootPageForm[] PROGMEM =
+  " Bridge</h1>"
+  "<p>Service Stopped<br />Save and Reboot<br />MANDATORY!</p>"
+  "<form action=\"/SaveParams\" method=\"POST\">"
+    "<p>"
+      "<label for=\"ssid\">SSID</label>"
+      "<br />"
+      "<input name=\"ssid\" type=\"text\" value=\"";
+static const char rootPagePsk[] PROGMEM =
+      "\" />"
+      "<br />"
+      "<br />"
+      "<label for=\"psk\">PSK</label>"
+      "<br />"
+      "<input name=\"psk\" type=\"text\" value=\"";
+static const char rootPageFields[] PROGMEM =
+      "\" />"
+      "<br />"
+      "<hr width=\"200px\" />";
+static const char rootPageTail[] PROGMEM =
+    "</p>"
+    "<p>"
+      "<br />"
+      "<button type=\"submit\" value=\"Submit\">Save and Reboot</button>"
+    "</p>"
+  "</form>";
+
+// Collects page text into fixed size chunks, so a page costs the same heap whatever its length
+static char pageChunk[WEB_CHUNK_LEN];
+static size_t pageChunkLength;
+
+static void pageWrite(const char* text) {
+  size_t length = strlen(text);
+  while (length > 0) {
+    size_t count = min(length, sizeof(pageChunk) - pageChunkLength);
+    memcpy(pageChunk + pageChunkLength, text, count);
+    pageChunkLength += count;
+    text += count;
+    length -= count;
+    if (pageChunkLength == sizeof(pageChunk)) {
+      server.sendContent(pageChunk, pageChunkLength);
+      pageChunkLength = 0;
+    }
+  }
+}
 
-  s += "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">";
+static void pageEnd() {
+  if (pageChunkLength) server.sendContent(pageChunk, pageChunkLength);
+  pageChunkLength = 0;
+  server.sendContent("");
+}
 
-  s +=  "<style> \
-          body { \
-            background-color: #505050; \
-            text-align: center; \
-            color: white; \
-            font-family: Arial, Helvetica, sans-serif; \
-            max-width: 150px \
-            margin: auto; \
-          } \
-        </style>";
+void handleRoot() {                          // When URI / is requested, stream the configuration page
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/html", "");
+  pageChunkLength = 0;
 
-  s +=  "<h1>WiFi DSC";
+  pageWrite(rootPageHead);
 #if defined(USE_MQTT)
   if (mqttEnabled) {
-    s +=  " MQTT";
+    pageWrite(" MQTT");
   }
 #endif
 #if defined(USE_TELEGRAM)
   if (telegramEnabled) {
-    s +=  " TeleGram";
+    pageWrite(" TeleGram");
   }
 #endif
-  s +=  " Bridge</h1> \
-        <p>Service Stopped<br />Save and Reboot<br />MANDATORY!</p> \
-        <form action=\"/SaveParams\" method=\"POST\"> \
-          <p> \
-            <label for=\"ssid\">SSID</label> \
-            <br /> \
-            <input name=\"ssid\" type=\"text\" value=\"";
-  s +=      wifiSSID;
-  s +=      "\" /> \
-            <br /> \
-            <br /> \
-            <label for=\"psk\">PSK</label> \
-            <br /> \
-            <input name=\"psk\" type=\"text\" value=\"";
-  s +=      wifiPassword;
-  s +=      "\" /> \
-            <br />";
-
-  s +=      "<hr width=\"200px\" />";
+  pageWrite(rootPageForm);
+  pageWrite(wifiSSID.c_str());
+  pageWrite(rootPagePsk);
+  pageWrite(wifiPassword.c_str());
+  pageWrite(rootPageFields);
 
   for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
-    s +=      "<label for=\"";
-    s +=      _config[idx].webFormName;
-    s +=      "\">";
-    s +=      _config[idx].webFormText;
-    s +=      "</label> \
-              <br /> \
-              <input name=\"";
-    s +=      _config[idx].webFormName;
-    s +=      "\" type=\"text\" value=\"";
-    s +=      _config[idx].val;
-    s +=      "\" /> \
-              <br /> \
-              <br />";
-  }
-
-  s +=  "</p> \
-        <p> \
-          <br /> \
-          <button type=\"submit\" value=\"Submit\">Save and Reboot</button> \
-        </p> \
-      </form>";
-
-  server.send(200, "text/html", s);
+    pageWrite("<label for=\"");
+    pageWrite(_config[idx].webFormName.c_str());
+    pageWrite("\">");
+    pageWrite(_config[idx].webFormText.c_str());
+    pageWrite("</label><br /><input name=\"");
+    pageWrite(_config[idx].webFormName.c_str());
+    pageWrite("\" type=\"text\" value=\"");
+    pageWrite(_config[idx].val);
+    pageWrite("\" /><br /><br />");
+  }
+
+  pageWrite(rootPageTail);
+  pageEnd();
+}
+
+// Serves stage timing and command latency histograms in Prometheus text format, one chunk per histogram
+void handleMetrics() {
+  static char metricsBuffer[2048];
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+  for (byte stage = 0; stage < STAGE_COUNT; stage++) {
+    size_t length = metricsFormatHistogram((teLoopStage)stage, metricsBuffer, sizeof(metricsBuffer));
+    if (length) server.sendContent(metricsBuffer, length);
+  }
+  size_t length = metricsFormatSummary(metricsBuffer, sizeof(metricsBuffer));
+  if (length) server.sendContent(metricsBuffer, length);
+
+  for (byte phase = 0; phase < TRACE_PHASE_COUNT; phase++) {
+    for (byte source = 0; source < TRACE_SOURCE_COUNT; source++) {
+      for (byte kind = 0; kind < TRACE_KIND_COUNT; kind++) {
+        length = traceFormatHistogram((teTracePhase)phase, (teTraceSource)source, (teTraceKind)kind, metricsBuffer, sizeof(metricsBuffer));
+        if (length) server.sendContent(metricsBuffer, length);
+      }
+    }
+  }
+  length = traceFormatCounters(metricsBuffer, sizeof(metricsBuffer));
+  if (length) server.sendContent(metricsBuffer, length);
+  length = keypadQueueFormat(metricsBuffer, sizeof(metricsBuffer));
+  if (length) server.sendContent(metricsBuffer, length);
+#if defined(USE_MQTT)
+  length = mqttSchedulerFormat(metricsBuffer, sizeof(metricsBuffer));
+  if (length) server.sendContent(metricsBuffer, length);
+#endif
+#if defined(USE_TELEGRAM)
+  length = telegramRecipientsFormat(metricsBuffer, sizeof(metricsBuffer));
+  if (length) server.sendContent(metricsBuffer, length);
+#endif
+  server.sendContent("");
+}
+
+// Serves the event history as "<Unix time> <event>" lines: /history?since=<time>&until=<time>&limit=<count>
+void handleHistory() {
+  uint32_t since = server.hasArg("since") ? strtoul(server.arg("since").c_str(), nullptr, 10) : 0;
+  uint32_t until = server.hasArg("until") ? strtoul(server.arg("until").c_str(), nullptr, 10) : UINT32_MAX;
+  unsigned long limit = server.hasArg("limit") ? strtoul(server.arg("limit").c_str(), nullptr, 10) : EVENT_LOG_SEGMENTS * EVENT_LOG_SEGMENT_RECORDS;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+  pageChunkLength = 0;
+
+  tsEventLogCursor cursor;
+  tsEventLogRecord record;
+  char line[80];
+  tsTextBuffer text;
+  if (eventLogSeek(cursor, since)) {
+    for (unsigned long count = 0; count < limit && eventLogNext(cursor, record) && record.time <= until; count++) {
+      textBegin(text, line, sizeof(line));
+      // Unsynced records show the time of the record before them, marked with ~
+      textPrintf(text, "%s%lu ", record.flags & EVENT_LOG_UNSYNCED ? "~" : "", (unsigned long)record.time);
+      panelEventFormat(record.event, text);
+      textAppend(text, "\n");
+      pageWrite(line);
+    }
+  }
+  cursor.file.close();
+  pageEnd();
+}
+
+// Serves a SPIFFS file as a download: /file?name=<path>, read from flash one block at a time
+// Files holding the settings or the gateway's own state, /file refuses them
+static bool fileInternal(const char* path) {
+  if (configStoreFile(path)) return true;
+#if defined(USE_TELEGRAM)
+  while (*path == '/') path++;
+  if (strcmp(path, telegramOffsetFile + 1) == 0) return true;
+#endif
+  return false;
+}
+
+void handleFile() {
+  String name = server.arg("name");
+  if (fileInternal(name.c_str())) {
+    server.send(403, "text/plain", "Forbidden");
+    return;
+  }
+  File file = name.startsWith("/") ? SPIFFS.open(name, FILE_READ) : File();
+  if (!file || file.isDirectory()) {
+    server.send(404, "text/plain", "File not found");
+    return;
+  }
+
+  server.setContentLength(file.size());
+  server.sendHeader("Content-Disposition", "attachment; filename=\"" + name.substring(name.lastIndexOf('/') + 1) + "\"");
+  server.send(200, "application/octet-stream", "");
+  size_t length;
+  while ((length = file.read(fileBlock, sizeof(fileBlock))) > 0) server.sendContent((const char*)fileBlock, length);
+  file.close();
+}
+
+// JSON API and UI responses carry an ETag, a client that sends it back in If-None-Match gets a 304.
+// The header is "*" or a comma separated list of quoted tags, W/ weak ones compared as strong ones.
+static bool etagMatches(const char* etag) {
+  String header = server.header("If-None-Match");
+  const char* list = header.c_str();
+  size_t etagLength = strlen(etag);
+  for (;;) {
+    while (*list == ' ' || *list == '\t' || *list == ',') list++;
+    if (*list == 0) return false;
+    if (*list == '*') return true;
+    if (strncmp(list, "W/", 2) == 0) list += 2;
+
+    const char* end = *list == '"' ? strchr(list + 1, '"') : nullptr;
+    if (end == nullptr) {
+      // Not a quoted tag, skipped up to the next comma
+      list = strchr(list, ',');
+      if (list == nullptr) return false;
+      continue;
+    }
+    end++;
+    if ((size_t)(end - list) == etagLength && memcmp(list, etag, etagLength) == 0) return true;
+    list = end;
+  }
+}
+
+static void sendEtag(const char* etag) {
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Cache-Control", "no-cache");   // Cached, but revalidated every time
+}
+
+static void sendJson(const char* etag, const char* json, size_t length) {
+  sendEtag(etag);
+  server.setContentLength(length);
+  server.send(200, "application/json", "");
+  server.sendContent(json, length);
+}
+
+// Serves the panel image as JSON, the same document as the dsc/Get/State topic: /api/state
+void handleApiState() {
+  static char stateJson[STATE_JSON_LEN];
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%08lx-%lx\"", (unsigned long)bootId, (unsigned long)panelGeneration);
+  if (etagMatches(etag)) {
+    sendEtag(etag);
+    server.send(304);
+    return;
+  }
+
+  size_t length = stateEncodeJson(panel, stateJson, sizeof(stateJson));
+  if (length == 0) {
+    server.send(500, "text/plain", "500: State does not fit");
+    return;
+  }
+  sendJson(etag, stateJson, length);
+}
+
+// Secrets are listed as set or empty, never with their value
+static const char* const secretConfig[] = { "mqtt_password", "dsc_access_code", "telegram_bot_token" };
+
+static bool configSecret(const tsConfig &entry) {
+  for (const char* name : secretConfig) {
+    if (entry.name == name) return true;
+  }
+  return false;
+}
+
+// Serves the settings as a JSON object of name and value: /api/config
+void handleApiConfig() {
+  static char configJson[API_CONFIG_JSON_LEN];
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%08lx-c%lx\"", (unsigned long)bootId, (unsigned long)configGeneration());
+  if (etagMatches(etag)) {
+    sendEtag(etag);
+    server.send(304);
+    return;
+  }
+
+  tsTextBuffer text;
+  textBegin(text, configJson, sizeof(configJson));
+  textAppend(text, "{");
+  for (size_t idx = 0; idx < COMMON_NUMEL(_config); idx++) {
+    const tsConfig &entry = _config[idx];
+    textPrintf(text, "%s\"%s\":", idx ? "," : "", entry.name.c_str());
+    textAppendJson(text, configSecret(entry) && entry.val[0] ? "********" : entry.val);
+  }
+  textAppend(text, "}");
+  if (text.overflow) {
+    server.send(500, "text/plain", "500: Settings do not fit");
+    return;
+  }
+  sendJson(etag, configJson, text.length);
+}
+
+// Serves a UI asset as stored, gzipped: decompressing it here would cost the heap it saves
+void handleWebAsset() {
+  for (const tsWebAsset &asset : webAssets) {
+    if (server.uri() != asset.uri) continue;
+    if (etagMatches(asset.etag)) {
+      sendEtag(asset.etag);
+      server.send(304);
+    }
+    else if (server.header("Accept-Encoding").indexOf("gzip") < 0) {
+      server.send(406, "text/plain", "406: gzip encoding required");
+    }
+    else {
+      sendEtag(asset.etag);
+      server.sendHeader("Content-Encoding", "gzip");
+      server.send_P(200, asset.type, (const char*)asset.data, asset.length);
+    }
+    return;
+  }
+  server.send(404, "text/plain", "404: Not found");
 }
 
 void handleSaveParams() {
@@ -1035,32 +1352,22 @@ void handleSaveParams() {
     //read updated parameters
     String tempStr = "";
 
-    for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
-      size_t sz = _config[idx].len;
-      tempStr = server.arg(_config[idx].webFormName);
-      tempStr.toCharArray(_config[idx].val, sz);
-    }
+    keybusStop();
 
-    //save the custom parameters to FS
+    //save the changed parameters to FS
     Serial.println("saving config");
-    DynamicJsonDocument json(1024);
-
     for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
-      json[_config[idx].name] = _config[idx].val;
-    }
-
-    dsc.stop();
+      size_t sz = _config[idx].len;
+      char value[sz];
+      tempStr = server.arg(_config[idx].webFormName);
+      tempStr.toCharArray(value, sz);
+      if (strcmp(value, _config[idx].val) == 0) continue;
 
-    File configFile = SPIFFS.open("/config.json", "w");
-    if (!configFile) {
-      Serial.println("failed to open config file for writing");
-      saveResult = false;
-    } else {
-      serializeJson(json, Serial);
-      serializeJson(json, configFile);
-    
-      configFile.close();
-      //end save
+      strcpy(_config[idx].val, value);
+      if (!configSave(_config[idx])) {
+        Serial.println("failed to save config");
+        saveResult = false;
+      }
     }
 
     if (saveResult) {
@@ -1072,37 +1379,265 @@ void handleSaveParams() {
 }
 
 #if defined(USE_MQTT)
-// Publishes HomeKit target and current states with partition numbers
-void publishState(const char* sourceTopic, byte partition, const char* targetSuffix, const char* currentState) {
-  char publishTopic[strlen(sourceTopic) + 2];
-  char partitionNumber[2];
-
+// Queues HomeKit target and current states with partition numbers, ahead of zones and PGMs
+void publishState(const char topics[][MQTT_TOPIC_LEN], byte partition, teMqttTarget target, const char* currentState) {
   if (!mqttEnabled) return;
+  const char* topic = topics[partition];
+
+  // Skips a state the broker already holds, e.g. "D" again from an alarm restore
+  if (currentState != 0 && !mqttCacheWant(topic, currentState)) return;
+
+  // Queues the target state, prepended with the partition number
+  if (target != MQTT_TARGET_NONE) {
+    const char* targetState = mqttTopics.target[partition][target];
+    if (currentState == 0) publishRetained(MQTT_LANE_CRITICAL, topic, targetState);
+    else mqttSchedulerPost(MQTT_LANE_CRITICAL, topic, targetState);
+  }
+
+  // Queues the current state
+  if (currentState != 0) mqttSchedulerPost(MQTT_LANE_CRITICAL, topic, currentState);
+}
+
+// Queues a retained entity value unless the broker already holds it, a value not sent is retried
+// by mqttResync() after reconnecting
+bool publishRetained(teMqttLane lane, const char* topic, const char* payload) {
+  if (!mqttCacheWant(topic, payload) && lane == MQTT_LANE_CRITICAL) return true;
+  return mqttSchedulerPost(lane, topic, payload);
+}
+
+// Sends a message of the scheduler lanes
+bool publishScheduled(const char* topic, const char* payload) {
+  return mqtt.publish(topic, payload, true);
+}
+
+// Brings the broker up to date after connecting: only the topics that changed since they were last
+// sent are published, partitions with the target state first
+void mqttResync() {
+  // Messages queued while offline are superseded by the cache
+  mqttSchedulerClear();
+  size_t index = 0;
+  const char* topic;
+  const char* payload;
+  while (mqttCacheNextStale(index, topic, payload)) {
+    char value[MQTT_CACHE_VALUE_LEN];
+    snprintf(value, sizeof(value), "%s", payload);
+
+    byte entity;
+    teMqttTopicKind kind = mqttTopicsFind(mqttTopics, topic, entity);
+    if (kind == MQTT_TOPIC_PARTITION) {
+      teMqttTarget target = MQTT_TARGET_NONE;
+      if (strcmp(value, "SA") == 0) target = MQTT_TARGET_STAY;
+      else if (strcmp(value, "AA") == 0) target = MQTT_TARGET_AWAY;
+      else if (strcmp(value, "NA") == 0) target = MQTT_TARGET_NIGHT;
+      else if (strcmp(value, "D") == 0) target = MQTT_TARGET_DISARM;
+      if (target != MQTT_TARGET_NONE) {
+        publishState(mqttTopics.partition, entity, target, value);
+        continue;
+      }
+    }
+    bool critical = kind == MQTT_TOPIC_PARTITION || kind == MQTT_TOPIC_FIRE;
+    publishRetained(critical ? MQTT_LANE_CRITICAL : MQTT_LANE_ENTITY, topic, value);
+  }
+
+  publishPanelState();
+  mqttFlush();
+}
 
-  // Appends the sourceTopic with the partition number
-  itoa(partition + 1, partitionNumber, 10);
-  strcpy(publishTopic, sourceTopic);
-  strcat(publishTopic, partitionNumber);
+// Publishes a panel event to its HomeKit partition, fire, zone or PGM topic
+void mqttPublishEvent(const tsPanelEvent &event) {
+  switch (event.type) {
+    case PANEL_EVENT_ARMED: {
+      exitState = 0;
+      switch (event.value) {
+        case PANEL_ARMED_STAY:  publishState(mqttTopics.partition, event.index, MQTT_TARGET_STAY, "SA"); break;
+        case PANEL_ARMED_AWAY:  publishState(mqttTopics.partition, event.index, MQTT_TARGET_AWAY, "AA"); break;
+        case PANEL_ARMED_NIGHT: publishState(mqttTopics.partition, event.index, MQTT_TARGET_NIGHT, "NA"); break;
+        default:                publishState(mqttTopics.partition, event.index, MQTT_TARGET_DISARM, "D"); break;
+      }
+      break;
+    }
 
-  if (targetSuffix != 0) {
+    // Sets the arming target state if the panel is armed externally
+    case PANEL_EVENT_EXIT_DELAY: {
+      if (exitState != 0 && !(event.value & PANEL_EXIT_STATE_CHANGED)) break;
+      switch (event.value & ~PANEL_EXIT_STATE_CHANGED) {
+        case DSC_EXIT_STAY: {
+          exitState = 'S';
+          publishState(mqttTopics.partition, event.index, MQTT_TARGET_STAY, 0);
+          break;
+        }
+        case DSC_EXIT_AWAY: {
+          exitState = 'A';
+          publishState(mqttTopics.partition, event.index, MQTT_TARGET_AWAY, 0);
+          break;
+        }
+        case DSC_EXIT_NO_ENTRY_DELAY: {
+          exitState = 'N';
+          publishState(mqttTopics.partition, event.index, MQTT_TARGET_NIGHT, 0);
+          break;
+        }
+      }
+      break;
+    }
+
+    case PANEL_EVENT_ALARM: publishState(mqttTopics.partition, event.index, MQTT_TARGET_NONE, "T"); break;
+    case PANEL_EVENT_FIRE: publishState(mqttTopics.fire, event.index, MQTT_TARGET_NONE, event.value ? "1" : "0"); break;
 
-    // Prepends the targetSuffix with the partition number
-    char targetState[strlen(targetSuffix) + 2];
-    strcpy(targetState, partitionNumber);
-    strcat(targetState, targetSuffix);
+    case PANEL_EVENT_ZONE_OPEN: {
+      if (mqttEnabled) publishRetained(MQTT_LANE_ENTITY, mqttTopics.zone[event.index], event.value ? "1" : "0");
+      break;
+    }
+
+    case PANEL_EVENT_PGM: {
+      if (mqttEnabled && event.index < MQTT_PGM_COUNT) publishRetained(MQTT_LANE_ENTITY, mqttTopics.pgm[event.index], event.value ? "1" : "0");
+      break;
+    }
+  }
+}
 
-    // Publishes the target state
-    mqtt.publish(publishTopic, targetState, true);
+// Publishes stage timing statistics every MQTT_STATS_INTERVAL
+void publishStats() {
+  static unsigned long statsPreviousTime;
+  static unsigned long overflowsPublished;
+  static char statsPayload[1024];
+
+  if (!mqttEnabled || !mqtt.connected()) return;
+
+  // Keybus buffer accounting, published at once when a new overflow is seen
+  unsigned long overflows = keybusStats.overflows;
+  bool statsDue = millis() - statsPreviousTime >= MQTT_STATS_INTERVAL;
+  if (statsDue || overflows != overflowsPublished) {
+    overflowsPublished = overflows;
+    int keybusLength = snprintf(statsPayload, sizeof(statsPayload),
+      "{\"overflows\":%lu,\"highWater\":%u,\"bufferSize\":%u,\"lastOverflow\":%ld,\"lastOverflowStage\":\"%s\",\"lastOverflowIntervalUs\":%lu}",
+      overflows, keybusStats.highWater, dscBufferSize, (long)keybusStats.lastOverflowTime,
+      overflows ? metricsStageName(keybusStats.lastOverflowStage) : "", (unsigned long)keybusStats.lastOverflowIntervalUs);
+    if (keybusLength > 0 && (size_t)keybusLength < sizeof(statsPayload)) {
+      mqtt.publish(mqttKeybusTopic, statsPayload, true);
+    }
   }
 
-  // Publishes the current state
-  if (currentState != 0) {
-    mqtt.publish(publishTopic, currentState, true);
+  if (!statsDue) return;
+  statsPreviousTime = millis();
+
+  size_t statsLength = metricsFormatJson(statsPayload, sizeof(statsPayload));
+  if (statsLength == 0) return;
+  if (mqtt.beginPublish(mqttStatsTopic, statsLength, false)) {
+    mqtt.write((const uint8_t*)statsPayload, statsLength);
+    mqtt.endPublish();
   }
 }
+
+static bool panelStatePending = false;
+
+// Publishes the whole panel state as one retained message once the entity topics are out
+void publishPanelState() {
+  if (mqttEnabled) panelStatePending = true;
+}
+
+// Sends the panel state message, encoded as set in mqtt_state_format, if it changed since it was
+// last sent and a publish token is left
+static void flushPanelState() {
+  static char statePayload[STATE_JSON_LEN];
+  size_t stateLength = 0;
+
+  if (strcmp(mqtt_state_format, "json") == 0) {
+    stateLength = stateEncodeJson(panel, statePayload, sizeof(statePayload));
+  }
+  else if (strcmp(mqtt_state_format, "binary") == 0) {
+    stateLength = stateEncodeBinary(panel, (uint8_t*)statePayload, sizeof(statePayload));
+  }
+  panelStatePending = false;
+  if (stateLength == 0) return;
+
+  // Skips a payload the broker already holds
+  static uint32_t stateSentHash;
+  static bool stateSent = false;
+  uint32_t stateHash = mqttCacheHash((const uint8_t*)statePayload, stateLength);
+  if (stateSent && stateHash == stateSentHash) return;
+  if (!mqttSchedulerAcquire()) {
+    panelStatePending = true;
+    return;
+  }
+
+  // Streams the payload, it does not have to fit in the PubSubClient buffer
+  if (mqtt.beginPublish(mqttStateTopic, stateLength, true)) {
+    mqtt.write((const uint8_t*)statePayload, stateLength);
+    stateSent = mqtt.endPublish() != 0;
+    stateSentHash = stateHash;
+  }
+  else stateSent = false;
+}
+
+// Sends queued entity publishes within MQTT_PUBLISH_BUDGET_US, then the panel state message
+void mqttFlush() {
+  if (!mqttEnabled || !mqtt.connected()) return;
+  mqttSchedulerRun(MQTT_PUBLISH_BUDGET_US);
+  if (panelStatePending && mqttSchedulerPending() == 0) flushPanelState();
+}
 #endif
 
 #if defined(USE_TELEGRAM)
+// Upload callbacks of sendMultipartFormDataToTelegram(), each block is read before it is requested
+bool uploadMoreData() {
+  uploadBlockLength = uploadFile.read(fileBlock, sizeof(fileBlock));
+  return uploadBlockLength > 0;
+}
+
+byte* uploadNextBuffer() {
+  return fileBlock;
+}
+
+int uploadNextBufferLength() {
+  return uploadBlockLength;
+}
+
+// Queues keys for a Telegram command and traces them as `kind`, partition 0 keeps the current
+// write partition. The chat is told whether the keys were queued.
+static void telegramKeypadWrite(const String &chatId, teKeypadPriority priority, byte partition, const char* keys,
+                                teTraceKind kind) {
+  byte writePartition = partition != 0 ? partition : panel.writePartition;
+  byte tracePartition = writePartition > 0 ? writePartition - 1 : 0;
+  uint16_t traceId = traceBegin(TRACE_TELEGRAM, kind, tracePartition);
+  teKeypadQueue result = keypadWrite(priority, partition, keys, traceId);
+  if (result == KEYPAD_QUEUED) {
+    telegramBot.sendMessage(chatId, "Command queued", "");
+    return;
+  }
+  traceCancel(traceId);
+  telegramBot.sendMessage(chatId, String("Command rejected: ") + keypadQueueError(result), "");
+}
+
+// Reads a SHA-256 written as 64 hex digits, surrounding blanks are skipped
+bool parseSha256(const char* text, uint8_t* sha256) {
+  while (*text == ' ') text++;
+  for (byte idx = 0; idx < 32; idx++) {
+    char hex[3] = { text[idx * 2], text[idx * 2 + 1], 0 };
+    if (!isxdigit(hex[0]) || !isxdigit(hex[1])) return false;
+    sha256[idx] = strtoul(hex, nullptr, 16);
+  }
+  return text[64] == 0 || text[64] == ' ';
+}
+
+// Runs a slice of a "write spiffs" download and reports the result to the chat that sent the file
+void telegramDownloadPoll() {
+  teDownload result = downloadPoll(DOWNLOAD_SLICE_MS);
+  if (result == DOWNLOAD_RUNNING) return;
+
+  const tsDownload &status = downloadStatus();
+  char reply[160];
+  tsTextBuffer s;
+  textBegin(s, reply, sizeof(reply));
+  if (result == DOWNLOAD_DONE) {
+    textPrintf(s, "Success. %lu bytes in %lu ms, %u resumed\nSHA-256: ",
+               (unsigned long)status.received, status.elapsed, status.resumes);
+    for (byte idx = 0; idx < sizeof(status.sha256); idx++) textPrintf(s, "%02x", status.sha256[idx]);
+  }
+  else textPrintf(s, "Error: %s after %lu bytes.", status.error, (unsigned long)status.received);
+  telegramBot.sendMessage(downloadChatId, reply, "");
+  telegramPending = 0;
+}
+
 int handleOTA(int i) {
   int numNewMessages = 0;
   if (telegramBot.messages[i].type == "message")
@@ -1111,61 +1646,28 @@ int handleOTA(int i) {
       {
         httpUpdate.rebootOnUpdate(false);
         t_httpUpdate_return ret = (t_httpUpdate_return)3;
-        if (telegramBot.messages[i].file_caption == "write spiffs")
+        // "write spiffs [<SHA-256 in hex>]", the file is checked against the hash if one is given
+        if (telegramBot.messages[i].file_caption.startsWith("write spiffs"))
         {
           numNewMessages = 1;
           size_t spiffsFreeSize = SPIFFS.totalBytes() - SPIFFS.usedBytes();
-          if (telegramBot.messages[i].file_size < spiffsFreeSize)
+          uint8_t sha256[32];
+          bool checkHash = parseSha256(telegramBot.messages[i].file_caption.c_str() + strlen("write spiffs"), sha256);
+          String path = "/" + telegramBot.messages[i].file_name;
+          if (telegramBot.messages[i].file_size >= spiffsFreeSize)
           {
-            telegramBot.sendMessage(telegramBot.messages[i].chat_id, "File downloading.", "");
-            HTTPClient http;
-            if (http.begin(wifiClientSecured, telegramBot.messages[i].file_path))
-            {
-              int code = http.GET();
-              if (code == HTTP_CODE_OK)
-              {
-                int total = http.getSize();
-                int len = total;
-                uint8_t buff[128] = {0};
-                WiFiClient *tcp = http.getStreamPtr();
-                if (SPIFFS.exists("/" + telegramBot.messages[i].file_name))
-                  SPIFFS.remove(("/" + telegramBot.messages[i].file_name));
-                File fl = SPIFFS.open("/" + telegramBot.messages[i].file_name, FILE_WRITE);
-                if (!fl)
-                {
-                  telegramBot.sendMessage(telegramBot.messages[i].chat_id, "File open error.", "");
-                }
-                else
-                {
-                  while (http.connected() && (len > 0 || len == -1))
-                  {
-                    size_t size_available = tcp->available();
-                    Serial.print("%");
-                    Serial.println(100 - ((len * 100) / total));
-                    if (size_available)
-                    {
-                      int c = tcp->readBytes(buff, ((size_available > sizeof(buff)) ? sizeof(buff) : size_available));
-                      fl.write(buff, c);
-                      if (len > 0)
-                      {
-                        len -= c;
-                      }
-                    }
-                    delay(1);
-                  }
-                  fl.close();
-                  if (len == 0)
-                    telegramBot.sendMessage(telegramBot.messages[i].chat_id, "Success.", "");
-                  else
-                    telegramBot.sendMessage(telegramBot.messages[i].chat_id, "Error.", "");
-                }
-              }
-              http.end();
-            }
+            telegramBot.sendMessage(telegramBot.messages[i].chat_id, "SPIFFS size to low (" + String(spiffsFreeSize) + ") needed: " + String(telegramBot.messages[i].file_size), "");
+          }
+          else if (!downloadBegin(wifiClientSecured, telegramBot.messages[i].file_path.c_str(), SPIFFS, path.c_str(),
+                                  telegramBot.messages[i].file_size, checkHash ? sha256 : nullptr))
+          {
+            telegramBot.sendMessage(telegramBot.messages[i].chat_id, "File open error.", "");
           }
           else
           {
-            telegramBot.sendMessage(telegramBot.messages[i].chat_id, "SPIFFS size to low (" + String(spiffsFreeSize) + ") needed: " + String(telegramBot.messages[i].file_size), "");
+            // Runs from the network task, see telegramDownloadPoll()
+            snprintf(downloadChatId, sizeof(downloadChatId), "%s", telegramBot.messages[i].chat_id.c_str());
+            telegramBot.sendMessage(telegramBot.messages[i].chat_id, "File downloading.", "");
           }
         }
         else
@@ -1195,7 +1697,7 @@ int handleOTA(int i) {
 
           case HTTP_UPDATE_OK:
             telegramBot.sendMessage(telegramBot.messages[i].chat_id, "UPDATE OK\nRestarting...", "");
-            numNewMessages = telegramBot.getUpdates(telegramBot.last_message_received + 1);
+            telegramOffsetSave(telegramBot.last_message_received, true);
             ESP.restart();
             break;
           default:
@@ -1222,52 +1724,38 @@ int handleOTA(int i) {
         bool res = SPIFFS.format();
         if (!res)
           telegramBot.sendMessage(telegramBot.messages[i].chat_id, "Format unsuccessful", "");
-        else
+        else {
+          // The event log starts over and the settings are written back from RAM, both keep file
+          // offsets that the format made stale
+          eventLogBegin(SPIFFS);
+          configCompact();
           telegramBot.sendMessage(telegramBot.messages[i].chat_id, "SPIFFS formatted.", "");
+        }
       }
       else if (telegramBot.messages[i].text.startsWith("/read_spiffs")) // "/read_spiffs <filename>")
       {
           numNewMessages = 1;
 
-          String rcvText = telegramBot.messages[i].text;
-          String fileName = "";
-          
-          char buf[rcvText.length() + 1];
-          rcvText.toCharArray(buf, sizeof(buf));
-          char *p = buf;
-          char *str;
-          while ((str = strtok_r(p, " ", &p)) != NULL) { // delimiter is the space
-              fileName = str;
-              //telegramBot.sendMessage(telegramBot.messages[i].chat_id, str, "");
-          }
-          
+          String fileName = telegramBot.messages[i].text.substring(strlen("/read_spiffs"));
+          fileName.trim();
+
           telegramBot.sendMessage(telegramBot.messages[i].chat_id, "Getting file " + fileName + "... ", "");
 
           if (fileName != "") {
               if (SPIFFS.exists(fileName)) {
-                File fl = SPIFFS.open(fileName, FILE_READ);
-                if (!fl)
+                uploadFile = SPIFFS.open(fileName, FILE_READ);
+                if (!uploadFile)
                 {
                   telegramBot.sendMessage(telegramBot.messages[i].chat_id, "File open error!", "");
                 } else {
-                  size_t size = fl.size();
-
-                  if (size <= 4096) {
-                    // Allocate a buffer to store contents of the file.
-                    std::unique_ptr<char[]> buf(new char[size]);
-                    fl.readBytes(buf.get(), size);
-
-                    // send file here
-                    //telegramBot.sendChatAction(telegramBot.messages[i].chat_id, "upload_document");
-                    String ss = String(buf.get()).substring(0, size);
-                    telegramBot.sendMessage(telegramBot.messages[i].chat_id, ss);
-                    //Serial.println(ss);
-                  } else {
-                    telegramBot.sendMessage(telegramBot.messages[i].chat_id, " File size exceed 4096 bytes = " + size, "");
-                  }
-                  
-                  fl.close();
-                  telegramBot.sendMessage(telegramBot.messages[i].chat_id, " OK", "");
+                  // Sent as a document, read from flash one block at a time while it is uploaded
+                  String response = telegramBot.sendMultipartFormDataToTelegram("sendDocument", "document",
+                    fileName.substring(fileName.lastIndexOf('/') + 1), "application/octet-stream",
+                    telegramBot.messages[i].chat_id, uploadFile.size(),
+                    uploadMoreData, nullptr, uploadNextBuffer, uploadNextBufferLength);
+                  uploadFile.close();
+                  if (response.indexOf("\"ok\":true") < 0)
+                    telegramBot.sendMessage(telegramBot.messages[i].chat_id, " File upload failed!", "");
                 }
               } else {
                 telegramBot.sendMessage(telegramBot.messages[i].chat_id, " File Not Found!", "");
@@ -1282,46 +1770,66 @@ int handleOTA(int i) {
   return numNewMessages;
 }
 
+// Parses a /history argument: a Unix time, or a number of m(inutes), h(ours) or d(ays) before `now`
+static uint32_t historySince(const char* arg, const uint32_t now) {
+  while (*arg == ' ') arg++;
+  if (*arg == 0) return now > 86400 ? now - 86400 : 0;
+
+  char* unit;
+  unsigned long value = strtoul(arg, &unit, 10);
+  unsigned long seconds;
+  switch (*unit) {
+    case 'm': seconds = value * 60; break;
+    case 'h': seconds = value * 3600; break;
+    case 'd': seconds = value * 86400; break;
+    default: return value;
+  }
+  return now > seconds ? now - seconds : 0;
+}
+
 void handleTelegram(byte telegramMessages) {
   static byte partition = 0;
   static byte oldPartition = 0;
+  static char reply[TELEGRAM_REPLY_LEN];
+  tsTextBuffer s;
 
   for (byte i = 0; i < telegramMessages; i++) {
 
-    String chat_id = telegramBot.messages[i].chat_id;
-    String text = telegramBot.messages[i].text;
-    String from_name = telegramBot.messages[i].from_name;
-    if (from_name == "")
-      from_name = "Guest";
+    const String &chat_id = telegramBot.messages[i].chat_id;
+    const String &text = telegramBot.messages[i].text;
+    const char* from_name = telegramBot.messages[i].from_name.length() ? telegramBot.messages[i].from_name.c_str() : "Guest";
 
-    String tgUserId = String(telegram_chat_id);
-    if (tgUserId != "" && tgUserId != chat_id) continue;  // don't process requests from unknown sender
+    bool tgUserIdSet = telegram_chat_id[0] != 0x00;
+    if (tgUserIdSet && strcmp(telegram_chat_id, chat_id.c_str()) != 0) continue;  // don't process requests from unknown sender
 
     if (0 != handleOTA(i)) continue; // FW/SPIFFS things handler
 
+    textBegin(s, reply, sizeof(reply));
+
     // ============================= FOR TESTING THINGS =========================
 
     if (text == "/chat_id") {
-      telegramBot.sendMessage(chat_id, chat_id + " " + telegramBot.messages[i].type);
+      textPrintf(s, "%s %s", chat_id.c_str(), telegramBot.messages[i].type.c_str());
+      telegramBot.sendMessage(chat_id, reply);
       continue;
     } 
     else if (text == "/start")
     {
-      String welcome = "Welcome, " + from_name + "!\n\n";
-      welcome += "Usage:\n";
-      welcome += "/chat_id : get ChatID\n";
-      telegramBot.sendMessage(chat_id, welcome);
+      textPrintf(s, "Welcome, %s!\n\n", from_name);
+      textAppend(s, "Usage:\n");
+      textAppend(s, "/chat_id : get ChatID\n");
+      telegramBot.sendMessage(chat_id, reply);
       continue;
     }
 
     // ============================= DSC THINGS =========================
 
     // answer ONLY to know UserID
-    if (tgUserId == "") continue;
+    if (!tgUserIdSet) continue;
 
     if (text == "/reset") {
       telegramBot.sendMessage(telegramBot.messages[i].chat_id, "Restarting...");
-      telegramBot.getUpdates(telegramBot.last_message_received + 1);
+      telegramOffsetSave(telegramBot.last_message_received, true);
       ESP.restart();
     } 
     else if (text == "/send_test_action")
@@ -1343,265 +1851,250 @@ void handleTelegram(byte telegramMessages) {
     }
     else if (text == "/status") 
     {
-      String s = "";
-
       // ======================================
 
-      s += "Partition status:\n";
+      textAppend(s, "Partition status:\n");
 
       for (byte partition = 0; partition < PARTITION_COUNT; partition++) {
-        s += "Partition ";
-        s += partition + 1;
-        s += " ";
-        if (dsc.disabled[partition]) {
-          s += "Disabled\n";
+        textPrintf(s, "Partition %d ", partition + 1);
+        if (panel.disabled[partition]) {
+          textAppend(s, "Disabled\n");
           continue;
         }
 
         // Ready
-        if (dsc.ready[partition]) {
-          s += "READY ";
+        if (panel.ready[partition]) {
+          textAppend(s, "READY ");
         }
 
         // Exit delay in progress
-        if (dsc.exitDelay[partition]) {
-          s += "Exit Delay in progress ";
-          switch (dsc.exitState[partition]) {
+        if (panel.exitDelay[partition]) {
+          textAppend(s, "Exit Delay in progress ");
+          switch (panel.exitState[partition]) {
             case DSC_EXIT_STAY: {
-              s += "Stay\n";
+              textAppend(s, "Stay\n");
               break;
             }
             case DSC_EXIT_AWAY: {
-              s += "Away\n";
+              textAppend(s, "Away\n");
               break;
             }
             case DSC_EXIT_NO_ENTRY_DELAY: {
-              s += "No Exit Delay\n";
+              textAppend(s, "No Exit Delay\n");
               break;
             }
           }
         }
         // // Disarmed during exit delay
         // else if (!dsc.armed[partition]) {
-        //   s += "Disarmed\n";
+        //   textAppend(s, "Disarmed\n");
         // }
 
-        if (dsc.alarm[partition]) {
-          s += "Alarm!\n";
+        if (panel.alarm[partition]) {
+          textAppend(s, "Alarm!\n");
         }
-        if (dsc.fire[partition]) {
-          s += "Fire!\n";
+        if (panel.fire[partition]) {
+          textAppend(s, "Fire!\n");
         }
 
 
-        if (dsc.armed[partition]) {
+        if (panel.armed[partition]) {
           // Night armed away
-          if (dsc.armedAway[partition] && dsc.noEntryDelay[partition]) {
-            s += "Night Arm\n";
+          if (panel.armedAway[partition] && panel.noEntryDelay[partition]) {
+            textAppend(s, "Night Arm\n");
           }
           // Armed away
-          else if (dsc.armedAway[partition]) {
-            s += "Away Arm\n";
+          else if (panel.armedAway[partition]) {
+            textAppend(s, "Away Arm\n");
           }
           // Night armed stay
-          else if (dsc.armedStay[partition] && dsc.noEntryDelay[partition]) {
-            s += "Night Stay Arm\n";
+          else if (panel.armedStay[partition] && panel.noEntryDelay[partition]) {
+            textAppend(s, "Night Stay Arm\n");
           }
           // Armed stay
-          else if (dsc.armedStay[partition]) {
-            s += "Stay Arm\n";
+          else if (panel.armedStay[partition]) {
+            textAppend(s, "Stay Arm\n");
           }
         }
         // Disarmed
         else {
-          s += "Disarmed\n";
+          textAppend(s, "Disarmed\n");
         }
       }
 
       // ======================================
 
-      s += "---\n";
-      s += "Zone status:\n";
+      textAppend(s, "---\n");
+      textAppend(s, "Zone status:\n");
 
       byte zonesTouchedCount = 0;
 
       for (byte zoneGroup = 0; zoneGroup < dscZones; zoneGroup++) {
         for (byte zoneBit = 0; zoneBit < 8; zoneBit++) {
-          char zone[3];
-          itoa(zoneBit + 1 + (zoneGroup * 8), zone, 10);
-
           bool zoneTouched = false;
-          if (bitRead(dsc.openZones[zoneGroup], zoneBit)) {  
-            s += zone;
-            s += ": opened";
+          if (bitRead(panel.openZones[zoneGroup], zoneBit)) {  
+            textPrintf(s, "%d: opened", zoneBit + 1 + (zoneGroup * 8));
             zoneTouched = true;
             zonesTouchedCount++;
           }
           // else {
-          //   s += "closed";
+          //   textAppend(s, "closed");
           // }
 
-          if (bitRead(dsc.alarmZones[zoneGroup], zoneBit)) {
-            s += "ALARM!\n";
+          if (bitRead(panel.alarmZones[zoneGroup], zoneBit)) {
+            textAppend(s, "ALARM!\n");
           } else if (zoneTouched) {
-            s += "\n";
+            textAppend(s, "\n");
           }
         }
       }
 
       if (0 == zonesTouchedCount) {
-        s += "All closed\n";
+        textAppend(s, "All closed\n");
       }
 
       // ======================================
 
-      s += "---\n";
-      s += "Keybus ";
-      if (dsc.keybusConnected) {
-        s += "connected";
-      } else {
-        s += "connected";
+      textAppend(s, "---\n");
+      textAppend(s, panel.keybusConnected ? "Keybus connected\n" : "Keybus disconnected\n");
+
+      unsigned long overflows = keybusStats.overflows;
+      textPrintf(s, "Buffer overflows: %lu, high water: %u/%u\n", overflows, keybusStats.highWater, dscBufferSize);
+      if (overflows) {
+        time_t overflowTime = keybusStats.lastOverflowTime;
+        struct tm timeInfo;
+        gmtime_r(&overflowTime, &timeInfo);
+        char strftime_buf[64];
+        strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeInfo);
+        textPrintf(s, "Last overflow (UTC): %s during %s, %lu us since the previous Keybus service\n",
+                   strftime_buf, metricsStageName(keybusStats.lastOverflowStage),
+                   (unsigned long)keybusStats.lastOverflowIntervalUs);
       }
-      s += "\n";
 
-      // s += "Panel version: ";
-      // s += dsc.panelVersion;
-      // s += "\n";
+      // textPrintf(s, "Panel version: %d\n", dsc.panelVersion);
 
       // ======================================
-      s += "---\n";
+      textAppend(s, "---\n");
 
-      if (!dsc.trouble) {
-        s += "No Troubles\n";
+      if (!panel.trouble) {
+        textAppend(s, "No Troubles\n");
       }
-      if (dsc.powerTrouble) {
-        s += "Power Trouble\n";
+      if (panel.powerTrouble) {
+        textAppend(s, "Power Trouble\n");
       }
-      if (dsc.batteryTrouble) {
-        s += "Battery Trouble\n";
+      if (panel.batteryTrouble) {
+        textAppend(s, "Battery Trouble\n");
       }
 
-      if (dsc.keypadFireAlarm) {
-        s += "Keypad Fire Alarm!\n";
+      if (panel.keypadFireAlarm) {
+        textAppend(s, "Keypad Fire Alarm!\n");
       }
-      if (dsc.keypadAuxAlarm) {
-        s += "Keypad Aux Alarm!\n";
+      if (panel.keypadAuxAlarm) {
+        textAppend(s, "Keypad Aux Alarm!\n");
       }
-      if (dsc.keypadPanicAlarm) {
-        s += "Keypad Panic Alarm!\n";
+      if (panel.keypadPanicAlarm) {
+        textAppend(s, "Keypad Panic Alarm!\n");
       }
 
       // ======================================
       
-      s += "---\n";
-      s += "PGMs:\n";
+      textAppend(s, "---\n");
+      textAppend(s, "PGMs:\n");
 
       byte _pgmGroups = (PGM_COUNT > 8) ? 2 : 1;
       byte _pgmCount = PGM_COUNT;
 
       for (byte pgmGroup = 0; pgmGroup < _pgmGroups; pgmGroup++) {
         for (byte pgmBit = 0; pgmBit < _pgmCount; pgmBit++) {
-          char pgm[3];
-          itoa(pgmBit + 1 + (pgmGroup * 8), pgm, 10);
-          s += pgm;
-          s += ": ";
-
-          if (bitRead(dsc.pgmOutputs[pgmGroup], pgmBit)) {
-            s += "on\n";
-          } else {
-            s += "off\n";
-          }
+          textPrintf(s, "%d: %s\n", pgmBit + 1 + (pgmGroup * 8), bitRead(panel.pgmOutputs[pgmGroup], pgmBit) ? "on" : "off");
         }
       }
 
       //
-      telegramBot.sendMessage(chat_id, s);
+      telegramBot.sendMessage(chat_id, reply);
     }
     else if (text == "/version") 
     {
-      String s = "";
-      s += "FW version: ";
-      s += version;
-      s += "\n";
-      s += "WiFi SSID: ";
-      s += WiFi.SSID();
-      s += "\n";
-      s += "WiFi PSK: ";
-      s += WiFi.psk();
-      s += "\n";
-      s += "WiFi RSSI: ";
-      s += WiFi.RSSI();
-      s += "\n";
-      s += "IP: ";
-      s += WiFi.localIP().toString();
-
-      s += "\n";
+      textPrintf(s, "FW version: %s\n", version);
+      textPrintf(s, "WiFi SSID: %s\n", WiFi.SSID().c_str());
+      textPrintf(s, "WiFi PSK: %s\n", WiFi.psk().c_str());
+      textPrintf(s, "WiFi RSSI: %d\n", (int)WiFi.RSSI());
+      IPAddress ip = WiFi.localIP();
+      textPrintf(s, "IP: %u.%u.%u.%u\n", ip[0], ip[1], ip[2], ip[3]);
+
       struct tm timeInfo;
       gmtime_r(&startTime, &timeInfo);
       char strftime_buf[64];
       strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeInfo);
-      s += "Start time (UTC): ";
-      s += "[";
-      s += startTime;
-      s += "] ";
-      s += String(strftime_buf);
+      textPrintf(s, "Start time (UTC): [%ld] %s", (long)startTime, strftime_buf);
+
+      tsTelegramQueueStats queueStats = telegramQueueStats();
+      textPrintf(s, "\nNotifications: %lu queued, %lu messages sent, %lu dropped",
+                 queueStats.queued, queueStats.batches, queueStats.dropped);
+
+      tsEventLogStats logStats = eventLogStats();
+      textPrintf(s, "\nEvent log: %lu records, %lu buffered, %lu write errors",
+                 logStats.records, logStats.buffered, logStats.writeErrors);
+
+      const tsTlsStats &tlsStats = wifiClientSecured.stats();
+      textPrintf(s, "\nTLS handshakes: %lu, mean %lu ms, %lu failed, %lu refused in backoff",
+                 (unsigned long)tlsStats.handshakes, (unsigned long)wifiClientSecured.meanHandshakeMs(),
+                 (unsigned long)tlsStats.failures, (unsigned long)tlsStats.refused);
+      const tsTlsStats &notifyStats = wifiClientNotify.stats();
+      textPrintf(s, "\nTLS handshakes (notifications): %lu, mean %lu ms, %lu failed",
+                 (unsigned long)notifyStats.handshakes, (unsigned long)wifiClientNotify.meanHandshakeMs(),
+                 (unsigned long)notifyStats.failures);
+      for (byte idx = 0; idx < telegramRecipientsCount(); idx++) {
+        tsTelegramRecipient recipient = telegramRecipient(idx);
+        textPrintf(s, "\nRecipient %s: %lu sent, mean %lu ms, max %lu ms, %lu failed", recipient.chatId,
+                   (unsigned long)recipient.stats.sent,
+                   (unsigned long)(recipient.stats.sent ? recipient.stats.sumMs / recipient.stats.sent : 0),
+                   (unsigned long)recipient.stats.maxMs, (unsigned long)recipient.stats.failures);
+      }
 
-      telegramBot.sendMessage(chat_id, s);
+      telegramBot.sendMessage(chat_id, reply);
     }
     else if (text == "/listconfig") 
     {
-      String s = "";
-
-      s += "Current configuration:\n";
+      textAppend(s, "Current configuration:\n");
 
       for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
-        s += _config[idx].name;
-        s += " = [";
-        s += String(_config[idx].val);
-        s += "]\n";
+        textPrintf(s, "%s = [%s]\n", _config[idx].name.c_str(), _config[idx].val);
       }
 
-      telegramBot.sendMessage(chat_id, s);
+      telegramBot.sendMessage(chat_id, reply);
     }
     else if (text.startsWith("/getconfig"))
     {
-      String rcvText = text;
-      String subCommand = "";
+      const char* subCommand = "";
       
-      char buf[rcvText.length() + 1];
-      rcvText.toCharArray(buf, sizeof(buf));
+      char buf[text.length() + 1];
+      text.toCharArray(buf, sizeof(buf));
       char *p = buf;
       char *str;
       while ((str = strtok_r(p, " ", &p)) != NULL) { // delimiter is the space
           subCommand = str;
       }
 
-      String s = subCommand;
-      s += " = [";
-
-      bool idFound = false;
+      const char* paramVal = "n/a";
       for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
         if (_config[idx].name == subCommand) {
-          s += String(_config[idx].val);
-          idFound = true;
+          paramVal = _config[idx].val;
           break;
         }
       }
 
-      if (!idFound) s += "n/a";
+      textPrintf(s, "%s = [%s]", subCommand, paramVal);
 
-      s += "]";
-
-      telegramBot.sendMessage(chat_id, s);
+      telegramBot.sendMessage(chat_id, reply);
     }
     else if (text.startsWith("/setconfig"))
     {
-      String rcvText = text;
-      String subCommand[3];
+      const char* subCommand[3];
 
       int subCommandIdx = 0;
-      char buf[rcvText.length() + 1];
-      rcvText.toCharArray(buf, sizeof(buf));
+      char buf[text.length() + 1];
+      text.toCharArray(buf, sizeof(buf));
       char *p = buf;
       char *str;
       while ((str = strtok_r(p, " ", &p)) != NULL) { // delimiter is the space
@@ -1613,74 +2106,100 @@ void handleTelegram(byte telegramMessages) {
         return;
       }
 
-      String paramId = subCommand[1];
-      String paramVal = subCommand[2];
+      const char* paramId = subCommand[1];
+      const char* paramVal = subCommand[2];
+      int paramValLength = strlen(paramVal);
 
-      String s = paramId + " ";
+      textPrintf(s, "%s ", paramId);
 
-      bool idFound = false;
+      tsConfig* entry = nullptr;
       for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
         if (_config[idx].name == paramId) {
-          size_t sz = _config[idx].len - 1;
-          if (paramVal == "empty") {
-            strncpy(_config[idx].val, "", sz);
+          entry = &_config[idx];
+          size_t sz = entry->len - 1;
+          if (strcmp(paramVal, "empty") == 0) {
+            strncpy(entry->val, "", sz);
           } else {
-            strncpy(_config[idx].val, paramVal.c_str(), sz);
+            strncpy(entry->val, paramVal, sz);
           }
-          if (paramVal.length() > sz) {
-            s += "size too big, truncated to ";
-            s += sz;
-            s += " ";
-            paramVal = paramVal.substring(0, sz);
+          if ((size_t)paramValLength > sz) {
+            textPrintf(s, "size too big, truncated to %u ", (unsigned)sz);
+            paramValLength = sz;
           }
-          idFound = true;
           break;
         }
       }
 
-      if (!idFound)
+      if (entry == nullptr)
       {
-        s += "n/a";
+        textAppend(s, "n/a");
       }
       else
       {
-        s += "-> " + paramVal;
+        textPrintf(s, "-> %.*s", paramValLength, paramVal);
 
         //save the parameter to FS
         Serial.println("saving config");
-        DynamicJsonDocument json(1024);
-
-        for (int idx = 0; idx < COMMON_NUMEL(_config); idx++) {
-          json[_config[idx].name] = _config[idx].val;
+        bool sResult = configSave(*entry);
+        // Notifications go to the new list, with the new prefix, from the next batch on
+        if (entry->val == telegram_chat_id || entry->val == telegram_recipients) {
+          telegramRecipientsBegin(telegram_chat_id, telegram_recipients);
         }
+        if (entry->val == telegram_msg_prefix) telegramRecipientsPrefix(telegram_msg_prefix);
 
-        bool sResult = true;
-
-        File configFile = SPIFFS.open("/config.json", "w");
-        if (!configFile) {
-          Serial.println("failed to open config file for writing");
-          sResult = false;
+        if (sResult) {
+          textAppend(s, " Saved OK");
         } else {
-          serializeJson(json, Serial);
-          serializeJson(json, configFile);
-        
-          configFile.close();
-          //end save
+          textAppend(s, " Saving Error!");
         }
+      }
 
-        if (sResult) {
-          s += " Saved OK";
-        } else {
-          s += " Saving Error!";
+      telegramBot.sendMessage(chat_id, reply);
+    }
+    else if (text == "/history" || text.startsWith("/history "))
+    {
+      uint32_t now = time(nullptr);
+      uint32_t since = historySince(text.length() > 9 ? text.c_str() + 9 : "", now);
+
+      tsEventLogCursor cursor;
+      tsEventLogRecord record;
+      unsigned long count = 0;
+      bool truncated = false;
+      if (eventLogSeek(cursor, since)) {
+        // Keeps room for the truncation note
+        s.size = sizeof(reply) - 48;
+        while (eventLogNext(cursor, record)) {
+          size_t length = s.length;
+          time_t recordTime = record.time;
+          struct tm timeInfo;
+          gmtime_r(&recordTime, &timeInfo);
+          char stamp[24];
+          strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S ", &timeInfo);
+          if (record.flags & EVENT_LOG_UNSYNCED) textAppend(s, "~");
+          textAppend(s, stamp);
+          panelEventFormat(record.event, s);
+          textAppend(s, "\n");
+          if (s.overflow) {
+            s.length = length;
+            s.buffer[length] = 0;
+            truncated = true;
+            break;
+          }
+          count++;
         }
+        cursor.file.close();
+        s.size = sizeof(reply);
+        s.overflow = false;
       }
 
-      telegramBot.sendMessage(chat_id, s);
+      if (count == 0) textAppend(s, "No events");
+      else if (truncated) textAppend(s, "... more events, use a later <since>");
+      telegramBot.sendMessage(chat_id, reply);
     }
     else if (text == "/wdt") 
     {
       telegramBot.sendMessage(telegramBot.messages[i].chat_id, "Awaiting WDT to restart...");
-      telegramBot.getUpdates(telegramBot.last_message_received + 1);
+      telegramOffsetSave(telegramBot.last_message_received, true);
       wdt_enable(WDT_TMO);
       while(1);
     }
@@ -1691,123 +2210,233 @@ void handleTelegram(byte telegramMessages) {
     }
     else if (text == "/help")
     {
-      String s = "Welcome, " + from_name + "!\n\n";
-      s += "Usage:\n";
-      s += "/start\n";
-      s += "/help\n";
-      s += "/send_test_action : to send test chat action message\n";
-      s += "/chat_id  : get ChatID\n";
-      s += "---\n";
-      s += "/X : X - partition number to control\n";
-      s += "/disarm\n";
-      s += "/armstay\n";
-      s += "/armaway\n";
-      s += "/armnight\n";
-      s += "/status\n";
-      s += "/version\n";
-      s += "/wdt\n";
-      s += "/wdtoff\n";
-      s += "/cmd ABCD, ABCD - key sequence to send to panel\n";
-      s += "---\n";
-      s += "/listconfig\n";
-      s += "/getconfig <param_id>\n";
-      s += "/setconfig <param_id> <new_value>, <new_value> can be word 'empty'\n";
-      s += "---\n";
-      s += "/reset\n";
-      s += "/dir\n";
-      s += "/format tt\n";
-      s += "/read_spiffs <filename>\n";
-      s += "File Message Caption can be:\n";
-      s += "write spiffs\n";
-      s += "update firmware\n";
-      s += "update spiffs\n";
-      telegramBot.sendMessage(chat_id, s);
+      textPrintf(s, "Welcome, %s!\n\n", from_name);
+      textAppend(s, "Usage:\n"
+                    "/start\n"
+                    "/help\n"
+                    "/send_test_action : to send test chat action message\n"
+                    "/chat_id  : get ChatID\n"
+                    "---\n"
+                    "/X : X - partition number to control\n"
+                    "/disarm\n"
+                    "/armstay\n"
+                    "/armaway\n"
+                    "/armnight\n"
+                    "/status\n"
+                    "/version\n"
+                    "/history [<since>] : events since a Unix time or e.g. 30m, 12h, 7d ago, default 1d\n"
+                    "/wdt\n"
+                    "/wdtoff\n"
+                    "/cmd ABCD, ABCD - key sequence to send to panel\n"
+                    "---\n"
+                    "/listconfig\n"
+                    "/getconfig <param_id>\n"
+                    "/setconfig <param_id> <new_value>, <new_value> can be word 'empty'\n"
+                    "---\n"
+                    "/reset\n"
+                    "/dir\n"
+                    "/format tt\n"
+                    "/read_spiffs <filename>\n"
+                    "File Message Caption can be:\n"
+                    "write spiffs\n"
+                    "update firmware\n"
+                    "update spiffs\n");
+      telegramBot.sendMessage(chat_id, reply);
     }
     // Checks if a partition number 1-8 has been sent and sets the partition
     else if (telegramBot.messages[i].text[1] >= 0x31 && telegramBot.messages[i].text[1] <= 0x38) {
       oldPartition = partition;
       partition = telegramBot.messages[i].text[1] - 49;
-      char messageContent[17];
-      if (dsc.status[partition] != 0xC7) {  // partition available
-        strcpy(messageContent, "Set: Partition ");
-        appendPartition(partition, messageContent);  // Appends the message with the partition number
+      if (panel.status[partition] != 0xC7) {  // partition available
+        textAppend(s, "Set: Partition ");
+        appendPartition(partition, s);  // Appends the message with the partition number
       } else {
-        strcpy(messageContent, "ERR: Partition ");
-        //sprintf(messageContent, "ERR: Partition %d switching back to %d", partition, oldPartition);
-        appendPartition(partition, messageContent);  // Appends the message with the partition number
+        textAppend(s, "ERR: Partition ");
+        appendPartition(partition, s);  // Appends the message with the partition number
         partition = oldPartition;
       }
-      sendMessage(messageContent);
+      sendMessage(reply);
     }
     // Resets status if attempting to change the armed mode while armed or not ready
-    else if (telegramBot.messages[i].text != "/disarm" && !dsc.ready[partition]) {
-      dsc.armedChanged[partition] = true;
-      dsc.statusChanged = true;
+    else if (telegramBot.messages[i].text != "/disarm" && !panel.ready[partition]) {
+      panelRequestRefresh(partition);
       return;
     }
     // Arm stay
-    else if (telegramBot.messages[i].text == "/armstay" && !dsc.armed[partition] && !dsc.exitDelay[partition]) {
-      dsc.writePartition = partition + 1;  // Sets writes to the partition number
-      dsc.write('s');
+    else if (telegramBot.messages[i].text == "/armstay" && !panel.armed[partition] && !panel.exitDelay[partition]) {
+      telegramKeypadWrite(chat_id, KEYPAD_PRIORITY_ARM, partition + 1, "s", TRACE_ARM_STAY);  // Writes to the partition number
     }
     // Arm away
-    else if (telegramBot.messages[i].text == "/armaway" && !dsc.armed[partition] && !dsc.exitDelay[partition]) {
-      dsc.writePartition = partition + 1;  // Sets writes to the partition number
-      dsc.write('w');
+    else if (telegramBot.messages[i].text == "/armaway" && !panel.armed[partition] && !panel.exitDelay[partition]) {
+      telegramKeypadWrite(chat_id, KEYPAD_PRIORITY_ARM, partition + 1, "w", TRACE_ARM_AWAY);  // Writes to the partition number
     }
     // Arm night
-    else if (telegramBot.messages[i].text == "/armnight" && !dsc.armed[partition] && !dsc.exitDelay[partition]) {
-      dsc.writePartition = partition + 1;  // Sets writes to the partition number
-      dsc.write('n');
+    else if (telegramBot.messages[i].text == "/armnight" && !panel.armed[partition] && !panel.exitDelay[partition]) {
+      telegramKeypadWrite(chat_id, KEYPAD_PRIORITY_ARM, partition + 1, "n", TRACE_ARM_NIGHT);  // Writes to the partition number
     }
     // Disarm
-    else if (telegramBot.messages[i].text == "/disarm" && (dsc.armed[partition] || dsc.exitDelay[partition] || dsc.alarm[partition])) {
-      dsc.writePartition = partition + 1;  // Sets writes to the partition number
-      dsc.write(dsc_access_code);
+    else if (telegramBot.messages[i].text == "/disarm" && (panel.armed[partition] || panel.exitDelay[partition] || panel.alarm[partition])) {
+      telegramKeypadWrite(chat_id, KEYPAD_PRIORITY_ACCESS_CODE, partition + 1, dsc_access_code, TRACE_DISARM);  // Writes to the partition number
     }
     else if (telegramBot.messages[i].text.startsWith("/cmd")) {
-      String rcvText = telegramBot.messages[i].text;
-      String cmd = "";
+      const char* cmd = "";
       
-      // Convert from String Object to String.
-      char buf[rcvText.length() + 1];
-      rcvText.toCharArray(buf, sizeof(buf));
+      char buf[text.length() + 1];
+      text.toCharArray(buf, sizeof(buf));
       char *p = buf;
       char *str;
       while ((str = strtok_r(p, " ", &p)) != NULL) { // delimiter is the space
           cmd = str;
-          //telegramBot.sendMessage(telegramBot.messages[i].chat_id, str, "");
       }
       
-      telegramBot.sendMessage(telegramBot.messages[i].chat_id, "Executing command " + cmd + "... ", "");
-      strcpy(keybuf, cmd.c_str());
-      dsc.write(keybuf);
+      telegramKeypadWrite(chat_id, KEYPAD_PRIORITY_KEYS, 0, cmd, TRACE_OTHER);
     }
   }
 }
 
 
-bool sendMessage(const char* messageContent) {
-  wifiClientSecured.setHandshakeTimeout(30);  // Workaround for https://github.com/espressif/arduino-esp32/issues/6165
-  String tgUID = String(telegram_chat_id);
-  String tgBT = String(telegram_bot_token);
-  if (tgUID == "" || tgBT == "") return false;
-  byte messageLength = strlen(telegram_msg_prefix) + strlen(messageContent) + 1;
-  char message[messageLength];
-  strcpy(message, telegram_msg_prefix);
-  strcat(message, messageContent);
-  if (telegramBot.sendMessage(telegram_chat_id, message, "")) return true;
-  else return false;
+// Sends notifications from the Telegram task, merging the ones queued within TELEGRAM_COALESCE_MS
+void telegramTask(void *pvParameters) {
+  (void)pvParameters;
+  for (;;) telegramNotifyHandle();
+}
+
+// Collects and delivers one batch, returns false if none was sent. While WiFi is down notifications
+// stay queued, and a batch collected as it dropped is held, both go out once it is back.
+bool telegramNotifyHandle() {
+  static tsTelegramBatch batch;
+  static bool batchHeld = false;
+  if (!wifiConnected) {
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    return false;
+  }
+  if (!batchHeld && !telegramQueueCollectBatch(batch, TELEGRAM_COALESCE_MS, 1000)) return false;
+
+  batchHeld = !wifiConnected;
+  if (batchHeld) return false;
+  telegramDeliver(batch);
+  return true;
+}
+
+// Long-polls Telegram for commands and hands them to the network task
+void telegramPollTask(void *pvParameters) {
+  (void)pvParameters;
+  for (;;) {
+    // Polls again right away after updates, a second later after a timeout or an error
+    if (telegramPollHandle() == 0) vTaskDelay(pdMS_TO_TICKS(1000));
+    while (telegramPending) vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+// One long poll, returns the number of updates received. The offset is saved before the commands
+// run, so a command that restarts the device is not run again; saves are rate limited, a command
+// that crashes the device within TELEGRAM_OFFSET_SAVE_MS of the last save may run once more.
+byte telegramPollHandle() {
+  if (telegramPending || !wifiConnected) return 0;
+
+  byte telegramMessages = telegramBot.getUpdates(telegramBot.last_message_received + 1);
+  // Also writes an offset held back by the rate limit
+  telegramOffsetSave(telegramBot.last_message_received);
+  if (telegramMessages == 0) return 0;
+
+  telegramPending = telegramMessages;
+  return telegramMessages;
+}
+
+long telegramOffsetLoad() {
+  uint8_t buffer[4];
+  File file = SPIFFS.open(telegramOffsetFile, FILE_READ);
+  if (!file) return 0;
+  bool ok = file.read(buffer, sizeof(buffer)) == sizeof(buffer);
+  file.close();
+  if (!ok) return 0;
+  telegramOffsetSaved = (long)((uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24));
+  return telegramOffsetSaved;
+}
+
+// Writes the offset only when it changed, and unless forced at most every TELEGRAM_OFFSET_SAVE_MS
+void telegramOffsetSave(long updateId, bool force) {
+  static unsigned long saveTime;
+  static bool saved = false;
+  if (updateId == telegramOffsetSaved) return;
+  if (!force && saved && millis() - saveTime < TELEGRAM_OFFSET_SAVE_MS) return;
+
+  uint8_t buffer[4] = { (uint8_t)updateId, (uint8_t)(updateId >> 8), (uint8_t)(updateId >> 16), (uint8_t)(updateId >> 24) };
+  File file = SPIFFS.open(telegramOffsetFile, FILE_WRITE);
+  if (!file) return;
+  file.write(buffer, sizeof(buffer));
+  file.close();
+  telegramOffsetSaved = updateId;
+  saveTime = millis();
+  saved = true;
+}
+
+// Queues a notification for the Telegram task, returns false if it was dropped
+bool sendMessage(const char* messageContent, teTelegramClass eventClass) {
+  if (!telegramConfigured()) return false;
+  return telegramQueuePush(messageContent, eventClass);
+}
+
+// Sends a batch to every recipient subscribed to any of its lines, only from the Telegram task once
+// the tasks are running. The batch was formatted once; each recipient gets its lines behind the
+// prefix, one after the other over the notifier's connection. The list and the prefix are a
+// snapshot, /setconfig may change them meanwhile.
+void telegramDeliver(const tsTelegramBatch &batch) {
+  static tsTelegramRecipients snapshot;
+  static char buffer[TELEGRAM_MSG_PREFIX_LEN + TELEGRAM_BATCH_LEN];
+  telegramRecipientsSnapshot(snapshot);
+  size_t prefixLength = strlen(snapshot.prefix);
+  memcpy(buffer, snapshot.prefix, prefixLength);
+
+  for (byte idx = 0; idx < snapshot.count; idx++) {
+    const tsTelegramRecipient &recipient = snapshot.recipients[idx];
+    if (!(recipient.classes & batch.mask)) continue;
+    if (!telegramBatchSelect(batch, recipient.classes, buffer + prefixLength, sizeof(buffer) - prefixLength)) continue;
+
+    unsigned long started = millis();
+    bool delivered = telegramNotifier.sendMessage(recipient.chatId, buffer, "");
+    telegramRecipientRecord(recipient.chatId, delivered, millis() - started);
+  }
+}
+
+bool telegramConfigured() {
+  return telegramRecipientsCount() > 0 && telegram_bot_token[0] != 0x00;
+}
+
+void appendPartition(byte sourceNumber, tsTextBuffer &message) {
+  textPrintf(message, "%d", sourceNumber + 1);
+}
+
+// Recipients subscribe to notifications by these classes
+static teTelegramClass telegramEventClass(const tsPanelEvent &event) {
+  switch (event.type) {
+    case PANEL_EVENT_ALARM:
+    case PANEL_EVENT_FIRE:
+    case PANEL_EVENT_ZONE_ALARM:
+    case PANEL_EVENT_KEYPAD_ALARM:
+      return TELEGRAM_CLASS_ALARM;
+    case PANEL_EVENT_ARMED:
+    case PANEL_EVENT_EXIT_DELAY:
+      return TELEGRAM_CLASS_ARMING;
+    case PANEL_EVENT_KEYBUS:
+    case PANEL_EVENT_TROUBLE:
+    case PANEL_EVENT_POWER:
+    case PANEL_EVENT_BATTERY:
+      return TELEGRAM_CLASS_TROUBLE;
+    default:
+      return TELEGRAM_CLASS_SYSTEM;
+  }
 }
 
+// Queues the notification for a panel event, zone open and PGM changes are not notified
+void telegramNotifyEvent(const tsPanelEvent &event) {
+  if (event.type == PANEL_EVENT_ZONE_OPEN || event.type == PANEL_EVENT_PGM) return;
 
-void appendPartition(byte sourceNumber, char* message) {
-  String tgUID = String(telegram_chat_id);
-  String tgBT = String(telegram_bot_token);
-  if (tgUID == "" || tgBT == "") return;
-  char partitionNumber[2];
-  itoa(sourceNumber + 1, partitionNumber, 10);
-  strcat(message, partitionNumber);
+  char buffer[TELEGRAM_QUEUE_MSG_LEN];
+  tsTextBuffer messageContent;
+  textBegin(messageContent, buffer, sizeof(buffer));
+  panelEventFormat(event, messageContent);
+  sendMessage(buffer, telegramEventClass(event));
 }
 
 void bot_setup()
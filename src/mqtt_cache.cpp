@@ -0,0 +1,67 @@
+#include "mqtt_cache.h"
+
+#define MQTT_CACHE_TOPICS  (sizeof(((tsMqttTopics*)0)->partition) + sizeof(((tsMqttTopics*)0)->fire) + \
+                            sizeof(((tsMqttTopics*)0)->zone) + sizeof(((tsMqttTopics*)0)->pgm)) / MQTT_TOPIC_LEN
+
+typedef struct {
+  char wanted[MQTT_CACHE_VALUE_LEN];
+  char sent[MQTT_CACHE_VALUE_LEN];    // Empty if unknown
+} tsCachedValue;
+
+static const char* tableStart = nullptr;
+static tsCachedValue values[MQTT_CACHE_TOPICS];
+
+// The entity topics are consecutive rows of MQTT_TOPIC_LEN: partitions, fire, zones, PGMs
+static int indexOf(const char* topic) {
+  if (tableStart == nullptr || topic < tableStart) return -1;
+  size_t offset = topic - tableStart;
+  if (offset % MQTT_TOPIC_LEN != 0 || offset / MQTT_TOPIC_LEN >= MQTT_CACHE_TOPICS) return -1;
+  return offset / MQTT_TOPIC_LEN;
+}
+
+void mqttCacheBegin(const tsMqttTopics &topics) {
+  tableStart = topics.partition[0];
+  memset(values, 0, sizeof(values));
+}
+
+bool mqttCacheWant(const char* topic, const char* payload) {
+  int index = indexOf(topic);
+  if (index < 0) return true;
+  strncpy(values[index].wanted, payload, MQTT_CACHE_VALUE_LEN - 1);
+  return strncmp(values[index].sent, payload, MQTT_CACHE_VALUE_LEN - 1) != 0;
+}
+
+void mqttCacheSent(const char* topic, const char* payload) {
+  int index = indexOf(topic);
+  if (index < 0) return;
+  strncpy(values[index].sent, payload, MQTT_CACHE_VALUE_LEN - 1);
+}
+
+bool mqttCacheHolds(const char* topic, const char* payload) {
+  int index = indexOf(topic);
+  if (index < 0 || values[index].sent[0] == 0) return false;
+  return strncmp(values[index].sent, payload, MQTT_CACHE_VALUE_LEN - 1) == 0;
+}
+
+void mqttCacheInvalidate(const char* topic) {
+  int index = indexOf(topic);
+  if (index >= 0) values[index].sent[0] = 0;
+}
+
+bool mqttCacheNextStale(size_t &index, const char* &topic, const char* &payload) {
+  for (; index < MQTT_CACHE_TOPICS; index++) {
+    const tsCachedValue &value = values[index];
+    if (value.wanted[0] == 0 || strcmp(value.wanted, value.sent) == 0) continue;
+    topic = tableStart + (index * MQTT_TOPIC_LEN);
+    payload = value.wanted;
+    index++;
+    return true;
+  }
+  return false;
+}
+
+uint32_t mqttCacheHash(const uint8_t* payload, const size_t length) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < length; i++) hash = (hash ^ payload[i]) * 16777619UL;
+  return hash;
+}
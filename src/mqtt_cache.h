@@ -0,0 +1,56 @@
+/**
+   Last retained value per entity topic of a tsMqttTopics table. Every
+   publish first records the value the topic should hold; it only goes out
+   if that differs from the last value the client accepted for the topic,
+   which is what the broker retains. Values that could not be sent while
+   disconnected stay stale and are resent after reconnecting, one publish
+   per topic that changed, rather than the whole panel image.
+*/
+#ifndef MQTT_CACHE_H
+#define MQTT_CACHE_H
+
+#include "mqtt_topics.h"
+
+#define MQTT_CACHE_VALUE_LEN  4   // Longest entity payload is a target state: "8S"
+
+/**
+   Track the entity topics of `topics`, all of them unknown.
+*/
+void mqttCacheBegin(const tsMqttTopics &topics);
+
+/**
+   Record that `topic` should hold `payload`. Returns false if the broker
+   already holds it, true if it has to be published. Topics outside the
+   table are always published.
+*/
+bool mqttCacheWant(const char* topic, const char* payload);
+
+/**
+   Record that `payload` was accepted for `topic`.
+*/
+void mqttCacheSent(const char* topic, const char* payload);
+
+/**
+   Returns true if the broker holds `payload` on `topic`.
+*/
+bool mqttCacheHolds(const char* topic, const char* payload);
+
+/**
+   Forget the value of `topic`, its next publish goes out even if equal.
+*/
+void mqttCacheInvalidate(const char* topic);
+
+/**
+   Find the next topic at or after `index` whose wanted value was not
+   sent. Returns false when there is none, otherwise sets `topic` and
+   `payload` and advances `index` past it.
+*/
+bool mqttCacheNextStale(size_t &index, const char* &topic, const char* &payload);
+
+/**
+   FNV-1a hash of a payload, to tell whether a message outside the table,
+   e.g. the panel state message, changed since it was last sent.
+*/
+uint32_t mqttCacheHash(const uint8_t* payload, const size_t length);
+
+#endif
@@ -0,0 +1,272 @@
+#include "mqtt_command.h"
+#include "settings.h"
+
+static const char* const commandNames[MQTT_CMD_COUNT] = {
+  "arm_stay", "arm_away", "arm_night", "disarm", "keys", "bypass", "output", "panic", "fire", "aux"
+};
+
+// HomeKit target letters of the first four commands
+static const char targetLetters[] = "SAND";
+
+static const char* const parseErrors[MQTT_PARSE_COUNT] = {
+  "", "unknown topic", "invalid payload", "invalid partition", "invalid keys", "invalid zones", "invalid output"
+};
+
+static const char keypadKeys[] = "0123456789*#fapswncrx<>";
+
+// A bounded view of the topic or payload, advanced while parsing
+typedef struct {
+  const char* at;
+  const char* end;
+} tsCursor;
+
+static bool consume(tsCursor &cursor, const char* text) {
+  size_t length = strlen(text);
+  if ((size_t)(cursor.end - cursor.at) < length || memcmp(cursor.at, text, length) != 0) return false;
+  cursor.at += length;
+  return true;
+}
+
+static bool equals(const char* text, const size_t length, const char* expected) {
+  return strlen(expected) == length && memcmp(text, expected, length) == 0;
+}
+
+static void skipBlanks(tsCursor &cursor) {
+  while (cursor.at < cursor.end && (*cursor.at == ' ' || *cursor.at == '\t' || *cursor.at == '\r' || *cursor.at == '\n')) cursor.at++;
+}
+
+// Reads an unsigned number of up to 3 digits
+static bool readNumber(tsCursor &cursor, unsigned int &value) {
+  const char* start = cursor.at;
+  value = 0;
+  while (cursor.at < cursor.end && isdigit((unsigned char)*cursor.at) && cursor.at - start < 3) value = value * 10 + (*cursor.at++ - '0');
+  return cursor.at != start && (cursor.at == cursor.end || !isdigit((unsigned char)*cursor.at));
+}
+
+static teMqttCommand findCommand(const char* text, const size_t length) {
+  for (byte command = 0; command < MQTT_CMD_COUNT; command++) {
+    if (equals(text, length, commandNames[command])) return (teMqttCommand)command;
+  }
+  return MQTT_CMD_NONE;
+}
+
+// A single HomeKit target letter or an arm command name
+static teMqttCommand findTarget(const char* text, const size_t length) {
+  if (length == 1) {
+    const char* letter = strchr(targetLetters, text[0]);
+    return letter != nullptr && text[0] != 0 ? (teMqttCommand)(letter - targetLetters) : MQTT_CMD_NONE;
+  }
+  teMqttCommand command = findCommand(text, length);
+  return command <= MQTT_CMD_DISARM ? command : MQTT_CMD_NONE;
+}
+
+static teMqttParse setKeys(tsMqttCommand &command, const char* keys, const size_t length) {
+  if (length == 0 || length >= KEYPAD_KEYS_LEN) return MQTT_PARSE_KEYS;
+  for (size_t idx = 0; idx < length; idx++) {
+    if (keys[idx] == 0 || strchr(keypadKeys, keys[idx]) == nullptr) return MQTT_PARSE_KEYS;
+  }
+  command.keys = keys;
+  command.keysLength = length;
+  return MQTT_PARSE_OK;
+}
+
+static bool addZone(tsMqttCommand &command, const unsigned int zone) {
+  if (zone < 1 || zone > MQTT_ZONE_COUNT) return false;
+  command.zones[(zone - 1) / 8] |= 1 << ((zone - 1) % 8);
+  return true;
+}
+
+static bool hasZones(const tsMqttCommand &command) {
+  for (byte idx = 0; idx < sizeof(command.zones); idx++) {
+    if (command.zones[idx]) return true;
+  }
+  return false;
+}
+
+// Zone numbers separated by commas, or closed by ']' in JSON
+static teMqttParse readZones(tsMqttCommand &command, tsCursor &cursor, const char close) {
+  for (;;) {
+    unsigned int zone;
+    skipBlanks(cursor);
+    if (!readNumber(cursor, zone) || !addZone(command, zone)) return MQTT_PARSE_ZONES;
+    skipBlanks(cursor);
+    if (cursor.at == cursor.end) return close == 0 ? MQTT_PARSE_OK : MQTT_PARSE_PAYLOAD;
+    if (*cursor.at == close) {
+      cursor.at++;
+      return MQTT_PARSE_OK;
+    }
+    if (*cursor.at++ != ',') return MQTT_PARSE_ZONES;
+  }
+}
+
+static bool readString(tsCursor &cursor, const char* &text, size_t &length) {
+  if (!consume(cursor, "\"")) return false;
+  text = cursor.at;
+  while (cursor.at < cursor.end && *cursor.at != '"') {
+    if (*cursor.at == '\\') return false;
+    cursor.at++;
+  }
+  if (cursor.at == cursor.end) return false;
+  length = cursor.at++ - text;
+  return true;
+}
+
+// Skips a value of an unknown member: a string, number, literal or array of those
+static bool skipValue(tsCursor &cursor) {
+  const char* text;
+  size_t length;
+  if (cursor.at < cursor.end && *cursor.at == '"') return readString(cursor, text, length);
+  if (cursor.at < cursor.end && *cursor.at == '[') {
+    cursor.at++;
+    for (;;) {
+      skipBlanks(cursor);
+      if (consume(cursor, "]")) return true;
+      if (!skipValue(cursor)) return false;
+      skipBlanks(cursor);
+      if (!consume(cursor, ",") && !(cursor.at < cursor.end && *cursor.at == ']')) return false;
+    }
+  }
+  const char* start = cursor.at;
+  while (cursor.at < cursor.end && (isalnum((unsigned char)*cursor.at) || *cursor.at == '-' || *cursor.at == '.')) cursor.at++;
+  return cursor.at != start;
+}
+
+static teMqttParse parseJson(tsMqttCommand &command, tsCursor &cursor) {
+  const char* keys = nullptr;
+  size_t keysLength = 0;
+  bool zones = false;
+  cursor.at++;
+
+  for (;;) {
+    skipBlanks(cursor);
+    if (consume(cursor, "}")) break;
+
+    const char* name;
+    size_t nameLength;
+    if (!readString(cursor, name, nameLength)) return MQTT_PARSE_PAYLOAD;
+    skipBlanks(cursor);
+    if (!consume(cursor, ":")) return MQTT_PARSE_PAYLOAD;
+    skipBlanks(cursor);
+
+    const char* text;
+    size_t length;
+    unsigned int number;
+    if (equals(name, nameLength, "id")) {
+      if (!readString(cursor, text, length) || length > MQTT_COMMAND_ID_LEN) return MQTT_PARSE_PAYLOAD;
+      command.id = text;
+      command.idLength = length;
+    }
+    else if (equals(name, nameLength, "command")) {
+      if (!readString(cursor, text, length)) return MQTT_PARSE_PAYLOAD;
+      command.command = findCommand(text, length);
+      if (command.command == MQTT_CMD_NONE) return MQTT_PARSE_PAYLOAD;
+    }
+    else if (equals(name, nameLength, "partition")) {
+      if (!readNumber(cursor, number)) return MQTT_PARSE_PAYLOAD;
+      if (number < 1 || number > dscPartitions) return MQTT_PARSE_PARTITION;
+      command.partition = number - 1;
+    }
+    else if (equals(name, nameLength, "keys")) {
+      if (!readString(cursor, keys, keysLength)) return MQTT_PARSE_PAYLOAD;
+    }
+    else if (equals(name, nameLength, "zones")) {
+      if (!consume(cursor, "[")) return MQTT_PARSE_PAYLOAD;
+      teMqttParse result = readZones(command, cursor, ']');
+      if (result != MQTT_PARSE_OK) return result;
+      zones = true;
+    }
+    else if (equals(name, nameLength, "output")) {
+      if (!readNumber(cursor, number)) return MQTT_PARSE_PAYLOAD;
+      if (number < 1 || number > MQTT_OUTPUT_COUNT) return MQTT_PARSE_OUTPUT;
+      command.output = number;
+    }
+    else if (!skipValue(cursor)) return MQTT_PARSE_PAYLOAD;
+
+    skipBlanks(cursor);
+    if (consume(cursor, "}")) break;
+    if (!consume(cursor, ",")) return MQTT_PARSE_PAYLOAD;
+  }
+
+  switch (command.command) {
+    case MQTT_CMD_NONE: return MQTT_PARSE_PAYLOAD;
+    case MQTT_CMD_KEYS: return setKeys(command, keys, keysLength);
+    case MQTT_CMD_BYPASS: return zones ? MQTT_PARSE_OK : MQTT_PARSE_ZONES;
+    case MQTT_CMD_OUTPUT: return command.output >= 1 && command.output <= MQTT_OUTPUT_COUNT ? MQTT_PARSE_OK : MQTT_PARSE_OUTPUT;
+    default: return MQTT_PARSE_OK;
+  }
+}
+
+// The payload of a dsc/Set/Partition<N>/<subtopic> message
+static teMqttParse parseSubtopic(tsMqttCommand &command, tsCursor &topic, tsCursor &payload) {
+  if (consume(topic, "Keys")) command.command = MQTT_CMD_KEYS;
+  else if (consume(topic, "Bypass")) command.command = MQTT_CMD_BYPASS;
+  else if (consume(topic, "Output")) command.command = MQTT_CMD_OUTPUT;
+  else if (consume(topic, "Panic")) command.command = MQTT_CMD_PANIC;
+  else if (consume(topic, "Fire")) command.command = MQTT_CMD_FIRE;
+  else if (consume(topic, "Aux")) command.command = MQTT_CMD_AUX;
+  if (command.command == MQTT_CMD_NONE || topic.at != topic.end) {
+    command.command = MQTT_CMD_NONE;
+    return MQTT_PARSE_TOPIC;
+  }
+
+  unsigned int number;
+  switch (command.command) {
+    case MQTT_CMD_KEYS:
+      return setKeys(command, payload.at, payload.end - payload.at);
+    case MQTT_CMD_BYPASS: {
+      teMqttParse result = readZones(command, payload, 0);
+      return result == MQTT_PARSE_OK && !hasZones(command) ? MQTT_PARSE_ZONES : result;
+    }
+    case MQTT_CMD_OUTPUT:
+      if (!readNumber(payload, number) || payload.at != payload.end || number < 1 || number > MQTT_OUTPUT_COUNT) return MQTT_PARSE_OUTPUT;
+      command.output = number;
+      return MQTT_PARSE_OK;
+    default:
+      return MQTT_PARSE_OK;
+  }
+}
+
+teMqttParse mqttCommandParse(tsMqttCommand &command, const char* baseTopic, const char* topic,
+                             const uint8_t* payload, const unsigned int length) {
+  memset(&command, 0, sizeof(command));
+  command.command = MQTT_CMD_NONE;
+
+  tsCursor topicCursor = { topic, topic + strlen(topic) };
+  tsCursor payloadCursor = { (const char*)payload, (const char*)payload + length };
+  if (!consume(topicCursor, baseTopic)) return MQTT_PARSE_TOPIC;
+
+  // dsc/Set: JSON or a HomeKit target with an optional partition digit
+  if (topicCursor.at == topicCursor.end) {
+    tsCursor json = payloadCursor;
+    skipBlanks(json);
+    if (json.at < json.end && *json.at == '{') return parseJson(command, json);
+
+    if (length == 2 && payload[0] >= '1' && payload[0] <= '0' + dscPartitions) {
+      command.partition = payload[0] - '1';
+      payloadCursor.at++;
+    }
+    if (payloadCursor.end - payloadCursor.at != 1) return MQTT_PARSE_PAYLOAD;
+    command.command = findTarget(payloadCursor.at, 1);
+    return command.command == MQTT_CMD_NONE ? MQTT_PARSE_PAYLOAD : MQTT_PARSE_OK;
+  }
+
+  unsigned int partition;
+  if (!consume(topicCursor, "/Partition") || !readNumber(topicCursor, partition)) return MQTT_PARSE_TOPIC;
+  if (partition < 1 || partition > dscPartitions) return MQTT_PARSE_PARTITION;
+  command.partition = partition - 1;
+
+  if (topicCursor.at == topicCursor.end) {
+    command.command = findTarget(payloadCursor.at, length);
+    return command.command == MQTT_CMD_NONE ? MQTT_PARSE_PAYLOAD : MQTT_PARSE_OK;
+  }
+  if (!consume(topicCursor, "/")) return MQTT_PARSE_TOPIC;
+  return parseSubtopic(command, topicCursor, payloadCursor);
+}
+
+const char* mqttCommandName(const teMqttCommand command) {
+  return command < MQTT_CMD_COUNT ? commandNames[command] : "unknown";
+}
+
+const char* mqttParseError(const teMqttParse result) {
+  return result < MQTT_PARSE_COUNT ? parseErrors[result] : "";
+}
@@ -0,0 +1,85 @@
+/**
+   Parser of the commands received under the MQTT command topic, e.g.
+   "dsc/Set". It works on the topic string and the payload buffer as
+   received, bounded by the payload length: nothing is copied, strings in
+   the result point into the payload.
+
+   Topics and payloads:
+     dsc/Set                        [1-8]S|A|N|D, HomeKit target with an optional partition
+     dsc/Set                        JSON object, see below
+     dsc/Set/Partition<N>           S|A|N|D or arm_stay|arm_away|arm_night|disarm
+     dsc/Set/Partition<N>/Keys      keypad keys: 0-9 * # and the special keys
+                                    f a p (fire, aux, panic), s w n (arm),
+                                    c (chime), r (reset), x (exit), < >
+     dsc/Set/Partition<N>/Bypass    zone numbers separated by commas, e.g. 3,12
+     dsc/Set/Partition<N>/Output    command output 1-4 (*7<N>)
+     dsc/Set/Partition<N>/Panic     payload ignored, likewise Fire and Aux
+
+   JSON payloads are flat objects: {"command":"bypass","partition":1,
+   "zones":[3,12],"id":"abc"}, with "keys" for keys and "output" for
+   outputs. Strings can't contain escapes. "id" is echoed in the
+   acknowledgement. Unknown members are skipped.
+*/
+#ifndef MQTT_COMMAND_H
+#define MQTT_COMMAND_H
+
+#include "mqtt_topics.h"
+
+#define MQTT_COMMAND_ID_LEN   32    // Longest request ID
+#define MQTT_OUTPUT_COUNT     4     // Command outputs
+
+typedef enum {
+  MQTT_CMD_ARM_STAY,
+  MQTT_CMD_ARM_AWAY,
+  MQTT_CMD_ARM_NIGHT,
+  MQTT_CMD_DISARM,
+  MQTT_CMD_KEYS,
+  MQTT_CMD_BYPASS,
+  MQTT_CMD_OUTPUT,
+  MQTT_CMD_PANIC,
+  MQTT_CMD_FIRE,
+  MQTT_CMD_AUX,
+  MQTT_CMD_COUNT,
+  MQTT_CMD_NONE = MQTT_CMD_COUNT
+} teMqttCommand;
+
+typedef enum {
+  MQTT_PARSE_OK,
+  MQTT_PARSE_TOPIC,           // Not a command topic
+  MQTT_PARSE_PAYLOAD,         // Malformed payload or unknown command
+  MQTT_PARSE_PARTITION,       // Partition outside 1-8
+  MQTT_PARSE_KEYS,            // Empty, too long or invalid keys
+  MQTT_PARSE_ZONES,           // No zones or a zone outside 1-64
+  MQTT_PARSE_OUTPUT,          // Output outside 1-4
+  MQTT_PARSE_COUNT
+} teMqttParse;
+
+typedef struct {
+  teMqttCommand command;
+  byte partition;                         // 0 based
+  const char* keys;                       // MQTT_CMD_KEYS, in the payload
+  byte keysLength;
+  uint8_t zones[MQTT_ZONE_COUNT / 8];     // MQTT_CMD_BYPASS, bit 0 of zones[0] = zone 1
+  byte output;                            // MQTT_CMD_OUTPUT, 1 based
+  const char* id;                         // Request ID in the payload, nullptr if none
+  byte idLength;
+} tsMqttCommand;
+
+/**
+   Parse a message on `topic` below `baseTopic`. On errors `command` holds
+   what was parsed so far, e.g. the ID for the acknowledgement.
+*/
+teMqttParse mqttCommandParse(tsMqttCommand &command, const char* baseTopic, const char* topic,
+                             const uint8_t* payload, const unsigned int length);
+
+/**
+   Command name as used in JSON payloads, e.g. "arm_away".
+*/
+const char* mqttCommandName(const teMqttCommand command);
+
+/**
+   Short reason of a parse error for the acknowledgement.
+*/
+const char* mqttParseError(const teMqttParse result);
+
+#endif
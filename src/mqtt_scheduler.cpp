@@ -0,0 +1,176 @@
+#include "mqtt_scheduler.h"
+#include "text_buffer.h"
+
+// Every partition sends a target and a current state, fire one state
+#define CRITICAL_LANE_LEN   (dscPartitions * 3)
+// One entry per zone and PGM topic at most, thanks to coalescing
+#define ENTITY_LANE_LEN     (MQTT_ZONE_COUNT + MQTT_PGM_COUNT)
+
+// Tokens are counted in thousandths of a message, refilled at `rate` per millisecond
+#define TOKEN               1000UL
+
+typedef struct {
+  const char* topic;
+  char payload[MQTT_CACHE_VALUE_LEN];
+} tsScheduledMessage;
+
+typedef struct {
+  tsScheduledMessage* messages;
+  uint16_t size;
+  uint16_t head;
+  uint16_t count;
+} tsLane;
+
+static tsScheduledMessage criticalMessages[CRITICAL_LANE_LEN];
+static tsScheduledMessage entityMessages[ENTITY_LANE_LEN];
+static tsLane lanes[MQTT_LANE_COUNT] = {
+  { criticalMessages, CRITICAL_LANE_LEN, 0, 0 },
+  { entityMessages, ENTITY_LANE_LEN, 0, 0 }
+};
+
+static tfMqttPublish publishMessage = nullptr;
+static uint32_t rate = 0;
+static uint32_t capacity = 0;
+static uint32_t tokens = 0;
+static unsigned long refillTime = 0;
+static tsMqttSchedulerStats stats;
+
+static const char* const laneNames[MQTT_LANE_COUNT] = { "critical", "entity" };
+
+static void refill() {
+  unsigned long now = millis();
+  uint32_t elapsed = now - refillTime;
+  refillTime = now;
+  uint64_t filled = (uint64_t)tokens + (uint64_t)elapsed * rate;
+  tokens = filled > capacity ? capacity : filled;
+}
+
+static bool send(const teMqttLane lane, const tsScheduledMessage &message) {
+  if (!publishMessage(message.topic, message.payload)) return false;
+  mqttCacheSent(message.topic, message.payload);
+  stats.sent[lane]++;
+  return true;
+}
+
+static tsScheduledMessage* findQueued(tsLane &lane, const char* topic) {
+  for (uint16_t idx = 0; idx < lane.count; idx++) {
+    tsScheduledMessage &message = lane.messages[(lane.head + idx) % lane.size];
+    if (message.topic == topic) return &message;
+  }
+  return nullptr;
+}
+
+void mqttSchedulerBegin(tfMqttPublish publish, const uint16_t messageRate, const uint16_t burst) {
+  publishMessage = publish;
+  rate = messageRate;
+  capacity = burst * TOKEN;
+  tokens = capacity;
+  refillTime = millis();
+  mqttSchedulerClear();
+}
+
+bool mqttSchedulerPost(const teMqttLane laneIndex, const char* topic, const char* payload) {
+  tsLane &lane = lanes[laneIndex];
+  if (laneIndex == MQTT_LANE_ENTITY) {
+    tsScheduledMessage* queued = findQueued(lane, topic);
+    if (queued != nullptr) {
+      strncpy(queued->payload, payload, MQTT_CACHE_VALUE_LEN - 1);
+      stats.coalesced++;
+      return true;
+    }
+    if (mqttCacheHolds(topic, payload)) return true;
+  }
+
+  tsScheduledMessage message = { topic, "" };
+  strncpy(message.payload, payload, MQTT_CACHE_VALUE_LEN - 1);
+  if (lane.count == lane.size) {
+    if (laneIndex != MQTT_LANE_CRITICAL) return false;
+    // Critical states are never dropped nor reordered: the lane is flushed first
+    stats.overflows++;
+    while (lane.count > 0) {
+      send(MQTT_LANE_CRITICAL, lane.messages[lane.head]);
+      lane.head = (lane.head + 1) % lane.size;
+      lane.count--;
+    }
+  }
+
+  lane.messages[(lane.head + lane.count) % lane.size] = message;
+  lane.count++;
+  stats.posted[laneIndex]++;
+  uint16_t depth = mqttSchedulerPending();
+  if (depth > stats.maxDepth) stats.maxDepth = depth;
+  return true;
+}
+
+size_t mqttSchedulerRun(const unsigned long budgetUs) {
+  if (publishMessage == nullptr) return 0;
+  unsigned long started = micros();
+  size_t sent = 0;
+  refill();
+
+  for (byte laneIndex = 0; laneIndex < MQTT_LANE_COUNT; laneIndex++) {
+    tsLane &lane = lanes[laneIndex];
+    while (lane.count > 0) {
+      if (tokens < TOKEN || micros() - started >= budgetUs) {
+        stats.deferred++;
+        return sent;
+      }
+      tsScheduledMessage &message = lane.messages[lane.head];
+      lane.head = (lane.head + 1) % lane.size;
+      lane.count--;
+
+      // A coalesced entity may have returned to the value the broker holds
+      if (laneIndex == MQTT_LANE_ENTITY && mqttCacheHolds(message.topic, message.payload)) continue;
+      tokens -= TOKEN;
+      if (!send((teMqttLane)laneIndex, message)) {
+        mqttSchedulerClear();
+        return sent;
+      }
+      sent++;
+    }
+  }
+  return sent;
+}
+
+bool mqttSchedulerAcquire() {
+  refill();
+  if (tokens < TOKEN) return false;
+  tokens -= TOKEN;
+  return true;
+}
+
+size_t mqttSchedulerPending() {
+  return lanes[MQTT_LANE_CRITICAL].count + lanes[MQTT_LANE_ENTITY].count;
+}
+
+void mqttSchedulerClear() {
+  for (byte laneIndex = 0; laneIndex < MQTT_LANE_COUNT; laneIndex++) {
+    lanes[laneIndex].head = 0;
+    lanes[laneIndex].count = 0;
+  }
+}
+
+const tsMqttSchedulerStats& mqttSchedulerStats() {
+  return stats;
+}
+
+size_t mqttSchedulerFormat(char* buffer, const size_t size) {
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  textAppend(text, "# TYPE dsc_mqtt_posted_total counter\n");
+  for (byte lane = 0; lane < MQTT_LANE_COUNT; lane++) {
+    textPrintf(text, "dsc_mqtt_posted_total{lane=\"%s\"} %lu\n", laneNames[lane], (unsigned long)stats.posted[lane]);
+  }
+  textAppend(text, "# TYPE dsc_mqtt_sent_total counter\n");
+  for (byte lane = 0; lane < MQTT_LANE_COUNT; lane++) {
+    textPrintf(text, "dsc_mqtt_sent_total{lane=\"%s\"} %lu\n", laneNames[lane], (unsigned long)stats.sent[lane]);
+  }
+  textPrintf(text, "# TYPE dsc_mqtt_coalesced_total counter\ndsc_mqtt_coalesced_total %lu\n", (unsigned long)stats.coalesced);
+  textPrintf(text, "# TYPE dsc_mqtt_overflows_total counter\ndsc_mqtt_overflows_total %lu\n", (unsigned long)stats.overflows);
+  textPrintf(text, "# TYPE dsc_mqtt_deferred_total counter\ndsc_mqtt_deferred_total %lu\n", (unsigned long)stats.deferred);
+  textPrintf(text, "# TYPE dsc_mqtt_pending gauge\ndsc_mqtt_pending %u\n", (unsigned int)mqttSchedulerPending());
+  textPrintf(text, "# TYPE dsc_mqtt_pending_max gauge\ndsc_mqtt_pending_max %u\n", stats.maxDepth);
+
+  return text.overflow ? 0 : text.length;
+}
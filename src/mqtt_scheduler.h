@@ -0,0 +1,80 @@
+/**
+   Paces the retained entity publishes of a tsMqttTopics table. Publishes
+   wait in two lanes: critical (partition, alarm and fire states) in order,
+   then entities (zones and PGMs), where a newer value for a queued topic
+   replaces the older one so a zone storm sends each zone's latest state
+   once. The lanes drain through a token bucket of `rate` messages per
+   second holding up to `burst` of them, and each run stops after its time
+   budget, leaving the rest for the next network iteration.
+
+   A message is recorded in mqtt_cache once sent. A failed publish is
+   dropped: the cache keeps the topic stale and mqttResync() sends it after
+   reconnecting.
+*/
+#ifndef MQTT_SCHEDULER_H
+#define MQTT_SCHEDULER_H
+
+#include "mqtt_cache.h"
+
+typedef enum {
+  MQTT_LANE_CRITICAL,         // Partition and fire topics, in order
+  MQTT_LANE_ENTITY,           // Zone and PGM topics, latest value per topic
+  MQTT_LANE_COUNT
+} teMqttLane;
+
+typedef struct {
+  uint32_t posted[MQTT_LANE_COUNT];
+  uint32_t sent[MQTT_LANE_COUNT];
+  uint32_t coalesced;         // Entity values replaced before they were sent
+  uint32_t overflows;         // Critical messages sent at once, their lane full
+  uint32_t deferred;          // Runs that ended with messages left, out of tokens or time
+  uint16_t maxDepth;
+} tsMqttSchedulerStats;
+
+/**
+   Sends one retained message, returns false if the client refused it.
+*/
+typedef bool (*tfMqttPublish)(const char* topic, const char* payload);
+
+/**
+   Set the publish function and the bucket, which starts full.
+*/
+void mqttSchedulerBegin(tfMqttPublish publish, const uint16_t rate, const uint16_t burst);
+
+/**
+   Queue `payload` for `topic`, a topic of the table. An entity value the
+   broker already holds is only queued to replace a pending one. Returns
+   false if the entity lane is full.
+*/
+bool mqttSchedulerPost(const teMqttLane lane, const char* topic, const char* payload);
+
+/**
+   Send queued messages, critical first, while tokens last and for at most
+   `budgetUs`. Returns the number sent.
+*/
+size_t mqttSchedulerRun(const unsigned long budgetUs);
+
+/**
+   Take a token for a message sent outside the lanes, e.g. the panel state
+   message. Returns false if the bucket is empty.
+*/
+bool mqttSchedulerAcquire();
+
+/**
+   Messages waiting in all lanes.
+*/
+size_t mqttSchedulerPending();
+
+/**
+   Drop every queued message, e.g. when the connection is lost.
+*/
+void mqttSchedulerClear();
+
+const tsMqttSchedulerStats& mqttSchedulerStats();
+
+/**
+   Prometheus text of the scheduler counters.
+*/
+size_t mqttSchedulerFormat(char* buffer, const size_t size);
+
+#endif
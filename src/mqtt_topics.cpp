@@ -0,0 +1,37 @@
+#include "mqtt_topics.h"
+
+static const char targetSuffix[MQTT_TARGET_COUNT] = { 'S', 'A', 'N', 'D' };
+
+void mqttTopicsBegin(tsMqttTopics &topics, const char* partitionTopic, const char* zoneTopic,
+                     const char* fireTopic, const char* pgmTopic) {
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    snprintf(topics.partition[partition], MQTT_TOPIC_LEN, "%s%d", partitionTopic, partition + 1);
+    snprintf(topics.fire[partition], MQTT_TOPIC_LEN, "%s%d", fireTopic, partition + 1);
+    for (byte target = 0; target < MQTT_TARGET_COUNT; target++) {
+      snprintf(topics.target[partition][target], sizeof(topics.target[partition][target]), "%d%c",
+               partition + 1, targetSuffix[target]);
+    }
+  }
+
+  for (byte zone = 0; zone < MQTT_ZONE_COUNT; zone++) {
+    snprintf(topics.zone[zone], MQTT_TOPIC_LEN, "%s%d", zoneTopic, zone + 1);
+  }
+
+  for (byte pgm = 0; pgm < MQTT_PGM_COUNT; pgm++) {
+    snprintf(topics.pgm[pgm], MQTT_TOPIC_LEN, "%s%d", pgmTopic, pgm + 1);
+  }
+}
+
+teMqttTopicKind mqttTopicsFind(const tsMqttTopics &topics, const char* topic, byte &index) {
+  for (index = 0; index < dscPartitions; index++) {
+    if (strcmp(topic, topics.partition[index]) == 0) return MQTT_TOPIC_PARTITION;
+    if (strcmp(topic, topics.fire[index]) == 0) return MQTT_TOPIC_FIRE;
+  }
+  for (index = 0; index < MQTT_ZONE_COUNT; index++) {
+    if (strcmp(topic, topics.zone[index]) == 0) return MQTT_TOPIC_ZONE;
+  }
+  for (index = 0; index < MQTT_PGM_COUNT; index++) {
+    if (strcmp(topic, topics.pgm[index]) == 0) return MQTT_TOPIC_PGM;
+  }
+  return MQTT_TOPIC_NONE;
+}
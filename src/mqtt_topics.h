@@ -0,0 +1,55 @@
+/**
+   MQTT topic strings and HomeKit target payloads for every partition, zone,
+   fire and PGM entity, built once at startup into a flat table indexed by
+   entity number (0 based). The publish path only looks entries up.
+*/
+#ifndef MQTT_TOPICS_H
+#define MQTT_TOPICS_H
+
+#include <dscKeybusInterface.h>
+
+#define MQTT_TOPIC_LEN    24
+#define MQTT_ZONE_COUNT   (dscZones * 8)
+#define MQTT_PGM_COUNT    14
+
+// HomeKit target states, published prefixed with the partition number: "1S", "1A", ...
+typedef enum {
+  MQTT_TARGET_STAY,
+  MQTT_TARGET_AWAY,
+  MQTT_TARGET_NIGHT,
+  MQTT_TARGET_DISARM,
+  MQTT_TARGET_COUNT,
+  MQTT_TARGET_NONE = MQTT_TARGET_COUNT
+} teMqttTarget;
+
+// Entity kinds of the table, as found by mqttTopicsFind()
+typedef enum {
+  MQTT_TOPIC_PARTITION,
+  MQTT_TOPIC_FIRE,
+  MQTT_TOPIC_ZONE,
+  MQTT_TOPIC_PGM,
+  MQTT_TOPIC_NONE
+} teMqttTopicKind;
+
+typedef struct {
+  char partition[dscPartitions][MQTT_TOPIC_LEN];
+  char fire[dscPartitions][MQTT_TOPIC_LEN];
+  char zone[MQTT_ZONE_COUNT][MQTT_TOPIC_LEN];
+  char pgm[MQTT_PGM_COUNT][MQTT_TOPIC_LEN];
+  char target[dscPartitions][MQTT_TARGET_COUNT][4];
+} tsMqttTopics;
+
+/**
+   Fill `topics` from the base topics, e.g. "dsc/Get/Zone" gives
+   zone[0] = "dsc/Get/Zone1" ... zone[63] = "dsc/Get/Zone64".
+*/
+void mqttTopicsBegin(tsMqttTopics &topics, const char* partitionTopic, const char* zoneTopic,
+                     const char* fireTopic, const char* pgmTopic);
+
+/**
+   Find the entity a topic names, compared by value: returns its kind and sets
+   `index` to its number (0 based), or returns MQTT_TOPIC_NONE.
+*/
+teMqttTopicKind mqttTopicsFind(const tsMqttTopics &topics, const char* topic, byte &index);
+
+#endif
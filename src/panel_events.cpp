@@ -0,0 +1,132 @@
+#include "panel_events.h"
+
+typedef struct {
+  tsPanelEvent* events;
+  size_t size;
+  size_t count;
+} tsEventList;
+
+static void emit(tsEventList &list, const byte type, const byte index, const byte value) {
+  if (list.count >= list.size) return;
+  list.events[list.count].type = type;
+  list.events[list.count].index = index;
+  list.events[list.count].value = value;
+  list.count++;
+}
+
+// Bitmaps are stored 1 bit per entity: byte 0 bit 0 = entity 1 ... byte 0 bit 7 = entity 8, byte 1 bit 0 = entity 9, ...
+static void emitBits(tsEventList &list, const byte type, const byte* values, const byte* changed,
+                     const byte groups, const byte count) {
+  for (byte group = 0; group < groups; group++) {
+    if (changed[group] == 0) continue;
+    for (byte bit = 0; bit < 8; bit++) {
+      byte index = bit + (group * 8);
+      if (index >= count) return;
+      if (bitRead(changed[group], bit)) emit(list, type, index, bitRead(values[group], bit));
+    }
+  }
+}
+
+size_t panelDiff(const tsPanelState &panel, tsPanelEvent* events, const size_t size) {
+  tsEventList list = { events, size, 0 };
+
+  if (panel.keybusChanged) emit(list, PANEL_EVENT_KEYBUS, 0, panel.keybusConnected);
+
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    // Skips processing if the partition is disabled or in installer programming
+    if (panel.disabled[partition]) continue;
+
+    // A partition is reported disarmed once, whichever flag noticed it
+    bool disarmed = false;
+
+    if (panel.armedChanged[partition]) {
+      if (!panel.armed[partition]) {
+        emit(list, PANEL_EVENT_ARMED, partition, PANEL_DISARMED);
+        disarmed = true;
+      }
+      else if (panel.noEntryDelay[partition] && (panel.armedAway[partition] || panel.armedStay[partition])) {
+        emit(list, PANEL_EVENT_ARMED, partition, PANEL_ARMED_NIGHT);
+      }
+      else if (panel.armedAway[partition]) emit(list, PANEL_EVENT_ARMED, partition, PANEL_ARMED_AWAY);
+      else if (panel.armedStay[partition]) emit(list, PANEL_EVENT_ARMED, partition, PANEL_ARMED_STAY);
+    }
+
+    if (panel.exitDelayChanged[partition]) {
+      if (panel.exitDelay[partition]) {
+        byte exitState = panel.exitState[partition];
+        if (panel.exitStateChanged[partition]) exitState |= PANEL_EXIT_STATE_CHANGED;
+        emit(list, PANEL_EVENT_EXIT_DELAY, partition, exitState);
+      }
+      // Disarmed during exit delay
+      else if (!panel.armed[partition] && !disarmed) {
+        emit(list, PANEL_EVENT_ARMED, partition, PANEL_DISARMED);
+        disarmed = true;
+      }
+    }
+
+    if (panel.alarmChanged[partition]) {
+      if (panel.alarm[partition]) emit(list, PANEL_EVENT_ALARM, partition, 1);
+      // Alarm restored without an armed change
+      else if (!panel.armedChanged[partition] && !disarmed) {
+        emit(list, PANEL_EVENT_ARMED, partition, PANEL_DISARMED);
+      }
+    }
+
+    if (panel.fireChanged[partition]) emit(list, PANEL_EVENT_FIRE, partition, panel.fire[partition]);
+  }
+
+  if (panel.openZonesStatusChanged) {
+    emitBits(list, PANEL_EVENT_ZONE_OPEN, panel.openZones, panel.openZonesChanged, dscZones, dscZones * 8);
+  }
+  if (panel.alarmZonesStatusChanged) {
+    emitBits(list, PANEL_EVENT_ZONE_ALARM, panel.alarmZones, panel.alarmZonesChanged, dscZones, dscZones * 8);
+  }
+  if (panel.pgmOutputsStatusChanged) {
+    emitBits(list, PANEL_EVENT_PGM, panel.pgmOutputs, panel.pgmOutputsChanged, 2, PANEL_PGM_COUNT);
+  }
+
+  if (panel.troubleChanged) emit(list, PANEL_EVENT_TROUBLE, 0, panel.trouble);
+  if (panel.powerChanged) emit(list, PANEL_EVENT_POWER, 0, panel.powerTrouble);
+  if (panel.batteryChanged) emit(list, PANEL_EVENT_BATTERY, 0, panel.batteryTrouble);
+  if (panel.keypadFireAlarm) emit(list, PANEL_EVENT_KEYPAD_ALARM, 0, PANEL_KEYPAD_FIRE);
+  if (panel.keypadAuxAlarm) emit(list, PANEL_EVENT_KEYPAD_ALARM, 0, PANEL_KEYPAD_AUX);
+  if (panel.keypadPanicAlarm) emit(list, PANEL_EVENT_KEYPAD_ALARM, 0, PANEL_KEYPAD_PANIC);
+
+  return list.count;
+}
+
+void panelEventFormat(const tsPanelEvent &event, tsTextBuffer &text) {
+  switch (event.type) {
+    case PANEL_EVENT_KEYBUS: textAppend(text, event.value ? "Connected" : "Disconnected"); break;
+
+    case PANEL_EVENT_ARMED: {
+      switch (event.value) {
+        case PANEL_ARMED_STAY:  textAppend(text, "Armed stay"); break;
+        case PANEL_ARMED_AWAY:  textAppend(text, "Armed away"); break;
+        case PANEL_ARMED_NIGHT: textAppend(text, "Armed night"); break;
+        default:                textAppend(text, "Disarmed"); break;
+      }
+      textPrintf(text, ": Partition %d", event.index + 1);
+      break;
+    }
+
+    case PANEL_EVENT_EXIT_DELAY: textPrintf(text, "Exit delay in progress: Partition %d", event.index + 1); break;
+    case PANEL_EVENT_ALARM: textPrintf(text, "Alarm: Partition %d", event.index + 1); break;
+    case PANEL_EVENT_FIRE: textPrintf(text, "%s: Partition %d", event.value ? "Fire alarm" : "Fire alarm restored", event.index + 1); break;
+    case PANEL_EVENT_ZONE_OPEN: textPrintf(text, "%s: %d", event.value ? "Zone open" : "Zone closed", event.index + 1); break;
+    case PANEL_EVENT_ZONE_ALARM: textPrintf(text, "%s: %d", event.value ? "Zone alarm" : "Zone alarm restored", event.index + 1); break;
+    case PANEL_EVENT_PGM: textPrintf(text, "%s: %d", event.value ? "PGM on" : "PGM off", event.index + 1); break;
+    case PANEL_EVENT_TROUBLE: textAppend(text, event.value ? "Trouble status on" : "Trouble status restored"); break;
+    case PANEL_EVENT_POWER: textAppend(text, event.value ? "AC power trouble" : "AC power restored"); break;
+    case PANEL_EVENT_BATTERY: textAppend(text, event.value ? "Panel battery trouble" : "Panel battery restored"); break;
+
+    case PANEL_EVENT_KEYPAD_ALARM: {
+      if (event.value == PANEL_KEYPAD_FIRE) textAppend(text, "Keypad Fire alarm");
+      else if (event.value == PANEL_KEYPAD_AUX) textAppend(text, "Keypad Aux alarm");
+      else textAppend(text, "Keypad Panic alarm");
+      break;
+    }
+
+    default: textPrintf(text, "Event %d: %d %d", event.type, event.index, event.value); break;
+  }
+}
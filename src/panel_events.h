@@ -0,0 +1,66 @@
+/**
+   Typed panel events. The network task diffs each panel image taken from
+   the Keybus task once into a list of compact records, in the order the
+   sinks used to handle them; MQTT and Telegram then consume the same list
+   without repeating the armed, exit delay, alarm, zone and PGM checks.
+*/
+#ifndef PANEL_EVENTS_H
+#define PANEL_EVENTS_H
+
+#include "panel_state.h"
+#include "text_buffer.h"
+
+typedef enum {
+  PANEL_EVENT_KEYBUS,         // value: 1 connected, 0 disconnected
+  PANEL_EVENT_ARMED,          // index: partition, value: tePanelArmedMode
+  PANEL_EVENT_EXIT_DELAY,     // index: partition, value: DSC_EXIT_* exit state, ORed with PANEL_EXIT_STATE_CHANGED
+  PANEL_EVENT_ALARM,          // index: partition, alarm restore is reported as PANEL_EVENT_ARMED disarmed
+  PANEL_EVENT_FIRE,           // index: partition, value: 1 alarm, 0 restored
+  PANEL_EVENT_ZONE_OPEN,      // index: zone (0 = zone 1), value: 1 open, 0 closed
+  PANEL_EVENT_ZONE_ALARM,     // index: zone (0 = zone 1), value: 1 alarm, 0 restored
+  PANEL_EVENT_PGM,            // index: PGM output (0 = PGM 1), value: 1 enabled, 0 disabled
+  PANEL_EVENT_TROUBLE,        // value: 1 trouble, 0 restored
+  PANEL_EVENT_POWER,          // value: 1 AC power trouble, 0 restored
+  PANEL_EVENT_BATTERY,        // value: 1 battery trouble, 0 restored
+  PANEL_EVENT_KEYPAD_ALARM    // value: tePanelKeypadAlarm
+} tePanelEvent;
+
+typedef enum {
+  PANEL_DISARMED,
+  PANEL_ARMED_STAY,
+  PANEL_ARMED_AWAY,
+  PANEL_ARMED_NIGHT
+} tePanelArmedMode;
+
+typedef enum {
+  PANEL_KEYPAD_FIRE,
+  PANEL_KEYPAD_AUX,
+  PANEL_KEYPAD_PANIC
+} tePanelKeypadAlarm;
+
+#define PANEL_EXIT_STATE_CHANGED  0x80
+#define PANEL_PGM_COUNT           14
+
+// Keybus, 4 per partition, open and alarm per zone, PGMs, trouble, power, battery, 3 keypad alarms
+#define PANEL_EVENT_MAX  (1 + (4 * dscPartitions) + (2 * dscZones * 8) + PANEL_PGM_COUNT + 6)
+
+typedef struct {
+  byte type;                  // tePanelEvent
+  byte index;
+  byte value;
+} tsPanelEvent;
+
+/**
+   Write the events for the change flags in `panel` into `events`, at most
+   `size` of them. Disabled partitions are skipped. Returns the number of
+   events written.
+*/
+size_t panelDiff(const tsPanelState &panel, tsPanelEvent* events, const size_t size);
+
+/**
+   Append the human readable text of `event` to `text`, e.g.
+   "Armed away: Partition 1" or "Zone alarm: 3".
+*/
+void panelEventFormat(const tsPanelEvent &event, tsTextBuffer &text);
+
+#endif
@@ -0,0 +1,154 @@
+#include "panel_state.h"
+
+static tsPanelState pending;
+static portMUX_TYPE panelMux = portMUX_INITIALIZER_UNLOCKED;
+
+void panelCapture(dscKeybusInterface &dsc) {
+  portENTER_CRITICAL(&panelMux);
+
+  pending.statusChanged = true;
+
+  pending.keybusConnected = dsc.keybusConnected;
+  pending.keybusChanged |= dsc.keybusChanged;
+  pending.trouble = dsc.trouble;
+  pending.troubleChanged |= dsc.troubleChanged;
+  pending.powerTrouble = dsc.powerTrouble;
+  pending.powerChanged |= dsc.powerChanged;
+  pending.batteryTrouble = dsc.batteryTrouble;
+  pending.batteryChanged |= dsc.batteryChanged;
+  pending.keypadFireAlarm |= dsc.keypadFireAlarm;
+  pending.keypadAuxAlarm |= dsc.keypadAuxAlarm;
+  pending.keypadPanicAlarm |= dsc.keypadPanicAlarm;
+  dsc.keybusChanged = false;
+  dsc.troubleChanged = false;
+  dsc.powerChanged = false;
+  dsc.batteryChanged = false;
+  dsc.keypadFireAlarm = false;
+  dsc.keypadAuxAlarm = false;
+  dsc.keypadPanicAlarm = false;
+
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    pending.ready[partition] = dsc.ready[partition];
+    pending.disabled[partition] = dsc.disabled[partition];
+    pending.armed[partition] = dsc.armed[partition];
+    pending.armedAway[partition] = dsc.armedAway[partition];
+    pending.armedStay[partition] = dsc.armedStay[partition];
+    pending.noEntryDelay[partition] = dsc.noEntryDelay[partition];
+    pending.armedChanged[partition] |= dsc.armedChanged[partition];
+    pending.alarm[partition] = dsc.alarm[partition];
+    pending.alarmChanged[partition] |= dsc.alarmChanged[partition];
+    pending.exitDelay[partition] = dsc.exitDelay[partition];
+    pending.exitDelayChanged[partition] |= dsc.exitDelayChanged[partition];
+    pending.exitState[partition] = dsc.exitState[partition];
+    pending.exitStateChanged[partition] |= dsc.exitStateChanged[partition];
+    pending.fire[partition] = dsc.fire[partition];
+    pending.fireChanged[partition] |= dsc.fireChanged[partition];
+    pending.status[partition] = dsc.status[partition];
+    dsc.armedChanged[partition] = false;
+    dsc.alarmChanged[partition] = false;
+    dsc.exitDelayChanged[partition] = false;
+    dsc.exitStateChanged[partition] = 0;
+    dsc.fireChanged[partition] = false;
+  }
+  pending.writePartition = dsc.writePartition;
+
+  pending.openZonesStatusChanged |= dsc.openZonesStatusChanged;
+  pending.alarmZonesStatusChanged |= dsc.alarmZonesStatusChanged;
+  dsc.openZonesStatusChanged = false;
+  dsc.alarmZonesStatusChanged = false;
+  for (byte zoneGroup = 0; zoneGroup < dscZones; zoneGroup++) {
+    pending.openZones[zoneGroup] = dsc.openZones[zoneGroup];
+    pending.openZonesChanged[zoneGroup] |= dsc.openZonesChanged[zoneGroup];
+    pending.alarmZones[zoneGroup] = dsc.alarmZones[zoneGroup];
+    pending.alarmZonesChanged[zoneGroup] |= dsc.alarmZonesChanged[zoneGroup];
+    dsc.openZonesChanged[zoneGroup] = 0;
+    dsc.alarmZonesChanged[zoneGroup] = 0;
+  }
+
+  pending.pgmOutputsStatusChanged |= dsc.pgmOutputsStatusChanged;
+  dsc.pgmOutputsStatusChanged = false;
+  for (byte pgmGroup = 0; pgmGroup < 2; pgmGroup++) {
+    pending.pgmOutputs[pgmGroup] = dsc.pgmOutputs[pgmGroup];
+    pending.pgmOutputsChanged[pgmGroup] |= dsc.pgmOutputsChanged[pgmGroup];
+    dsc.pgmOutputsChanged[pgmGroup] = 0;
+  }
+
+  portEXIT_CRITICAL(&panelMux);
+}
+
+bool panelTake(tsPanelState &panel) {
+  portENTER_CRITICAL(&panelMux);
+
+  if (!pending.statusChanged) {
+    portEXIT_CRITICAL(&panelMux);
+    return false;
+  }
+
+  panel = pending;
+
+  // Keeps the latest values, only the change and event flags are consumed
+  pending.statusChanged = false;
+  pending.keybusChanged = false;
+  pending.troubleChanged = false;
+  pending.powerChanged = false;
+  pending.batteryChanged = false;
+  pending.keypadFireAlarm = false;
+  pending.keypadAuxAlarm = false;
+  pending.keypadPanicAlarm = false;
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    pending.armedChanged[partition] = false;
+    pending.alarmChanged[partition] = false;
+    pending.exitDelayChanged[partition] = false;
+    pending.exitStateChanged[partition] = 0;
+    pending.fireChanged[partition] = false;
+  }
+  pending.openZonesStatusChanged = false;
+  pending.alarmZonesStatusChanged = false;
+  pending.pgmOutputsStatusChanged = false;
+  memset(pending.openZonesChanged, 0, sizeof(pending.openZonesChanged));
+  memset(pending.alarmZonesChanged, 0, sizeof(pending.alarmZonesChanged));
+  memset(pending.pgmOutputsChanged, 0, sizeof(pending.pgmOutputsChanged));
+
+  portEXIT_CRITICAL(&panelMux);
+  return true;
+}
+
+void panelRequestRefresh(byte partition) {
+  if (partition >= dscPartitions) return;
+  portENTER_CRITICAL(&panelMux);
+  pending.armedChanged[partition] = true;
+  pending.statusChanged = true;
+  portEXIT_CRITICAL(&panelMux);
+}
+
+void panelMerge(tsPanelState &held, const tsPanelState &taken) {
+  tsPanelState merged = taken;
+
+  merged.statusChanged |= held.statusChanged;
+  merged.keybusChanged |= held.keybusChanged;
+  merged.troubleChanged |= held.troubleChanged;
+  merged.powerChanged |= held.powerChanged;
+  merged.batteryChanged |= held.batteryChanged;
+  merged.keypadFireAlarm |= held.keypadFireAlarm;
+  merged.keypadAuxAlarm |= held.keypadAuxAlarm;
+  merged.keypadPanicAlarm |= held.keypadPanicAlarm;
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    merged.armedChanged[partition] |= held.armedChanged[partition];
+    merged.alarmChanged[partition] |= held.alarmChanged[partition];
+    merged.exitDelayChanged[partition] |= held.exitDelayChanged[partition];
+    merged.exitStateChanged[partition] |= held.exitStateChanged[partition];
+    merged.fireChanged[partition] |= held.fireChanged[partition];
+  }
+  merged.openZonesStatusChanged |= held.openZonesStatusChanged;
+  merged.alarmZonesStatusChanged |= held.alarmZonesStatusChanged;
+  merged.pgmOutputsStatusChanged |= held.pgmOutputsStatusChanged;
+  for (byte zoneGroup = 0; zoneGroup < dscZones; zoneGroup++) {
+    merged.openZonesChanged[zoneGroup] |= held.openZonesChanged[zoneGroup];
+    merged.alarmZonesChanged[zoneGroup] |= held.alarmZonesChanged[zoneGroup];
+  }
+  for (byte pgmGroup = 0; pgmGroup < 2; pgmGroup++) {
+    merged.pgmOutputsChanged[pgmGroup] |= held.pgmOutputsChanged[pgmGroup];
+  }
+
+  held = merged;
+}
@@ -0,0 +1,66 @@
+/**
+   Hand-off of panel status from the Keybus task to the network task.
+   The Keybus task merges the library's status and change flags into a
+   pending image and clears them; the network task takes that image in one
+   short critical section and dispatches it without touching `dsc`.
+*/
+#ifndef PANEL_STATE_H
+#define PANEL_STATE_H
+
+#include <dscKeybusInterface.h>
+
+typedef struct {
+  bool statusChanged;
+
+  bool keybusConnected, keybusChanged;
+  bool trouble, troubleChanged;
+  bool powerTrouble, powerChanged;
+  bool batteryTrouble, batteryChanged;
+  bool keypadFireAlarm, keypadAuxAlarm, keypadPanicAlarm;
+
+  bool ready[dscPartitions];
+  bool disabled[dscPartitions];
+  bool armed[dscPartitions], armedAway[dscPartitions], armedStay[dscPartitions];
+  bool noEntryDelay[dscPartitions], armedChanged[dscPartitions];
+  bool alarm[dscPartitions], alarmChanged[dscPartitions];
+  bool exitDelay[dscPartitions], exitDelayChanged[dscPartitions];
+  byte exitState[dscPartitions], exitStateChanged[dscPartitions];
+  bool fire[dscPartitions], fireChanged[dscPartitions];
+  byte status[dscPartitions];
+  byte writePartition;        // Partition the keys of a command without one go to
+
+  bool openZonesStatusChanged;
+  byte openZones[dscZones], openZonesChanged[dscZones];
+  bool alarmZonesStatusChanged;
+  byte alarmZones[dscZones], alarmZonesChanged[dscZones];
+  bool pgmOutputsStatusChanged;
+  byte pgmOutputs[2], pgmOutputsChanged[2];
+} tsPanelState;
+
+/**
+   Keybus task side: merges the current status of `dsc` into the pending
+   image and resets the library's change flags. Call when dsc.statusChanged
+   is set.
+*/
+void panelCapture(dscKeybusInterface &dsc);
+
+/**
+   Network task side: copies the pending image into `panel` and clears its
+   change flags. Returns false if nothing changed since the last call.
+*/
+bool panelTake(tsPanelState &panel);
+
+/**
+   Marks the armed state of a partition as changed so the next panelTake()
+   republishes it, e.g. to reset a HomeKit target state after a rejected
+   command.
+*/
+void panelRequestRefresh(byte partition);
+
+/**
+   Network task side: merges `taken`, a newer image from panelTake(), into
+   `held`: the values of `taken` with the change flags of both.
+*/
+void panelMerge(tsPanelState &held, const tsPanelState &taken);
+
+#endif
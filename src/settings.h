@@ -1,25 +1,115 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
-const char* version = "1.8.5";
+const char* const version = "1.8.5";
 
 #define USE_MQTT
 #define USE_TELEGRAM
 
 #define WDT_TMO 60000
 
+// Wall clock times before 2020-01-01 mean NTP has not set the clock yet
+#define CLOCK_VALID_AFTER       1577836800UL
+
 #define MQTT_SERVER_LEN         40
 #define MQTT_PORT_LEN           6
 #define MQTT_USER_LEN           16
 #define MQTT_PASSWORD_LEN       16
+#define MQTT_STATE_FORMAT_LEN   8
+#define MQTT_STATS_INTERVAL     60000
+
+// The broker connection is polled without blocking, failed attempts back off exponentially
+// between MQTT_BACKOFF_MIN_MS and MQTT_BACKOFF_MAX_MS with half of each delay random. Two steps
+// still block the network task (never the Keybus task): the DNS lookup of the broker, made once
+// and again every MQTT_RESOLVE_FAILURES failed attempts, and the CONNACK wait inside PubSubClient,
+// bounded by MQTT_CONNACK_TIMEOUT
+#define MQTT_CONNECT_TIMEOUT_MS 5000
+#define MQTT_CONNACK_TIMEOUT    2       // Seconds PubSubClient waits for CONNACK
+#define MQTT_RESOLVE_FAILURES   4
+#define MQTT_BACKOFF_MIN_MS     1000
+#define MQTT_BACKOFF_MAX_MS     60000
+
+// Entity publishes drain through a token bucket: messages per second, bucket size, and the time
+// one network iteration may spend publishing
+#define MQTT_PUBLISH_RATE       20
+#define MQTT_PUBLISH_BURST      32
+#define MQTT_PUBLISH_BUDGET_US  20000
+
+// The configuration page is streamed in chunks of this size
+#define WEB_CHUNK_LEN           512
+
+// /api/config is built in a buffer of this size, values escaped as JSON
+#define API_CONFIG_JSON_LEN     1024
+
+// SPIFFS files are sent over HTTP and Telegram in blocks of this size
+#define FILE_BLOCK_LEN          4096
 
 #define TELEGRAM_CHAT_ID_LEN    32
 #define TELEGRAM_BOT_TOKEN_LEN  64
 #define TELEGRAM_MSG_PREFIX_LEN 40
+#define TELEGRAM_REPLY_LEN      2048
+
+// Notification chats besides the command chat, and the setting listing them
+#define TELEGRAM_RECIPIENTS_MAX 6
+#define TELEGRAM_RECIPIENTS_LEN 160
 
 #define DSC_ACCESS_CODE_LEN     5
 
+// Binary configuration store, compacted into a snapshot when the journal would outgrow this
+#define CONFIG_STORE_LEN        1024
+
 #define PGM_COUNT               4
 #define PARTITION_COUNT         2
 
+// Keybus processing runs on its own core, away from the WiFi stack and the network sinks
+#define KEYBUS_TASK_CORE        1
+#define KEYBUS_TASK_PRIORITY    3
+#define KEYBUS_TASK_STACK       4096
+#define NETWORK_TASK_CORE       0
+#define NETWORK_TASK_PRIORITY   1
+#define NETWORK_TASK_STACK      16384
+// How long the network task waits for the Keybus task to stop the interface before writing flash
+#define KEYBUS_STOP_WAIT_MS     100
+
+// Keypad writes waiting per priority class, access codes, arming and other keys
+#define KEYPAD_QUEUE_LEN        8
+#define KEYPAD_KEYS_LEN         32
+
+// Command latency tracing: commands followed at once, and how long one may wait for the panel
+#define TRACE_SLOTS             8
+#define TRACE_TIMEOUT_MS        30000
+
+// Outbound Telegram notifications, events within the window are merged into one message
+#define TELEGRAM_TASK_STACK     8192
+#define TELEGRAM_QUEUE_LEN      32
+#define TELEGRAM_QUEUE_MSG_LEN  64
+#define TELEGRAM_BATCH_LEN      512
+#define TELEGRAM_COALESCE_MS    1500
+
+// Commands are long-polled from their own task, the server holds each request up to this many seconds
+#define TELEGRAM_LONG_POLL      50
+// The update offset is written to flash at most this often, restart commands write it at once
+#define TELEGRAM_OFFSET_SAVE_MS 60000
+
+// Telegram TLS connections are kept open between requests, a failed handshake blocks new attempts
+// for a delay doubling from TLS_BACKOFF_MIN_MS up to TLS_BACKOFF_MAX_MS
+#define TLS_HANDSHAKE_TIMEOUT   30      // Seconds
+#define TLS_BACKOFF_MIN_MS      2000
+#define TLS_BACKOFF_MAX_MS      120000
+
+// "write spiffs" downloads run in slices of the network task, a connection that drops or stalls
+// is resumed up to DOWNLOAD_RETRIES times in a row
+#define DOWNLOAD_BUFFER_LEN     4096    // One flash sector
+#define DOWNLOAD_SLICE_MS       20
+#define DOWNLOAD_STALL_MS       10000
+#define DOWNLOAD_RETRIES        3
+#define DOWNLOAD_PATH_LEN       27      // SPIFFS names hold 31 characters, 5 of them for ".part"
+
+// Panel event history on SPIFFS, 8 byte records, a segment with its header fills one 4 KB flash sector
+#define EVENT_LOG_SEGMENTS          8
+#define EVENT_LOG_SEGMENT_RECORDS   511
+#define EVENT_LOG_INDEX_STRIDE      64
+#define EVENT_LOG_BUFFER_LEN        32
+#define EVENT_LOG_FLUSH_MS          5000
+
 #endif
@@ -0,0 +1,118 @@
+#include "state_codec.h"
+#include "text_buffer.h"
+
+size_t stateEncodeBinary(const tsPanelState &panel, uint8_t* buffer, const size_t size) {
+  if (size < STATE_BINARY_LEN) return 0;
+
+  size_t length = 0;
+  buffer[length++] = 'D';
+  buffer[length++] = 'S';
+  buffer[length++] = STATE_BINARY_VERSION;
+  buffer[length++] = dscPartitions;
+
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    byte flags = 0;
+    bitWrite(flags, 0, panel.ready[partition]);
+    bitWrite(flags, 1, panel.armed[partition]);
+    bitWrite(flags, 2, panel.armedAway[partition]);
+    bitWrite(flags, 3, panel.armedStay[partition]);
+    bitWrite(flags, 4, panel.noEntryDelay[partition]);
+    bitWrite(flags, 5, panel.exitDelay[partition]);
+    bitWrite(flags, 6, panel.alarm[partition]);
+    bitWrite(flags, 7, panel.fire[partition]);
+    buffer[length++] = flags;
+
+    byte extra = panel.exitState[partition] & 0x03;
+    bitWrite(extra, 7, panel.disabled[partition]);
+    buffer[length++] = extra;
+  }
+
+  memcpy(buffer + length, panel.openZones, dscZones);
+  length += dscZones;
+  memcpy(buffer + length, panel.alarmZones, dscZones);
+  length += dscZones;
+  memcpy(buffer + length, panel.pgmOutputs, 2);
+  length += 2;
+
+  byte trouble = 0;
+  bitWrite(trouble, 0, panel.trouble);
+  bitWrite(trouble, 1, panel.powerTrouble);
+  bitWrite(trouble, 2, panel.batteryTrouble);
+  bitWrite(trouble, 3, panel.keybusConnected);
+  buffer[length++] = trouble;
+
+  return length;
+}
+
+// Appends the numbers of the set bits as a JSON array, bit 0 of byte 0 is number 1
+static void appendBitList(tsTextBuffer &text, const byte* bits, const byte bytes) {
+  bool first = true;
+  textAppend(text, "[");
+  for (byte group = 0; group < bytes; group++) {
+    if (bits[group] == 0) continue;
+    for (byte bit = 0; bit < 8; bit++) {
+      if (!bitRead(bits[group], bit)) continue;
+      textPrintf(text, first ? "%d" : ",%d", bit + 1 + (group * 8));
+      first = false;
+    }
+  }
+  textAppend(text, "]");
+}
+
+static const char* armedMode(const tsPanelState &panel, const byte partition) {
+  if (!panel.armed[partition]) return "disarmed";
+  if (panel.noEntryDelay[partition]) return "night";
+  if (panel.armedAway[partition]) return "away";
+  if (panel.armedStay[partition]) return "stay";
+  return "armed";
+}
+
+static const char* exitMode(const byte exitState) {
+  switch (exitState) {
+    case DSC_EXIT_STAY: return "stay";
+    case DSC_EXIT_AWAY: return "away";
+    case DSC_EXIT_NO_ENTRY_DELAY: return "night";
+    default: return "";
+  }
+}
+
+size_t stateEncodeJson(const tsPanelState &panel, char* buffer, const size_t size) {
+  if (size == 0) return 0;
+
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+  bool first = true;
+
+  textAppend(text, "{\"partitions\":[");
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    if (panel.disabled[partition]) continue;
+    textPrintf(text,
+               "%s{\"partition\":%d,\"ready\":%s,\"armed\":\"%s\",\"exitDelay\":\"%s\",\"alarm\":%s,\"fire\":%s}",
+               first ? "" : ",",
+               partition + 1,
+               panel.ready[partition] ? "true" : "false",
+               armedMode(panel, partition),
+               panel.exitDelay[partition] ? exitMode(panel.exitState[partition]) : "",
+               panel.alarm[partition] ? "true" : "false",
+               panel.fire[partition] ? "true" : "false");
+    first = false;
+  }
+  textAppend(text, "],\"openZones\":");
+  appendBitList(text, panel.openZones, dscZones);
+  textAppend(text, ",\"alarmZones\":");
+  appendBitList(text, panel.alarmZones, dscZones);
+  textAppend(text, ",\"pgm\":");
+  appendBitList(text, panel.pgmOutputs, 2);
+  textPrintf(text,
+             ",\"trouble\":%s,\"powerTrouble\":%s,\"batteryTrouble\":%s,\"keybusConnected\":%s}",
+             panel.trouble ? "true" : "false",
+             panel.powerTrouble ? "true" : "false",
+             panel.batteryTrouble ? "true" : "false",
+             panel.keybusConnected ? "true" : "false");
+
+  if (text.overflow) {
+    buffer[0] = 0x00;
+    return 0;
+  }
+  return text.length;
+}
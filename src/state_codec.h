@@ -0,0 +1,41 @@
+/**
+   Encodes the whole panel image into a single message for the
+   dsc/Get/State topic, either as JSON or as a compact binary record.
+
+   Binary layout (STATE_BINARY_LEN bytes, multi-byte fields little endian):
+     0      'D'
+     1      'S'
+     2      STATE_BINARY_VERSION
+     3      number of partitions (dscPartitions)
+     4..    per partition, 2 bytes:
+              flags: bit 0 ready, 1 armed, 2 armed away, 3 armed stay,
+                     4 no entry delay, 5 exit delay, 6 alarm, 7 fire
+              extra: bits 0-1 exit state, bit 7 disabled
+     then   open zones bitmap, dscZones bytes, bit 0 of byte 0 = zone 1
+     then   alarm zones bitmap, dscZones bytes
+     then   PGM outputs bitmap, 2 bytes, bit 0 of byte 0 = PGM 1
+     then   trouble flags: bit 0 trouble, 1 AC power trouble,
+                           2 battery trouble, 3 Keybus connected
+*/
+#ifndef STATE_CODEC_H
+#define STATE_CODEC_H
+
+#include "panel_state.h"
+
+#define STATE_BINARY_VERSION  1
+#define STATE_BINARY_LEN      (4 + (2 * dscPartitions) + (2 * dscZones) + 2 + 1)
+#define STATE_JSON_LEN        1536
+
+/**
+   Write the binary record into `buffer`. Returns the encoded length, or 0
+   if `size` is smaller than STATE_BINARY_LEN.
+*/
+size_t stateEncodeBinary(const tsPanelState &panel, uint8_t* buffer, const size_t size);
+
+/**
+   Write the JSON document into `buffer` (null terminated). Returns the
+   encoded length, or 0 if it does not fit in `size`.
+*/
+size_t stateEncodeJson(const tsPanelState &panel, char* buffer, const size_t size);
+
+#endif
@@ -0,0 +1,62 @@
+#include "tcp_connect.h"
+#include <errno.h>
+#include <lwip/sockets.h>
+
+static void setBlocking(const int fd, const bool blocking) {
+  int flags = lwip_fcntl(fd, F_GETFL, 0);
+  lwip_fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+}
+
+bool tcpConnectBegin(tsTcpConnect &connection, const IPAddress &ip, const uint16_t port) {
+  tcpConnectAbort(connection);
+
+  connection.fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (connection.fd < 0) return false;
+  setBlocking(connection.fd, false);
+  connection.started = millis();
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  uint8_t octets[4] = { ip[0], ip[1], ip[2], ip[3] };
+  memcpy(&address.sin_addr.s_addr, octets, sizeof(octets));
+
+  if (lwip_connect(connection.fd, (struct sockaddr*)&address, sizeof(address)) != 0 && errno != EINPROGRESS) {
+    tcpConnectAbort(connection);
+    return false;
+  }
+  return true;
+}
+
+teTcpConnect tcpConnectPoll(tsTcpConnect &connection, const unsigned long timeoutMs) {
+  if (connection.fd < 0) return TCP_CONNECT_FAILED;
+
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(connection.fd, &writable);
+  struct timeval noWait = { 0, 0 };
+  int ready = lwip_select(connection.fd + 1, nullptr, &writable, nullptr, &noWait);
+
+  if (ready == 0) {
+    if (millis() - connection.started < timeoutMs) return TCP_CONNECT_PENDING;
+    tcpConnectAbort(connection);
+    return TCP_CONNECT_FAILED;
+  }
+
+  // Writable means the handshake finished, SO_ERROR tells how
+  int error = 0;
+  socklen_t length = sizeof(error);
+  if (ready < 0 || lwip_getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+    tcpConnectAbort(connection);
+    return TCP_CONNECT_FAILED;
+  }
+
+  setBlocking(connection.fd, true);
+  return TCP_CONNECT_DONE;
+}
+
+void tcpConnectAbort(tsTcpConnect &connection) {
+  if (connection.fd >= 0) lwip_close(connection.fd);
+  connection.fd = -1;
+}
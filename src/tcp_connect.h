@@ -0,0 +1,41 @@
+/**
+   Non-blocking TCP connect. WiFiClient::connect() and the PubSubClient
+   connect built on it wait for the whole TCP handshake, up to the stack's
+   connect timeout when the peer blackholes the SYN. Here the socket is
+   opened in non-blocking mode and polled on every network task pass; once
+   connected the descriptor is handed to a WiFiClient.
+*/
+#ifndef TCP_CONNECT_H
+#define TCP_CONNECT_H
+
+#include <WiFi.h>
+
+typedef enum {
+  TCP_CONNECT_PENDING,
+  TCP_CONNECT_DONE,           // `fd` is connected and back in blocking mode
+  TCP_CONNECT_FAILED          // Refused, timed out or no socket, `fd` is closed
+} teTcpConnect;
+
+typedef struct {
+  int fd;                     // -1 when no connect is in progress
+  unsigned long started;
+} tsTcpConnect;
+
+/**
+   Start connecting to `ip`:`port`. Returns false if no socket could be
+   opened or the connect failed right away.
+*/
+bool tcpConnectBegin(tsTcpConnect &connection, const IPAddress &ip, const uint16_t port);
+
+/**
+   Check the connect without waiting. It fails once `timeoutMs` have passed
+   since tcpConnectBegin().
+*/
+teTcpConnect tcpConnectPoll(tsTcpConnect &connection, const unsigned long timeoutMs);
+
+/**
+   Close the socket of a connect in progress, if any.
+*/
+void tcpConnectAbort(tsTcpConnect &connection);
+
+#endif
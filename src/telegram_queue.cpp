@@ -0,0 +1,117 @@
+#include "telegram_queue.h"
+#include "settings.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+typedef struct {
+  char text[TELEGRAM_QUEUE_MSG_LEN];
+  uint8_t eventClass;
+} tsTelegramItem;
+
+static QueueHandle_t queue = NULL;
+static tsTelegramItem carry;          // Message that did not fit in the previous batch
+static bool carryPending = false;
+static tsTelegramQueueStats stats;
+
+void telegramQueueBegin(const unsigned int length) {
+  if (queue == NULL) queue = xQueueCreate(length, sizeof(tsTelegramItem));
+}
+
+bool telegramQueuePush(const char* messageContent, const teTelegramClass eventClass) {
+  if (queue == NULL) return false;
+
+  tsTelegramItem item;
+  strncpy(item.text, messageContent, sizeof(item.text) - 1);
+  item.text[sizeof(item.text) - 1] = 0x00;
+  item.eventClass = eventClass;
+
+  if (xQueueSend(queue, &item, 0) != pdTRUE) {
+    stats.dropped++;
+    return false;
+  }
+  stats.queued++;
+  return true;
+}
+
+// Appends a line to the message, returns false if it does not fit
+static bool appendLine(char* message, const size_t size, size_t &length, const char* line) {
+  size_t lineLength = strlen(line);
+  size_t separator = (length > 0) ? 1 : 0;
+  if (length + separator + lineLength >= size) return false;
+  if (separator) message[length++] = '\n';
+  memcpy(message + length, line, lineLength + 1);
+  length += lineLength;
+  return true;
+}
+
+// Adds an item to the batch, returns false if it does not fit
+static bool appendItem(tsTelegramBatch &batch, size_t &length, const tsTelegramItem &item) {
+  if (batch.lines == TELEGRAM_QUEUE_LEN) return false;
+  if (!appendLine(batch.text, sizeof(batch.text), length, item.text)) return false;
+  batch.classes[batch.lines++] = item.eventClass;
+  batch.mask |= item.eventClass;
+  return true;
+}
+
+unsigned int telegramQueueCollectBatch(tsTelegramBatch &batch, const unsigned long windowMs, const unsigned long waitMs) {
+  if (queue == NULL) return 0;
+
+  tsTelegramItem item;
+  size_t length = 0;
+  batch.text[0] = 0x00;
+  batch.lines = 0;
+  batch.mask = 0;
+
+  if (carryPending) {
+    item = carry;
+    carryPending = false;
+  }
+  else if (xQueueReceive(queue, &item, pdMS_TO_TICKS(waitMs)) != pdTRUE) {
+    return 0;
+  }
+  appendItem(batch, length, item);
+
+  // Merges whatever else arrives within the window of the first message
+  TickType_t windowStart = xTaskGetTickCount();
+  TickType_t windowTicks = pdMS_TO_TICKS(windowMs);
+  for (;;) {
+    TickType_t elapsed = xTaskGetTickCount() - windowStart;
+    TickType_t remaining = (elapsed < windowTicks) ? windowTicks - elapsed : 0;
+    if (xQueueReceive(queue, &item, remaining) != pdTRUE) break;
+    if (!appendItem(batch, length, item)) {
+      carry = item;
+      carryPending = true;
+      break;
+    }
+  }
+
+  stats.batches++;
+  return batch.lines;
+}
+
+unsigned int telegramBatchSelect(const tsTelegramBatch &batch, const uint8_t classes, char* message, const size_t size) {
+  size_t length = 0;
+  unsigned int count = 0;
+  const char* line = batch.text;
+  message[0] = 0x00;
+  for (unsigned int idx = 0; idx < batch.lines; idx++) {
+    const char* end = strchr(line, '\n');
+    size_t lineLength = end != nullptr ? (size_t)(end - line) : strlen(line);
+    if (batch.classes[idx] & classes) {
+      size_t separator = (length > 0) ? 1 : 0;
+      if (length + separator + lineLength >= size) break;
+      if (separator) message[length++] = '\n';
+      memcpy(message + length, line, lineLength);
+      length += lineLength;
+      message[length] = 0x00;
+      count++;
+    }
+    line += lineLength + 1;
+  }
+  return count;
+}
+
+tsTelegramQueueStats telegramQueueStats() {
+  return stats;
+}
@@ -0,0 +1,66 @@
+/**
+   Bounded outbound queue for Telegram notifications. Producers push short
+   messages without blocking; the Telegram task collects them and merges
+   everything that arrives within the coalescing window into one message,
+   so an alarm burst costs one HTTPS request instead of one per event.
+   Every message carries its event class, so each recipient of a batch
+   can be sent only the lines it subscribed to.
+*/
+#ifndef TELEGRAM_QUEUE_H
+#define TELEGRAM_QUEUE_H
+
+#include <Arduino.h>
+#include "settings.h"
+
+typedef enum {
+  TELEGRAM_CLASS_ALARM   = 1 << 0,    // Alarms, fire, zone and keypad alarms
+  TELEGRAM_CLASS_ARMING  = 1 << 1,    // Armed, disarmed and exit delay
+  TELEGRAM_CLASS_TROUBLE = 1 << 2,    // Panel troubles and the Keybus connection
+  TELEGRAM_CLASS_SYSTEM  = 1 << 3,    // Gateway messages, e.g. startup
+  TELEGRAM_CLASS_ALL     = 0x0F
+} teTelegramClass;
+
+// Messages merged into one batch, each line with its class
+typedef struct {
+  char text[TELEGRAM_BATCH_LEN];      // Lines separated by '\n'
+  uint8_t classes[TELEGRAM_QUEUE_LEN];
+  unsigned int lines;
+  uint8_t mask;                       // Classes of all lines
+} tsTelegramBatch;
+
+/**
+   Create the queue, holding up to `length` pending messages.
+*/
+void telegramQueueBegin(const unsigned int length);
+
+/**
+   Queue a message of `eventClass`, truncated to TELEGRAM_QUEUE_MSG_LEN - 1
+   characters. Returns false if the queue is full and the message was
+   dropped.
+*/
+bool telegramQueuePush(const char* messageContent, const teTelegramClass eventClass = TELEGRAM_CLASS_SYSTEM);
+
+/**
+   Wait up to `waitMs` for a message, then keep appending the messages that
+   arrive within `windowMs` of the first one to `batch`, one per line with
+   its class, while they fit: up to TELEGRAM_QUEUE_LEN lines. A message that
+   does not fit starts the next batch. Returns the number of merged
+   messages, 0 on timeout.
+*/
+unsigned int telegramQueueCollectBatch(tsTelegramBatch &batch, const unsigned long windowMs, const unsigned long waitMs);
+
+/**
+   Copy the lines of `batch` in `classes` to `message`, one per line.
+   Returns the number of lines copied.
+*/
+unsigned int telegramBatchSelect(const tsTelegramBatch &batch, const uint8_t classes, char* message, const size_t size);
+
+typedef struct {
+  unsigned long queued;       // Messages accepted by telegramQueuePush()
+  unsigned long dropped;      // Messages rejected because the queue was full
+  unsigned long batches;      // Merged messages handed out by telegramQueueCollectBatch()
+} tsTelegramQueueStats;
+
+tsTelegramQueueStats telegramQueueStats();
+
+#endif
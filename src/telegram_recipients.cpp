@@ -0,0 +1,141 @@
+#include "telegram_recipients.h"
+#include "text_buffer.h"
+
+static tsTelegramRecipient recipients[TELEGRAM_RECIPIENTS_MAX];
+static byte recipientCount = 0;
+static char messagePrefix[TELEGRAM_MSG_PREFIX_LEN] = "";
+static portMUX_TYPE recipientsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const classNames[] = { "alarm", "arming", "trouble", "system" };
+
+static tsTelegramRecipient* find(tsTelegramRecipient* list, const byte count, const char* chatId, const size_t length) {
+  for (byte idx = 0; idx < count; idx++) {
+    if (strlen(list[idx].chatId) == length && memcmp(list[idx].chatId, chatId, length) == 0) return &list[idx];
+  }
+  return nullptr;
+}
+
+// Adds a recipient to `list` or, for one already listed, replaces its classes
+static void add(tsTelegramRecipient* list, byte &count, const char* chatId, const size_t length, const uint8_t classes) {
+  if (length == 0 || length >= TELEGRAM_CHAT_ID_LEN || classes == 0) return;
+  tsTelegramRecipient* recipient = find(list, count, chatId, length);
+  if (recipient == nullptr) {
+    if (count == TELEGRAM_RECIPIENTS_MAX) return;
+    recipient = &list[count++];
+    memset(recipient, 0, sizeof(*recipient));
+    memcpy(recipient->chatId, chatId, length);
+  }
+  recipient->classes = classes;
+}
+
+uint8_t telegramClassesParse(const char* names, const size_t length) {
+  uint8_t classes = 0;
+  const char* end = names + length;
+  while (names < end) {
+    const char* separator = (const char*)memchr(names, '+', end - names);
+    size_t nameLength = (separator != nullptr ? separator : end) - names;
+    uint8_t found = 0;
+    for (byte idx = 0; idx < sizeof(classNames) / sizeof(classNames[0]); idx++) {
+      if (strlen(classNames[idx]) == nameLength && memcmp(classNames[idx], names, nameLength) == 0) found = 1 << idx;
+    }
+    if (found == 0) return 0;
+    classes |= found;
+    names += nameLength + (separator != nullptr ? 1 : 0);
+  }
+  return classes;
+}
+
+byte telegramRecipientsBegin(const char* commandChatId, const char* list) {
+  // Built aside and swapped in, the Telegram task may be delivering meanwhile
+  static tsTelegramRecipient built[TELEGRAM_RECIPIENTS_MAX];
+  byte builtCount = 0;
+
+  add(built, builtCount, commandChatId, strlen(commandChatId), TELEGRAM_CLASS_ALL);
+  while (*list != 0) {
+    size_t length = strcspn(list, ", ");
+    if (length > 0) {
+      const char* colon = (const char*)memchr(list, ':', length);
+      if (colon == nullptr) add(built, builtCount, list, length, TELEGRAM_CLASS_ALL);
+      else add(built, builtCount, list, colon - list, telegramClassesParse(colon + 1, list + length - colon - 1));
+    }
+    list += length;
+    if (*list != 0) list++;
+  }
+
+  portENTER_CRITICAL(&recipientsMux);
+  // Chats listed before keep their statistics
+  for (byte idx = 0; idx < builtCount; idx++) {
+    const tsTelegramRecipient* previous = find(recipients, recipientCount, built[idx].chatId, strlen(built[idx].chatId));
+    if (previous != nullptr) built[idx].stats = previous->stats;
+  }
+  memcpy(recipients, built, sizeof(recipients));
+  recipientCount = builtCount;
+  portEXIT_CRITICAL(&recipientsMux);
+  return builtCount;
+}
+
+void telegramRecipientsPrefix(const char* prefix) {
+  size_t length = strnlen(prefix, sizeof(messagePrefix) - 1);
+  portENTER_CRITICAL(&recipientsMux);
+  memcpy(messagePrefix, prefix, length);
+  messagePrefix[length] = 0;
+  portEXIT_CRITICAL(&recipientsMux);
+}
+
+byte telegramRecipientsCount() {
+  return recipientCount;
+}
+
+void telegramRecipientsSnapshot(tsTelegramRecipients &snapshot) {
+  portENTER_CRITICAL(&recipientsMux);
+  memcpy(snapshot.prefix, messagePrefix, sizeof(snapshot.prefix));
+  memcpy(snapshot.recipients, recipients, sizeof(snapshot.recipients));
+  snapshot.count = recipientCount;
+  portEXIT_CRITICAL(&recipientsMux);
+}
+
+tsTelegramRecipient telegramRecipient(const byte index) {
+  portENTER_CRITICAL(&recipientsMux);
+  tsTelegramRecipient recipient = recipients[index];
+  portEXIT_CRITICAL(&recipientsMux);
+  return recipient;
+}
+
+void telegramRecipientRecord(const char* chatId, const bool delivered, const uint32_t ms) {
+  portENTER_CRITICAL(&recipientsMux);
+  tsTelegramRecipient* recipient = find(recipients, recipientCount, chatId, strlen(chatId));
+  if (recipient != nullptr) {
+    tsRecipientStats &stats = recipient->stats;
+    stats.lastMs = ms;
+    if (delivered) {
+      stats.sent++;
+      stats.sumMs += ms;
+      if (ms > stats.maxMs) stats.maxMs = ms;
+    }
+    else stats.failures++;
+  }
+  portEXIT_CRITICAL(&recipientsMux);
+}
+
+size_t telegramRecipientsFormat(char* buffer, const size_t size) {
+  tsTextBuffer text;
+  textBegin(text, buffer, size);
+
+  textAppend(text, "# HELP dsc_telegram_delivery_ms Time to deliver a notification to a recipient\n"
+                   "# TYPE dsc_telegram_delivery_ms summary\n");
+  for (byte idx = 0; idx < recipientCount; idx++) {
+    tsRecipientStats stats = telegramRecipient(idx).stats;
+    textPrintf(text, "dsc_telegram_delivery_ms_sum{recipient=\"%u\"} %llu\n", idx, (unsigned long long)stats.sumMs);
+    textPrintf(text, "dsc_telegram_delivery_ms_count{recipient=\"%u\"} %lu\n", idx, (unsigned long)stats.sent);
+  }
+  textAppend(text, "# TYPE dsc_telegram_delivery_ms_max gauge\n");
+  for (byte idx = 0; idx < recipientCount; idx++) {
+    textPrintf(text, "dsc_telegram_delivery_ms_max{recipient=\"%u\"} %lu\n", idx, (unsigned long)telegramRecipient(idx).stats.maxMs);
+  }
+  textAppend(text, "# TYPE dsc_telegram_delivery_failures_total counter\n");
+  for (byte idx = 0; idx < recipientCount; idx++) {
+    textPrintf(text, "dsc_telegram_delivery_failures_total{recipient=\"%u\"} %lu\n", idx, (unsigned long)telegramRecipient(idx).stats.failures);
+  }
+
+  return text.overflow ? 0 : text.length;
+}
@@ -0,0 +1,86 @@
+/**
+   Chats that receive Telegram notifications, each with the event classes
+   it subscribed to, and their delivery statistics. The list is read from
+   the `telegram_recipients` setting: entries separated by commas or
+   spaces, each a chat ID with optional classes joined by '+':
+
+     -1001234567,25235518:alarm+trouble
+
+   Class names are alarm, arming, trouble and system; an entry without
+   classes gets all of them. The command chat `telegram_chat_id` always
+   receives everything unless the list names it with other classes.
+
+   The list and the message prefix change from the network task while the
+   Telegram task delivers: it takes a snapshot of both once per batch.
+*/
+#ifndef TELEGRAM_RECIPIENTS_H
+#define TELEGRAM_RECIPIENTS_H
+
+#include <Arduino.h>
+#include "settings.h"
+#include "telegram_queue.h"
+
+typedef struct {
+  uint32_t sent;
+  uint32_t failures;
+  uint32_t lastMs;            // Duration of the last delivery, successful or not
+  uint32_t maxMs;
+  uint64_t sumMs;             // Of the successful deliveries
+} tsRecipientStats;
+
+typedef struct {
+  char chatId[TELEGRAM_CHAT_ID_LEN];
+  uint8_t classes;            // teTelegramClass bits
+  tsRecipientStats stats;
+} tsTelegramRecipient;
+
+typedef struct {
+  char prefix[TELEGRAM_MSG_PREFIX_LEN];
+  tsTelegramRecipient recipients[TELEGRAM_RECIPIENTS_MAX];
+  byte count;
+} tsTelegramRecipients;
+
+/**
+   Build the list from `commandChatId` and the `list` setting, dropping
+   entries that are too long, repeated or name an unknown class. Returns
+   the number of recipients, at most TELEGRAM_RECIPIENTS_MAX. Called again
+   when the settings change, chats listed before keep their statistics.
+*/
+byte telegramRecipientsBegin(const char* commandChatId, const char* list);
+
+/**
+   Set the prefix put before every notification, truncated to
+   TELEGRAM_MSG_PREFIX_LEN - 1 characters.
+*/
+void telegramRecipientsPrefix(const char* prefix);
+
+byte telegramRecipientsCount();
+
+/**
+   Consistent copy of the list and the prefix into `snapshot`.
+*/
+void telegramRecipientsSnapshot(tsTelegramRecipients &snapshot);
+
+/**
+   Recipient `index`, its statistics a consistent copy.
+*/
+tsTelegramRecipient telegramRecipient(const byte index);
+
+/**
+   Record a delivery to chat `chatId` that took `ms`, ignored if the chat
+   left the list meanwhile.
+*/
+void telegramRecipientRecord(const char* chatId, const bool delivered, const uint32_t ms);
+
+/**
+   Classes in a '+' separated list of names, 0 if a name is unknown.
+*/
+uint8_t telegramClassesParse(const char* names, const size_t length);
+
+/**
+   Prometheus text of the delivery counters and latency per recipient,
+   labelled by position in the list rather than chat ID.
+*/
+size_t telegramRecipientsFormat(char* buffer, const size_t size);
+
+#endif
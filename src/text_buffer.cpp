@@ -0,0 +1,57 @@
+#include "text_buffer.h"
+
+#include <stdarg.h>
+
+void textBegin(tsTextBuffer &text, char* buffer, const size_t size) {
+  text.buffer = buffer;
+  text.size = size;
+  text.length = 0;
+  text.overflow = size == 0;
+  if (size) buffer[0] = 0x00;
+}
+
+bool textAppend(tsTextBuffer &text, const char* s) {
+  if (text.overflow) return false;
+  size_t length = strlen(s);
+  if (length >= text.size - text.length) {
+    text.overflow = true;
+    return false;
+  }
+  memcpy(text.buffer + text.length, s, length + 1);
+  text.length += length;
+  return true;
+}
+
+bool textPrintf(tsTextBuffer &text, const char* format, ...) {
+  if (text.overflow) return false;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(text.buffer + text.length, text.size - text.length, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= text.size - text.length) {
+    text.buffer[text.length] = 0x00;
+    text.overflow = true;
+    return false;
+  }
+  text.length += written;
+  return true;
+}
+
+bool textAppendJson(tsTextBuffer &text, const char* s) {
+  if (text.overflow) return false;
+  size_t length = text.length;
+  bool ok = textAppend(text, "\"");
+  for (; ok && *s != 0; s++) {
+    char c = *s;
+    if (c == '"' || c == '\\') ok = textPrintf(text, "\\%c", c);
+    else if ((unsigned char)c < 0x20) ok = textPrintf(text, "\\u%04x", c);
+    else ok = textPrintf(text, "%c", c);
+  }
+  if (ok) ok = textAppend(text, "\"");
+  // A string is written whole or not at all
+  if (!ok) {
+    text.length = length;
+    text.buffer[length] = 0x00;
+  }
+  return ok;
+}
@@ -0,0 +1,41 @@
+/**
+   Bounded text formatting into a caller supplied buffer, without heap
+   allocation. Every outbound message is built with it. A piece that does
+   not fit is not written and marks the buffer as overflowed; everything
+   appended before it stays in place and null terminated.
+*/
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include <Arduino.h>
+
+typedef struct {
+  char* buffer;
+  size_t size;
+  size_t length;
+  bool overflow;
+} tsTextBuffer;
+
+/**
+   Start an empty text in `buffer` of `size` bytes.
+*/
+void textBegin(tsTextBuffer &text, char* buffer, const size_t size);
+
+/**
+   Append `s`. Returns false, and leaves the text unchanged, if it does not
+   fit or the text has overflowed before.
+*/
+bool textAppend(tsTextBuffer &text, const char* s);
+
+/**
+   Append printf style formatted text, same rules as textAppend().
+*/
+bool textPrintf(tsTextBuffer &text, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+   Append `s` as a quoted JSON string, escaping quotes, backslashes and
+   control characters. Same rules as textAppend().
+*/
+bool textAppendJson(tsTextBuffer &text, const char* s);
+
+#endif
@@ -0,0 +1,36 @@
+#include "tls_client.h"
+#include "settings.h"
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  if (backingOff()) return 0;
+  unsigned long started = millis();
+  return recordHandshake(WiFiClientSecure::connect(host, port), started);
+}
+
+int TlsClient::connect(const char* host, uint16_t port, int32_t timeout) {
+  if (backingOff()) return 0;
+  unsigned long started = millis();
+  return recordHandshake(WiFiClientSecure::connect(host, port, timeout), started);
+}
+
+bool TlsClient::backingOff() {
+  if (failures_ == 0 || (long)(millis() - retryTime_) >= 0) return false;
+  stats_.refused++;
+  return true;
+}
+
+int TlsClient::recordHandshake(const int connected, const unsigned long started) {
+  if (connected) {
+    stats_.handshakes++;
+    stats_.handshakeMs += millis() - started;
+    failures_ = 0;
+    return connected;
+  }
+
+  stats_.failures++;
+  unsigned long backoff = (unsigned long)TLS_BACKOFF_MIN_MS << min(failures_, (byte)16);
+  if (backoff > TLS_BACKOFF_MAX_MS) backoff = TLS_BACKOFF_MAX_MS;
+  retryTime_ = millis() + backoff;
+  if (failures_ < 255) failures_++;
+  return connected;
+}
@@ -0,0 +1,42 @@
+/**
+   WiFiClientSecure that keeps one TLS session to the Telegram API open for
+   every request made through it: the bot's long polls and replies, file
+   downloads and firmware updates. The libraries only connect when they find
+   the connection closed, so each connect() is a full handshake; those are
+   counted and timed, and after a failed one further attempts are refused
+   until a backoff delay has passed, rather than each request spending up
+   to the handshake timeout on an unreachable server.
+*/
+#ifndef TLS_CLIENT_H
+#define TLS_CLIENT_H
+
+#include <WiFiClientSecure.h>
+
+typedef struct {
+  uint32_t handshakes;        // Successful handshakes
+  uint32_t failures;          // Failed handshakes
+  uint32_t refused;           // Connects refused during backoff
+  uint32_t handshakeMs;       // Total time of successful handshakes
+} tsTlsStats;
+
+class TlsClient : public WiFiClientSecure {
+ public:
+  using WiFiClientSecure::connect;
+  int connect(const char* host, uint16_t port) override;
+  int connect(const char* host, uint16_t port, int32_t timeout) override;
+
+  const tsTlsStats &stats() const { return stats_; }
+
+  // Mean time of a successful handshake
+  uint32_t meanHandshakeMs() const { return stats_.handshakes ? stats_.handshakeMs / stats_.handshakes : 0; }
+
+ private:
+  bool backingOff();
+  int recordHandshake(const int connected, const unsigned long started);
+
+  tsTlsStats stats_ = {};
+  unsigned long retryTime_ = 0;
+  byte failures_ = 0;
+};
+
+#endif
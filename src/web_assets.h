@@ -0,0 +1,96 @@
+/**
+   Web UI assets, gzipped at build time and sent as they are with
+   Content-Encoding: gzip. Generated by tools/web_assets.py from web/,
+   do not edit.
+*/
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+
+typedef struct {
+  const char* uri;
+  const char* type;
+  const uint8_t* data;
+  size_t length;
+  const char* etag;             // Quoted, from the uncompressed content
+} tsWebAsset;
+
+// index.html: 2388 bytes, 1101 gzipped
+static const uint8_t webAsset0[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x85, 0x56, 0x6d, 0x6f, 0xdb, 0x36,
+  0x10, 0xfe, 0xee, 0x5f, 0x71, 0x55, 0xb0, 0x41, 0x46, 0x6c, 0xd9, 0xd9, 0xda, 0x66, 0xf0, 0xdb,
+  0x90, 0x25, 0xe9, 0x5a, 0xac, 0x6f, 0x58, 0x3d, 0x0c, 0xdb, 0xb0, 0x0f, 0xb4, 0x78, 0xb2, 0xd8,
+  0x4a, 0xa4, 0x40, 0x52, 0x71, 0xdc, 0xb5, 0xff, 0x7d, 0x77, 0x94, 0x64, 0xab, 0x09, 0xd2, 0x26,
+  0x48, 0xa4, 0x3b, 0xde, 0xf3, 0xdc, 0xf1, 0x5e, 0x48, 0x2d, 0x1e, 0x5d, 0xbd, 0xb9, 0x5c, 0xff,
+  0xf5, 0xf6, 0x1a, 0x72, 0x5f, 0x16, 0xab, 0xc1, 0xa2, 0x7b, 0xa0, 0x90, 0xf4, 0x28, 0xd1, 0x0b,
+  0x48, 0x73, 0x61, 0x1d, 0xfa, 0x65, 0x54, 0xfb, 0x6c, 0xfc, 0x53, 0xd4, 0xa9, 0xb5, 0x28, 0x71,
+  0x19, 0xdd, 0x28, 0xdc, 0x55, 0xc6, 0xfa, 0x08, 0x52, 0xa3, 0x3d, 0x6a, 0x32, 0xdb, 0x29, 0xe9,
+  0xf3, 0xa5, 0xc4, 0x1b, 0x95, 0xe2, 0x38, 0x08, 0x23, 0x50, 0x5a, 0x79, 0x25, 0x8a, 0xb1, 0x4b,
+  0x45, 0x81, 0xcb, 0xb3, 0x64, 0xca, 0x34, 0x5e, 0xf9, 0x02, 0x57, 0x7f, 0xaa, 0x67, 0x0a, 0xae,
+  0xde, 0x5d, 0x2e, 0x26, 0x8d, 0x3c, 0x58, 0x38, 0xbf, 0xe7, 0xe7, 0xc6, 0xc8, 0x3d, 0xfc, 0x07,
+  0x1b, 0x91, 0x7e, 0xd8, 0x5a, 0x53, 0x6b, 0x39, 0x4e, 0x4d, 0x61, 0xec, 0x0c, 0x4e, 0x9e, 0x4c,
+  0xf9, 0x77, 0x0e, 0xad, 0xbc, 0xcb, 0x95, 0xc7, 0x39, 0x64, 0x14, 0xc0, 0x38, 0x13, 0xa5, 0x2a,
+  0xf6, 0x33, 0xb8, 0xb0, 0xe4, 0x6e, 0x04, 0xcf, 0xb1, 0xb8, 0x41, 0xaf, 0x52, 0x31, 0x02, 0x27,
+  0xb4, 0x1b, 0x3b, 0xb4, 0x2a, 0x9b, 0x43, 0x29, 0xec, 0x56, 0xe9, 0x19, 0x9c, 0x61, 0x09, 0xa2,
+  0xf6, 0x86, 0x35, 0xb7, 0x4d, 0xac, 0x33, 0x78, 0x3c, 0xc5, 0x72, 0x0e, 0x9f, 0x07, 0x5e, 0x6c,
+  0x0a, 0xe4, 0x00, 0x8c, 0x95, 0x68, 0xd9, 0x79, 0x21, 0x2a, 0x87, 0x33, 0xe8, 0xde, 0xe6, 0xd0,
+  0x22, 0xce, 0xa6, 0xd3, 0xef, 0x02, 0x42, 0x8e, 0xc0, 0xe7, 0x47, 0xc8, 0xc6, 0x78, 0x6f, 0x4a,
+  0x5a, 0xaf, 0x6e, 0xc1, 0x99, 0x42, 0x49, 0x38, 0x39, 0x3f, 0x3f, 0x9f, 0x43, 0x25, 0xa4, 0x54,
+  0x7a, 0x4b, 0xae, 0xaa, 0xdb, 0x39, 0x78, 0xbc, 0xf5, 0x63, 0x51, 0xa8, 0x2d, 0x05, 0x54, 0x60,
+  0xe6, 0x99, 0x29, 0x11, 0x85, 0xb0, 0x25, 0x31, 0x75, 0x5b, 0xce, 0xb2, 0xa7, 0xd3, 0xa7, 0xd3,
+  0x76, 0x93, 0x3b, 0x54, 0xdb, 0xdc, 0xcf, 0xc8, 0x4d, 0x21, 0xd9, 0xfa, 0xc4, 0x79, 0xe1, 0x6b,
+  0xd7, 0x33, 0xdf, 0x6c, 0x36, 0xad, 0xad, 0x53, 0x1f, 0x29, 0x64, 0x57, 0x8a, 0xa2, 0x60, 0xd3,
+  0xc5, 0xa4, 0xcd, 0xee, 0x62, 0xd2, 0xd6, 0x98, 0xd3, 0xcc, 0x15, 0x3f, 0xeb, 0x55, 0x82, 0x04,
+  0x2a, 0x0f, 0xef, 0x9f, 0x9f, 0xc1, 0x70, 0xe1, 0x2d, 0xfd, 0xe5, 0xab, 0xb7, 0xc2, 0x52, 0x9d,
+  0x94, 0xd1, 0x54, 0xaf, 0x3c, 0x68, 0x2e, 0x6c, 0x89, 0xf2, 0x20, 0xfd, 0x4e, 0xc6, 0xfb, 0x83,
+  0x74, 0x7d, 0xab, 0x3c, 0x48, 0x2c, 0xc4, 0x51, 0x75, 0xc1, 0x3b, 0x3b, 0x48, 0xcf, 0x94, 0xc5,
+  0x46, 0x98, 0xb0, 0x83, 0x89, 0x6f, 0xa3, 0xf2, 0xa1, 0xfa, 0x4a, 0x2e, 0xa3, 0xaa, 0x73, 0xe8,
+  0x22, 0x5e, 0x6f, 0xc3, 0x9d, 0x74, 0xd1, 0x55, 0xab, 0x37, 0x15, 0x6a, 0xf8, 0x68, 0x34, 0xba,
+  0x19, 0x2c, 0x5c, 0x25, 0x74, 0x80, 0x19, 0xd2, 0x32, 0x80, 0x15, 0xf4, 0xa8, 0x82, 0x69, 0xf0,
+  0x7d, 0xdf, 0x36, 0x24, 0xdb, 0x51, 0x0b, 0x17, 0xc2, 0xb9, 0x56, 0xbc, 0x87, 0x5d, 0x53, 0x0f,
+  0x92, 0xcb, 0x2f, 0x80, 0xbe, 0xd5, 0xdd, 0x35, 0x0e, 0x8b, 0x4d, 0x51, 0xa2, 0x03, 0xc1, 0x42,
+  0x40, 0x6e, 0x31, 0x5b, 0x46, 0x93, 0x68, 0x75, 0x69, 0x74, 0xa6, 0xb6, 0xb5, 0x15, 0x4d, 0x26,
+  0xc5, 0x0a, 0xbe, 0x2f, 0x95, 0x94, 0x86, 0x8a, 0x7f, 0x34, 0x13, 0x95, 0x9a, 0x30, 0x09, 0x46,
+  0xab, 0xe3, 0xfb, 0xd7, 0x8c, 0xd3, 0xc0, 0xda, 0x5a, 0x37, 0x02, 0x9b, 0x37, 0x01, 0xb8, 0xd4,
+  0xaa, 0xca, 0xaf, 0x06, 0x93, 0x09, 0xac, 0x73, 0x84, 0x8d, 0x35, 0x3b, 0x9a, 0x06, 0xb0, 0x78,
+  0x43, 0xbd, 0x27, 0x89, 0xd9, 0x51, 0x3b, 0x53, 0xf7, 0xbe, 0xc8, 0xc6, 0xaf, 0x29, 0x41, 0xe3,
+  0x57, 0xc2, 0xa7, 0x34, 0xb9, 0xb4, 0xd3, 0x5a, 0xd3, 0x11, 0xa0, 0xb7, 0x28, 0x21, 0x44, 0x40,
+  0x4d, 0xe6, 0xbc, 0x03, 0x01, 0x3f, 0x4e, 0x1f, 0x0f, 0x32, 0x5a, 0xe4, 0x3d, 0x84, 0x2e, 0x8e,
+  0x15, 0x0d, 0x00, 0xd1, 0xd5, 0x38, 0xa4, 0x5e, 0x94, 0x26, 0xad, 0x4b, 0x3a, 0x11, 0x92, 0x2d,
+  0xfa, 0xeb, 0x02, 0xf9, 0xf5, 0x97, 0xfd, 0x0b, 0x49, 0x46, 0xc3, 0x84, 0xad, 0x2f, 0x9b, 0x03,
+  0x03, 0x96, 0x0d, 0x84, 0xbb, 0xf3, 0x48, 0x67, 0x51, 0xd3, 0x04, 0xc5, 0xc1, 0x21, 0x91, 0x0d,
+  0x80, 0x8c, 0x28, 0x58, 0x8a, 0x99, 0xec, 0xa3, 0x68, 0x4e, 0x8a, 0xb0, 0x96, 0x1c, 0xdb, 0x23,
+  0xc9, 0x8c, 0xbd, 0x16, 0x69, 0x1e, 0x1f, 0x48, 0xe2, 0xaa, 0x81, 0x42, 0x03, 0x3c, 0x25, 0x64,
+  0xd3, 0xc6, 0x72, 0x15, 0xc1, 0x29, 0x54, 0x47, 0x30, 0x49, 0x11, 0xf5, 0x94, 0xec, 0xad, 0x09,
+  0x6e, 0xeb, 0x7b, 0xfa, 0xb8, 0x4a, 0x2c, 0x77, 0x38, 0xfc, 0x0c, 0xd1, 0x9e, 0x0a, 0x0f, 0x33,
+  0x88, 0xb4, 0x89, 0x86, 0x70, 0x1a, 0xfc, 0x74, 0x3f, 0x77, 0xc9, 0x90, 0xe6, 0xe0, 0x8a, 0xc7,
+  0xa0, 0x4f, 0xd8, 0xf2, 0x35, 0xa3, 0x4e, 0x7c, 0x6d, 0xff, 0x05, 0x79, 0xd5, 0x91, 0xaf, 0xbe,
+  0xc6, 0xde, 0x32, 0x64, 0x34, 0x44, 0xdf, 0x22, 0xe8, 0x40, 0x3c, 0x66, 0x21, 0x7d, 0x9f, 0x87,
+  0xfc, 0xff, 0xa1, 0x22, 0xf5, 0xc7, 0x6e, 0x98, 0x28, 0xad, 0xd1, 0x3e, 0x5f, 0xbf, 0x7a, 0x49,
+  0xc9, 0xe7, 0x54, 0x32, 0x32, 0x14, 0xbc, 0x19, 0xb3, 0x51, 0x5b, 0x0b, 0x16, 0xfe, 0xe6, 0xe1,
+  0x4a, 0xde, 0x1b, 0xa5, 0x63, 0xd2, 0x93, 0xe7, 0x4f, 0x9f, 0x38, 0x43, 0x1a, 0xa3, 0xe1, 0x11,
+  0xd5, 0x0e, 0x5c, 0x87, 0x0b, 0xe2, 0x37, 0x80, 0x5c, 0xfe, 0x6e, 0xdc, 0x28, 0x8a, 0x7f, 0xfe,
+  0x65, 0xa5, 0xca, 0xa0, 0x69, 0x91, 0xa4, 0x5d, 0x1a, 0x1e, 0x6c, 0x92, 0xaa, 0x76, 0x39, 0x6f,
+  0x43, 0x63, 0xd1, 0x30, 0x1c, 0x8d, 0x2b, 0xb3, 0x43, 0xbb, 0x7e, 0x00, 0x71, 0x71, 0x09, 0x61,
+  0xfd, 0x2e, 0x68, 0x23, 0xbc, 0x47, 0xbb, 0x7f, 0x08, 0xd6, 0x2e, 0x1f, 0x51, 0x8f, 0x1a, 0xd8,
+  0x07, 0xdc, 0x6f, 0x6a, 0x47, 0xbd, 0xae, 0x31, 0xf5, 0x28, 0xef, 0xe1, 0x7e, 0x0b, 0xeb, 0x20,
+  0x95, 0x4b, 0x3b, 0x9b, 0x7e, 0xa6, 0x0e, 0x27, 0xcc, 0xe8, 0x08, 0x7c, 0x20, 0x47, 0xfd, 0xf1,
+  0xa9, 0xe8, 0x8a, 0x8a, 0x9b, 0xe6, 0xcf, 0x90, 0xe6, 0x38, 0xee, 0x9f, 0x26, 0x23, 0xbe, 0x28,
+  0x68, 0x50, 0x30, 0xf4, 0xee, 0x38, 0xbc, 0x46, 0xd4, 0x0f, 0xa1, 0xc7, 0x12, 0x3a, 0x81, 0x75,
+  0x6f, 0x84, 0x2c, 0xba, 0x8a, 0x9a, 0x20, 0x4c, 0xb4, 0x45, 0x5f, 0x5b, 0x9e, 0xcd, 0x46, 0x95,
+  0xbc, 0x77, 0x46, 0xc7, 0xc3, 0xf9, 0x43, 0xd0, 0x6e, 0x78, 0xbf, 0x1c, 0xe6, 0x79, 0xbb, 0xb3,
+  0xf6, 0x78, 0xa4, 0x6d, 0xfc, 0x51, 0xf1, 0xf1, 0x23, 0x81, 0xbb, 0x59, 0xe3, 0x0e, 0xae, 0x48,
+  0x8a, 0xe9, 0x8c, 0x30, 0x2f, 0x0d, 0x7f, 0x2e, 0xac, 0x55, 0x89, 0xef, 0xbc, 0xa5, 0x0b, 0x33,
+  0x1e, 0xf6, 0x9c, 0xa5, 0x7c, 0x3e, 0xf5, 0xbc, 0xb1, 0xa3, 0xbb, 0xcc, 0xbf, 0x12, 0xd3, 0x8e,
+  0x86, 0xae, 0xd6, 0x34, 0xb4, 0x74, 0x88, 0x51, 0xfa, 0xa2, 0x1e, 0x45, 0xa6, 0x34, 0x5d, 0x8b,
+  0xfb, 0x3b, 0x24, 0xf4, 0xad, 0xc3, 0x2e, 0x4d, 0xed, 0x63, 0x4e, 0xe3, 0x08, 0x7e, 0x98, 0x4e,
+  0xa7, 0x01, 0xc5, 0x39, 0x6e, 0x32, 0x3b, 0xe7, 0x8b, 0xb4, 0x3d, 0x50, 0x17, 0x93, 0xee, 0x4e,
+  0x6a, 0x3e, 0x9e, 0xfe, 0x07, 0x5b, 0x0c, 0x72, 0xb6, 0x54, 0x09, 0x00, 0x00,
+};
+
+static const tsWebAsset webAssets[] = {
+  { "/ui", "text/html", webAsset0, sizeof(webAsset0), "\"540939fce44f31f3\"" },
+};
+
+#endif
@@ -0,0 +1,293 @@
+/**
+   Host stand-in for the Arduino core, just enough of it to build the gateway
+   sources with the native PlatformIO environment. Time is virtual: millis()
+   and micros() only advance through delay() or mockAdvanceMillis().
+*/
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define PROGMEM
+#define LOW  0x0
+#define HIGH 0x1
+#define INPUT  0x01
+#define OUTPUT 0x03
+#define HEX 16
+#define DEC 10
+
+#define F(s) (s)
+#define PSTR(s) (s)
+#define FPSTR(p) (p)
+typedef char __FlashStringHelper;
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+using std::max;
+using std::min;
+
+inline unsigned long &mockMillisRef() { static unsigned long ms = 0; return ms; }
+inline unsigned long &mockMicrosRef() { static unsigned long us = 0; return us; }
+
+inline unsigned long millis() { return mockMillisRef(); }
+inline unsigned long micros() { return mockMicrosRef(); }
+inline void mockAdvanceMicros(unsigned long us) {
+  mockMicrosRef() += us;
+  mockMillisRef() = mockMicrosRef() / 1000;
+}
+inline void mockAdvanceMillis(unsigned long ms) { mockAdvanceMicros(ms * 1000); }
+inline void delay(unsigned long ms) { mockAdvanceMillis(ms); }
+inline void delayMicroseconds(unsigned int us) { mockAdvanceMicros(us); }
+inline void yield() {}
+
+inline long random(long howbig) { return howbig ? rand() % howbig : 0; }
+inline long random(long howsmall, long howbig) { return howsmall + random(howbig - howsmall); }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+
+inline char *itoa(int value, char *str, int base) {
+  if (base == 16) sprintf(str, "%x", value);
+  else sprintf(str, "%d", value);
+  return str;
+}
+
+inline char *ultoa(unsigned long value, char *str, int base) {
+  if (base == 16) sprintf(str, "%lx", value);
+  else sprintf(str, "%lu", value);
+  return str;
+}
+
+class String {
+ public:
+  String() {}
+  String(const char *s) : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v, unsigned char base = DEC) { fromLong(v, base); }
+  String(unsigned int v, unsigned char base = DEC) { fromULong(v, base); }
+  String(long v, unsigned char base = DEC) { fromLong(v, base); }
+  String(unsigned long v, unsigned char base = DEC) { fromULong(v, base); }
+  String(long long v, unsigned char base = DEC) { fromLong((long)v, base); }
+  String(unsigned long long v, unsigned char base = DEC) { fromULong((unsigned long)v, base); }
+  String(unsigned char v, unsigned char base = DEC) { fromULong(v, base); }
+  String(float v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+  String(double v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.length(); }
+  bool isEmpty() const { return s_.empty(); }
+  bool reserve(unsigned int size) { s_.reserve(size); return true; }
+
+  String &operator+=(const String &rhs) { s_ += rhs.s_; return *this; }
+  String &operator+=(const char *rhs) { if (rhs) s_ += rhs; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  String &operator+=(int v) { return *this += String(v); }
+  String &operator+=(unsigned int v) { return *this += String(v); }
+  String &operator+=(long v) { return *this += String(v); }
+  String &operator+=(unsigned long v) { return *this += String(v); }
+  String &operator+=(long long v) { return *this += String(v); }
+  String &operator+=(unsigned char v) { return *this += String(v); }
+  bool concat(const char *s) { *this += s; return true; }
+
+  bool operator==(const String &rhs) const { return s_ == rhs.s_; }
+  bool operator==(const char *rhs) const { return rhs ? s_ == rhs : s_.empty(); }
+  bool operator!=(const String &rhs) const { return !(*this == rhs); }
+  bool operator!=(const char *rhs) const { return !(*this == rhs); }
+  char operator[](unsigned int idx) const { return idx < s_.length() ? s_[idx] : 0; }
+  char charAt(unsigned int idx) const { return (*this)[idx]; }
+
+  bool startsWith(const String &prefix) const { return s_.compare(0, prefix.s_.length(), prefix.s_) == 0; }
+  bool endsWith(const String &suffix) const {
+    return s_.length() >= suffix.s_.length() &&
+           s_.compare(s_.length() - suffix.s_.length(), suffix.s_.length(), suffix.s_) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t p = s_.find(c, from);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  int indexOf(const String &str, unsigned int from = 0) const {
+    size_t p = s_.find(str.s_, from);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  int lastIndexOf(char c) const {
+    size_t p = s_.rfind(c);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  String substring(unsigned int from) const { return from < s_.length() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) { unsigned int t = from; from = to; to = t; }
+    if (from >= s_.length()) return String();
+    return String(s_.substr(from, to - from));
+  }
+  void toCharArray(char *buf, unsigned int bufsize) const {
+    if (!bufsize || !buf) return;
+    size_t n = s_.length() < bufsize - 1 ? s_.length() : bufsize - 1;
+    memcpy(buf, s_.data(), n);
+    buf[n] = 0;
+  }
+  long toInt() const { return atol(s_.c_str()); }
+  void trim() {
+    size_t b = s_.find_first_not_of(" \t\r\n");
+    size_t e = s_.find_last_not_of(" \t\r\n");
+    s_ = (b == std::string::npos) ? std::string() : s_.substr(b, e - b + 1);
+  }
+
+  friend String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+  friend String operator+(const String &a, const char *b) { String r(a); r += b; return r; }
+  friend String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+  friend String operator+(const String &a, char b) { String r(a); r += b; return r; }
+  friend String operator+(const String &a, int b) { String r(a); r += b; return r; }
+  friend String operator+(const String &a, unsigned int b) { String r(a); r += b; return r; }
+  friend String operator+(const String &a, long b) { String r(a); r += b; return r; }
+  friend String operator+(const String &a, unsigned long b) { String r(a); r += b; return r; }
+
+ private:
+  void fromLong(long v, unsigned char base) {
+    char buf[24];
+    if (base == HEX) snprintf(buf, sizeof(buf), "%lx", v);
+    else snprintf(buf, sizeof(buf), "%ld", v);
+    s_ = buf;
+  }
+  void fromULong(unsigned long v, unsigned char base) {
+    char buf[24];
+    if (base == HEX) snprintf(buf, sizeof(buf), "%lx", v);
+    else snprintf(buf, sizeof(buf), "%lu", v);
+    s_ = buf;
+  }
+  void fromDouble(double v, unsigned int decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    s_ = buf;
+  }
+
+  std::string s_;
+};
+
+class StringSumHelper : public String {
+ public:
+  StringSumHelper(const String &s) : String(s) {}
+};
+
+class Print;
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buf++);
+    return n;
+  }
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+  size_t write(const char *buf, size_t size) { return write((const uint8_t *)buf, size); }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(const Printable &p) { return p.printTo(*this); }
+  size_t print(int v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(long long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned long long v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(unsigned char v, int base = DEC) { return print(String(v, (unsigned char)base)); }
+  size_t print(double v, int digits = 2) { return print(String(v, (unsigned int)digits)); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(const T &v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n < 0) return 0;
+    return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+  }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+  virtual size_t readBytes(uint8_t *buffer, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+      int c = read();
+      if (c < 0) break;
+      buffer[n++] = (uint8_t)c;
+    }
+    return n;
+  }
+  void setTimeout(unsigned long) {}
+};
+
+// Serial output is swallowed unless MOCK_SERIAL_ECHO is set in the environment
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long) { echo_ = getenv("MOCK_SERIAL_ECHO") != nullptr; }
+  size_t write(uint8_t c) override {
+    if (echo_) fputc(c, stdout);
+    return 1;
+  }
+  using Print::write;
+
+ private:
+  bool echo_ = false;
+};
+
+inline HardwareSerial Serial;
+
+class EspClass {
+ public:
+  void restart() { restarts++; }
+  uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ULL; }
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getMinFreeHeap() { return 150000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+  uint32_t getCycleCount() { return (uint32_t)(micros() * 240UL); }
+  uint32_t getCpuFreqMHz() { return 240; }
+  int restarts = 0;
+};
+
+inline EspClass ESP;
+
+inline void configTime(long, int, const char *, const char * = nullptr, const char * = nullptr) {}
+
+// The ESP32 core pulls FreeRTOS in with Arduino.h
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MOCK_ARDUINO_OTA_H
+#define MOCK_ARDUINO_OTA_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+  typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+  ArduinoOTAClass &setPassword(const char *) { return *this; }
+  ArduinoOTAClass &setPasswordHash(const char *) { return *this; }
+  ArduinoOTAClass &setHostname(const char *) { return *this; }
+  ArduinoOTAClass &onStart(THandlerFunction fn) { startFn = fn; return *this; }
+  ArduinoOTAClass &onEnd(THandlerFunction fn) { endFn = fn; return *this; }
+  ArduinoOTAClass &onError(THandlerFunction_Error fn) { errorFn = fn; return *this; }
+  ArduinoOTAClass &onProgress(THandlerFunction_Progress fn) { progressFn = fn; return *this; }
+  void begin() {}
+  void handle() {}
+  int getCommand() { return U_FLASH; }
+
+  THandlerFunction startFn, endFn;
+  THandlerFunction_Error errorFn;
+  THandlerFunction_Progress progressFn;
+};
+
+inline ArduinoOTAClass ArduinoOTA;
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef MOCK_DNS_SERVER_H
+#define MOCK_DNS_SERVER_H
+
+class DNSServer {};
+
+#endif
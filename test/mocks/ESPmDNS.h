@@ -0,0 +1,14 @@
+#ifndef MOCK_ESPMDNS_H
+#define MOCK_ESPMDNS_H
+
+#include <Arduino.h>
+
+class MDNSResponder {
+ public:
+  bool begin(const char *) { return true; }
+  void addService(const char *, const char *, uint16_t) {}
+};
+
+inline MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,155 @@
+/**
+   Host stand-in for the ESP32 FS layer. Files live in memory and survive
+   until the test clears them with SPIFFS.mockReset().
+*/
+#ifndef MOCK_FS_H
+#define MOCK_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+typedef std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> MockFileMap;
+
+class File : public Stream {
+ public:
+  File() {}
+  File(MockFileMap *files, const std::string &path, std::shared_ptr<std::vector<uint8_t>> data, bool writable,
+       size_t pos)
+      : files_(files), path_(path), data_(data), writable_(writable), pos_(pos) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t size) override {
+    if (!data_ || !writable_) return 0;
+    if (pos_ + size > data_->size()) data_->resize(pos_ + size);
+    memcpy(data_->data() + pos_, buf, size);
+    pos_ += size;
+    return size;
+  }
+  using Print::write;
+
+  int available() override { return data_ ? (int)(data_->size() - pos_) : 0; }
+  int read() override { return (data_ && pos_ < data_->size()) ? (*data_)[pos_++] : -1; }
+  int peek() override { return (data_ && pos_ < data_->size()) ? (*data_)[pos_] : -1; }
+  size_t read(uint8_t *buf, size_t size) { return readBytes(buf, size); }
+  size_t readBytes(uint8_t *buf, size_t size) override {
+    if (!data_) return 0;
+    size_t n = data_->size() - pos_ < size ? data_->size() - pos_ : size;
+    memcpy(buf, data_->data() + pos_, n);
+    pos_ += n;
+    return n;
+  }
+  using Stream::readBytes;
+
+  bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+    if (!data_) return false;
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? pos_ : data_->size();
+    if (base + pos > data_->size()) return false;
+    pos_ = base + pos;
+    return true;
+  }
+  size_t position() const { return pos_; }
+  size_t size() const { return data_ ? data_->size() : 0; }
+  void flush() override {}
+  void close() { data_.reset(); }
+  const char *name() const { return path_.c_str(); }
+  const char *path() const { return path_.c_str(); }
+  bool isDirectory() const { return dir_; }
+
+  File openNextFile() {
+    if (!dir_ || !files_) return File();
+    auto it = files_->upper_bound(iter_);
+    if (it == files_->end()) return File();
+    iter_ = it->first;
+    return File(files_, it->first, it->second, false, 0);
+  }
+
+  explicit operator bool() const { return data_ != nullptr || dir_; }
+
+  static File directory(MockFileMap *files) {
+    File f;
+    f.files_ = files;
+    f.dir_ = true;
+    return f;
+  }
+
+ private:
+  MockFileMap *files_ = nullptr;
+  std::string path_;
+  std::shared_ptr<std::vector<uint8_t>> data_;
+  bool writable_ = false;
+  size_t pos_ = 0;
+  bool dir_ = false;
+  std::string iter_;
+};
+
+class FS {
+ public:
+  bool begin(bool = false) { return mounted_ = !mockMountFails; }
+  void end() { mounted_ = false; }
+  bool format() { files_.clear(); return true; }
+
+  bool exists(const char *path) { return files_.count(path) != 0; }
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path) { return files_.erase(path) != 0; }
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to) {
+    auto it = files_.find(from);
+    if (it == files_.end()) return false;
+    files_[to] = it->second;
+    files_.erase(it);
+    return true;
+  }
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+
+  File open(const char *path, const char *mode = FILE_READ, bool = false) {
+    if (strcmp(path, "/") == 0) return File::directory(&files_);
+    auto it = files_.find(path);
+    if (mode[0] == 'r') {
+      if (it == files_.end()) return File();
+      return File(&files_, path, it->second, mode[1] == '+', 0);
+    }
+    if (mode[0] == 'w' || it == files_.end()) {
+      auto data = std::make_shared<std::vector<uint8_t>>();
+      files_[path] = data;
+      return File(&files_, path, data, true, 0);
+    }
+    return File(&files_, path, it->second, true, it->second->size());
+  }
+  File open(const String &path, const char *mode = FILE_READ, bool create = false) {
+    return open(path.c_str(), mode, create);
+  }
+
+  size_t totalBytes() { return 1441792; }
+  size_t usedBytes() {
+    size_t used = 0;
+    for (auto &f : files_) used += f.second->size();
+    return used;
+  }
+
+  void mockReset() { files_.clear(); }
+  bool mockMountFails = false;
+
+ private:
+  MockFileMap files_;
+  bool mounted_ = false;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekSet;
+
+#endif
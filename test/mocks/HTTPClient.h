@@ -0,0 +1,96 @@
+/**
+   Host stand-in for the ESP32 HTTPClient. Requests are answered by
+   mockHttpServer: GET serves `body`, from the offset of a "Range:
+   bytes=<offset>-" header if one was added, a segment per available()
+   call like a TCP stream, each charging `segmentUs` of virtual time.
+   Setting `dropAt` closes the connection once the body has been sent up
+   to that offset, once.
+*/
+#ifndef MOCK_HTTP_CLIENT_H
+#define MOCK_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string>
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+struct MockHttpServer {
+  bool up = false;
+  bool ranges = true;             // Honours Range headers
+  std::string body;
+  size_t dropAt = SIZE_MAX;
+  size_t segment = 1460;          // Bytes available at a time
+  unsigned long segmentUs = 0;    // Virtual time to receive a segment
+  int requests = 0;
+  std::string lastRange;
+};
+
+inline MockHttpServer mockHttpServer;
+
+class MockHttpStream : public WiFiClient {
+ public:
+  void open(size_t offset) { position_ = offset; connected_ = true; }
+  int available() override {
+    if (!connected_) return 0;
+    size_t end = min(mockHttpServer.body.size(), mockHttpServer.dropAt);
+    return position_ < end ? (int)min(end - position_, mockHttpServer.segment) : 0;
+  }
+  int read() override {
+    uint8_t c;
+    return readBytes(&c, 1) == 1 ? c : -1;
+  }
+  size_t readBytes(uint8_t *buffer, size_t length) override {
+    size_t n = min(length, (size_t)available());
+    if (n) mockAdvanceMicros(mockHttpServer.segmentUs * n / mockHttpServer.segment);
+    memcpy(buffer, mockHttpServer.body.data() + position_, n);
+    position_ += n;
+    if (position_ == mockHttpServer.dropAt) {
+      mockHttpServer.dropAt = SIZE_MAX;
+      connected_ = false;
+    }
+    return n;
+  }
+  uint8_t connected() override { return connected_ && (available() > 0 || position_ < mockHttpServer.body.size()); }
+
+ private:
+  size_t position_ = 0;
+};
+
+class HTTPClient {
+ public:
+  bool begin(WiFiClient &client, const String &) { client_ = &client; range_.clear(); return true; }
+  bool begin(const String &) { range_.clear(); return true; }
+  void end() { client_ = nullptr; }
+  void setReuse(bool reuse) { reuse_ = reuse; }
+  void setTimeout(uint16_t) {}
+  void addHeader(const String &name, const String &value, bool = false, bool = true) {
+    if (name == "Range") range_ = value.c_str();
+  }
+  void collectHeaders(const char *[], const size_t) {}
+  String header(const char *) { return String(); }
+  int GET() {
+    mockHttpServer.requests++;
+    mockHttpServer.lastRange = range_;
+    if (!mockHttpServer.up) return HTTPC_ERROR_CONNECTION_REFUSED;
+    offset_ = 0;
+    if (mockHttpServer.ranges && range_.rfind("bytes=", 0) == 0) offset_ = strtoul(range_.c_str() + 6, nullptr, 10);
+    stream_.open(offset_);
+    return offset_ ? HTTP_CODE_PARTIAL_CONTENT : HTTP_CODE_OK;
+  }
+  int getSize() { return mockHttpServer.up ? (int)(mockHttpServer.body.size() - offset_) : -1; }
+  bool connected() { return stream_.connected(); }
+  WiFiClient *getStreamPtr() { return &stream_; }
+  WiFiClient &getStream() { return stream_; }
+
+ private:
+  WiFiClient *client_ = nullptr;
+  bool reuse_ = true;
+  std::string range_;
+  size_t offset_ = 0;
+  MockHttpStream stream_;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef MOCK_HTTP_UPDATE_H
+#define MOCK_HTTP_UPDATE_H
+
+#include <HTTPClient.h>
+
+enum HTTPUpdateResult { HTTP_UPDATE_FAILED, HTTP_UPDATE_NO_UPDATES, HTTP_UPDATE_OK };
+typedef HTTPUpdateResult t_httpUpdate_return;
+
+class HTTPUpdate {
+ public:
+  void rebootOnUpdate(bool reboot) { reboot_ = reboot; }
+  t_httpUpdate_return update(WiFiClient &, const String &) { return HTTP_UPDATE_FAILED; }
+  t_httpUpdate_return updateSpiffs(WiFiClient &, const String &) { return HTTP_UPDATE_FAILED; }
+  int getLastError() { return -1; }
+  String getLastErrorString() { return String("not supported on host"); }
+
+ private:
+  bool reboot_ = true;
+};
+
+inline HTTPUpdate httpUpdate;
+
+#endif
@@ -0,0 +1,117 @@
+/**
+   Host stand-in for knolleary/PubSubClient 2.8. Every publish is recorded in
+   `published` and mockDeliver() feeds an inbound message to the callback.
+   connect() costs virtual time like the library: opening the socket itself
+   waits out a blackholed broker, and a broker that takes the connection
+   but does not answer CONNECT is waited for up to the socket timeout.
+*/
+#ifndef MOCK_PUB_SUB_CLIENT_H
+#define MOCK_PUB_SUB_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include <functional>
+#include <vector>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+struct MockMqttMessage {
+  std::string topic;
+  std::string payload;
+  bool retained;
+};
+
+class PubSubClient {
+ public:
+  PubSubClient() {}
+  PubSubClient(const char *, uint16_t, Client &client) : client_(&client) {}
+
+  PubSubClient &setServer(const char *, uint16_t) { return *this; }
+  PubSubClient &setClient(Client &client) { client_ = &client; return *this; }
+  PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE) { this->callback = callback; return *this; }
+  PubSubClient &setKeepAlive(uint16_t) { return *this; }
+  PubSubClient &setSocketTimeout(uint16_t timeout) { socketTimeout = timeout; return *this; }
+  bool setBufferSize(uint16_t size) { bufferSize = size; return true; }
+  uint16_t getBufferSize() { return bufferSize; }
+
+  bool connect(const char *id) { return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr); }
+  bool connect(const char *, const char *, const char *, const char *, uint8_t, bool, const char *,
+               bool = true) {
+    connectAttempts++;
+    if (client_ == nullptr || !client_->connected()) {
+      if (mockBrokerMode == MOCK_BROKER_BLACKHOLE) mockAdvanceMillis(MOCK_TCP_CONNECT_TIMEOUT_MS);
+      if (mockBrokerMode != MOCK_BROKER_ACCEPT) {
+        state_ = MQTT_CONNECT_FAILED;
+        return false;
+      }
+    }
+    if (!mockBrokerUp) {
+      mockAdvanceMillis(socketTimeout * 1000UL);
+      state_ = MQTT_CONNECTION_TIMEOUT;
+      return false;
+    }
+    connected_ = true;
+    state_ = MQTT_CONNECTED;
+    return true;
+  }
+  void disconnect() { connected_ = false; state_ = MQTT_DISCONNECTED; }
+  bool connected() { return connected_; }
+  int state() { return state_; }
+  bool loop() { return connected_; }
+
+  bool publish(const char *topic, const char *payload) { return publish(topic, payload, false); }
+  bool publish(const char *topic, const char *payload, bool retained) {
+    return publish(topic, (const uint8_t *)payload, payload ? strlen(payload) : 0, retained);
+  }
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained) {
+    if (!connected_) return false;
+    published.push_back({topic, std::string((const char *)payload, length), retained});
+    return true;
+  }
+  bool beginPublish(const char *topic, unsigned int, bool retained) {
+    if (!connected_) return false;
+    published.push_back({topic, std::string(), retained});
+    return true;
+  }
+  size_t write(uint8_t c) { published.back().payload += (char)c; return 1; }
+  size_t write(const uint8_t *buf, size_t size) { published.back().payload.append((const char *)buf, size); return size; }
+  int endPublish() { return 1; }
+
+  bool subscribe(const char *topic, uint8_t = 0) {
+    if (!connected_) return false;
+    subscriptions.push_back(topic);
+    return true;
+  }
+  bool unsubscribe(const char *) { return connected_; }
+
+  // Test hooks
+  void mockDeliver(const char *topic, const char *payload) {
+    std::vector<char> t(topic, topic + strlen(topic) + 1);
+    std::vector<uint8_t> p(payload, payload + strlen(payload));
+    p.push_back(0);
+    if (callback) callback(t.data(), p.data(), (unsigned int)strlen(payload));
+  }
+  void mockDrop() { connected_ = false; state_ = MQTT_CONNECTION_LOST; }
+
+  MQTT_CALLBACK_SIGNATURE;
+  bool mockBrokerUp = true;
+  int connectAttempts = 0;
+  uint16_t bufferSize = 256;
+  uint16_t socketTimeout = 15;
+  std::vector<MockMqttMessage> published;
+  std::vector<std::string> subscriptions;
+
+ private:
+  Client *client_ = nullptr;
+  bool connected_ = false;
+  int state_ = MQTT_DISCONNECTED;
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef MOCK_SPIFFS_H
+#define MOCK_SPIFFS_H
+
+#include <FS.h>
+
+inline fs::FS SPIFFS;
+
+#endif
@@ -0,0 +1,144 @@
+/**
+   Host stand-in for witnessmenow/UniversalTelegramBot 1.3.0. Outgoing
+   messages are recorded in `sent`; tests queue inbound updates with
+   mockReceive() and they are returned by the next getUpdates().
+*/
+#ifndef MOCK_UNIVERSAL_TELEGRAM_BOT_H
+#define MOCK_UNIVERSAL_TELEGRAM_BOT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <deque>
+#include <vector>
+
+#define HANDLE_MESSAGES 1
+#define TELEGRAM_CERTIFICATE_ROOT ""
+#define TELEGRAM_HOST "api.telegram.org"
+#define TELEGRAM_SSL_PORT 443
+
+typedef bool (*MoreDataAvailable)();
+typedef byte (*GetNextByte)();
+typedef byte *(*GetNextBuffer)();
+typedef int(GetNextBufferLen)();
+
+struct telegramMessage {
+  String text;
+  String chat_id;
+  String chat_title;
+  String from_id;
+  String from_name;
+  String date;
+  String type;
+  String file_caption;
+  String file_path;
+  String file_name;
+  bool hasDocument = false;
+  long file_size = 0;
+  float longitude = 0;
+  float latitude = 0;
+  int update_id = 0;
+  int message_id = 0;
+  int reply_to_message_id = 0;
+  String reply_to_text;
+  String query_id;
+};
+
+struct MockTelegramSent {
+  std::string chat_id;
+  std::string text;
+};
+
+class UniversalTelegramBot {
+ public:
+  UniversalTelegramBot(const String &token, Client &client) : token_(token), client_(&client) {}
+
+  void updateToken(const String &token) { token_ = token; }
+  String getToken() { return token_; }
+
+  bool sendMessage(const String &chat_id, const String &text, const String & = "", int = 0) {
+    requests++;
+    if (!mockApiUp || !connect()) return false;
+    sent.push_back({chat_id.c_str(), text.c_str()});
+    return true;
+  }
+  bool sendChatAction(const String &, const String &) { requests++; return mockApiUp && connect(); }
+  bool setMyCommands(const String &) { requests++; return mockApiUp && connect(); }
+  String sendMultipartFormDataToTelegram(const String &, const String &, const String &fileName, const String &,
+                                         const String &chat_id, int fileSize,
+                                         MoreDataAvailable moreDataAvailableCallback, GetNextByte getNextByteCallback,
+                                         GetNextBuffer getNextBufferCallback,
+                                         GetNextBufferLen getNextBufferLenCallback) {
+    requests++;
+    std::string data;
+    while ((int)data.size() < fileSize && moreDataAvailableCallback()) {
+      if (getNextBufferCallback) {
+        int len = getNextBufferLenCallback();
+        byte *buf = getNextBufferCallback();
+        data.append((const char *)buf, len);
+      } else {
+        data += (char)getNextByteCallback();
+      }
+    }
+    if (!mockApiUp || !connect()) return String();
+    uploads.push_back({chat_id.c_str(), fileName.c_str()});
+    uploadedBytes += data.size();
+    return String("{\"ok\":true}");
+  }
+
+  int getUpdates(long offset) {
+    requests++;
+    lastOffset = offset;
+    if (!mockApiUp || !connect()) return 0;
+    while (!inbox_.empty() && inbox_.front().update_id < offset) inbox_.pop_front();
+    if (inbox_.empty()) return 0;
+    messages[0] = inbox_.front();
+    inbox_.pop_front();
+    last_message_received = messages[0].update_id;
+    return 1;
+  }
+
+  // Test hooks
+  void mockReceive(const String &chat_id, const String &text) {
+    telegramMessage message;
+    message.chat_id = chat_id;
+    message.text = text;
+    message.type = "message";
+    message.from_name = "Tester";
+    message.update_id = ++nextUpdateId_;
+    inbox_.push_back(message);
+  }
+
+  void mockReceiveDocument(const String &chat_id, const String &caption, const String &file_name,
+                           const String &file_path, long file_size) {
+    mockReceive(chat_id, "");
+    telegramMessage &message = inbox_.back();
+    message.hasDocument = true;
+    message.file_caption = caption;
+    message.file_name = file_name;
+    message.file_path = file_path;
+    message.file_size = file_size;
+  }
+
+  telegramMessage messages[HANDLE_MESSAGES];
+  long last_message_received = 0;
+  int longPoll = 0;
+  unsigned int waitForResponse = 1500;
+
+  bool mockApiUp = true;
+  int requests = 0;
+  long lastOffset = 0;
+  std::vector<MockTelegramSent> sent;
+  std::vector<MockTelegramSent> uploads;
+  size_t uploadedBytes = 0;
+
+ private:
+  // Like the library, a request reuses the open connection and only connects when it was closed
+  bool connect() { return client_->connected() || client_->connect(TELEGRAM_HOST, TELEGRAM_SSL_PORT); }
+
+  String token_;
+  Client *client_;
+  std::deque<telegramMessage> inbox_;
+  int nextUpdateId_ = 0;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/**
+   Host stand-in for the ESP32 WebServer. Tests dispatch a request with
+   mockRequest() and then read the captured status, headers and body.
+*/
+#ifndef MOCK_WEB_SERVER_H
+#define MOCK_WEB_SERVER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <WiFi.h>
+#include <functional>
+#include <map>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  WebServer(int port = 80) : port_(port) {}
+
+  void begin() {}
+  void handleClient() {}
+  void on(const String &uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn) { routes_.push_back({uri, method, fn}); }
+  void onNotFound(THandlerFunction fn) { notFound_ = fn; }
+
+  String uri() { return uri_; }
+  HTTPMethod method() { return method_; }
+  bool hasArg(const String &name) { return args_.count(name.c_str()) != 0; }
+  String arg(const String &name) {
+    auto it = args_.find(name.c_str());
+    return it == args_.end() ? String() : String(it->second);
+  }
+  bool hasHeader(const String &name) { return reqHeaders_.count(name.c_str()) != 0; }
+  String header(const String &name) {
+    auto it = reqHeaders_.find(name.c_str());
+    return it == reqHeaders_.end() ? String() : String(it->second);
+  }
+  void collectHeaders(const char *[], const size_t) {}
+
+  void setContentLength(size_t length) { contentLength = length; }
+  void sendHeader(const String &name, const String &value, bool = false) {
+    headers[name.c_str()] = value.c_str();
+  }
+  void send(int code, const char *type = nullptr, const String &content = String()) {
+    status = code;
+    contentType = type ? type : "";
+    body += content.c_str();
+    sends++;
+  }
+  void send(int code, const String &type, const String &content) { send(code, type.c_str(), content); }
+  void send_P(int code, const char *type, const char *content, size_t length) {
+    send(code, type, String());
+    body.append(content, length);
+  }
+  void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char *content, size_t length) {
+    body.append(content, length);
+    chunks++;
+  }
+  void sendContent(const char *content) { sendContent(content, strlen(content)); }
+  void sendContent_P(const char *content) { sendContent(content); }
+  void sendContent_P(const char *content, size_t length) { sendContent(content, length); }
+  template <typename T> size_t streamFile(T &file, const String &type, int code = 200) {
+    send(code, type.c_str(), String());
+    uint8_t buf[256];
+    size_t total = 0, n;
+    while ((n = file.read(buf, sizeof(buf))) > 0) {
+      body.append((const char *)buf, n);
+      total += n;
+    }
+    return total;
+  }
+  WiFiClient &client() { return client_; }
+
+  // Test hooks
+  bool mockRequest(const String &uri, HTTPMethod method = HTTP_GET,
+                   const std::map<std::string, std::string> &args = {},
+                   const std::map<std::string, std::string> &requestHeaders = {}) {
+    uri_ = uri;
+    method_ = method;
+    args_ = args;
+    reqHeaders_ = requestHeaders;
+    status = 0;
+    contentType.clear();
+    body.clear();
+    headers.clear();
+    contentLength = CONTENT_LENGTH_NOT_SET;
+    sends = chunks = 0;
+    for (auto &route : routes_) {
+      if (route.uri == uri && (route.method == HTTP_ANY || route.method == method)) {
+        route.fn();
+        return true;
+      }
+    }
+    if (notFound_) notFound_();
+    return false;
+  }
+
+  int status = 0;
+  std::string contentType;
+  std::string body;
+  std::map<std::string, std::string> headers;
+  size_t contentLength = CONTENT_LENGTH_NOT_SET;
+  int sends = 0;
+  int chunks = 0;
+
+ private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+  };
+
+  int port_;
+  std::vector<Route> routes_;
+  THandlerFunction notFound_;
+  String uri_;
+  HTTPMethod method_ = HTTP_GET;
+  std::map<std::string, std::string> args_;
+  std::map<std::string, std::string> reqHeaders_;
+  WiFiClient client_;
+};
+
+#endif
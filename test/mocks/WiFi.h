@@ -0,0 +1,89 @@
+#ifndef MOCK_WIFI_H
+#define MOCK_WIFI_H
+
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class IPAddress : public Printable {
+ public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets_{a, b, c, d} {}
+  uint8_t operator[](int index) const { return octets_[index]; }
+  bool fromString(const char *address) {
+    unsigned int a, b, c, d;
+    char tail;
+    if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+    octets_[0] = a; octets_[1] = b; octets_[2] = c; octets_[3] = d;
+    return true;
+  }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets_[0], octets_[1], octets_[2], octets_[3]);
+    return String(buf);
+  }
+  size_t printTo(Print &p) const override { return p.print(toString()); }
+
+ private:
+  uint8_t octets_[4];
+};
+
+class Client : public Stream {
+ public:
+  virtual int connect(const char *host, uint16_t port) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  virtual operator bool() { return connected(); }
+};
+
+// Plain TCP client; connect() fails unless a test opts in, so code paths
+// that talk to a broker or API can be exercised without a network
+class WiFiClient : public Client {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(int) : connected_(true) {}
+  int connect(const char *, uint16_t) override { return connected_ = mockConnectSucceeds; }
+  virtual int connect(const char *host, uint16_t port, int32_t) { return connect(host, port); }
+  int connect(IPAddress, uint16_t port) { return connect("", port); }
+  uint8_t connected() override { return connected_; }
+  void stop() override { connected_ = false; }
+  size_t write(uint8_t) override { return connected_ ? 1 : 0; }
+  size_t write(const uint8_t *, size_t size) override { return connected_ ? size : 0; }
+  using Print::write;
+  void setNoDelay(bool) {}
+  int setTimeout(uint32_t) { return 0; }
+  int fd() const { return connected_ ? 3 : -1; }
+
+  bool mockConnectSucceeds = false;
+
+ protected:
+  bool connected_ = false;
+};
+
+class WiFiClass {
+ public:
+  wl_status_t status() { return mockStatus; }
+  bool disconnect(bool = false) { return true; }
+  bool reconnect() { return true; }
+  IPAddress localIP() { return IPAddress(192, 168, 1, 161); }
+  String SSID() { return String("mock-ssid"); }
+  String psk() { return String("mock-psk"); }
+  int8_t RSSI() { return -55; }
+  int hostByName(const char *, IPAddress &result) { mockLookups++; result = IPAddress(127, 0, 0, 1); return 1; }
+  bool setHostname(const char *) { return true; }
+  bool mode(int) { return true; }
+  void setAutoReconnect(bool) {}
+
+  wl_status_t mockStatus = WL_CONNECTED;
+  unsigned mockLookups = 0;
+};
+
+inline WiFiClass WiFi;
+
+#endif
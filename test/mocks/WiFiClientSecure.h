@@ -0,0 +1,38 @@
+/**
+   Host stand-in for WiFiClientSecure, acting as a local HTTPS server that
+   accepts every connection. Each connect() is a full handshake: it is
+   counted and charges `mockHandshakeMs` of virtual time. The connection
+   then stays open until stop() or mockDrop(), like a keep-alive session.
+*/
+#ifndef MOCK_WIFI_CLIENT_SECURE_H
+#define MOCK_WIFI_CLIENT_SECURE_H
+
+#include <WiFi.h>
+
+class WiFiClientSecure : public WiFiClient {
+ public:
+  void setCACert(const char *) {}
+  void setInsecure() {}
+  void setHandshakeTimeout(unsigned long seconds) { handshakeTimeout = seconds; }
+
+  // Like the core, neither overload goes through the other
+  int connect(const char *, uint16_t) override { return handshake(); }
+  int connect(const char *, uint16_t, int32_t) override { return handshake(); }
+
+  // The server closes the connection, e.g. after its keep-alive timeout
+  void mockDrop() { connected_ = false; }
+
+  unsigned long handshakeTimeout = 0;
+  bool mockServerUp = true;
+  unsigned long mockHandshakeMs = 0;
+  int mockHandshakes = 0;
+
+ private:
+  int handshake() {
+    mockHandshakes++;
+    mockAdvanceMillis(mockHandshakeMs);
+    return connected_ = mockServerUp;
+  }
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef MOCK_WIFI_MANAGER_H
+#define MOCK_WIFI_MANAGER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+class WiFiManager {
+ public:
+  bool setHostname(const char *) { return true; }
+  void setSaveConfigCallback(void (*fn)(void)) { saveConfigCallback_ = fn; }
+  void setClass(const char *) {}
+  void setTimeout(unsigned long) {}
+  void setConfigPortalTimeout(unsigned long) {}
+  void setMinimumSignalQuality(int = 8) {}
+  void resetSettings() {}
+  bool autoConnect() { return WiFi.status() == WL_CONNECTED; }
+  bool autoConnect(const char *, const char * = nullptr) { return autoConnect(); }
+
+ private:
+  void (*saveConfigCallback_)(void) = nullptr;
+};
+
+#endif
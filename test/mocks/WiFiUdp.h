@@ -0,0 +1,8 @@
+#ifndef MOCK_WIFI_UDP_H
+#define MOCK_WIFI_UDP_H
+
+#include <WiFi.h>
+
+class WiFiUDP {};
+
+#endif
@@ -0,0 +1,108 @@
+/**
+   Host stand-in for taligentx/dscKeybusInterface 2.0. It exposes the public
+   status members the gateway reads and records everything written to the
+   virtual keypad, so tests can drive panel changes and inspect key presses.
+*/
+#ifndef MOCK_DSC_KEYBUS_INTERFACE_H
+#define MOCK_DSC_KEYBUS_INTERFACE_H
+
+#include <Arduino.h>
+
+#define dscPartitions 8
+#define dscZones 8
+#define dscReadSize 16
+#define dscBufferSize 50
+
+#define DSC_EXIT_STAY 1
+#define DSC_EXIT_AWAY 2
+#define DSC_EXIT_NO_ENTRY_DELAY 3
+
+class dscKeybusInterface {
+ public:
+  dscKeybusInterface(byte, byte, byte) {}
+
+  void begin(Stream & = Serial) { running = true; }
+  void stop() { running = false; }
+
+  // Each queued Keybus command makes one loop() call return true, which is
+  // how the library drains its ISR buffer
+  bool loop() {
+    loopCalls++;
+    if (mockPendingCommands == 0) return false;
+    mockPendingCommands--;
+    return true;
+  }
+
+  void resetStatus() {
+    statusChanged = true;
+    keybusChanged = true;
+    troubleChanged = true;
+    powerChanged = true;
+    batteryChanged = true;
+    for (byte partition = 0; partition < dscPartitions; partition++) {
+      readyChanged[partition] = true;
+      armedChanged[partition] = true;
+      alarmChanged[partition] = true;
+      fireChanged[partition] = true;
+    }
+    openZonesStatusChanged = true;
+    alarmZonesStatusChanged = true;
+    pgmOutputsStatusChanged = true;
+    for (byte zoneGroup = 0; zoneGroup < dscZones; zoneGroup++) {
+      openZonesChanged[zoneGroup] = 0xFF;
+      alarmZonesChanged[zoneGroup] = 0xFF;
+    }
+    pgmOutputsChanged[0] = 0xFF;
+    pgmOutputsChanged[1] = 0x3F;
+  }
+
+  void write(const char receivedKey) {
+    written += receivedKey;
+    writtenPartition = writePartition;
+  }
+  void write(const char *receivedKeys, bool = false) {
+    written += receivedKeys;
+    writtenPartition = writePartition;
+  }
+
+  bool writeReady = true;
+  byte writePartition = 1;
+  bool pauseStatus = false;
+  bool processModuleData = false;
+
+  bool statusChanged = false;
+  bool bufferOverflow = false;
+  bool keybusConnected = true, keybusChanged = false;
+  bool accessCodePrompt = false;
+  bool trouble = false, troubleChanged = false;
+  bool powerTrouble = false, powerChanged = false;
+  bool batteryTrouble = false, batteryChanged = false;
+  bool keypadFireAlarm = false, keypadAuxAlarm = false, keypadPanicAlarm = false;
+
+  bool ready[dscPartitions] = {}, readyChanged[dscPartitions] = {};
+  bool disabled[dscPartitions] = {};
+  bool armed[dscPartitions] = {}, armedAway[dscPartitions] = {}, armedStay[dscPartitions] = {};
+  bool noEntryDelay[dscPartitions] = {}, armedChanged[dscPartitions] = {};
+  bool alarm[dscPartitions] = {}, alarmChanged[dscPartitions] = {};
+  bool exitDelay[dscPartitions] = {}, exitDelayChanged[dscPartitions] = {};
+  byte exitState[dscPartitions] = {}, exitStateChanged[dscPartitions] = {};
+  bool entryDelay[dscPartitions] = {}, entryDelayChanged[dscPartitions] = {};
+  bool fire[dscPartitions] = {}, fireChanged[dscPartitions] = {};
+  byte status[dscPartitions] = {}, lights[dscPartitions] = {};
+
+  bool openZonesStatusChanged = false;
+  byte openZones[dscZones] = {}, openZonesChanged[dscZones] = {};
+  bool alarmZonesStatusChanged = false;
+  byte alarmZones[dscZones] = {}, alarmZonesChanged[dscZones] = {};
+  bool pgmOutputsStatusChanged = false;
+  byte pgmOutputs[2] = {}, pgmOutputsChanged[2] = {};
+
+  // Test hooks
+  bool running = false;
+  unsigned long loopCalls = 0;
+  unsigned int mockPendingCommands = 0;
+  String written;
+  byte writtenPartition = 0;
+};
+
+#endif
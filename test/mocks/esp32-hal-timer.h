@@ -0,0 +1,21 @@
+#ifndef MOCK_ESP32_HAL_TIMER_H
+#define MOCK_ESP32_HAL_TIMER_H
+
+#include <Arduino.h>
+
+struct hw_timer_t {
+  bool enabled;
+};
+
+inline hw_timer_t *timerBegin(uint8_t, uint16_t, bool) { static hw_timer_t timer; return &timer; }
+inline void timerEnd(hw_timer_t *timer) { timer->enabled = false; }
+inline void timerAttachInterrupt(hw_timer_t *, void (*)(), bool) {}
+inline void timerDetachInterrupt(hw_timer_t *) {}
+inline void timerAlarmWrite(hw_timer_t *, uint64_t, bool) {}
+inline void timerAlarmEnable(hw_timer_t *timer) { timer->enabled = true; }
+inline void timerWrite(hw_timer_t *, uint64_t) {}
+
+inline void ets_printf(const char *, ...) {}
+inline void esp_restart() { ESP.restart(); }
+
+#endif
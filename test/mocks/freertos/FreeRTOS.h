@@ -0,0 +1,53 @@
+/**
+   Host stand-in for the ESP-IDF FreeRTOS API. Tasks are recorded but never
+   started: tests call the task bodies' service functions directly so runs
+   stay deterministic. Queues are plain single-threaded FIFOs.
+*/
+#ifndef MOCK_FREERTOS_H
+#define MOCK_FREERTOS_H
+
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define errQUEUE_FULL 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define PRO_CPU_NUM 0
+#define APP_CPU_NUM 1
+
+struct MockTask {
+  const char *name;
+  TaskFunction_t fn;
+  UBaseType_t priority;
+  BaseType_t core;
+};
+typedef MockTask *TaskHandle_t;
+
+inline std::vector<MockTask> &mockTasks() { static std::vector<MockTask> tasks; return tasks; }
+
+typedef struct {
+  int owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+
+inline BaseType_t xPortGetCoreID() { return 1; }
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef MOCK_FREERTOS_QUEUE_H
+#define MOCK_FREERTOS_QUEUE_H
+
+#include <freertos/FreeRTOS.h>
+
+struct MockQueue {
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+};
+typedef MockQueue *QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return new MockQueue{length, itemSize, {}};
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t) {
+  if (!queue || queue->items.size() >= queue->length) return errQUEUE_FULL;
+  const uint8_t *p = (const uint8_t *)item;
+  queue->items.emplace_back(p, p + queue->itemSize);
+  return pdPASS;
+}
+#define xQueueSendToBack xQueueSend
+
+inline BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t) {
+  if (!queue || queue->items.size() >= queue->length) return errQUEUE_FULL;
+  const uint8_t *p = (const uint8_t *)item;
+  queue->items.emplace_front(p, p + queue->itemSize);
+  return pdPASS;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t) {
+  if (!queue || queue->items.empty()) return pdFALSE;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+inline BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t) {
+  if (!queue || queue->items.empty()) return pdFALSE;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue ? queue->items.size() : 0; }
+inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+  return queue ? queue->length - queue->items.size() : 0;
+}
+inline BaseType_t xQueueReset(QueueHandle_t queue) {
+  if (queue) queue->items.clear();
+  return pdPASS;
+}
+
+#endif
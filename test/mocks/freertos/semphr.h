@@ -0,0 +1,24 @@
+#ifndef MOCK_FREERTOS_SEMPHR_H
+#define MOCK_FREERTOS_SEMPHR_H
+
+#include <freertos/queue.h>
+
+struct MockSemaphore {
+  int count;
+};
+typedef MockSemaphore *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new MockSemaphore{1}; }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new MockSemaphore{0}; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t) {
+  if (!sem || sem->count == 0) return pdFALSE;
+  sem->count--;
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  if (!sem) return pdFALSE;
+  sem->count++;
+  return pdTRUE;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/**
+   Host stand-in for the lwIP socket API, acting as a broker on the other
+   end of every connect. mockBrokerMode picks how it answers: accept the
+   connection, refuse it, or blackhole it so the handshake never finishes.
+*/
+#ifndef MOCK_LWIP_SOCKETS_H
+#define MOCK_LWIP_SOCKETS_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+enum MockBrokerMode { MOCK_BROKER_ACCEPT, MOCK_BROKER_REFUSE, MOCK_BROKER_BLACKHOLE };
+
+// How long a blocking connect waits on a blackholed broker
+#define MOCK_TCP_CONNECT_TIMEOUT_MS 18000
+
+inline MockBrokerMode mockBrokerMode = MOCK_BROKER_ACCEPT;
+inline int mockSocketsOpen = 0;
+inline int mockSocketConnects = 0;
+
+inline int lwip_socket(int, int, int) { mockSocketsOpen++; return 3; }
+inline int lwip_close(int) { mockSocketsOpen--; return 0; }
+inline int lwip_fcntl(int, int, int) { return 0; }
+
+inline int lwip_connect(int, const struct sockaddr *, socklen_t) {
+  mockSocketConnects++;
+  errno = EINPROGRESS;
+  return -1;
+}
+
+inline int lwip_select(int, fd_set *, fd_set *, fd_set *, struct timeval *) {
+  return mockBrokerMode == MOCK_BROKER_BLACKHOLE ? 0 : 1;
+}
+
+inline int lwip_getsockopt(int, int, int, void *value, socklen_t *) {
+  *(int *)value = mockBrokerMode == MOCK_BROKER_REFUSE ? ECONNREFUSED : 0;
+  return 0;
+}
+
+#endif
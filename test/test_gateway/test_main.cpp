@@ -0,0 +1,1082 @@
+/**
+   Runs the gateway on the host against the mocks in test/mocks: panel status
+   dispatch, mqttCallback() and handleTelegram(), driven through the same
+   keybusHandle() / networkHandle() calls the two tasks make on the device.
+*/
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+#include <dscKeybusInterface.h>
+#include <HTTPClient.h>
+#include <PubSubClient.h>
+#include <SPIFFS.h>
+#include <UniversalTelegramBot.h>
+#include <WebServer.h>
+#include <lwip/sockets.h>
+#include <mbedtls/sha256.h>
+#include <unity.h>
+#include <chrono>
+#include <new>
+
+#include <command_trace.h>
+#include <keypad_queue.h>
+#include <loop_metrics.h>
+#include <mqtt_scheduler.h>
+#include <telegram_recipients.h>
+#include <settings.h>
+#include <telegram_queue.h>
+#include <tls_client.h>
+
+void setup();
+void telegramDeliver(const tsTelegramBatch &batch);
+void keybusHandle();
+void networkHandle();
+byte telegramPollHandle();
+bool telegramNotifyHandle();
+
+extern dscKeybusInterface dsc;
+extern PubSubClient mqtt;
+extern UniversalTelegramBot telegramBot;
+extern UniversalTelegramBot telegramNotifier;
+extern TlsClient wifiClientSecured;
+extern WebServer server;
+extern char mqtt_server[];
+extern char telegram_bot_token[];
+extern char telegram_chat_id[];
+extern char telegram_recipients[];
+extern char dsc_access_code[];
+extern bool wifiConnected;
+extern volatile bool servicesStarted;
+extern volatile bool keybusStopRequested;
+extern volatile bool keybusStopped;
+
+// Counts heap allocations, including the ones the mocks make to record traffic
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static const char* lastPublished(const char* topic) {
+  for (auto it = mqtt.published.rbegin(); it != mqtt.published.rend(); ++it) {
+    if (it->topic == topic) return it->payload.c_str();
+  }
+  return nullptr;
+}
+
+static String queuedNotifications() {
+  static tsTelegramBatch batch;
+  String notifications;
+  while (telegramQueueCollectBatch(batch, 0, 0)) notifications += batch.text;
+  return notifications;
+}
+
+// Number of lines of a /history response holding an event
+static size_t historyCount(const std::string &history, const char* event) {
+  size_t count = 0;
+  for (size_t at = history.find(event); at != std::string::npos; at = history.find(event, at + 1)) count++;
+  return count;
+}
+
+// One pass of each task, the Keybus task first as on the device
+static void serviceTasks() {
+  keybusHandle();
+  networkHandle();
+}
+
+// One long poll of the Telegram poll task, then the network task runs the commands
+static void pollTelegram() {
+  telegramPollHandle();
+  networkHandle();
+}
+
+// Runs both tasks for `ms` of virtual time as if they shared one core: the Keybus task every
+// millisecond, the network task every `networkPeriodMs`. A network pass that waits holds up the next
+// Keybus service by as long, so the recorded interval bounds the device's, where each task has a core.
+static void simulateTasks(unsigned long ms, unsigned long networkPeriodMs = 10) {
+  unsigned long end = millis() + ms;
+  unsigned long networkTime = millis();
+  while ((long)(millis() - end) < 0) {
+    keybusHandle();
+    if ((long)(millis() - networkTime) >= 0) {
+      networkHandle();
+      networkTime = millis() + networkPeriodMs;
+    }
+    delay(1);
+  }
+}
+
+// Starts a fresh record of the Keybus service interval
+static void keybusIntervalReset() {
+  keybusHandle();
+  metricsReset(STAGE_KEYBUS_INTERVAL);
+}
+
+// Hands the mock panel status to the network task, as a status change on the Keybus does
+static void panelSync() {
+  dsc.statusChanged = true;
+  serviceTasks();
+}
+
+// Returns the mock panel to ready and disarmed with every zone closed, flagging only what a test
+// left set so the gateway reports it cleared
+static void panelReset() {
+  dscKeybusInterface fresh(18, 19, 21);
+  for (byte partition = 0; partition < dscPartitions; partition++) {
+    fresh.ready[partition] = true;
+    fresh.armedChanged[partition] = dsc.armed[partition];
+    fresh.alarmChanged[partition] = dsc.alarm[partition];
+    fresh.exitDelayChanged[partition] = dsc.exitDelay[partition];
+    fresh.fireChanged[partition] = dsc.fire[partition];
+  }
+  for (byte zoneGroup = 0; zoneGroup < dscZones; zoneGroup++) {
+    fresh.openZonesChanged[zoneGroup] = dsc.openZones[zoneGroup];
+    fresh.alarmZonesChanged[zoneGroup] = dsc.alarmZones[zoneGroup];
+  }
+  fresh.openZonesStatusChanged = true;
+  fresh.alarmZonesStatusChanged = true;
+  dsc = fresh;
+  panelSync();
+}
+
+// Every test starts connected, with the panel disarmed and closed, no keys or command traces
+// pending, the periodic stats just sent and a full publish bucket, whatever the previous test left
+void setUp() {
+  WiFi.mockStatus = WL_CONNECTED;
+  mockBrokerMode = MOCK_BROKER_ACCEPT;
+  telegramBot.mockApiUp = true;
+  telegramNotifier.mockApiUp = true;
+  keypadQueueClear();
+  panelReset();
+
+  // Longer than TRACE_TIMEOUT_MS as well
+  delay(MQTT_STATS_INTERVAL);
+  byte pass = 0;
+  do {
+    serviceTasks();
+    delay(2000);
+  } while (++pass < 10 && (!mqtt.connected() || mqttSchedulerPending() > 0));
+
+  mqtt.published.clear();
+  telegramBot.sent.clear();
+  telegramNotifier.sent.clear();
+  queuedNotifications();
+}
+
+void tearDown() {}
+
+void test_mqtt_reconnects_after_drop() {
+  unsigned lookups = WiFi.mockLookups;
+  mqtt.mockDrop();
+  mqtt.subscriptions.clear();
+  // Notices the drop, connects TCP, then opens the session
+  for (byte pass = 0; pass < 3; pass++) networkHandle();
+
+  TEST_ASSERT_TRUE(mqtt.connected());
+  TEST_ASSERT_EQUAL_STRING("Online", lastPublished("dsc/status/LWT"));
+  TEST_ASSERT_TRUE(std::find(mqtt.subscriptions.begin(), mqtt.subscriptions.end(), "dsc/Set/#") != mqtt.subscriptions.end());
+  // The broker's address is reused, not looked up again
+  TEST_ASSERT_EQUAL(lookups, WiFi.mockLookups);
+}
+
+void test_armed_away_is_published() {
+  dsc.armed[0] = true;
+  dsc.armedAway[0] = true;
+  dsc.armedChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  String notifications = queuedNotifications();
+  TEST_ASSERT_EQUAL_STRING("AA", lastPublished("dsc/Get/Partition1"));
+  TEST_ASSERT_EQUAL_STRING("Armed away: Partition 1", notifications.c_str());
+}
+
+void test_zone_alarm_is_published() {
+  dsc.alarm[0] = true;
+  dsc.alarmChanged[0] = true;
+  dsc.alarmZones[0] = 0x14;
+  dsc.alarmZonesChanged[0] = 0x14;
+  dsc.alarmZonesStatusChanged = true;
+  dsc.openZones[0] = 0x04;
+  dsc.openZonesChanged[0] = 0x04;
+  dsc.openZonesStatusChanged = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  TEST_ASSERT_EQUAL_STRING("1", lastPublished("dsc/Get/Zone3"));
+  String notifications = queuedNotifications();
+  TEST_ASSERT_TRUE(notifications.indexOf('3') >= 0);
+  TEST_ASSERT_TRUE(notifications.indexOf('5') >= 0);
+  TEST_ASSERT_NOT_NULL(lastPublished("dsc/Get/State"));
+}
+
+// A storm of zone changes doesn't hold up the alarm: it goes out first, the zones at the publish rate
+void test_zone_storm_is_paced_behind_alarm() {
+  for (byte group = 0; group < dscZones; group++) {
+    dsc.openZones[group] = 0xFF;
+    dsc.openZonesChanged[group] = 0xFF;
+  }
+  dsc.openZonesStatusChanged = true;
+  dsc.alarm[1] = true;
+  dsc.alarmChanged[1] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  TEST_ASSERT_EQUAL(MQTT_PUBLISH_BURST, mqtt.published.size());
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/Partition2", mqtt.published[0].topic.c_str());
+  TEST_ASSERT_EQUAL_STRING("T", mqtt.published[0].payload.c_str());
+  TEST_ASSERT_EQUAL(MQTT_ZONE_COUNT - (MQTT_PUBLISH_BURST - 1), mqttSchedulerPending());
+  TEST_ASSERT_NULL(lastPublished("dsc/Get/State"));
+
+  // Out of tokens, a network pass publishes nothing more until time passes
+  networkHandle();
+  TEST_ASSERT_EQUAL(MQTT_PUBLISH_BURST, mqtt.published.size());
+  delay(500);
+  networkHandle();
+  TEST_ASSERT_EQUAL(MQTT_PUBLISH_BURST + MQTT_PUBLISH_RATE / 2, mqtt.published.size());
+
+  delay(5000);
+  networkHandle();
+  TEST_ASSERT_EQUAL(0, mqttSchedulerPending());
+  TEST_ASSERT_EQUAL_STRING("1", lastPublished("dsc/Get/Zone64"));
+  TEST_ASSERT_NOT_NULL(lastPublished("dsc/Get/State"));
+
+  for (byte group = 0; group < dscZones; group++) {
+    dsc.openZones[group] = 0;
+    dsc.openZonesChanged[group] = 0xFF;
+  }
+  dsc.openZonesStatusChanged = true;
+  dsc.alarm[1] = false;
+  dsc.alarmChanged[1] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  for (byte pass = 0; pass < 3; pass++) {
+    delay(2000);
+    networkHandle();
+  }
+  TEST_ASSERT_EQUAL_STRING("0", lastPublished("dsc/Get/Zone64"));
+}
+
+// A broker that blackholes or refuses connections costs the network pass no waiting: with both tasks
+// on one simulated core, the Keybus is still served every millisecond through two minutes of outage,
+// and the attempts back off
+void test_mqtt_outage_keeps_keybus_interval_flat() {
+  const MockBrokerMode outages[] = { MOCK_BROKER_BLACKHOLE, MOCK_BROKER_REFUSE };
+  for (MockBrokerMode outage : outages) {
+    mockBrokerMode = outage;
+    mqtt.mockDrop();
+    int socketConnects = mockSocketConnects;
+    unsigned lookups = WiFi.mockLookups;
+
+    keybusIntervalReset();
+    simulateTasks(120000, 100);
+
+    const tsStageMetrics &interval = metricsStage(STAGE_KEYBUS_INTERVAL);
+    TEST_ASSERT_EQUAL(120000, interval.count);
+    TEST_ASSERT_EQUAL(1000, interval.maxUs);
+    TEST_ASSERT_FALSE(mqtt.connected());
+    int attempts = mockSocketConnects - socketConnects;
+    TEST_ASSERT_TRUE(attempts >= 2 && attempts <= 12);
+    TEST_ASSERT_TRUE(WiFi.mockLookups - lookups <= attempts / MQTT_RESOLVE_FAILURES + 1);
+  }
+
+  mockBrokerMode = MOCK_BROKER_ACCEPT;
+  for (int pass = 0; pass < 700 && !mqtt.connected(); pass++) {
+    serviceTasks();
+    delay(100);
+  }
+  TEST_ASSERT_TRUE(mqtt.connected());
+  TEST_ASSERT_EQUAL_STRING("Online", lastPublished("dsc/status/LWT"));
+}
+
+static size_t publishCount(const char* topic) {
+  size_t count = 0;
+  for (const MockMqttMessage &message : mqtt.published) count += message.topic == topic;
+  return count;
+}
+
+void test_repeated_state_is_not_republished() {
+  dsc.armed[0] = true;
+  dsc.armedStay[0] = true;
+  dsc.armedChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  dsc.armed[0] = false;
+  dsc.armedStay[0] = false;
+  dsc.armedChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  TEST_ASSERT_EQUAL_STRING("D", lastPublished("dsc/Get/Partition1"));
+  size_t partitionPublishes = publishCount("dsc/Get/Partition1");
+  size_t statePublishes = publishCount("dsc/Get/State");
+
+  // Alarm restore while disarmed reports disarmed again
+  dsc.alarmChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  TEST_ASSERT_EQUAL(partitionPublishes, publishCount("dsc/Get/Partition1"));
+  TEST_ASSERT_EQUAL(statePublishes, publishCount("dsc/Get/State"));
+}
+
+void test_reconnect_sends_only_changes() {
+  mqtt.mockDrop();
+  dsc.openZones[0] = 0x08;
+  dsc.openZonesChanged[0] = 0x08;
+  dsc.openZonesStatusChanged = true;
+  dsc.armed[1] = true;
+  dsc.armedAway[1] = true;
+  dsc.armedChanged[1] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  TEST_ASSERT_EQUAL(0, mqtt.published.size());
+
+  for (byte pass = 0; pass < 3; pass++) networkHandle();
+  TEST_ASSERT_TRUE(mqtt.connected());
+
+  // The LWT, zone 4, target and current state of partition 2 and the state message
+  TEST_ASSERT_EQUAL(5, mqtt.published.size());
+  TEST_ASSERT_EQUAL_STRING("2A", mqtt.published[1].payload.c_str());
+  TEST_ASSERT_EQUAL_STRING("AA", mqtt.published[2].payload.c_str());
+  TEST_ASSERT_EQUAL_STRING("1", lastPublished("dsc/Get/Zone4"));
+  TEST_ASSERT_NOT_NULL(lastPublished("dsc/Get/State"));
+}
+
+void test_status_waits_for_wifi() {
+  WiFi.mockStatus = WL_DISCONNECTED;
+  networkHandle();
+
+  dsc.armed[0] = true;
+  dsc.armedStay[0] = true;
+  dsc.armedChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  TEST_ASSERT_NULL(lastPublished("dsc/Get/Partition1"));
+
+  WiFi.mockStatus = WL_CONNECTED;
+  serviceTasks();
+  serviceTasks();
+  TEST_ASSERT_EQUAL_STRING("SA", lastPublished("dsc/Get/Partition1"));
+}
+
+// Changes while WiFi is down are logged as they happen, the sinks get the merged state once it is back
+void test_outage_changes_are_logged() {
+  server.mockRequest("/history", HTTP_GET, { { "limit", "1000" } });
+  const std::string before = server.body;
+  WiFi.mockStatus = WL_DISCONNECTED;
+  networkHandle();
+  mqtt.published.clear();
+
+  dsc.openZones[0] = 0x20;
+  dsc.openZonesChanged[0] = 0x20;
+  dsc.openZonesStatusChanged = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  dsc.openZones[0] = 0x40;
+  dsc.openZonesChanged[0] = 0x60;
+  dsc.openZonesStatusChanged = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  TEST_ASSERT_NULL(lastPublished("dsc/Get/Zone7"));
+
+  server.mockRequest("/history", HTTP_GET, { { "limit", "1000" } });
+  TEST_ASSERT_EQUAL(historyCount(before, " Zone open: 6\n") + 1, historyCount(server.body, " Zone open: 6\n"));
+  TEST_ASSERT_EQUAL(historyCount(before, " Zone closed: 6\n") + 1, historyCount(server.body, " Zone closed: 6\n"));
+  TEST_ASSERT_EQUAL(historyCount(before, " Zone open: 7\n") + 1, historyCount(server.body, " Zone open: 7\n"));
+
+  WiFi.mockStatus = WL_CONNECTED;
+  serviceTasks();
+  serviceTasks();
+  TEST_ASSERT_EQUAL_STRING("1", lastPublished("dsc/Get/Zone7"));
+  TEST_ASSERT_NULL(lastPublished("dsc/Get/Zone6"));
+}
+
+// Panel changes, MQTT commands and HTTP requests leave the Keybus served every millisecond
+void test_keybus_interval_under_network_load() {
+  keybusIntervalReset();
+  for (int step = 0; step < 100; step++) {
+    dsc.openZones[0] ^= 0x01;
+    dsc.openZonesChanged[0] = 0x01;
+    dsc.openZonesStatusChanged = true;
+    dsc.statusChanged = true;
+    mqtt.mockDeliver("dsc/Set/Partition1/Keys", "1");
+    server.mockRequest("/api/state");
+    simulateTasks(50);
+  }
+
+  const tsStageMetrics &interval = metricsStage(STAGE_KEYBUS_INTERVAL);
+  TEST_ASSERT_EQUAL(5000, interval.count);
+  TEST_ASSERT_EQUAL(1000, interval.maxUs);
+  TEST_ASSERT_EQUAL(100, dsc.written.length());
+}
+
+void test_mqtt_away_arm_writes_keypad() {
+  mqtt.mockDeliver("dsc/Set", "1A");
+  TEST_ASSERT_EQUAL_STRING("1A", lastPublished("dsc/Get/Partition1"));
+
+  keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("w", dsc.written.c_str());
+  TEST_ASSERT_EQUAL(1, dsc.writtenPartition);
+}
+
+void test_mqtt_arm_while_not_ready_resets_target() {
+  dsc.ready[1] = false;
+  panelSync();
+  mqtt.mockDeliver("dsc/Set", "2S");
+  serviceTasks();
+
+  TEST_ASSERT_EQUAL_STRING("", dsc.written.c_str());
+  TEST_ASSERT_EQUAL_STRING("D", lastPublished("dsc/Get/Partition2"));
+}
+
+void test_mqtt_disarm_writes_access_code() {
+  strcpy(dsc_access_code, "1234");
+  dsc.armed[0] = true;
+  panelSync();
+  mqtt.mockDeliver("dsc/Set", "1D");
+  keybusHandle();
+
+  TEST_ASSERT_EQUAL_STRING("1234", dsc.written.c_str());
+}
+
+void test_mqtt_bypass_is_written_and_acknowledged() {
+  mqtt.mockDeliver("dsc/Set/Partition2/Bypass", "3,9");
+  TEST_ASSERT_TRUE(String(lastPublished("dsc/status/Ack")).startsWith("{\"command\":\"bypass\",\"partition\":2,\"result\":\"ok\",\"trace\":"));
+
+  keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("*10309#", dsc.written.c_str());
+  TEST_ASSERT_EQUAL(2, dsc.writtenPartition);
+}
+
+void test_mqtt_json_command_acknowledges_id() {
+  mqtt.mockDeliver("dsc/Set", "{\"id\":\"hk-42\",\"command\":\"keys\",\"keys\":\"*71\"}");
+  TEST_ASSERT_TRUE(String(lastPublished("dsc/status/Ack")).startsWith("{\"id\":\"hk-42\",\"command\":\"keys\",\"partition\":1,\"result\":\"ok\",\"trace\":"));
+  keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("*71", dsc.written.c_str());
+
+  mqtt.mockDeliver("dsc/Set", "{\"id\":\"hk-43\",\"command\":\"disarm\"}");
+  TEST_ASSERT_EQUAL_STRING("{\"id\":\"hk-43\",\"command\":\"disarm\",\"partition\":1,\"result\":\"error\",\"error\":\"not armed\"}",
+                           lastPublished("dsc/status/Ack"));
+
+  mqtt.mockDeliver("dsc/Set/Partition1/Keys", "1;2");
+  TEST_ASSERT_EQUAL_STRING("{\"command\":\"keys\",\"partition\":1,\"result\":\"error\",\"error\":\"invalid keys\"}", lastPublished("dsc/status/Ack"));
+}
+
+void test_mqtt_command_latency_is_traced() {
+  const tsTraceMetrics &trace = traceMetrics(TRACE_MQTT, TRACE_ARM_STAY);
+  uint32_t confirmed = trace.phases[TRACE_CONFIRMED].count;
+
+  mqtt.mockDeliver("dsc/Set/Partition3", "arm_stay");
+  delay(20);
+  keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("s", dsc.written.c_str());
+
+  // The panel starts the exit delay
+  delay(700);
+  dsc.exitDelay[2] = true;
+  dsc.exitDelayChanged[2] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  TEST_ASSERT_EQUAL(confirmed + 1, trace.phases[TRACE_CONFIRMED].count);
+  TEST_ASSERT_EQUAL(720, trace.phases[TRACE_CONFIRMED].maxMs);
+
+  server.mockRequest("/metrics");
+  TEST_ASSERT_TRUE(server.body.find("dsc_command_confirm_ms_count{source=\"mqtt\",command=\"arm_stay\"} 1\n") != std::string::npos);
+  TEST_ASSERT_TRUE(server.body.find("dsc_command_timeouts_total{source=\"telegram\",command=\"arm_away\"} 0\n") != std::string::npos);
+}
+
+void test_keypad_queue_rejects_when_full() {
+  strcpy(dsc_access_code, "1234");
+  dsc.armed[0] = true;
+  panelSync();
+  dsc.writeReady = false;
+  for (byte idx = 0; idx < KEYPAD_QUEUE_LEN; idx++) mqtt.mockDeliver("dsc/Set/Partition1/Keys", "1");
+  TEST_ASSERT_TRUE(String(lastPublished("dsc/status/Ack")).startsWith("{\"command\":\"keys\",\"partition\":1,\"result\":\"ok\""));
+  mqtt.mockDeliver("dsc/Set/Partition1/Keys", "2");
+  TEST_ASSERT_EQUAL_STRING("{\"command\":\"keys\",\"partition\":1,\"result\":\"error\",\"error\":\"keypad queue full\"}",
+                           lastPublished("dsc/status/Ack"));
+
+  // Disarm has its own class and goes out first once the keypad is ready
+  mqtt.mockDeliver("dsc/Set", "1D");
+  TEST_ASSERT_TRUE(String(lastPublished("dsc/status/Ack")).startsWith("{\"command\":\"disarm\",\"partition\":1,\"result\":\"ok\""));
+  keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("", dsc.written.c_str());
+  dsc.writeReady = true;
+  keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("1234", dsc.written.c_str());
+
+  telegramBot.mockReceive(telegram_chat_id, "/cmd 3");
+  pollTelegram();
+  TEST_ASSERT_EQUAL_STRING("Command rejected: keypad queue full", telegramBot.sent.back().text.c_str());
+
+  for (byte idx = 0; idx < KEYPAD_QUEUE_LEN; idx++) keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("123411111111", dsc.written.c_str());
+  telegramBot.mockReceive(telegram_chat_id, "/cmd 3");
+  pollTelegram();
+  TEST_ASSERT_EQUAL_STRING("Command queued", telegramBot.sent.back().text.c_str());
+  keybusHandle();
+  TEST_ASSERT_EQUAL_STRING("1234111111113", dsc.written.c_str());
+}
+
+// Each notification batch is formatted once and sent to every recipient with only its classes
+void test_notifications_fan_out_by_class() {
+  static tsTelegramBatch batch;
+  dsc.armed[0] = true;
+  dsc.armedAway[0] = true;
+  dsc.armedChanged[0] = true;
+  dsc.alarm[0] = true;
+  dsc.alarmChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  TEST_ASSERT_EQUAL(2, telegramQueueCollectBatch(batch, 0, 0));
+  telegramNotifier.sent.clear();
+  telegramDeliver(batch);
+  TEST_ASSERT_EQUAL(3, telegramNotifier.sent.size());
+  TEST_ASSERT_EQUAL_STRING("42", telegramNotifier.sent[0].chat_id.c_str());
+  TEST_ASSERT_EQUAL_STRING("Armed away: Partition 1\nAlarm: Partition 1", telegramNotifier.sent[0].text.c_str());
+  TEST_ASSERT_EQUAL_STRING("77", telegramNotifier.sent[1].chat_id.c_str());
+  TEST_ASSERT_EQUAL_STRING("Alarm: Partition 1", telegramNotifier.sent[1].text.c_str());
+  TEST_ASSERT_EQUAL_STRING("88", telegramNotifier.sent[2].chat_id.c_str());
+  TEST_ASSERT_EQUAL_STRING("Armed away: Partition 1", telegramNotifier.sent[2].text.c_str());
+  TEST_ASSERT_EQUAL(1, telegramRecipient(1).stats.sent);
+
+  // A failed delivery is counted for each recipient it was meant for
+  dsc.armed[0] = false;
+  dsc.armedAway[0] = false;
+  dsc.armedChanged[0] = true;
+  dsc.alarm[0] = false;
+  dsc.alarmChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  TEST_ASSERT_TRUE(telegramQueueCollectBatch(batch, 0, 0) > 0);
+  telegramNotifier.mockApiUp = false;
+  telegramDeliver(batch);
+  telegramNotifier.mockApiUp = true;
+  TEST_ASSERT_EQUAL(1, telegramRecipient(0).stats.failures);
+  TEST_ASSERT_EQUAL(0, telegramRecipient(1).stats.failures);
+  TEST_ASSERT_EQUAL(1, telegramRecipient(2).stats.failures);
+
+  server.mockRequest("/metrics");
+  TEST_ASSERT_TRUE(server.body.find("dsc_telegram_delivery_failures_total{recipient=\"2\"} 1\n") != std::string::npos);
+}
+
+// Notifications raised while WiFi is down wait in the queue instead of being thrown away
+void test_notifications_wait_for_wifi() {
+  WiFi.mockStatus = WL_DISCONNECTED;
+  networkHandle();
+  telegramQueuePush("Gateway message", TELEGRAM_CLASS_SYSTEM);
+  telegramNotifier.sent.clear();
+  TEST_ASSERT_FALSE(telegramNotifyHandle());
+  TEST_ASSERT_EQUAL(0, telegramNotifier.sent.size());
+
+  WiFi.mockStatus = WL_CONNECTED;
+  networkHandle();
+  TEST_ASSERT_TRUE(telegramNotifyHandle());
+  TEST_ASSERT_EQUAL(1, telegramNotifier.sent.size());
+  TEST_ASSERT_EQUAL_STRING("Gateway message", telegramNotifier.sent[0].text.c_str());
+}
+
+// While WiFiManager connects, the network task logs and queues the panel changes and leaves WiFi alone
+void test_changes_are_kept_before_services_start() {
+  servicesStarted = false;
+  WiFi.mockStatus = WL_DISCONNECTED;
+  dsc.alarm[0] = true;
+  dsc.alarmChanged[0] = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  TEST_ASSERT_TRUE(wifiConnected);
+  TEST_ASSERT_EQUAL(0, mqtt.published.size());
+  String notifications = queuedNotifications();
+  TEST_ASSERT_EQUAL_STRING("Alarm: Partition 1", notifications.c_str());
+  server.mockRequest("/history", HTTP_GET, { { "limit", "1000" } });
+  TEST_ASSERT_TRUE(server.body.find(" Alarm: Partition 1\n") != std::string::npos);
+
+  WiFi.mockStatus = WL_CONNECTED;
+  servicesStarted = true;
+  serviceTasks();
+  TEST_ASSERT_EQUAL_STRING("T", lastPublished("dsc/Get/Partition1"));
+}
+
+void test_telegram_arm_stay_writes_keypad() {
+  telegramBot.mockReceive(telegram_chat_id, "/armstay");
+  pollTelegram();
+  keybusHandle();
+
+  TEST_ASSERT_EQUAL_STRING("s", dsc.written.c_str());
+}
+
+void test_telegram_ignores_unknown_chat() {
+  telegramBot.mockReceive("1", "/armstay");
+  pollTelegram();
+  keybusHandle();
+
+  TEST_ASSERT_EQUAL_STRING("", dsc.written.c_str());
+  TEST_ASSERT_EQUAL(0, telegramBot.sent.size());
+}
+
+void test_telegram_status_reply() {
+  telegramBot.mockReceive(telegram_chat_id, "/status");
+  pollTelegram();
+
+  TEST_ASSERT_EQUAL(1, telegramBot.sent.size());
+  TEST_ASSERT_TRUE(String(telegramBot.sent[0].text.c_str()).startsWith("Partition status:"));
+}
+
+void test_telegram_getconfig_reply() {
+  telegramBot.mockReceive(telegram_chat_id, "/getconfig mqtt_server");
+  pollTelegram();
+
+  TEST_ASSERT_EQUAL(1, telegramBot.sent.size());
+  TEST_ASSERT_EQUAL_STRING("mqtt_server = [broker]", telegramBot.sent[0].text.c_str());
+}
+
+static long savedTelegramOffset() {
+  File file = SPIFFS.open("/telegram.offset", FILE_READ);
+  TEST_ASSERT_TRUE((bool)file);
+  uint8_t offset[4] = { 0 };
+  TEST_ASSERT_EQUAL(4, file.read(offset, sizeof(offset)));
+  file.close();
+  return offset[0] | (offset[1] << 8) | (offset[2] << 16) | ((long)offset[3] << 24);
+}
+
+void test_telegram_offset_is_persisted() {
+  TEST_ASSERT_EQUAL(TELEGRAM_LONG_POLL, telegramBot.longPoll);
+
+  delay(TELEGRAM_OFFSET_SAVE_MS);
+  telegramBot.mockReceive(telegram_chat_id, "/status");
+  pollTelegram();
+  TEST_ASSERT_EQUAL(1, telegramBot.sent.size());
+  TEST_ASSERT_EQUAL(telegramBot.last_message_received, savedTelegramOffset());
+
+  // The next offset waits for the rate limit, a later poll writes it
+  long first = telegramBot.last_message_received;
+  telegramBot.mockReceive(telegram_chat_id, "/status");
+  pollTelegram();
+  TEST_ASSERT_EQUAL(first, savedTelegramOffset());
+  delay(TELEGRAM_OFFSET_SAVE_MS);
+  telegramPollHandle();
+  TEST_ASSERT_EQUAL(telegramBot.last_message_received, savedTelegramOffset());
+
+  // An idle long poll is one request and hands nothing to the network task
+  int requests = telegramBot.requests;
+  TEST_ASSERT_EQUAL(0, telegramPollHandle());
+  TEST_ASSERT_EQUAL(requests + 1, telegramBot.requests);
+}
+
+// A restart command saves its offset at once instead of acknowledging it with another long poll
+void test_telegram_reset_saves_offset() {
+  telegramBot.mockReceive(telegram_chat_id, "/status");
+  pollTelegram();
+  telegramBot.mockReceive(telegram_chat_id, "/reset");
+  int requests = telegramBot.requests;
+  int restarts = ESP.restarts;
+  pollTelegram();
+
+  TEST_ASSERT_EQUAL(restarts + 1, ESP.restarts);
+  TEST_ASSERT_EQUAL(requests + 2, telegramBot.requests);
+  TEST_ASSERT_EQUAL(telegramBot.last_message_received, savedTelegramOffset());
+}
+
+void test_telegram_reuses_tls_connection() {
+  wifiClientSecured.mockDrop();
+  wifiClientSecured.mockHandshakeMs = 1200;
+  tsTlsStats before = wifiClientSecured.stats();
+
+  // One handshake for all requests while the connection stays open
+  for (int i = 0; i < 3; i++) {
+    telegramBot.mockReceive(telegram_chat_id, "/status");
+    pollTelegram();
+  }
+  TEST_ASSERT_EQUAL(3, telegramBot.sent.size());
+  TEST_ASSERT_EQUAL(before.handshakes + 1, wifiClientSecured.stats().handshakes);
+  TEST_ASSERT_EQUAL(before.handshakeMs + 1200, wifiClientSecured.stats().handshakeMs);
+
+  // An unreachable server costs one handshake, then requests are refused until the backoff ends
+  wifiClientSecured.mockDrop();
+  wifiClientSecured.mockServerUp = false;
+  int attempts = wifiClientSecured.mockHandshakes;
+  for (int i = 0; i < 3; i++) telegramPollHandle();
+  TEST_ASSERT_EQUAL(attempts + 1, wifiClientSecured.mockHandshakes);
+  TEST_ASSERT_EQUAL(before.failures + 1, wifiClientSecured.stats().failures);
+
+  wifiClientSecured.mockServerUp = true;
+  delay(TLS_BACKOFF_MIN_MS);
+  telegramBot.mockReceive(telegram_chat_id, "/status");
+  pollTelegram();
+  TEST_ASSERT_EQUAL(4, telegramBot.sent.size());
+  TEST_ASSERT_EQUAL(before.handshakes + 2, wifiClientSecured.stats().handshakes);
+  wifiClientSecured.mockHandshakeMs = 0;
+}
+
+static std::string sha256Hex(const std::string &data) {
+  mbedtls_sha256_context sha;
+  uint8_t hash[32];
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  mbedtls_sha256_update_ret(&sha, (const uint8_t*)data.data(), data.size());
+  mbedtls_sha256_finish_ret(&sha, hash);
+  char hex[65];
+  for (int i = 0; i < 32; i++) snprintf(hex + i * 2, 3, "%02x", hash[i]);
+  return hex;
+}
+
+static std::string fileContent(const char* path) {
+  File file = SPIFFS.open(path, FILE_READ);
+  std::string data;
+  while (file.available()) data += (char)file.read();
+  file.close();
+  return data;
+}
+
+void test_write_spiffs_streams_and_resumes() {
+  std::string body;
+  for (int i = 0; i < 100000; i++) body += (char)(i * 7 + i / 256);
+  mockHttpServer.up = true;
+  mockHttpServer.body = body;
+  mockHttpServer.dropAt = 30000;
+  mockHttpServer.segmentUs = 10000;
+
+  telegramBot.mockReceiveDocument(telegram_chat_id, ("write spiffs " + sha256Hex(body)).c_str(), "capture.bin",
+                                  "https://api.telegram.org/file/bot/capture.bin", body.size());
+  pollTelegram();
+  TEST_ASSERT_EQUAL_STRING("File downloading.", telegramBot.sent[0].text.c_str());
+
+  // Downloads in slices while both tasks keep running
+  int passes = 0;
+  while (telegramBot.sent.size() < 2 && passes < 1000) {
+    serviceTasks();
+    passes++;
+  }
+  TEST_ASSERT_TRUE(passes > 10);
+  TEST_ASSERT_EQUAL(2, telegramBot.sent.size());
+  TEST_ASSERT_TRUE(telegramBot.sent[1].text.rfind("Success.", 0) == 0);
+  TEST_ASSERT_TRUE(telegramBot.sent[1].text.find(sha256Hex(body)) != std::string::npos);
+  TEST_ASSERT_EQUAL_STRING("bytes=30000-", mockHttpServer.lastRange.c_str());
+  TEST_ASSERT_TRUE(fileContent("/capture.bin") == body);
+  TEST_ASSERT_FALSE(SPIFFS.exists("/capture.bin.part"));
+
+  // The handoff is released, commands are polled again
+  telegramBot.mockReceive(telegram_chat_id, "/status");
+  pollTelegram();
+  TEST_ASSERT_EQUAL(3, telegramBot.sent.size());
+
+  SPIFFS.remove("/capture.bin");
+  mockHttpServer = MockHttpServer();
+}
+
+void test_write_spiffs_rejects_wrong_checksum() {
+  mockHttpServer.up = true;
+  mockHttpServer.body = "not the expected content";
+
+  telegramBot.mockReceiveDocument(telegram_chat_id, ("write spiffs " + sha256Hex("expected")).c_str(), "bad.bin",
+                                  "https://api.telegram.org/file/bot/bad.bin", mockHttpServer.body.size());
+  pollTelegram();
+  for (int i = 0; i < 10; i++) serviceTasks();
+
+  TEST_ASSERT_EQUAL(2, telegramBot.sent.size());
+  TEST_ASSERT_EQUAL_STRING("Error: checksum mismatch after 24 bytes.", telegramBot.sent[1].text.c_str());
+  TEST_ASSERT_FALSE(SPIFFS.exists("/bad.bin"));
+  TEST_ASSERT_FALSE(SPIFFS.exists("/bad.bin.part"));
+
+  mockHttpServer = MockHttpServer();
+}
+
+static std::string writeTestFile(const char* path, size_t size) {
+  std::string data;
+  for (size_t i = 0; i < size; i++) data += (char)(i * 13 + i / 256);
+  File file = SPIFFS.open(path, FILE_WRITE);
+  file.write((const uint8_t*)data.data(), data.size());
+  file.close();
+  return data;
+}
+
+void test_read_spiffs_uploads_large_file() {
+  writeTestFile("/capture.bin", 3 * FILE_BLOCK_LEN + 100);
+  telegramBot.uploads.clear();
+  telegramBot.uploadedBytes = 0;
+
+  telegramBot.mockReceive(telegram_chat_id, "/read_spiffs /capture.bin");
+  pollTelegram();
+
+  TEST_ASSERT_EQUAL(1, telegramBot.uploads.size());
+  TEST_ASSERT_EQUAL_STRING("capture.bin", telegramBot.uploads[0].text.c_str());
+  TEST_ASSERT_EQUAL(3 * FILE_BLOCK_LEN + 100, telegramBot.uploadedBytes);
+  TEST_ASSERT_EQUAL(1, telegramBot.sent.size());
+  SPIFFS.remove("/capture.bin");
+}
+
+void test_file_route_streams_blocks() {
+  std::string data = writeTestFile("/capture.bin", 2 * FILE_BLOCK_LEN + 100);
+  server.mockRequest("/file", HTTP_GET, {{"name", "/capture.bin"}});
+
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_EQUAL(data.size(), server.contentLength);
+  TEST_ASSERT_EQUAL(3, server.chunks);
+  TEST_ASSERT_TRUE(server.body == data);
+
+  server.mockRequest("/file", HTTP_GET, {{"name", "/missing.bin"}});
+  TEST_ASSERT_EQUAL(404, server.status);
+  SPIFFS.remove("/capture.bin");
+}
+
+void test_file_route_refuses_internal_files() {
+  static const char* const names[] = { "/config.bin", "//config.bin", "/config.tmp", "/config.json", "/telegram.offset" };
+  for (const char* name : names) {
+    server.mockRequest("/file", HTTP_GET, {{"name", name}});
+    TEST_ASSERT_EQUAL(403, server.status);
+  }
+}
+
+void test_history_lists_events() {
+  dsc.openZones[0] = 0x02;
+  dsc.openZonesChanged[0] = 0x02;
+  dsc.openZonesStatusChanged = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  server.mockRequest("/history", HTTP_GET, { { "limit", "1000" } });
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_TRUE(server.body.find(" Zone open: 2\n") != std::string::npos);
+
+  telegramBot.mockReceive(telegram_chat_id, "/history 1h");
+  pollTelegram();
+  TEST_ASSERT_EQUAL(1, telegramBot.sent.size());
+  TEST_ASSERT_TRUE(telegramBot.sent[0].text.find("Zone open: 2") != std::string::npos);
+}
+
+// After a format the settings are written back and the event log starts new segments
+void test_format_rebuilds_stores() {
+  telegramBot.mockReceive(telegram_chat_id, "/formattt");
+  pollTelegram();
+  TEST_ASSERT_EQUAL_STRING("SPIFFS formatted.", telegramBot.sent.back().text.c_str());
+
+  File config = SPIFFS.open("/config.bin", FILE_READ);
+  uint8_t header[2] = { 0 };
+  TEST_ASSERT_EQUAL(2, config.read(header, sizeof(header)));
+  config.close();
+  TEST_ASSERT_EQUAL('C', header[0]);
+  TEST_ASSERT_EQUAL('S', header[1]);
+
+  dsc.openZones[0] ^= 0x08;
+  dsc.openZonesChanged[0] = 0x08;
+  dsc.openZonesStatusChanged = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+  server.mockRequest("/history", HTTP_GET, { { "limit", "1000" } });
+  TEST_ASSERT_TRUE(server.body.find(" Zone ") != std::string::npos);
+  File segment = SPIFFS.open("/events0.log", FILE_READ);
+  TEST_ASSERT_EQUAL(2, segment.read(header, sizeof(header)));
+  segment.close();
+  TEST_ASSERT_EQUAL('E', header[0]);
+}
+
+void test_root_page_is_streamed() {
+  unsigned long allocationsStart = allocations;
+  server.mockRequest("/");
+  unsigned long pageAllocations = allocations - allocationsStart;
+
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_EQUAL(CONTENT_LENGTH_UNKNOWN, server.contentLength);
+  TEST_ASSERT_TRUE(server.chunks > 2);
+  TEST_ASSERT_TRUE(server.body.find("<input name=\"mqtt-server\" type=\"text\" value=\"broker\" />") != std::string::npos);
+  TEST_ASSERT_TRUE(server.body.find("</form>") != std::string::npos);
+
+  char report[64];
+  snprintf(report, sizeof(report), "configuration page: %u bytes, %lu allocations",
+           (unsigned)server.body.size(), pageAllocations);
+  TEST_MESSAGE(report);
+}
+
+// A client that sends the ETag back gets a 304 until the panel changes
+void test_api_state_is_revalidated() {
+  server.mockRequest("/api/state");
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_EQUAL_STRING("application/json", server.contentType.c_str());
+  TEST_ASSERT_EQUAL(server.body.size(), server.contentLength);
+  TEST_ASSERT_TRUE(server.body.find("\"partitions\":[") != std::string::npos);
+  std::string etag = server.headers["ETag"];
+  TEST_ASSERT_FALSE(etag.empty());
+
+  server.mockRequest("/api/state", HTTP_GET, {}, { { "If-None-Match", etag } });
+  TEST_ASSERT_EQUAL(304, server.status);
+  TEST_ASSERT_TRUE(server.body.empty());
+  TEST_ASSERT_EQUAL_STRING(etag.c_str(), server.headers["ETag"].c_str());
+
+  // Tags are compared whole, in a list and with the weak prefix
+  std::string unquoted = etag.substr(1, etag.size() - 2);
+  const std::string matching[] = { "\"other\", " + etag, "W/" + etag, "*" };
+  for (const std::string &header : matching) {
+    server.mockRequest("/api/state", HTTP_GET, {}, { { "If-None-Match", header } });
+    TEST_ASSERT_EQUAL(304, server.status);
+  }
+  const std::string differing[] = { unquoted, "\"" + unquoted + "0\"", "\"x" + etag + "\"", "\"" + unquoted, "" };
+  for (const std::string &header : differing) {
+    server.mockRequest("/api/state", HTTP_GET, {}, { { "If-None-Match", header } });
+    TEST_ASSERT_EQUAL(200, server.status);
+  }
+
+  dsc.openZones[0] ^= 0x40;
+  dsc.openZonesChanged[0] = 0x40;
+  dsc.openZonesStatusChanged = true;
+  dsc.statusChanged = true;
+  serviceTasks();
+
+  server.mockRequest("/api/state", HTTP_GET, {}, { { "If-None-Match", etag } });
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_NOT_EQUAL(0, etag.compare(server.headers["ETag"]));
+}
+
+void test_api_config_masks_secrets() {
+  server.mockRequest("/api/config");
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_TRUE(server.body.find("\"mqtt_server\":\"broker\"") != std::string::npos);
+  TEST_ASSERT_TRUE(server.body.find("\"telegram_bot_token\":\"********\"") != std::string::npos);
+  TEST_ASSERT_TRUE(server.body.find("\"mqtt_password\":\"\"") != std::string::npos);
+  TEST_ASSERT_TRUE(server.body.find(":\"token\"") == std::string::npos);
+  std::string etag = server.headers["ETag"];
+
+  server.mockRequest("/api/config", HTTP_GET, {}, { { "If-None-Match", etag } });
+  TEST_ASSERT_EQUAL(304, server.status);
+
+  telegramBot.mockReceive(telegram_chat_id, "/setconfig telegram_msg_prefix [Home]");
+  pollTelegram();
+  server.mockRequest("/api/config", HTTP_GET, {}, { { "If-None-Match", etag } });
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_TRUE(server.body.find("\"telegram_msg_prefix\":\"[Home]\"") != std::string::npos);
+
+  // The next batch goes out behind the new prefix
+  static tsTelegramBatch batch;
+  TEST_ASSERT_TRUE(telegramQueuePush("Trouble", TELEGRAM_CLASS_TROUBLE));
+  TEST_ASSERT_EQUAL(1, telegramQueueCollectBatch(batch, 0, 0));
+  telegramNotifier.sent.clear();
+  telegramDeliver(batch);
+  TEST_ASSERT_EQUAL_STRING("[Home]Trouble", telegramNotifier.sent[0].text.c_str());
+  telegramBot.mockReceive(telegram_chat_id, "/setconfig telegram_msg_prefix");
+  pollTelegram();
+}
+
+void test_setconfig_reloads_recipients() {
+  byte count = telegramRecipientsCount();
+  telegramBot.mockReceive(telegram_chat_id, "/setconfig telegram_recipients 77:alarm,88:arming+trouble,99:system");
+  pollTelegram();
+  TEST_ASSERT_EQUAL(count + 1, telegramRecipientsCount());
+  TEST_ASSERT_EQUAL_STRING("99", telegramRecipient(count).chatId);
+  TEST_ASSERT_EQUAL(TELEGRAM_CLASS_SYSTEM, telegramRecipient(count).classes);
+
+  telegramBot.mockReceive(telegram_chat_id, "/setconfig telegram_recipients 77:alarm,88:arming+trouble");
+  pollTelegram();
+  TEST_ASSERT_EQUAL(count, telegramRecipientsCount());
+}
+
+// An update stops the interface from the Keybus task, the network task only asks for it
+void test_ota_start_stops_keybus_from_its_task() {
+  dsc.begin();
+  ArduinoOTA.startFn();
+  TEST_ASSERT_TRUE(dsc.running);
+
+  unsigned long loopCalls = dsc.loopCalls;
+  keybusHandle();
+  TEST_ASSERT_FALSE(dsc.running);
+  TEST_ASSERT_EQUAL(loopCalls, dsc.loopCalls);
+
+  keybusStopRequested = false;
+  keybusStopped = false;
+  dsc.begin();
+}
+
+void test_ui_is_served_gzipped() {
+  server.mockRequest("/ui", HTTP_GET, {}, { { "Accept-Encoding", "gzip, deflate" } });
+  TEST_ASSERT_EQUAL(200, server.status);
+  TEST_ASSERT_EQUAL_STRING("text/html", server.contentType.c_str());
+  TEST_ASSERT_EQUAL_STRING("gzip", server.headers["Content-Encoding"].c_str());
+  TEST_ASSERT_TRUE(server.body.size() > 2);
+  TEST_ASSERT_EQUAL_HEX8(0x1f, (uint8_t)server.body[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x8b, (uint8_t)server.body[1]);
+  std::string etag = server.headers["ETag"];
+
+  server.mockRequest("/ui", HTTP_GET, {}, { { "Accept-Encoding", "gzip" }, { "If-None-Match", etag } });
+  TEST_ASSERT_EQUAL(304, server.status);
+
+  server.mockRequest("/ui");
+  TEST_ASSERT_EQUAL(406, server.status);
+}
+
+// Reports host time and heap allocations from a panel change to its publish
+void test_event_to_publish_cost() {
+  dsc.armed[0] = true;
+  dsc.armedAway[0] = true;
+  dsc.armedChanged[0] = true;
+  dsc.statusChanged = true;
+
+  unsigned long allocationsStart = allocations;
+  auto start = std::chrono::steady_clock::now();
+  serviceTasks();
+  auto end = std::chrono::steady_clock::now();
+  unsigned long eventAllocations = allocations - allocationsStart;
+
+  TEST_ASSERT_EQUAL_STRING("AA", lastPublished("dsc/Get/Partition1"));
+
+  char report[96];
+  snprintf(report, sizeof(report), "event to publish: %ld us, %lu allocations",
+           (long)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(), eventAllocations);
+  TEST_MESSAGE(report);
+}
+
+int main(int argc, char** argv) {
+  strcpy(mqtt_server, "broker");
+  strcpy(telegram_bot_token, "token");
+  strcpy(telegram_chat_id, "42");
+  strcpy(telegram_recipients, "77:alarm, 88:arming+trouble");
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_mqtt_reconnects_after_drop);
+  RUN_TEST(test_mqtt_outage_keeps_keybus_interval_flat);
+  RUN_TEST(test_armed_away_is_published);
+  RUN_TEST(test_zone_alarm_is_published);
+  RUN_TEST(test_zone_storm_is_paced_behind_alarm);
+  RUN_TEST(test_status_waits_for_wifi);
+  RUN_TEST(test_outage_changes_are_logged);
+  RUN_TEST(test_repeated_state_is_not_republished);
+  RUN_TEST(test_reconnect_sends_only_changes);
+  RUN_TEST(test_keybus_interval_under_network_load);
+  RUN_TEST(test_mqtt_away_arm_writes_keypad);
+  RUN_TEST(test_mqtt_arm_while_not_ready_resets_target);
+  RUN_TEST(test_mqtt_disarm_writes_access_code);
+  RUN_TEST(test_mqtt_bypass_is_written_and_acknowledged);
+  RUN_TEST(test_mqtt_json_command_acknowledges_id);
+  RUN_TEST(test_mqtt_command_latency_is_traced);
+  RUN_TEST(test_keypad_queue_rejects_when_full);
+  RUN_TEST(test_notifications_fan_out_by_class);
+  RUN_TEST(test_notifications_wait_for_wifi);
+  RUN_TEST(test_changes_are_kept_before_services_start);
+  RUN_TEST(test_telegram_arm_stay_writes_keypad);
+  RUN_TEST(test_telegram_ignores_unknown_chat);
+  RUN_TEST(test_telegram_status_reply);
+  RUN_TEST(test_telegram_getconfig_reply);
+  RUN_TEST(test_telegram_offset_is_persisted);
+  RUN_TEST(test_telegram_reset_saves_offset);
+  RUN_TEST(test_telegram_reuses_tls_connection);
+  RUN_TEST(test_write_spiffs_streams_and_resumes);
+  RUN_TEST(test_write_spiffs_rejects_wrong_checksum);
+  RUN_TEST(test_read_spiffs_uploads_large_file);
+  RUN_TEST(test_file_route_streams_blocks);
+  RUN_TEST(test_file_route_refuses_internal_files);
+  RUN_TEST(test_history_lists_events);
+  RUN_TEST(test_format_rebuilds_stores);
+  RUN_TEST(test_root_page_is_streamed);
+  RUN_TEST(test_api_state_is_revalidated);
+  RUN_TEST(test_api_config_masks_secrets);
+  RUN_TEST(test_setconfig_reloads_recipients);
+  RUN_TEST(test_ui_is_served_gzipped);
+  RUN_TEST(test_ota_start_stops_keybus_from_its_task);
+  RUN_TEST(test_event_to_publish_cost);
+  return UNITY_END();
+}
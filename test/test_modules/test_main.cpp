@@ -0,0 +1,901 @@
+/**
+   Unit tests of the standalone gateway modules: panel state hand-off, event
+   diffing, state encoding, text formatting, MQTT topic table, Telegram notification queue and stage metrics.
+*/
+#include <Arduino.h>
+#include <dscKeybusInterface.h>
+#include <SPIFFS.h>
+#include <unity.h>
+#include <chrono>
+
+#include <command_trace.h>
+#include <config_store.h>
+#include <event_log.h>
+#include <keypad_queue.h>
+#include <loop_metrics.h>
+#include <mqtt_cache.h>
+#include <mqtt_command.h>
+#include <mqtt_scheduler.h>
+#include <mqtt_topics.h>
+#include <panel_events.h>
+#include <panel_state.h>
+#include <settings.h>
+#include <state_codec.h>
+#include <telegram_queue.h>
+#include <telegram_recipients.h>
+#include <text_buffer.h>
+
+// Host wall clock, moved back by clockOffset to run as before NTP sync
+static time_t clockOffset = 0;
+
+extern "C" time_t time(time_t *out) noexcept {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  time_t result = now.tv_sec - clockOffset;
+  if (out) *out = result;
+  return result;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_panel_take_consumes_changes() {
+  dscKeybusInterface dsc(18, 19, 21);
+  tsPanelState panel;
+
+  dsc.armed[0] = true;
+  dsc.armedChanged[0] = true;
+  panelCapture(dsc);
+  TEST_ASSERT_FALSE(dsc.armedChanged[0]);
+
+  TEST_ASSERT_TRUE(panelTake(panel));
+  TEST_ASSERT_TRUE(panel.armed[0]);
+  TEST_ASSERT_TRUE(panel.armedChanged[0]);
+
+  TEST_ASSERT_FALSE(panelTake(panel));
+}
+
+void test_panel_capture_merges_changes() {
+  dscKeybusInterface dsc(18, 19, 21);
+  tsPanelState panel;
+
+  dsc.openZones[0] = 0x01;
+  dsc.openZonesChanged[0] = 0x01;
+  panelCapture(dsc);
+  dsc.openZones[0] = 0x03;
+  dsc.openZonesChanged[0] = 0x02;
+  panelCapture(dsc);
+
+  TEST_ASSERT_TRUE(panelTake(panel));
+  TEST_ASSERT_EQUAL_HEX8(0x03, panel.openZones[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x03, panel.openZonesChanged[0]);
+}
+
+void test_panel_refresh_marks_partition() {
+  tsPanelState panel;
+
+  panelRequestRefresh(2);
+  TEST_ASSERT_TRUE(panelTake(panel));
+  TEST_ASSERT_TRUE(panel.armedChanged[2]);
+  TEST_ASSERT_FALSE(panel.armedChanged[1]);
+}
+
+void test_panel_diff_partition_events() {
+  tsPanelState panel = {};
+  tsPanelEvent events[PANEL_EVENT_MAX];
+
+  panel.armed[0] = true;
+  panel.armedStay[0] = true;
+  panel.noEntryDelay[0] = true;
+  panel.armedChanged[0] = true;
+  panel.disabled[1] = true;
+  panel.armedChanged[1] = true;
+  panel.exitDelayChanged[2] = true;
+  panel.armedChanged[2] = true;
+  panel.alarmChanged[2] = true;
+
+  TEST_ASSERT_EQUAL(2, panelDiff(panel, events, PANEL_EVENT_MAX));
+  TEST_ASSERT_EQUAL(PANEL_EVENT_ARMED, events[0].type);
+  TEST_ASSERT_EQUAL(0, events[0].index);
+  TEST_ASSERT_EQUAL(PANEL_ARMED_NIGHT, events[0].value);
+  TEST_ASSERT_EQUAL(PANEL_EVENT_ARMED, events[1].type);
+  TEST_ASSERT_EQUAL(2, events[1].index);
+  TEST_ASSERT_EQUAL(PANEL_DISARMED, events[1].value);
+}
+
+void test_panel_diff_bitmap_events() {
+  tsPanelState panel = {};
+  tsPanelEvent events[PANEL_EVENT_MAX];
+
+  panel.openZonesStatusChanged = true;
+  panel.openZones[1] = 0x02;
+  panel.openZonesChanged[1] = 0x03;
+  panel.pgmOutputsStatusChanged = true;
+  panel.pgmOutputs[1] = 0xFF;
+  panel.pgmOutputsChanged[1] = 0xFF;
+  panel.exitDelayChanged[0] = true;
+  panel.exitDelay[0] = true;
+  panel.exitState[0] = DSC_EXIT_AWAY;
+  panel.exitStateChanged[0] = true;
+
+  TEST_ASSERT_EQUAL(9, panelDiff(panel, events, PANEL_EVENT_MAX));
+  TEST_ASSERT_EQUAL(PANEL_EVENT_EXIT_DELAY, events[0].type);
+  TEST_ASSERT_EQUAL(DSC_EXIT_AWAY | PANEL_EXIT_STATE_CHANGED, events[0].value);
+  TEST_ASSERT_EQUAL(PANEL_EVENT_ZONE_OPEN, events[1].type);
+  TEST_ASSERT_EQUAL(8, events[1].index);
+  TEST_ASSERT_EQUAL(0, events[1].value);
+  TEST_ASSERT_EQUAL(9, events[2].index);
+  TEST_ASSERT_EQUAL(1, events[2].value);
+  TEST_ASSERT_EQUAL(PANEL_EVENT_PGM, events[3].type);
+  TEST_ASSERT_EQUAL(PANEL_PGM_COUNT - 1, events[8].index);
+
+  TEST_ASSERT_EQUAL(3, panelDiff(panel, events, 3));
+}
+
+void test_state_binary_layout() {
+  tsPanelState panel = {};
+  uint8_t record[STATE_BINARY_LEN];
+
+  panel.ready[0] = true;
+  panel.armed[1] = true;
+  panel.armedAway[1] = true;
+  panel.openZones[0] = 0x05;
+  panel.keybusConnected = true;
+
+  TEST_ASSERT_EQUAL(0, stateEncodeBinary(panel, record, sizeof(record) - 1));
+  TEST_ASSERT_EQUAL(STATE_BINARY_LEN, stateEncodeBinary(panel, record, sizeof(record)));
+  TEST_ASSERT_EQUAL_CHAR('D', record[0]);
+  TEST_ASSERT_EQUAL_CHAR('S', record[1]);
+  TEST_ASSERT_EQUAL(STATE_BINARY_VERSION, record[2]);
+  TEST_ASSERT_EQUAL(dscPartitions, record[3]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, record[4]);
+  TEST_ASSERT_EQUAL_HEX8(0x06, record[6]);
+  TEST_ASSERT_EQUAL_HEX8(0x05, record[4 + 2 * dscPartitions]);
+  TEST_ASSERT_EQUAL_HEX8(0x08, record[STATE_BINARY_LEN - 1]);
+}
+
+void test_state_json_lists_zones() {
+  tsPanelState panel = {};
+  char json[STATE_JSON_LEN];
+
+  panel.disabled[1] = true;
+  panel.openZones[0] = 0x05;
+  panel.alarmZones[1] = 0x01;
+
+  TEST_ASSERT_EQUAL(0, stateEncodeJson(panel, json, 16));
+  TEST_ASSERT_TRUE(stateEncodeJson(panel, json, sizeof(json)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"openZones\":[1,3]"));
+  TEST_ASSERT_NOT_NULL(strstr(json, "\"alarmZones\":[9]"));
+  TEST_ASSERT_NULL(strstr(json, "\"partition\":2"));
+}
+
+void test_text_buffer_keeps_whole_pieces() {
+  char buffer[16];
+  tsTextBuffer text;
+
+  textBegin(text, buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(textAppend(text, "Zone "));
+  TEST_ASSERT_TRUE(textPrintf(text, "%d: %s\n", 12, "open"));
+  TEST_ASSERT_FALSE(textPrintf(text, "%d: %s\n", 13, "open"));
+  TEST_ASSERT_TRUE(text.overflow);
+  TEST_ASSERT_EQUAL_STRING("Zone 12: open\n", buffer);
+  TEST_ASSERT_EQUAL(14, text.length);
+
+  // Nothing is appended after an overflow, even if it would fit
+  TEST_ASSERT_FALSE(textAppend(text, "!"));
+  TEST_ASSERT_EQUAL_STRING("Zone 12: open\n", buffer);
+}
+
+void test_text_buffer_escapes_json() {
+  char buffer[24];
+  tsTextBuffer text;
+
+  textBegin(text, buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(textAppendJson(text, "a\"b\\c\n"));
+  TEST_ASSERT_EQUAL_STRING("\"a\\\"b\\\\c\\u000a\"", buffer);
+
+  // A string that does not fit leaves the text as it was
+  size_t length = text.length;
+  TEST_ASSERT_FALSE(textAppendJson(text, "longer text"));
+  TEST_ASSERT_EQUAL(length, text.length);
+  TEST_ASSERT_EQUAL_STRING("\"a\\\"b\\\\c\\u000a\"", buffer);
+}
+
+void test_event_log_seeks_by_time() {
+  SPIFFS.mockReset();
+  TEST_ASSERT_EQUAL(0, eventLogBegin(SPIFFS));
+
+  tsPanelEvent event = { PANEL_EVENT_ZONE_OPEN, 0, 1 };
+  for (byte i = 0; i < 200; i++) {
+    event.index = i;
+    eventLogAppend(event, 1000 + (i * 10));
+  }
+  eventLogFlush(true);
+  TEST_ASSERT_EQUAL(200, eventLogStats().records);
+
+  tsEventLogCursor cursor;
+  tsEventLogRecord record;
+  TEST_ASSERT_TRUE(eventLogSeek(cursor, 1995));
+  TEST_ASSERT_TRUE(eventLogNext(cursor, record));
+  TEST_ASSERT_EQUAL(2000, record.time);
+  TEST_ASSERT_EQUAL(100, record.event.index);
+
+  byte remaining = 1;
+  while (eventLogNext(cursor, record)) remaining++;
+  TEST_ASSERT_EQUAL(100, remaining);
+  TEST_ASSERT_FALSE(eventLogSeek(cursor, 3000));
+}
+
+void test_event_log_rotates_and_reloads() {
+  SPIFFS.mockReset();
+  eventLogBegin(SPIFFS);
+
+  // One segment more than fits, the first one is rewritten
+  const unsigned long total = (EVENT_LOG_SEGMENTS + 1) * EVENT_LOG_SEGMENT_RECORDS;
+  tsPanelEvent event = { PANEL_EVENT_TROUBLE, 0, 1 };
+  for (unsigned long i = 1; i <= total; i++) eventLogAppend(event, i);
+  eventLogFlush(true);
+
+  TEST_ASSERT_EQUAL(EVENT_LOG_SEGMENTS * EVENT_LOG_SEGMENT_RECORDS, eventLogStats().records);
+  TEST_ASSERT_EQUAL(EVENT_LOG_SEGMENT_RECORDS + 1, eventLogStats().oldest);
+  TEST_ASSERT_EQUAL(EVENT_LOG_SEGMENTS * EVENT_LOG_SEGMENT_RECORDS, eventLogBegin(SPIFFS));
+
+  tsEventLogCursor cursor;
+  tsEventLogRecord record;
+  TEST_ASSERT_TRUE(eventLogSeek(cursor, 0));
+  TEST_ASSERT_TRUE(eventLogNext(cursor, record));
+  TEST_ASSERT_EQUAL(EVENT_LOG_SEGMENT_RECORDS + 1, record.time);
+
+  // New events continue after the newest segment
+  eventLogAppend(event, total + 1);
+  eventLogFlush(true);
+  TEST_ASSERT_TRUE(eventLogSeek(cursor, total + 1));
+  TEST_ASSERT_TRUE(eventLogNext(cursor, record));
+  TEST_ASSERT_EQUAL(total + 1, record.time);
+  TEST_ASSERT_FALSE(eventLogNext(cursor, record));
+}
+
+static char configServer[16] = "default";
+static char configPort[6] = "1883";
+static tsConfig configTable[] = {
+  { configServer, sizeof(configServer), "mqtt_server", "mqtt-server", "MQTT Server" },
+  { configPort, sizeof(configPort), "mqtt_port", "mqtt-port", "MQTT Port" },
+};
+
+static void writeFile(const char* path, const char* text) {
+  File file = SPIFFS.open(path, FILE_WRITE);
+  file.write((const uint8_t*)text, strlen(text));
+  file.close();
+}
+
+void test_event_log_backdates_events_before_sync() {
+  SPIFFS.mockReset();
+  eventLogBegin(SPIFFS);
+
+  tsPanelEvent event = { PANEL_EVENT_KEYBUS, 0, 1 };
+  eventLogAppend(event, 0);
+  delay(10000);
+  eventLogFlush(true);
+
+  tsEventLogCursor cursor;
+  tsEventLogRecord record;
+  TEST_ASSERT_TRUE(eventLogSeek(cursor, 0));
+  TEST_ASSERT_TRUE(eventLogNext(cursor, record));
+  uint32_t now = time(nullptr);
+  TEST_ASSERT_UINT32_WITHIN(1, now - 10, record.time);
+  TEST_ASSERT_EQUAL(0, record.flags);
+}
+
+void test_event_log_flags_events_without_sync() {
+  SPIFFS.mockReset();
+  eventLogBegin(SPIFFS);
+
+  tsPanelEvent event = { PANEL_EVENT_KEYBUS, 0, 1 };
+  eventLogAppend(event, 1000);
+  eventLogFlush(true);
+
+  // The clock reads the uptime until NTP sets it, a full buffer is written anyway
+  clockOffset = time(nullptr) - 100;
+  for (byte i = 0; i < EVENT_LOG_BUFFER_LEN; i++) eventLogAppend(event, EVENT_LOG_TIME_UNSYNCED);
+  clockOffset = 0;
+
+  tsEventLogCursor cursor;
+  tsEventLogRecord record;
+  TEST_ASSERT_TRUE(eventLogSeek(cursor, 0));
+  TEST_ASSERT_TRUE(eventLogNext(cursor, record));
+  TEST_ASSERT_EQUAL(1000, record.time);
+  TEST_ASSERT_EQUAL(0, record.flags);
+  byte unsynced = 0;
+  while (eventLogNext(cursor, record)) {
+    TEST_ASSERT_EQUAL(1000, record.time);
+    TEST_ASSERT_EQUAL(EVENT_LOG_UNSYNCED, record.flags);
+    unsynced++;
+  }
+  TEST_ASSERT_EQUAL(EVENT_LOG_BUFFER_LEN, unsynced);
+}
+
+void test_config_migrates_json() {
+  SPIFFS.mockReset();
+  writeFile("/config.json", "{\"mqtt_server\":\"broker.local\",\"unknown\":\"x\"}");
+
+  TEST_ASSERT_EQUAL(CONFIG_MIGRATED, configBegin(SPIFFS, configTable, 2));
+  TEST_ASSERT_EQUAL_STRING("broker.local", configServer);
+  TEST_ASSERT_EQUAL_STRING("1883", configPort);
+  TEST_ASSERT_FALSE(SPIFFS.exists("/config.json"));
+
+  strcpy(configServer, "");
+  TEST_ASSERT_EQUAL(CONFIG_LOADED, configBegin(SPIFFS, configTable, 2));
+  TEST_ASSERT_EQUAL_STRING("broker.local", configServer);
+}
+
+void test_config_appends_and_survives_torn_write() {
+  SPIFFS.mockReset();
+  strcpy(configServer, "default");
+  TEST_ASSERT_EQUAL(CONFIG_DEFAULTS, configBegin(SPIFFS, configTable, 2));
+  TEST_ASSERT_TRUE(configCompact());
+  size_t snapshot = SPIFFS.open("/config.bin").size();
+
+  strcpy(configPort, "8883");
+  TEST_ASSERT_TRUE(configSave(configTable[1]));
+  size_t appended = SPIFFS.open("/config.bin").size();
+  TEST_ASSERT_EQUAL(snapshot + 1 + 9 + 1 + 4 + 2, appended);
+
+  // A torn append keeps the previous value
+  strcpy(configPort, "1");
+  TEST_ASSERT_TRUE(configSave(configTable[1]));
+  File file = SPIFFS.open("/config.bin", "r+");
+  file.seek(appended + 3);
+  file.write((const uint8_t*)"?", 1);
+  file.close();
+
+  strcpy(configPort, "");
+  TEST_ASSERT_EQUAL(CONFIG_LOADED, configBegin(SPIFFS, configTable, 2));
+  TEST_ASSERT_EQUAL_STRING("8883", configPort);
+  TEST_ASSERT_EQUAL_STRING("default", configServer);
+}
+
+void test_config_compacts_when_full() {
+  SPIFFS.mockReset();
+  configBegin(SPIFFS, configTable, 2);
+  for (unsigned int i = 0; i < 200; i++) {
+    snprintf(configPort, sizeof(configPort), "%u", i);
+    TEST_ASSERT_TRUE(configSave(configTable[1]));
+  }
+  TEST_ASSERT_TRUE(SPIFFS.open("/config.bin").size() <= CONFIG_STORE_LEN);
+
+  strcpy(configPort, "");
+  configBegin(SPIFFS, configTable, 2);
+  TEST_ASSERT_EQUAL_STRING("199", configPort);
+}
+
+void test_mqtt_cache_tracks_stale_topics() {
+  static tsMqttTopics topics;
+  mqttTopicsBegin(topics, "dsc/Get/Partition", "dsc/Get/Zone", "dsc/Get/Fire", "dsc/Get/PGM");
+  mqttCacheBegin(topics);
+
+  TEST_ASSERT_TRUE(mqttCacheWant(topics.zone[2], "1"));
+  mqttCacheSent(topics.zone[2], "1");
+  TEST_ASSERT_FALSE(mqttCacheWant(topics.zone[2], "1"));
+  TEST_ASSERT_TRUE(mqttCacheWant("dsc/status/LWT", "Online"));
+
+  // Not sent while disconnected
+  TEST_ASSERT_TRUE(mqttCacheWant(topics.zone[2], "0"));
+  TEST_ASSERT_TRUE(mqttCacheWant(topics.pgm[0], "1"));
+
+  size_t index = 0;
+  const char* topic;
+  const char* payload;
+  TEST_ASSERT_TRUE(mqttCacheNextStale(index, topic, payload));
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/Zone3", topic);
+  TEST_ASSERT_EQUAL_STRING("0", payload);
+  TEST_ASSERT_TRUE(mqttCacheNextStale(index, topic, payload));
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/PGM1", topic);
+  TEST_ASSERT_FALSE(mqttCacheNextStale(index, topic, payload));
+
+  mqttCacheSent(topics.zone[2], "0");
+  mqttCacheInvalidate(topics.zone[2]);
+  TEST_ASSERT_TRUE(mqttCacheWant(topics.zone[2], "0"));
+}
+
+static std::string schedulerSent;
+static bool schedulerAccepts = true;
+
+static bool recordPublish(const char* topic, const char* payload) {
+  if (!schedulerAccepts) return false;
+  schedulerSent += std::string(topic) + "=" + payload + " ";
+  return true;
+}
+
+void test_mqtt_scheduler_lanes_and_bucket() {
+  static tsMqttTopics topics;
+  mqttTopicsBegin(topics, "dsc/Get/Partition", "dsc/Get/Zone", "dsc/Get/Fire", "dsc/Get/PGM");
+  mqttCacheBegin(topics);
+  mqttSchedulerBegin(recordPublish, 10, 4);
+  schedulerSent.clear();
+
+  // A zone storm, then an alarm: the alarm goes out first and each zone once with its latest value
+  for (byte round = 0; round < 3; round++) {
+    TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_ENTITY, topics.zone[2], round % 2 ? "0" : "1"));
+    TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_ENTITY, topics.zone[3], round % 2 ? "0" : "1"));
+  }
+  TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_ENTITY, topics.pgm[0], "1"));
+  TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_CRITICAL, topics.partition[0], "T"));
+  TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_CRITICAL, topics.fire[0], "1"));
+  TEST_ASSERT_EQUAL(5, mqttSchedulerPending());
+  TEST_ASSERT_EQUAL(4, mqttSchedulerStats().coalesced);
+
+  // The bucket holds 4 messages
+  TEST_ASSERT_EQUAL(4, mqttSchedulerRun(100000));
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/Partition1=T dsc/Get/Fire1=1 dsc/Get/Zone3=1 dsc/Get/Zone4=1 ", schedulerSent.c_str());
+  TEST_ASSERT_FALSE(mqttSchedulerAcquire());
+  TEST_ASSERT_EQUAL(1, mqttSchedulerStats().deferred);
+
+  // 10 per second: one token after 100 ms
+  mockAdvanceMillis(100);
+  TEST_ASSERT_EQUAL(1, mqttSchedulerRun(100000));
+  TEST_ASSERT_TRUE(mqttCacheHolds(topics.pgm[0], "1"));
+
+  // A value the broker holds is not queued, nor one that returns to it before being sent
+  mockAdvanceMillis(1000);
+  schedulerSent.clear();
+  TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_ENTITY, topics.zone[2], "1"));
+  TEST_ASSERT_EQUAL(0, mqttSchedulerPending());
+  TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_ENTITY, topics.zone[2], "0"));
+  TEST_ASSERT_TRUE(mqttSchedulerPost(MQTT_LANE_ENTITY, topics.zone[2], "1"));
+  TEST_ASSERT_EQUAL(0, mqttSchedulerRun(100000));
+  TEST_ASSERT_EQUAL_STRING("", schedulerSent.c_str());
+
+  // A refused publish drops the lanes, the cache keeps the value stale
+  schedulerAccepts = false;
+  mqttCacheWant(topics.zone[5], "1");
+  mqttSchedulerPost(MQTT_LANE_ENTITY, topics.zone[5], "1");
+  mqttSchedulerPost(MQTT_LANE_ENTITY, topics.zone[6], "1");
+  TEST_ASSERT_EQUAL(0, mqttSchedulerRun(100000));
+  TEST_ASSERT_EQUAL(0, mqttSchedulerPending());
+  TEST_ASSERT_FALSE(mqttCacheHolds(topics.zone[5], "1"));
+  schedulerAccepts = true;
+
+  char buffer[1024];
+  TEST_ASSERT_TRUE(mqttSchedulerFormat(buffer, sizeof(buffer)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_mqtt_sent_total{lane=\"critical\"} 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_mqtt_coalesced_total 5\n"));
+}
+
+void test_mqtt_topics_table() {
+  static tsMqttTopics topics;
+
+  mqttTopicsBegin(topics, "dsc/Get/Partition", "dsc/Get/Zone", "dsc/Get/Fire", "dsc/Get/PGM");
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/Partition1", topics.partition[0]);
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/Zone64", topics.zone[MQTT_ZONE_COUNT - 1]);
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/Fire8", topics.fire[dscPartitions - 1]);
+  TEST_ASSERT_EQUAL_STRING("dsc/Get/PGM14", topics.pgm[MQTT_PGM_COUNT - 1]);
+  TEST_ASSERT_EQUAL_STRING("3N", topics.target[2][MQTT_TARGET_NIGHT]);
+  TEST_ASSERT_EQUAL_STRING("1D", topics.target[0][MQTT_TARGET_DISARM]);
+
+  byte index = 0;
+  TEST_ASSERT_EQUAL(MQTT_TOPIC_PARTITION, mqttTopicsFind(topics, "dsc/Get/Partition2", index));
+  TEST_ASSERT_EQUAL(1, index);
+  TEST_ASSERT_EQUAL(MQTT_TOPIC_FIRE, mqttTopicsFind(topics, "dsc/Get/Fire8", index));
+  TEST_ASSERT_EQUAL(7, index);
+  TEST_ASSERT_EQUAL(MQTT_TOPIC_ZONE, mqttTopicsFind(topics, "dsc/Get/Zone64", index));
+  TEST_ASSERT_EQUAL(63, index);
+  TEST_ASSERT_EQUAL(MQTT_TOPIC_PGM, mqttTopicsFind(topics, "dsc/Get/PGM1", index));
+  TEST_ASSERT_EQUAL(0, index);
+  TEST_ASSERT_EQUAL(MQTT_TOPIC_NONE, mqttTopicsFind(topics, "dsc/Get/Zone65", index));
+  TEST_ASSERT_EQUAL(MQTT_TOPIC_NONE, mqttTopicsFind(topics, "dsc/Get/Trouble", index));
+}
+
+// Reports the cost of a zone topic built on every publish, as before the table, against a table lookup
+void test_mqtt_topics_build_vs_lookup() {
+  static tsMqttTopics topics;
+  const char* zoneTopic = "dsc/Get/Zone";
+  const unsigned long rounds = 20000;
+  size_t builtBytes = 0, lookedUpBytes = 0;
+
+  mqttTopicsBegin(topics, "dsc/Get/Partition", zoneTopic, "dsc/Get/Fire", "dsc/Get/PGM");
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long round = 0; round < rounds; round++) {
+    for (byte zone = 0; zone < MQTT_ZONE_COUNT; zone++) {
+      char zonePublishTopic[strlen(zoneTopic) + 3];
+      char zoneNumber[3];
+      strcpy(zonePublishTopic, zoneTopic);
+      itoa(zone + 1, zoneNumber, 10);
+      strcat(zonePublishTopic, zoneNumber);
+      builtBytes += strlen(zonePublishTopic);
+      if (round == 0) TEST_ASSERT_EQUAL_STRING(topics.zone[zone], zonePublishTopic);
+    }
+  }
+  auto built = std::chrono::steady_clock::now();
+  for (unsigned long round = 0; round < rounds; round++) {
+    for (byte zone = 0; zone < MQTT_ZONE_COUNT; zone++) lookedUpBytes += strlen(topics.zone[zone]);
+  }
+  auto end = std::chrono::steady_clock::now();
+  TEST_ASSERT_EQUAL(builtBytes, lookedUpBytes);
+
+  double topicCount = (double)rounds * MQTT_ZONE_COUNT;
+  char report[96];
+  snprintf(report, sizeof(report), "zone topic: built %.1f ns, looked up %.1f ns",
+           std::chrono::duration<double, std::nano>(built - start).count() / topicCount,
+           std::chrono::duration<double, std::nano>(end - built).count() / topicCount);
+  TEST_MESSAGE(report);
+}
+
+static teMqttParse parseCommand(tsMqttCommand &command, const char* topic, const char* payload) {
+  return mqttCommandParse(command, "dsc/Set", topic, (const uint8_t*)payload, strlen(payload));
+}
+
+void test_mqtt_command_grammar() {
+  tsMqttCommand command;
+
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set", "3N"));
+  TEST_ASSERT_EQUAL(MQTT_CMD_ARM_NIGHT, command.command);
+  TEST_ASSERT_EQUAL(2, command.partition);
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set", "D"));
+  TEST_ASSERT_EQUAL(MQTT_CMD_DISARM, command.command);
+  TEST_ASSERT_EQUAL(0, command.partition);
+  TEST_ASSERT_EQUAL(MQTT_PARSE_PAYLOAD, parseCommand(command, "dsc/Set", "9A"));
+
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set/Partition2", "arm_away"));
+  TEST_ASSERT_EQUAL(MQTT_CMD_ARM_AWAY, command.command);
+  TEST_ASSERT_EQUAL(1, command.partition);
+  TEST_ASSERT_EQUAL(MQTT_PARSE_PARTITION, parseCommand(command, "dsc/Set/Partition9", "A"));
+  TEST_ASSERT_EQUAL(MQTT_PARSE_TOPIC, parseCommand(command, "dsc/Set/Partition1/Open", "A"));
+  TEST_ASSERT_EQUAL(MQTT_PARSE_TOPIC, parseCommand(command, "dsc/Get/Partition1", "A"));
+
+  // Keys point into the payload, bounded by its length and not by a terminator
+  const uint8_t keys[] = { '*', '1', '0', '3', '#', 'X' };
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, mqttCommandParse(command, "dsc/Set", "dsc/Set/Partition1/Keys", keys, 5));
+  TEST_ASSERT_EQUAL(MQTT_CMD_KEYS, command.command);
+  TEST_ASSERT_EQUAL_PTR(keys, command.keys);
+  TEST_ASSERT_EQUAL(5, command.keysLength);
+  TEST_ASSERT_EQUAL(MQTT_PARSE_KEYS, parseCommand(command, "dsc/Set/Partition1/Keys", "12;4"));
+
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set/Partition1/Bypass", "3, 12,64"));
+  TEST_ASSERT_EQUAL_HEX8(0x04, command.zones[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x08, command.zones[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, command.zones[7]);
+  TEST_ASSERT_EQUAL(MQTT_PARSE_ZONES, parseCommand(command, "dsc/Set/Partition1/Bypass", "65"));
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set/Partition1/Output", "2"));
+  TEST_ASSERT_EQUAL(2, command.output);
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OUTPUT, parseCommand(command, "dsc/Set/Partition1/Output", "5"));
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set/Partition4/Panic", ""));
+  TEST_ASSERT_EQUAL(MQTT_CMD_PANIC, command.command);
+}
+
+void test_mqtt_command_json() {
+  tsMqttCommand command;
+  const char* payload = "{\"id\":\"req-7\", \"command\":\"bypass\",\"partition\":2,\"zones\":[1,9],\"source\":{}}";
+
+  // Unknown members are skipped, objects are not
+  TEST_ASSERT_EQUAL(MQTT_PARSE_PAYLOAD, parseCommand(command, "dsc/Set", payload));
+  TEST_ASSERT_EQUAL(5, command.idLength);
+
+  payload = "{\"id\":\"req-7\", \"command\":\"bypass\",\"partition\":2,\"zones\":[1,9],\"source\":\"app\"}";
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set", payload));
+  TEST_ASSERT_EQUAL(MQTT_CMD_BYPASS, command.command);
+  TEST_ASSERT_EQUAL(1, command.partition);
+  TEST_ASSERT_EQUAL_HEX8(0x01, command.zones[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, command.zones[1]);
+  TEST_ASSERT_EQUAL_PTR(payload + 7, command.id);
+
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OK, parseCommand(command, "dsc/Set", "{\"command\":\"keys\",\"keys\":\"*71\"}"));
+  TEST_ASSERT_EQUAL(3, command.keysLength);
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OUTPUT, parseCommand(command, "dsc/Set", "{\"command\":\"output\"}"));
+  // 257 would wrap to output 1 in a byte
+  TEST_ASSERT_EQUAL(MQTT_PARSE_OUTPUT, parseCommand(command, "dsc/Set", "{\"command\":\"output\",\"output\":257}"));
+  TEST_ASSERT_EQUAL(MQTT_PARSE_PAYLOAD, parseCommand(command, "dsc/Set", "{\"command\":\"arm_away\""));
+  TEST_ASSERT_EQUAL(MQTT_PARSE_PAYLOAD, parseCommand(command, "dsc/Set", "{\"command\":\"ar\\u006d\"}"));
+}
+
+// Reports the parser throughput on the host
+void test_mqtt_command_parse_throughput() {
+  static const char* const topics[] = { "dsc/Set", "dsc/Set/Partition2/Bypass", "dsc/Set" };
+  static const char* const payloads[] = {
+    "1A", "1,2,3,4,5,6,7,8", "{\"id\":\"abc\",\"command\":\"keys\",\"partition\":1,\"keys\":\"*1#\"}" };
+  const unsigned long count = 300000;
+  tsMqttCommand command;
+  unsigned long parsed = 0;
+  size_t bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long idx = 0; idx < count; idx++) {
+    const char* payload = payloads[idx % 3];
+    size_t length = strlen(payload);
+    bytes += length;
+    if (mqttCommandParse(command, "dsc/Set", topics[idx % 3], (const uint8_t*)payload, length) == MQTT_PARSE_OK) parsed++;
+  }
+  auto end = std::chrono::steady_clock::now();
+  TEST_ASSERT_EQUAL(count, parsed);
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  char report[96];
+  snprintf(report, sizeof(report), "MQTT command parser: %.0f commands/s, %.1f MB/s",
+           count / seconds, bytes / seconds / 1e6);
+  TEST_MESSAGE(report);
+}
+
+void test_command_trace_confirms_and_expires() {
+  dscKeybusInterface dsc(18, 19, 21);
+  const tsTraceMetrics &arm = traceMetrics(TRACE_MQTT, TRACE_ARM_AWAY);
+  const tsTraceMetrics &disarm = traceMetrics(TRACE_TELEGRAM, TRACE_DISARM);
+
+  uint16_t armId = traceBegin(TRACE_MQTT, TRACE_ARM_AWAY, 1);
+  uint16_t disarmId = traceBegin(TRACE_TELEGRAM, TRACE_DISARM, 0);
+  TEST_ASSERT_NOT_EQUAL(armId, disarmId);
+  delay(40);
+  traceWritten(armId, dsc);
+  TEST_ASSERT_EQUAL(1, arm.phases[TRACE_WRITTEN].count);
+  TEST_ASSERT_EQUAL(1, arm.phases[TRACE_WRITTEN].buckets[2]);   // 33-64 ms
+
+  // A change on another partition or in the wrong direction does not confirm
+  delay(1000);
+  dsc.exitDelay[0] = true;
+  dsc.exitDelayChanged[0] = true;
+  traceConfirm(dsc);
+  dsc.exitDelayChanged[0] = false;
+  dsc.exitDelayChanged[1] = true;
+  traceConfirm(dsc);
+  dsc.exitDelay[1] = true;
+  traceConfirm(dsc);
+  TEST_ASSERT_EQUAL(1, arm.phases[TRACE_CONFIRMED].count);
+  TEST_ASSERT_EQUAL(1040, arm.phases[TRACE_CONFIRMED].maxMs);
+
+  // The disarm was never written, it times out
+  traceExpire();
+  TEST_ASSERT_EQUAL(0, disarm.timeouts);
+  delay(TRACE_TIMEOUT_MS);
+  traceExpire();
+  TEST_ASSERT_EQUAL(1, disarm.timeouts);
+  TEST_ASSERT_EQUAL(0, arm.timeouts);
+
+  char buffer[2048];
+  TEST_ASSERT_TRUE(traceFormatHistogram(TRACE_CONFIRMED, TRACE_MQTT, TRACE_ARM_AWAY, buffer, sizeof(buffer)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_command_confirm_ms_bucket{source=\"mqtt\",command=\"arm_away\",le=\"1024\"} 0\n"));
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_command_confirm_ms_bucket{source=\"mqtt\",command=\"arm_away\",le=\"2048\"} 1\n"));
+  TEST_ASSERT_TRUE(traceFormatCounters(buffer, sizeof(buffer)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_command_timeouts_total{source=\"telegram\",command=\"disarm\"} 1\n"));
+}
+
+void test_telegram_queue_merges_burst() {
+  static tsTelegramBatch batch;
+
+  telegramQueuePush("Alarm: Partition 1", TELEGRAM_CLASS_ALARM);
+  telegramQueuePush("Zone alarm: 3", TELEGRAM_CLASS_ALARM);
+  TEST_ASSERT_EQUAL(2, telegramQueueCollectBatch(batch, 1500, 0));
+  TEST_ASSERT_EQUAL_STRING("Alarm: Partition 1\nZone alarm: 3", batch.text);
+  TEST_ASSERT_EQUAL(TELEGRAM_CLASS_ALARM, batch.mask);
+  TEST_ASSERT_EQUAL(0, telegramQueueCollectBatch(batch, 1500, 0));
+}
+
+void test_telegram_queue_carries_over() {
+  static tsTelegramBatch batch;
+  char line[TELEGRAM_QUEUE_MSG_LEN];
+  memset(line, 'x', sizeof(line) - 1);
+  line[sizeof(line) - 1] = 0x00;
+
+  // Full length lines and their separators fill the batch text, the next one starts a new batch
+  const unsigned int fit = sizeof(batch.text) / sizeof(line);
+  for (unsigned int i = 0; i <= fit; i++) telegramQueuePush(line);
+  TEST_ASSERT_EQUAL(fit, telegramQueueCollectBatch(batch, 1500, 0));
+  TEST_ASSERT_EQUAL(1, telegramQueueCollectBatch(batch, 1500, 0));
+  TEST_ASSERT_EQUAL_STRING(line, batch.text);
+}
+
+void test_telegram_queue_drops_when_full() {
+  static tsTelegramBatch batch;
+  unsigned long dropped = telegramQueueStats().dropped;
+
+  for (byte i = 0; i <= TELEGRAM_QUEUE_LEN; i++) telegramQueuePush("Zone alarm: 3");
+  TEST_ASSERT_EQUAL(dropped + 1, telegramQueueStats().dropped);
+  TEST_ASSERT_EQUAL(TELEGRAM_QUEUE_LEN, telegramQueueCollectBatch(batch, 1500, 0));
+}
+
+void test_telegram_recipients_and_classes() {
+  TEST_ASSERT_EQUAL(TELEGRAM_CLASS_ALARM | TELEGRAM_CLASS_TROUBLE, telegramClassesParse("alarm+trouble", 13));
+  TEST_ASSERT_EQUAL(0, telegramClassesParse("alarm+fire", 10));
+
+  // Unknown classes drop the entry, the command chat can be narrowed, repeats replace
+  TEST_ASSERT_EQUAL(2, telegramRecipientsBegin("42", "-1001,7:alarm+fire 42:arming,,-1001:system"));
+  tsTelegramRecipient command = telegramRecipient(0);
+  tsTelegramRecipient group = telegramRecipient(1);
+  TEST_ASSERT_EQUAL_STRING("42", command.chatId);
+  TEST_ASSERT_EQUAL(TELEGRAM_CLASS_ARMING, command.classes);
+  TEST_ASSERT_EQUAL_STRING("-1001", group.chatId);
+  TEST_ASSERT_EQUAL(TELEGRAM_CLASS_SYSTEM, group.classes);
+  TEST_ASSERT_EQUAL(TELEGRAM_RECIPIENTS_MAX, telegramRecipientsBegin("", "1,2,3,4,5,6,7,8"));
+
+  telegramRecipientRecord("1", true, 300);
+  telegramRecipientRecord("1", true, 100);
+  telegramRecipientRecord("1", false, 5000);
+  tsRecipientStats stats = telegramRecipient(0).stats;
+  TEST_ASSERT_EQUAL(2, stats.sent);
+  TEST_ASSERT_EQUAL(1, stats.failures);
+  TEST_ASSERT_EQUAL(400, stats.sumMs);
+  TEST_ASSERT_EQUAL(300, stats.maxMs);
+
+  // A reload keeps the statistics of the chats still listed
+  TEST_ASSERT_EQUAL(2, telegramRecipientsBegin("9", "1:alarm"));
+  TEST_ASSERT_EQUAL_STRING("9", telegramRecipient(0).chatId);
+  TEST_ASSERT_EQUAL(0, telegramRecipient(0).stats.sent);
+  TEST_ASSERT_EQUAL(2, telegramRecipient(1).stats.sent);
+  TEST_ASSERT_EQUAL(TELEGRAM_CLASS_ALARM, telegramRecipient(1).classes);
+
+  // A delivery that outlived its chat's place in the list credits no one else
+  telegramRecipientRecord("2", true, 50);
+  static tsTelegramRecipients snapshot;
+  telegramRecipientsPrefix("[Home] 0123456789012345678901234567890123456789");
+  telegramRecipientsSnapshot(snapshot);
+  TEST_ASSERT_EQUAL(2, snapshot.count);
+  TEST_ASSERT_EQUAL(0, snapshot.recipients[0].stats.sent);
+  TEST_ASSERT_EQUAL(2, snapshot.recipients[1].stats.sent);
+  TEST_ASSERT_EQUAL(TELEGRAM_MSG_PREFIX_LEN - 1, strlen(snapshot.prefix));
+  telegramRecipientsPrefix("");
+
+  // Lines of a batch are picked by class
+  static tsTelegramBatch batch;
+  char message[64];
+  telegramQueuePush("Armed away: Partition 1", TELEGRAM_CLASS_ARMING);
+  telegramQueuePush("Alarm: Partition 1", TELEGRAM_CLASS_ALARM);
+  telegramQueuePush("Power trouble", TELEGRAM_CLASS_TROUBLE);
+  TEST_ASSERT_EQUAL(3, telegramQueueCollectBatch(batch, 1500, 0));
+  TEST_ASSERT_EQUAL(TELEGRAM_CLASS_ARMING | TELEGRAM_CLASS_ALARM | TELEGRAM_CLASS_TROUBLE, batch.mask);
+  TEST_ASSERT_EQUAL(2, telegramBatchSelect(batch, TELEGRAM_CLASS_ALARM | TELEGRAM_CLASS_TROUBLE, message, sizeof(message)));
+  TEST_ASSERT_EQUAL_STRING("Alarm: Partition 1\nPower trouble", message);
+  TEST_ASSERT_EQUAL(0, telegramBatchSelect(batch, TELEGRAM_CLASS_SYSTEM, message, sizeof(message)));
+  TEST_ASSERT_EQUAL_STRING("", message);
+}
+
+void test_metrics_histogram() {
+  tsMetricsMark start = metricsMark();
+  delayMicroseconds(300);
+  metricsRecord(STAGE_OTA, start);
+  start = metricsMark();
+  delay(20);
+  metricsRecord(STAGE_OTA, start);
+
+  const tsStageMetrics &ota = metricsStage(STAGE_OTA);
+  TEST_ASSERT_EQUAL(2, ota.count);
+  TEST_ASSERT_EQUAL(20000, ota.maxUs);
+  TEST_ASSERT_EQUAL(1, ota.overBudget);
+  TEST_ASSERT_EQUAL(1, ota.buckets[8]);
+  TEST_ASSERT_EQUAL(32768, metricsP99(STAGE_OTA));
+
+  // A duration on a bucket bound is counted under that `le`
+  metricsReset(STAGE_OTA);
+  start = metricsMark();
+  delayMicroseconds(256);
+  metricsRecord(STAGE_OTA, start);
+  start = metricsMark();
+  delayMicroseconds(257);
+  metricsRecord(STAGE_OTA, start);
+  TEST_ASSERT_EQUAL(1, ota.buckets[7]);
+  TEST_ASSERT_EQUAL(1, ota.buckets[8]);
+  char buffer[2048];
+  TEST_ASSERT_TRUE(metricsFormatHistogram(STAGE_OTA, buffer, sizeof(buffer)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_stage_duration_us_bucket{stage=\"ota\",le=\"256\"} 1\n"));
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_stage_duration_us_bucket{stage=\"ota\",le=\"512\"} 2\n"));
+}
+
+void test_metrics_long_stage_uses_millis() {
+  tsMetricsMark start = metricsMark();
+  delay(30000);
+  metricsRecord(STAGE_TELEGRAM, start);
+
+  TEST_ASSERT_EQUAL(30000000, metricsStage(STAGE_TELEGRAM).maxUs);
+}
+
+void test_keypad_queue_priority_and_rejection() {
+  keypadQueueClear();
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePush(KEYPAD_PRIORITY_KEYS, 1, "*71", 0));
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePush(KEYPAD_PRIORITY_ARM, 2, "w", 7));
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePush(KEYPAD_PRIORITY_ACCESS_CODE, 1, "1234", 8));
+  TEST_ASSERT_EQUAL(KEYPAD_INVALID, keypadQueuePush(KEYPAD_PRIORITY_KEYS, 1, "", 0));
+  TEST_ASSERT_EQUAL(KEYPAD_INVALID, keypadQueuePush(KEYPAD_PRIORITY_KEYS, 1, "0123456789012345678901234567890123", 0));
+
+  // Access codes first, then arming, then other keys
+  tsKeypadCommand command;
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("1234", command.keys);
+  TEST_ASSERT_EQUAL(8, command.traceId);
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("w", command.keys);
+  TEST_ASSERT_EQUAL(2, command.partition);
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("*71", command.keys);
+  TEST_ASSERT_FALSE(keypadQueuePop(command));
+
+  // A full class rejects, the others still take commands
+  for (byte idx = 0; idx < KEYPAD_QUEUE_LEN; idx++) TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePush(KEYPAD_PRIORITY_KEYS, 1, "1", 0));
+  TEST_ASSERT_EQUAL(KEYPAD_FULL, keypadQueuePush(KEYPAD_PRIORITY_KEYS, 1, "2", 0));
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePush(KEYPAD_PRIORITY_ACCESS_CODE, 1, "1234", 0));
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUE_LEN + 1, keypadQueueStats().depth);
+
+  // Several writes go in together or not at all
+  keypadQueuePop(command);
+  keypadQueuePop(command);
+  const char keys[3][KEYPAD_KEYS_LEN] = { "*101", "02", "03#" };
+  TEST_ASSERT_EQUAL(KEYPAD_FULL, keypadQueuePushAll(KEYPAD_PRIORITY_KEYS, 1, keys, 3, 9));
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUE_LEN - 1, keypadQueueStats().depth);
+  keypadQueueClear();
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePushAll(KEYPAD_PRIORITY_KEYS, 1, keys, 3, 9));
+  keypadQueuePop(command);
+  TEST_ASSERT_EQUAL(0, command.traceId);
+  keypadQueuePop(command);
+  keypadQueuePop(command);
+  TEST_ASSERT_EQUAL_STRING("03#", command.keys);
+  TEST_ASSERT_EQUAL(9, command.traceId);
+
+  char buffer[1024];
+  TEST_ASSERT_TRUE(keypadQueueFormat(buffer, sizeof(buffer)) > 0);
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_keypad_rejected_total{class=\"keys\"} 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(buffer, "dsc_keypad_queue_depth 0\n"));
+}
+
+// An arm for another partition queued mid-bypass waits for the bypass to finish
+void test_keypad_queue_group_is_atomic() {
+  keypadQueueClear();
+  const char keys[3][KEYPAD_KEYS_LEN] = { "*1", "0102", "#" };
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePushAll(KEYPAD_PRIORITY_KEYS, 1, keys, 3, 5));
+
+  tsKeypadCommand command;
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("*1", command.keys);
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePush(KEYPAD_PRIORITY_ARM, 2, "w", 6));
+  TEST_ASSERT_EQUAL(KEYPAD_QUEUED, keypadQueuePush(KEYPAD_PRIORITY_ACCESS_CODE, 2, "1234", 7));
+
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("0102", command.keys);
+  TEST_ASSERT_EQUAL(1, command.partition);
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("#", command.keys);
+  TEST_ASSERT_EQUAL(5, command.traceId);
+
+  // Then the classes by priority again
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("1234", command.keys);
+  TEST_ASSERT_TRUE(keypadQueuePop(command));
+  TEST_ASSERT_EQUAL_STRING("w", command.keys);
+  TEST_ASSERT_EQUAL(2, command.partition);
+  TEST_ASSERT_FALSE(keypadQueuePop(command));
+}
+
+int main(int argc, char** argv) {
+  metricsBegin();
+  telegramQueueBegin(TELEGRAM_QUEUE_LEN);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_panel_take_consumes_changes);
+  RUN_TEST(test_panel_capture_merges_changes);
+  RUN_TEST(test_panel_refresh_marks_partition);
+  RUN_TEST(test_panel_diff_partition_events);
+  RUN_TEST(test_panel_diff_bitmap_events);
+  RUN_TEST(test_state_binary_layout);
+  RUN_TEST(test_state_json_lists_zones);
+  RUN_TEST(test_text_buffer_keeps_whole_pieces);
+  RUN_TEST(test_text_buffer_escapes_json);
+  RUN_TEST(test_event_log_seeks_by_time);
+  RUN_TEST(test_event_log_rotates_and_reloads);
+  RUN_TEST(test_event_log_backdates_events_before_sync);
+  RUN_TEST(test_event_log_flags_events_without_sync);
+  RUN_TEST(test_config_migrates_json);
+  RUN_TEST(test_config_appends_and_survives_torn_write);
+  RUN_TEST(test_config_compacts_when_full);
+  RUN_TEST(test_mqtt_topics_table);
+  RUN_TEST(test_mqtt_topics_build_vs_lookup);
+  RUN_TEST(test_mqtt_cache_tracks_stale_topics);
+  RUN_TEST(test_mqtt_scheduler_lanes_and_bucket);
+  RUN_TEST(test_mqtt_command_grammar);
+  RUN_TEST(test_mqtt_command_json);
+  RUN_TEST(test_mqtt_command_parse_throughput);
+  RUN_TEST(test_command_trace_confirms_and_expires);
+  RUN_TEST(test_keypad_queue_priority_and_rejection);
+  RUN_TEST(test_keypad_queue_group_is_atomic);
+  RUN_TEST(test_telegram_queue_merges_burst);
+  RUN_TEST(test_telegram_queue_carries_over);
+  RUN_TEST(test_telegram_queue_drops_when_full);
+  RUN_TEST(test_telegram_recipients_and_classes);
+  RUN_TEST(test_metrics_histogram);
+  RUN_TEST(test_metrics_long_stage_uses_millis);
+  return UNITY_END();
+}
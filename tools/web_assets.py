@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Compress the files of web/ into src/web_assets.h, served as they are.
+
+The PlatformIO environments run this before every build (extra_scripts), the
+header is only rewritten when web/ changed. By hand:
+
+  python3 tools/web_assets.py            regenerate src/web_assets.h
+  python3 tools/web_assets.py --check    fail if src/web_assets.h is out of date
+"""
+import gzip
+import hashlib
+import os
+import sys
+
+OUTPUT = os.path.join("src", "web_assets.h")
+
+# File in web/, URI and content type
+ASSETS = [
+    ("index.html", "/ui", "text/html"),
+]
+
+
+def render(root):
+    lines = [
+        "/**",
+        "   Web UI assets, gzipped at build time and sent as they are with",
+        "   Content-Encoding: gzip. Generated by tools/web_assets.py from web/,",
+        "   do not edit.",
+        "*/",
+        "#ifndef WEB_ASSETS_H",
+        "#define WEB_ASSETS_H",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "typedef struct {",
+        "  const char* uri;",
+        "  const char* type;",
+        "  const uint8_t* data;",
+        "  size_t length;",
+        "  const char* etag;             // Quoted, from the uncompressed content",
+        "} tsWebAsset;",
+        "",
+    ]
+    entries = []
+    for index, (name, uri, content_type) in enumerate(ASSETS):
+        with open(os.path.join(root, "web", name), "rb") as source:
+            content = source.read()
+        data = gzip.compress(content, compresslevel=9, mtime=0)
+        etag = hashlib.sha256(content).hexdigest()[:16]
+        symbol = "webAsset%d" % index
+        lines.append("// %s: %u bytes, %u gzipped" % (name, len(content), len(data)))
+        lines.append("static const uint8_t %s[] PROGMEM = {" % symbol)
+        for offset in range(0, len(data), 16):
+            lines.append("  " + ", ".join("0x%02x" % byte for byte in data[offset:offset + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+        entries.append('  { "%s", "%s", %s, sizeof(%s), "\\"%s\\"" },' % (uri, content_type, symbol, symbol, etag))
+
+    lines.append("static const tsWebAsset webAssets[] = {")
+    lines.extend(entries)
+    lines.append("};")
+    lines.append("")
+    lines.append("#endif")
+    # CRLF as the rest of src/
+    return "\r\n".join(lines) + "\r\n"
+
+
+def main(root, check=False):
+    path = os.path.join(root, OUTPUT)
+    text = render(root)
+    try:
+        with open(path, newline="") as header:
+            current = header.read()
+    except FileNotFoundError:
+        current = None
+
+    if current == text:
+        return 0
+    if check:
+        print("%s does not match web/, run python3 tools/web_assets.py" % OUTPUT, file=sys.stderr)
+        return 1
+    with open(path, "w", newline="") as header:
+        header.write(text)
+    print("Generated %s" % OUTPUT)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "--check" in sys.argv[1:]))
+else:
+    # Run by PlatformIO as a pre: extra script, where __file__ is not set
+    Import("env")  # noqa: F821
+    main(env.subst("$PROJECT_DIR"))  # noqa: F821